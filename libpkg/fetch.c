@@ -169,7 +169,7 @@ ssh_read(void *data, char *buf, int len)
 	ssize_t rlen;
 	int deltams;
 
-	pkg_debug(2, "ssh: start reading %d");
+	pkg_dbg(FETCH, 2, "ssh: start reading %d bytes", len);
 
 	if (fetchTimeout > 0) {
 		gettimeofday(&timeout, NULL);
@@ -183,7 +183,7 @@ ssh_read(void *data, char *buf, int len)
 
 	for (;;) {
 		rlen = read(pfd.fd, buf, len);
-		pkg_debug(2, "read %d", rlen);
+		pkg_dbg(FETCH, 2, "read %zd", rlen);
 		if (rlen >= 0) {
 			break;
 		} else if (rlen == -1) {
@@ -209,18 +209,18 @@ ssh_read(void *data, char *buf, int len)
 
 		errno = 0;
 		pfd.revents = 0;
-		pkg_debug(1, "begin poll()");
+		pkg_dbg(FETCH, 1, "begin poll()");
 		if (poll(&pfd, 1, deltams) < 0) {
 			if (errno == EINTR)
 				continue;
 			return (-1);
 		}
-		pkg_debug(1, "end poll()");
+		pkg_dbg(FETCH, 1, "end poll()");
 
 
 	}
 
-	pkg_debug(2, "ssh: have read %d bytes", rlen);
+	pkg_dbg(FETCH, 2, "ssh: have read %zd bytes", rlen);
 
 	return (rlen);
 }
@@ -301,7 +301,7 @@ ssh_write(void *data, const char *buf, int l)
 	iov.iov_base = __DECONST(char *, buf);
 	iov.iov_len = l;
 
-	pkg_debug(1, "writing data");
+	pkg_dbg(FETCH, 1, "writing data");
 
 	return (ssh_writev(repo->sshio.out, &iov, 1));
 }
@@ -376,7 +376,7 @@ start_ssh(struct pkg_repo *repo, struct url *u, off_t *sz)
 			sbuf_cat(cmd, u->host);
 			sbuf_printf(cmd, " pkg ssh");
 			sbuf_finish(cmd);
-			pkg_debug(1, "Fetch: running '%s'", sbuf_data(cmd));
+			pkg_dbg(FETCH, 1, "Fetch: running '%s'", sbuf_data(cmd));
 			argv[0] = _PATH_BSHELL;
 			argv[1] = "-c";
 			argv[2] = sbuf_data(cmd);
@@ -395,7 +395,7 @@ start_ssh(struct pkg_repo *repo, struct url *u, off_t *sz)
 			goto ssh_cleanup;
 		}
 
-		pkg_debug(1, "SSH> connected");
+		pkg_dbg(FETCH, 1, "SSH> connected");
 
 		repo->sshio.in = sshout[0];
 		repo->sshio.out = sshin[1];
@@ -409,22 +409,22 @@ start_ssh(struct pkg_repo *repo, struct url *u, off_t *sz)
 
 		if (getline(&line, &linecap, repo->ssh) > 0) {
 			if (strncmp(line, "ok:", 3) != 0) {
-				pkg_debug(1, "SSH> server rejected, got: %s", line);
+				pkg_dbg(FETCH, 1, "SSH> server rejected, got: %s", line);
 				goto ssh_cleanup;
 			}
-			pkg_debug(1, "SSH> server is: %s", line +4);
+			pkg_dbg(FETCH, 1, "SSH> server is: %s", line +4);
 		} else {
-			pkg_debug(1, "SSH> nothing to read, got: %s", line);
+			pkg_dbg(FETCH, 1, "SSH> nothing to read, got: %s", line);
 			goto ssh_cleanup;
 		}
 	}
-	pkg_debug(1, "SSH> get %s %" PRIdMAX "", u->doc, (intmax_t)u->ims_time);
+	pkg_dbg(FETCH, 1, "SSH> get %s %" PRIdMAX "", u->doc, (intmax_t)u->ims_time);
 	fprintf(repo->ssh, "get %s %" PRIdMAX "\n", u->doc, (intmax_t)u->ims_time);
 	if ((linelen = getline(&line, &linecap, repo->ssh)) > 0) {
 		if (line[linelen -1 ] == '\n')
 			line[linelen -1 ] = '\0';
 
-		pkg_debug(1, "SSH> recv: %s", line);
+		pkg_dbg(FETCH, 1, "SSH> recv: %s", line);
 		if (strncmp(line, "ok:", 3) == 0) {
 			*sz = strtonum(line + 4, 0, LONG_MAX, &errstr);
 			if (errstr) {
@@ -578,10 +578,10 @@ pkg_fetch_file_to_fd(struct pkg_repo *repo, const char *url, int dest,
 				sbuf_cat(fetchOpts, "6");
 		}
 
-		if (debug_level >= 4)
+		if (pkg_dbg_enabled(FETCH, 4))
 			sbuf_cat(fetchOpts, "v");
 
-		pkg_debug(1,"Fetch: fetching from: %s://%s%s%s%s with opts \"%s\"",
+		pkg_dbg(FETCH, 1,"Fetch: fetching from: %s://%s%s%s%s with opts \"%s\"",
 		    u->scheme,
 		    u->user,
 		    u->user[0] != '\0' ? "@" : "",
@@ -650,11 +650,14 @@ pkg_fetch_file_to_fd(struct pkg_repo *repo, const char *url, int dest,
 			goto cleanup;
 		}
 		done += r;
+		if ((retcode = pkg_cancel_check(r)) != EPKG_OK)
+			goto cleanup;
 		if (sz > 0) {
 			left -= r;
-			pkg_debug(1, "Read status: %d over %d", done, sz);
+			pkg_dbg(FETCH, 1, "Read status: %jd over %jd",
+			    (intmax_t)done, (intmax_t)sz);
 		} else
-			pkg_debug(1, "Read status: %d", done);
+			pkg_dbg(FETCH, 1, "Read status: %jd", (intmax_t)done);
 		if (sz > 0)
 			pkg_emit_progress_tick(done, sz);
 	}
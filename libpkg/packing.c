@@ -29,12 +29,14 @@
 #include <archive.h>
 #include <archive_entry.h>
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <fts.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <pwd.h>
 #include <grp.h>
+#include <unistd.h>
 
 #include "pkg.h"
 #include "private/event.h"
@@ -47,13 +49,165 @@ struct packing {
 	struct archive *aread;
 	struct archive *awrite;
 	struct archive_entry_linkresolver *resolver;
+	struct pkg_archive_index *index;
+	int fd;
 };
 
+static ssize_t
+packing_index_write(struct archive *a __unused, void *data, const void *buf,
+    size_t len)
+{
+
+	if (pkg_archive_index_write(data, buf, len) != EPKG_OK)
+		return (-1);
+
+	return (len);
+}
+
+/* Open an indexed tgz, see pkg_archive_index.c */
+static int
+packing_index_open(struct packing *pack, const char *path)
+{
+
+	if ((pack->fd = open(path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,
+	    0666)) == -1) {
+		pkg_emit_errno("open", path);
+		return (EPKG_FATAL);
+	}
+
+	if ((pack->index = pkg_archive_index_new(pack->fd)) == NULL) {
+		close(pack->fd);
+		return (EPKG_FATAL);
+	}
+
+	/* no blocking: every member boundary reaches the index */
+	archive_write_set_bytes_per_block(pack->awrite, 0);
+	if (archive_write_open(pack->awrite, pack->index, NULL,
+	    packing_index_write, NULL) != ARCHIVE_OK) {
+		pkg_emit_error("archive_write_open: %s",
+		    archive_error_string(pack->awrite));
+		pkg_archive_index_free(pack->index);
+		pack->index = NULL;
+		close(pack->fd);
+		return (EPKG_FATAL);
+	}
+
+	return (EPKG_OK);
+}
+
+static int
+packing_write_header(struct packing *pack, struct archive_entry *entry)
+{
+
+	if (pack->index != NULL) {
+		/* flush the padding of the previous member */
+		archive_write_finish_entry(pack->awrite);
+		if (pkg_archive_index_member(pack->index,
+		    archive_entry_pathname(entry)) != EPKG_OK)
+			return (ARCHIVE_FATAL);
+	}
+
+	return (archive_write_header(pack->awrite, entry));
+}
+
+/*
+ * Record the data regions of a sparse file when the libarchive disk reader
+ * did not do it already, so the holes are not stored in the package.
+ */
+static void
+packing_set_sparse(const char *filepath, const struct stat *st,
+    struct archive_entry *entry)
+{
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+	off_t data, hole;
+	int fd;
+
+	if (archive_entry_sparse_count(entry) > 0 ||
+	    st->st_blocks * 512 >= st->st_size)
+		return;
+
+	if ((fd = open(filepath, O_RDONLY)) == -1)
+		return;
+
+	for (hole = 0; hole < st->st_size; ) {
+		if ((data = lseek(fd, hole, SEEK_DATA)) == -1) {
+			if (errno != ENXIO)
+				archive_entry_sparse_clear(entry);
+			else if (hole == 0)
+				/* a file made of holes only */
+				archive_entry_sparse_add_entry(entry,
+				    st->st_size, 0);
+			break;
+		}
+		if ((hole = lseek(fd, data, SEEK_HOLE)) == -1) {
+			archive_entry_sparse_clear(entry);
+			break;
+		}
+		archive_entry_sparse_add_entry(entry, data, hole - data);
+	}
+	close(fd);
+#endif
+}
+
+/*
+ * Only the data regions are read, the pax writer drops what is fed for the
+ * holes.
+ */
+static int
+packing_append_sparse(struct packing *pack, int fd, const char *filepath,
+    struct archive_entry *entry)
+{
+	static const char zero[65536];
+	char buf[65536];
+	int64_t offset, length, pos, size;
+	ssize_t len;
+	bool last = false;
+
+	size = archive_entry_size(entry);
+	archive_entry_sparse_reset(entry);
+	for (pos = 0; !last; ) {
+		if (archive_entry_sparse_next(entry, &offset, &length) !=
+		    ARCHIVE_OK) {
+			offset = size;
+			length = 0;
+			last = true;
+		}
+
+		while (pos < offset) {
+			len = MIN(sizeof(zero), offset - pos);
+			if (archive_write_data(pack->awrite, zero, len) == -1) {
+				pkg_emit_errno("archive_write_data",
+				    "archive write error");
+				return (EPKG_FATAL);
+			}
+			pos += len;
+		}
+
+		while (pos < offset + length) {
+			len = pread(fd, buf, MIN(sizeof(buf),
+			    offset + length - pos), pos);
+			if (len <= 0) {
+				pkg_emit_errno("read", filepath);
+				return (EPKG_FATAL);
+			}
+			if (archive_write_data(pack->awrite, buf, len) == -1) {
+				pkg_emit_errno("archive_write_data",
+				    "archive write error");
+				return (EPKG_FATAL);
+			}
+			pos += len;
+		}
+	}
+
+	return (EPKG_OK);
+}
+
 int
 packing_init(struct packing **pack, const char *path, pkg_formats format, bool passmode)
 {
 	char archive_path[MAXPATHLEN];
 	const char *ext;
+	bool indexed;
 
 	assert(pack != NULL);
 
@@ -75,7 +229,14 @@ packing_init(struct packing **pack, const char *path, pkg_formats format, bool p
 		(*pack)->pass = false;
 		(*pack)->awrite = archive_write_new();
 		archive_write_set_format_pax_restricted((*pack)->awrite);
-		ext = packing_set_format((*pack)->awrite, format);
+		indexed = (format == TGZ &&
+		    pkg_object_bool(pkg_config_get("ARCHIVE_INDEX")));
+		if (indexed) {
+			/* the frames are compressed by the index */
+			archive_write_add_filter_none((*pack)->awrite);
+			ext = "tgz";
+		} else
+			ext = packing_set_format((*pack)->awrite, format);
 		if (ext == NULL) {
 			archive_read_close((*pack)->aread);
 			archive_read_free((*pack)->aread);
@@ -88,7 +249,16 @@ packing_init(struct packing **pack, const char *path, pkg_formats format, bool p
 		    ext);
 
 		pkg_debug(1, "Packing to file '%s'", archive_path);
-		if (archive_write_open_filename(
+		if (indexed) {
+			if (packing_index_open(*pack, archive_path) != EPKG_OK) {
+				archive_read_close((*pack)->aread);
+				archive_read_free((*pack)->aread);
+				archive_write_free((*pack)->awrite);
+				free(*pack);
+				*pack = NULL;
+				return (EPKG_FATAL);
+			}
+		} else if (archive_write_open_filename(
 		    (*pack)->awrite, archive_path) != ARCHIVE_OK) {
 			pkg_emit_errno("archive_write_open_filename",
 			    archive_path);
@@ -129,7 +299,7 @@ packing_append_buffer(struct packing *pack, const char *buffer,
 	archive_entry_set_uname(entry, "root");
 	archive_entry_set_pathname(entry, path);
 	archive_entry_set_size(entry, size);
-	if (archive_write_header(pack->awrite, entry) == -1) {
+	if (packing_write_header(pack, entry) == -1) {
 		pkg_emit_errno("archive_write_header", path);
 		ret = EPKG_FATAL;
 		goto cleanup;
@@ -146,10 +316,10 @@ cleanup:
 	return (ret);
 }
 
-int
-packing_append_file_attr(struct packing *pack, const char *filepath,
-    const char *newpath, const char *uname, const char *gname, mode_t perm,
-    u_long fflags)
+static int
+packing_append_entry(struct packing *pack, const char *filepath,
+    const char *newpath, const char *hardlink, const char *uname,
+    const char *gname, mode_t perm, u_long fflags)
 {
 	int fd;
 	char *map;
@@ -184,9 +354,10 @@ packing_append_file_attr(struct packing *pack, const char *filepath,
 	if (newpath != NULL)
 		archive_entry_set_pathname(entry, newpath);
 
-	if (archive_entry_filetype(entry) != AE_IFREG) {
+	if (archive_entry_filetype(entry) != AE_IFREG || hardlink != NULL) {
 		archive_entry_set_size(entry, 0);
-	}
+	} else if (st.st_size > 0)
+		packing_set_sparse(filepath, &st, entry);
 
 	if (uname != NULL && uname[0] != '\0') {
 		if (pack->pass) {
@@ -243,12 +414,16 @@ packing_append_file_attr(struct packing *pack, const char *filepath,
 		archive_entry_set_birthtime(entry, source_time, 0);
 	}
 
-	archive_entry_linkify(pack->resolver, &entry, &sparse_entry);
+	if (hardlink != NULL) {
+		archive_entry_set_hardlink(entry, hardlink);
+	} else {
+		archive_entry_linkify(pack->resolver, &entry, &sparse_entry);
 
-	if (sparse_entry != NULL && entry == NULL)
-		entry = sparse_entry;
+		if (sparse_entry != NULL && entry == NULL)
+			entry = sparse_entry;
+	}
 
-	archive_write_header(pack->awrite, entry);
+	packing_write_header(pack, entry);
 
 	if (archive_entry_size(entry) > 0) {
 		if ((fd = open(filepath, O_RDONLY)) < 0) {
@@ -256,7 +431,12 @@ packing_append_file_attr(struct packing *pack, const char *filepath,
 			retcode = EPKG_FATAL;
 			goto cleanup;
 		}
-		if (st.st_size > SSIZE_MAX) {
+		if (archive_entry_sparse_count(entry) > 0) {
+			retcode = packing_append_sparse(pack, fd, filepath,
+			    entry);
+			close(fd);
+		}
+		else if (st.st_size > SSIZE_MAX) {
 			char buf[BUFSIZ];
 			int len;
 
@@ -297,6 +477,30 @@ packing_append_file_attr(struct packing *pack, const char *filepath,
 	return (retcode);
 }
 
+int
+packing_append_file_attr(struct packing *pack, const char *filepath,
+    const char *newpath, const char *uname, const char *gname, mode_t perm,
+    u_long fflags)
+{
+
+	return (packing_append_entry(pack, filepath, newpath, NULL, uname,
+	    gname, perm, fflags));
+}
+
+/*
+ * Appends `newpath` as a hardlink to `hardlink`, which must have been
+ * appended already, instead of relying on the link resolver.
+ */
+int
+packing_append_hardlink(struct packing *pack, const char *filepath,
+    const char *newpath, const char *hardlink, const char *uname,
+    const char *gname, mode_t perm, u_long fflags)
+{
+
+	return (packing_append_entry(pack, filepath, newpath, hardlink, uname,
+	    gname, perm, fflags));
+}
+
 int
 packing_append_tree(struct packing *pack, const char *treepath,
     const char *newroot)
@@ -361,6 +565,13 @@ packing_finish(struct packing *pack)
 
 	archive_write_close(pack->awrite);
 	archive_write_free(pack->awrite);
+	archive_entry_linkresolver_free(pack->resolver);
+
+	if (pack->index != NULL) {
+		pkg_archive_index_finish(pack->index);
+		pkg_archive_index_free(pack->index);
+		close(pack->fd);
+	}
 
 	free(pack);
 }
@@ -47,9 +47,11 @@ pkg_new(struct pkg **pkg, pkg_t type)
 		pkg_emit_errno("calloc", "pkg");
 		return EPKG_FATAL;
 	}
+	pkg_mem_alloc(PKG_MEM_PKG, sizeof(**pkg));
 
 	(*pkg)->type = type;
 	(*pkg)->rootfd = -1;
+	(*pkg)->archivefd = -1;
 
 	return (EPKG_OK);
 }
@@ -69,17 +71,10 @@ pkg_free(struct pkg *pkg)
 	if (pkg == NULL)
 		return;
 
-	free(pkg->name);
-	free(pkg->origin);
 	free(pkg->old_version);
-	free(pkg->maintainer);
-	free(pkg->www);
-	free(pkg->arch);
 	free(pkg->abi);
-	free(pkg->uid);
 	free(pkg->digest);
 	free(pkg->old_digest);
-	free(pkg->prefix);
 	free(pkg->comment);
 	free(pkg->desc);
 	free(pkg->sum);
@@ -108,9 +103,17 @@ pkg_free(struct pkg *pkg)
 	LL_FREE(pkg->message, pkg_message_free);
 	LL_FREE(pkg->annotations, pkg_kv_free);
 
+	for (size_t i = 0; i < pkg->dir_to_del_len; i++)
+		free(pkg->dir_to_del[i]);
+	free(pkg->dir_to_del);
+	kh_destroy_strings(pkg->dir_to_del_seen);
+
 	if (pkg->rootfd != -1)
 		close(pkg->rootfd);
+	if (pkg->archivefd != -1)
+		close(pkg->archivefd);
 
+	pkg_mem_free(PKG_MEM_PKG, sizeof(*pkg));
 	free(pkg);
 }
 
@@ -282,6 +285,12 @@ pkg_vget(const struct pkg * restrict pkg, va_list ap)
 		case PKG_VITAL:
 			*va_arg(ap, bool *) = pkg->vital;
 			break;
+		case PKG_DEPTH:
+			*va_arg(ap, int64_t *) = pkg->depth;
+			break;
+		case PKG_VIA:
+			*va_arg(ap, const char **) = pkg->via;
+			break;
 		}
 	}
 
@@ -319,18 +328,14 @@ pkg_vset(struct pkg *pkg, va_list ap)
 
 		switch (attr) {
 		case PKG_NAME:
-			free(pkg->name);
-			pkg->name = strdup(va_arg(ap, const char *));
-			free(pkg->uid);
-			pkg->uid = strdup(pkg->name);
+			pkg->name = pkg_intern(va_arg(ap, const char *));
+			pkg->uid = pkg->name;
 			break;
 		case PKG_ORIGIN:
-			free(pkg->origin);
-			pkg->origin = strdup(va_arg(ap, const char *));
+			pkg->origin = pkg_intern(va_arg(ap, const char *));
 			break;
 		case PKG_VERSION:
-			free(pkg->version);
-			pkg->version = strdup(va_arg(ap, const char *));
+			pkg->version = pkg_intern(va_arg(ap, const char *));
 			break;
 		case PKG_COMMENT:
 			free(pkg->comment);
@@ -358,24 +363,20 @@ pkg_vset(struct pkg *pkg, va_list ap)
 			}
 			break;
 		case PKG_ARCH:
-			free(pkg->arch);
-			pkg->arch = strdup(va_arg(ap, const char *));
+			pkg->arch = pkg_intern(va_arg(ap, const char *));
 			break;
 		case PKG_ABI:
 			free(pkg->abi);
 			pkg->abi = strdup(va_arg(ap, const char *));
 			break;
 		case PKG_MAINTAINER:
-			free(pkg->maintainer);
-			pkg->maintainer = strdup(va_arg(ap, const char *));
+			pkg->maintainer = pkg_intern(va_arg(ap, const char *));
 			break;
 		case PKG_WWW:
-			free(pkg->www);
-			pkg->www = strdup(va_arg(ap, const char *));
+			pkg->www = pkg_intern(va_arg(ap, const char *));
 			break;
 		case PKG_PREFIX:
-			free(pkg->prefix);
-			pkg->prefix = strdup(va_arg(ap, const char *));
+			pkg->prefix = pkg_intern(va_arg(ap, const char *));
 			break;
 		case PKG_REPOPATH:
 			free(pkg->repopath);
@@ -390,8 +391,7 @@ pkg_vset(struct pkg *pkg, va_list ap)
 			pkg->old_version = strdup(va_arg(ap, const char *));
 			break;
 		case PKG_REPONAME:
-			free(pkg->reponame);
-			pkg->reponame = strdup(va_arg(ap, const char *));
+			pkg->reponame = pkg_intern(va_arg(ap, const char *));
 			break;
 		case PKG_REPOURL:
 			free(pkg->repourl);
@@ -436,6 +436,12 @@ pkg_vset(struct pkg *pkg, va_list ap)
 		case PKG_VITAL:
 			pkg->vital = (bool)va_arg(ap, int);
 			break;
+		case PKG_DEPTH:
+			pkg->depth = va_arg(ap, int64_t);
+			break;
+		case PKG_VIA:
+			pkg->via = pkg_intern(va_arg(ap, const char *));
+			break;
 		}
 	}
 
@@ -660,11 +666,11 @@ pkg_adddep(struct pkg *pkg, const char *name, const char *origin, const char *ve
 
 	pkg_dep_new(&d);
 
-	d->origin = strdup(origin);
-	d->name = strdup(name);
+	d->origin = pkg_intern(origin);
+	d->name = pkg_intern(name);
 	if (version != NULL && version[0] != '\0')
-		d->version = strdup(version);
-	d->uid = strdup(name);
+		d->version = pkg_intern(version);
+	d->uid = d->name;
 	d->locked = locked;
 
 	kh_add(pkg_deps, pkg->deps, d, d->name, pkg_dep_free);
@@ -684,11 +690,11 @@ pkg_addrdep(struct pkg *pkg, const char *name, const char *origin, const char *v
 	pkg_debug(3, "Pkg: add a new reverse dependency origin: %s, name: %s", origin, name);
 	pkg_dep_new(&d);
 
-	d->origin = strdup(origin);
-	d->name = strdup(name);
+	d->origin = pkg_intern(origin);
+	d->name = pkg_intern(name);
 	if (version != NULL && version[0] != '\0')
-		d->version = strdup(version);
-	d->uid = strdup(name);
+		d->version = pkg_intern(version);
+	d->uid = d->name;
 	d->locked = locked;
 
 	kh_add(pkg_deps, pkg->rdeps, d, d->name, pkg_dep_free);
@@ -1395,6 +1401,67 @@ pkg_open_fd(struct pkg **pkg_p, int fd, struct pkg_manifest_key *keys, int flags
 	return (EPKG_OK);
 }
 
+/*
+ * Indexed archive: the manifest is read from its own frame, then the archive
+ * is positioned on the first payload member without decoding the meta files
+ * again.
+ */
+static int
+pkg_open_index(struct pkg *pkg, struct pkg_archive_index *idx, int fd,
+    bool own, struct archive **a, struct archive_entry **ae, const char *path,
+    struct pkg_manifest_key *keys, int flags)
+{
+	const char *manifest = "+MANIFEST";
+	char *buffer;
+	size_t len;
+	int ret;
+
+	if ((flags & PKG_OPEN_MANIFEST_COMPACT) &&
+	    pkg_archive_index_has(idx, "+COMPACT_MANIFEST"))
+		manifest = "+COMPACT_MANIFEST";
+
+	if (pkg_archive_index_open(idx, fd, manifest, false, a, ae) != EPKG_OK) {
+		if ((flags & PKG_OPEN_TRY) == 0)
+			pkg_emit_error("%s is not a valid package: "
+			    "no manifest found", path);
+		goto fatal;
+	}
+
+	len = archive_entry_size(*ae);
+	buffer = malloc(len);
+	archive_read_data(*a, buffer, len);
+	ret = pkg_parse_manifest(pkg, buffer, len, keys);
+	free(buffer);
+	archive_read_close(*a);
+	archive_read_free(*a);
+	*a = NULL;
+	if (ret != EPKG_OK) {
+		if ((flags & PKG_OPEN_TRY) == 0)
+			pkg_emit_error("%s is not a valid package: "
+			    "Invalid manifest", path);
+		goto fatal;
+	}
+
+	if ((flags & (PKG_OPEN_MANIFEST_ONLY|PKG_OPEN_MANIFEST_COMPACT)) == 0) {
+		ret = pkg_archive_index_open(idx, fd, NULL, own, a, ae);
+		if (ret != EPKG_END)
+			return (ret);
+	}
+
+	/* nothing more to read, hand back an archive to be closed */
+	if (own)
+		close(fd);
+	*a = archive_read_new();
+	*ae = NULL;
+
+	return (ret == EPKG_END ? EPKG_END : EPKG_OK);
+
+fatal:
+	if (own)
+		close(fd);
+	return (EPKG_FATAL);
+}
+
 int
 pkg_open2(struct pkg **pkg_p, struct archive **a, struct archive_entry **ae,
     const char *path, struct pkg_manifest_key *keys, int flags, int fd)
@@ -1405,6 +1472,32 @@ pkg_open2(struct pkg **pkg_p, struct archive **a, struct archive_entry **ae,
 	const char	*fpath;
 	bool		 manifest = false;
 	bool		 read_from_stdin = 0;
+	struct pkg_archive_index *idx;
+	bool		 own = false;
+	int		 ifd = fd;
+
+	if (fd == -1 && strncmp(path, "-", 2) != 0 &&
+	    (ifd = open(path, O_RDONLY|O_CLOEXEC)) != -1)
+		own = true;
+
+	if (ifd != -1 && pkg_archive_index_load(ifd, &idx) == EPKG_OK) {
+		retcode = pkg_new(pkg_p, PKG_FILE);
+		if (retcode == EPKG_OK)
+			retcode = pkg_open_index(*pkg_p, idx, ifd, own, a, ae,
+			    path, keys, flags);
+		else if (own)
+			close(ifd);
+		pkg_archive_index_free(idx);
+		if (retcode != EPKG_OK && retcode != EPKG_END) {
+			free(*pkg_p);
+			*pkg_p = NULL;
+			*a = NULL;
+			*ae = NULL;
+		}
+		return (retcode);
+	}
+	if (own)
+		close(ifd);
 
 	*a = archive_read_new();
 	archive_read_support_filter_all(*a);
@@ -1538,7 +1631,7 @@ pkg_validate(struct pkg *pkg, struct pkgdb *db)
 		if (pkg->name == NULL)
 			return (EPKG_FATAL);
 
-		pkg->uid = strdup(pkg->name);
+		pkg->uid = pkg->name;
 	}
 
 	if (pkg->digest == NULL || !pkg_checksum_is_valid(pkg->digest,
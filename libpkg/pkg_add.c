@@ -99,43 +99,46 @@ attempt_to_merge(int rootfd, struct pkg_config_file *rcf, struct pkg *local,
 	char *localsum;
 
 	if (rcf == NULL) {
-		pkg_debug(3, "No remote config file");
+		pkg_dbg(ADD, 3, "No remote config file");
 		return;
 	}
 
 	if (local == NULL) {
-		pkg_debug(3, "No local package");
+		pkg_dbg(ADD, 3, "No local package");
 		return;
 	}
 
 	if (!pkg_is_config_file(local, rcf->path, &lf, &lcf)) {
-		pkg_debug(3, "No local package");
+		pkg_dbg(ADD, 3, "No local package");
 		return;
 	}
 
 	if (lcf->content == NULL) {
-		pkg_debug(3, "Empty configuration content for local package");
+		pkg_dbg(ADD, 3, "Empty configuration content for local package");
 		return;
 	}
 
-	pkg_debug(1, "Config file found %s", rcf->path);
+	pkg_dbg(ADD, 1, "Config file found %s", rcf->path);
 	if (file_to_bufferat(rootfd, RELATIVE_PATH(rcf->path), &localconf, &sz) != EPKG_OK)
 		return;
 
-	pkg_debug(2, "size: %d vs %d", sz, strlen(lcf->content));
+	pkg_dbg(ADD, 2, "size: %jd vs %zu", (intmax_t)sz,
+	    strlen(lcf->content));
 
 	if (sz == strlen(lcf->content)) {
-		pkg_debug(2, "Ancient vanilla and deployed conf are the same size testing checksum");
+		pkg_dbg(ADD, 2, "Ancient vanilla and deployed conf are the same size testing checksum");
 		localsum = pkg_checksum_data(localconf, sz,
 		    PKG_HASH_TYPE_SHA256_HEX);
 		if (localsum && strcmp(localsum, lf->sum) == 0) {
-			pkg_debug(2, "Checksum are the same %d", strlen(localconf));
+			pkg_dbg(ADD, 2, "Checksum are the same %zu",
+			    strlen(localconf));
 			free(localconf);
 			free(localsum);
 			return;
 		}
 		free(localsum);
-		pkg_debug(2, "Checksum are different %d", strlen(localconf));
+		pkg_dbg(ADD, 2, "Checksum are different %zu",
+		    strlen(localconf));
 	}
 	rcf->status = MERGE_FAILED;
 	if (!merge) {
@@ -143,7 +146,7 @@ attempt_to_merge(int rootfd, struct pkg_config_file *rcf, struct pkg *local,
 		return;
 	}
 
-	pkg_debug(1, "Attempting to merge %s", rcf->path);
+	pkg_dbg(ADD, 1, "Attempting to merge %s", rcf->path);
 	newconf = sbuf_new_auto();
 	if (merge_3way(lcf->content, localconf, rcf->content, newconf) != 0) {
 		pkg_emit_error("Impossible to merge configuration file");
@@ -401,6 +404,89 @@ do_extract_hardlink(struct pkg *pkg, struct archive *a __unused, struct archive_
 	return (EPKG_OK);
 }
 
+/*
+ * Like archive_read_data_into_fd() but the holes of sparse entries, the
+ * trailing one included, are kept as holes.
+ */
+static int
+extract_data_into_fd(struct archive *a, struct archive_entry *ae, int fd,
+    const char *path)
+{
+	const void *buf;
+	size_t len;
+	int64_t offset;
+	ssize_t w;
+	int ret;
+
+	while ((ret = archive_read_data_block(a, &buf, &len, &offset)) ==
+	    ARCHIVE_OK) {
+		while (len > 0) {
+			if ((w = pwrite(fd, buf, len, offset)) == -1) {
+				pkg_emit_errno("pwrite", path);
+				return (EPKG_FATAL);
+			}
+			buf = (const char *)buf + w;
+			len -= w;
+			offset += w;
+		}
+	}
+
+	if (ret != ARCHIVE_EOF) {
+		pkg_emit_error("Fail to extract %s from package: %s",
+		    path, archive_error_string(a));
+		return (EPKG_FATAL);
+	}
+
+	if (ftruncate(fd, archive_entry_size(ae)) == -1) {
+		pkg_emit_errno("ftruncate", path);
+		return (EPKG_FATAL);
+	}
+
+	return (EPKG_OK);
+}
+
+/*
+ * In an uncompressed package the data of a member lies as is in the package
+ * file, right after its header: let the kernel copy it.  On failure the
+ * caller falls back to extract_data_into_fd(), which rewrites the file from
+ * its start.
+ */
+static int
+copy_data_into_fd(struct pkg *pkg, struct archive *a, struct archive_entry *ae,
+    int fd)
+{
+#ifdef HAVE_COPY_FILE_RANGE
+	off_t offset;
+	int64_t len;
+	ssize_t r;
+
+	if (pkg->archivefd == -1 || archive_entry_sparse_count(ae) > 0)
+		return (EPKG_FATAL);
+
+	offset = archive_filter_bytes(a, 0);
+	for (len = archive_entry_size(ae); len > 0; len -= r) {
+		r = copy_file_range(pkg->archivefd, &offset, fd, NULL,
+		    MIN(len, SSIZE_MAX), 0);
+		if (r <= 0) {
+			pkg_dbg(ADD, 1, "copy_file_range: %s, falling back",
+			    r == 0 ? "short package" : strerror(errno));
+			close(pkg->archivefd);
+			pkg->archivefd = -1;
+			return (EPKG_FATAL);
+		}
+	}
+	pkg_dbg(ADD, 2, "copy_file_range: %s, %jd bytes",
+	    archive_entry_pathname(ae), (intmax_t)archive_entry_size(ae));
+
+	if (archive_read_data_skip(a) != ARCHIVE_OK)
+		return (EPKG_FATAL);
+
+	return (EPKG_OK);
+#else
+	return (EPKG_FATAL);
+#endif
+}
+
 static int
 do_extract_regfile(struct pkg *pkg, struct archive *a, struct archive_entry *ae,
     const char *path, struct pkg *local)
@@ -443,7 +529,7 @@ do_extract_regfile(struct pkg *pkg, struct archive *a, struct archive_entry *ae,
 		const char *cfdata;
 		bool merge = pkg_object_bool(pkg_config_get("AUTOMERGE"));
 
-		pkg_debug(1, "Populating config_file %s", f->path);
+		pkg_dbg(ADD, 1, "Populating config_file %s", f->path);
 		len = archive_entry_size(ae);
 		f->config->content = malloc(len + 1);
 		archive_read_data(a, f->config->content, len);
@@ -457,11 +543,9 @@ do_extract_regfile(struct pkg *pkg, struct archive *a, struct archive_entry *ae,
 			free(f->config->newcontent);
 	}
 
-	if (!f->config && archive_read_data_into_fd(a, fd) != ARCHIVE_OK) {
-		pkg_emit_error("Fail to extract %s from package: %s",
-		    path, archive_error_string(a));
+	if (!f->config && copy_data_into_fd(pkg, a, ae, fd) != EPKG_OK &&
+	    extract_data_into_fd(a, ae, fd, path) != EPKG_OK)
 		return (EPKG_FATAL);
-	}
 	if (fd != -1) {
 		close(fd);
 	}
@@ -482,6 +566,7 @@ do_extract(struct archive *a, struct archive_entry *ae,
 	int	retcode = EPKG_OK;
 	int	ret = 0, cur_file = 0;
 	char	path[MAXPATHLEN];
+	pkg_jobs_phase_t prev;
 	int (*extract_cb)(struct pkg *pkg, struct archive *a,
 	    struct archive_entry *ae, const char *path, struct pkg *local);
 
@@ -495,9 +580,13 @@ do_extract(struct archive *a, struct archive_entry *ae,
 	pkg_emit_extract_begin(pkg);
 	pkg_open_root_fd(pkg);
 	pkg_emit_progress_start(NULL);
+	prev = pkg_cancel_enter(PKG_JOBS_PHASE_EXTRACT);
 
 	do {
 		ret = ARCHIVE_OK;
+		if ((retcode = pkg_cancel_check(archive_entry_filetype(ae) ==
+		    AE_IFREG ? archive_entry_size(ae) : 0)) != EPKG_OK)
+			goto cleanup;
 		pkg_absolutepath(archive_entry_pathname(ae), path, sizeof(path), true);
 		switch (archive_entry_filetype(ae)) {
 		case AE_IFDIR:
@@ -562,6 +651,7 @@ do_extract(struct archive *a, struct archive_entry *ae,
 	}
 
 cleanup:
+	pkg_cancel_leave(prev);
 	pkg_emit_progress_tick(nfiles, nfiles);
 	pkg_emit_extract_finished(pkg);
 
@@ -825,7 +915,7 @@ pkg_add_cleanup_old(struct pkgdb *db, struct pkg *old, struct pkg *new, int flag
 		f = NULL;
 		while (pkg_files(old, &f) == EPKG_OK) {
 			if (!pkg_has_file(new, f->path)) {
-				pkg_debug(2, "File %s is not in the new package", f->path);
+				pkg_dbg(ADD, 2, "File %s is not in the new package", f->path);
 				pkg_delete_file(old, f, flags & PKG_DELETE_FORCE ? 1 : 0);
 			}
 		}
@@ -888,6 +978,12 @@ pkg_add_common(struct pkgdb *db, const char *path, unsigned flags,
 		retcode = ret;
 		goto cleanup;
 	}
+#ifdef HAVE_COPY_FILE_RANGE
+	/* uncompressed packages can be copied from straight to the disk */
+	if (extract && strcmp(path, "-") != 0 &&
+	    archive_filter_code(a, 0) == ARCHIVE_FILTER_NONE)
+		pkg->archivefd = open(path, O_RDONLY|O_CLOEXEC);
+#endif
 	if ((flags & PKG_ADD_SPLITTED_UPGRADE) != PKG_ADD_SPLITTED_UPGRADE)
 		pkg_emit_new_action();
 	if ((flags & PKG_ADD_UPGRADE) == 0)
@@ -936,6 +1032,16 @@ pkg_add_common(struct pkgdb *db, const char *path, unsigned flags,
 	if (reloc != NULL)
 		pkg_kv_add(&pkg->annotations, "relocated", reloc, "annotation");
 
+	/*
+	 * Fetch the pristine config files to merge with while the old
+	 * version is still registered.
+	 */
+	if (local != NULL && pkg_list_count(pkg, PKG_CONFIG_FILES) > 0 &&
+	    pkgdb_load_config_contents(db->sqlite, local) != EPKG_OK) {
+		retcode = EPKG_FATAL;
+		goto cleanup;
+	}
+
 	/* register the package before installing it in case there are
 	 * problems that could be caught here. */
 	retcode = pkgdb_register_pkg(db, pkg,
@@ -949,7 +1055,7 @@ pkg_add_common(struct pkgdb *db, const char *path, unsigned flags,
 	 */
 	if ((flags & (PKG_ADD_NOSCRIPT | PKG_ADD_USE_UPGRADE_SCRIPTS)) == 0)
 		if ((retcode = pkg_script_run(pkg, PKG_SCRIPT_PRE_INSTALL)) != EPKG_OK)
-			goto cleanup;
+			goto cleanup_reg;
 
 
 	/* add the user and group if necessary */
@@ -972,7 +1078,7 @@ pkg_add_common(struct pkgdb *db, const char *path, unsigned flags,
 	}
 
 	if (local != NULL) {
-		pkg_debug(1, "Cleaning up old version");
+		pkg_dbg(ADD, 1, "Cleaning up old version");
 		if (pkg_add_cleanup_old(db, local, pkg, flags) != EPKG_OK) {
 			retcode = EPKG_FATAL;
 			goto cleanup;
@@ -981,7 +1087,12 @@ pkg_add_common(struct pkgdb *db, const char *path, unsigned flags,
 
 
 	/* Update configuration file content with db with newer versions */
-	pkgdb_update_config_file_content(pkg, db->sqlite);
+	if ((retcode = pkgdb_update_config_file_content(pkg, db->sqlite)) !=
+	    EPKG_OK) {
+		pkg_rollback_pkg(pkg);
+		pkg_delete_dirs(db, pkg, NULL);
+		goto cleanup_reg;
+	}
 
 	retcode = pkg_extract_finalize(pkg);
 cleanup_reg:
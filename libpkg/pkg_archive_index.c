@@ -0,0 +1,478 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "pkg_config.h"
+#endif
+
+#include <sys/stat.h>
+
+#include <archive.h>
+#include <archive_entry.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "pkg.h"
+#include "private/event.h"
+#include "private/pkg.h"
+#include "khash.h"
+
+/*
+ * Indexed package archives.
+ *
+ * The archive is a regular gzip compressed tar, but the tar stream is cut
+ * into frames at member boundaries and every frame is compressed as its own
+ * gzip member. Any gzip reader decodes the concatenated members as a single
+ * stream, while a reader knowing the frame offsets can start decoding at any
+ * of them.
+ *
+ * After the end of the tar archive comes one more frame holding the index:
+ * "<frame offset> <member path>" per line, in archive order. Tar readers
+ * stop at the end of archive marker and never see it. The file ends with an
+ * empty gzip member whose extra field records the offset of the index
+ * frame, so that the index is found by reading the last bytes of the file.
+ *
+ * The meta files are always in frames of their own, the manifest of an
+ * indexed package is read without decoding any of the payload.
+ */
+
+#define INDEX_FRAME_SIZE	(256 * 1024)
+#define INDEX_MAGIC		"pkg-archive-index 1\n"
+
+/* empty gzip member: header, FEXTRA with one 'P' 'K' subfield, trailer */
+#define INDEX_TRAILER_SIZE	34
+
+KHASH_MAP_INIT_STR(members, int64_t);
+
+struct pkg_archive_index {
+	int fd;
+	kh_members_t *members;
+	int64_t payload;
+	/* writer */
+	z_stream z;
+	bool zinit;
+	int64_t written;
+	int64_t frame;
+	size_t framelen;
+	bool meta;
+	struct sbuf *index;
+};
+
+struct index_reader {
+	int fd;
+	bool own;
+	char buf[32768];
+};
+
+static int
+index_write_all(struct pkg_archive_index *idx, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t w;
+
+	while (len > 0) {
+		if ((w = write(idx->fd, p, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			pkg_emit_errno("write", "archive index");
+			return (EPKG_FATAL);
+		}
+		p += w;
+		len -= w;
+		idx->written += w;
+	}
+
+	return (EPKG_OK);
+}
+
+static int
+index_deflate(struct pkg_archive_index *idx, const void *buf, size_t len,
+    int flush)
+{
+	unsigned char out[32768];
+	int ret;
+
+	idx->z.next_in = __DECONST(void *, buf);
+	idx->z.avail_in = len;
+	do {
+		idx->z.next_out = out;
+		idx->z.avail_out = sizeof(out);
+		ret = deflate(&idx->z, flush);
+		if (ret == Z_STREAM_ERROR) {
+			pkg_emit_error("archive index: deflate failed");
+			return (EPKG_FATAL);
+		}
+		if (index_write_all(idx, out, sizeof(out) - idx->z.avail_out)
+		    != EPKG_OK)
+			return (EPKG_FATAL);
+	} while (idx->z.avail_out == 0 ||
+	    (flush == Z_FINISH && ret != Z_STREAM_END));
+
+	return (EPKG_OK);
+}
+
+/* Terminate the current gzip member, the next byte starts a new frame */
+static int
+index_cut(struct pkg_archive_index *idx)
+{
+
+	if (idx->framelen == 0)
+		return (EPKG_OK);
+
+	if (index_deflate(idx, NULL, 0, Z_FINISH) != EPKG_OK)
+		return (EPKG_FATAL);
+	deflateReset(&idx->z);
+	idx->frame = idx->written;
+	idx->framelen = 0;
+
+	return (EPKG_OK);
+}
+
+struct pkg_archive_index *
+pkg_archive_index_new(int fd)
+{
+	struct pkg_archive_index *idx;
+
+	if ((idx = calloc(1, sizeof(*idx))) == NULL) {
+		pkg_emit_errno("calloc", "pkg_archive_index");
+		return (NULL);
+	}
+
+	/* 16 + MAX_WBITS: gzip wrapping */
+	if (deflateInit2(&idx->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+	    16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		pkg_emit_error("archive index: deflateInit failed");
+		free(idx);
+		return (NULL);
+	}
+	idx->zinit = true;
+	idx->fd = fd;
+	idx->meta = true;
+	idx->index = sbuf_new_auto();
+	sbuf_cat(idx->index, INDEX_MAGIC);
+
+	return (idx);
+}
+
+int
+pkg_archive_index_write(struct pkg_archive_index *idx, const void *buf,
+    size_t len)
+{
+
+	idx->framelen += len;
+	return (index_deflate(idx, buf, len, Z_NO_FLUSH));
+}
+
+int
+pkg_archive_index_member(struct pkg_archive_index *idx, const char *path)
+{
+	bool meta = (path[0] == '+');
+
+	/* the meta files never share a frame with the payload */
+	if ((idx->meta && !meta) || idx->framelen >= INDEX_FRAME_SIZE) {
+		if (index_cut(idx) != EPKG_OK)
+			return (EPKG_FATAL);
+	}
+	idx->meta = meta;
+	sbuf_printf(idx->index, "%"PRId64" %s\n", idx->frame, path);
+
+	return (EPKG_OK);
+}
+
+int
+pkg_archive_index_finish(struct pkg_archive_index *idx)
+{
+	unsigned char trailer[INDEX_TRAILER_SIZE] = {
+		0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff,	/* FEXTRA */
+		12, 0, 'P', 'K', 8, 0,			/* XLEN, subfield */
+		0, 0, 0, 0, 0, 0, 0, 0,			/* index offset */
+		3, 0,					/* empty block */
+		0, 0, 0, 0, 0, 0, 0, 0			/* crc, size */
+	};
+	int64_t off;
+	int i;
+
+	if (index_cut(idx) != EPKG_OK)
+		return (EPKG_FATAL);
+
+	off = idx->written;
+	sbuf_finish(idx->index);
+	idx->framelen = sbuf_len(idx->index);
+	if (index_deflate(idx, sbuf_data(idx->index), sbuf_len(idx->index),
+	    Z_FINISH) != EPKG_OK)
+		return (EPKG_FATAL);
+
+	for (i = 0; i < 8; i++)
+		trailer[16 + i] = (off >> (8 * i)) & 0xff;
+
+	return (index_write_all(idx, trailer, sizeof(trailer)));
+}
+
+static int
+index_parse(struct pkg_archive_index *idx, const char *buf, size_t len)
+{
+	const char *p, *end, *eol;
+	char *path, *sep;
+	int64_t frame;
+	khint_t k;
+	int ret;
+
+	if (len < strlen(INDEX_MAGIC) ||
+	    strncmp(buf, INDEX_MAGIC, strlen(INDEX_MAGIC)) != 0)
+		return (EPKG_FATAL);
+
+	end = buf + len;
+	for (p = buf + strlen(INDEX_MAGIC); p < end; p = eol + 1) {
+		if ((eol = memchr(p, '\n', end - p)) == NULL)
+			return (EPKG_FATAL);
+		frame = strtoimax(p, &sep, 10);
+		if (sep == p || *sep != ' ' || frame < 0)
+			return (EPKG_FATAL);
+		path = strndup(sep + 1, eol - sep - 1);
+		k = kh_put_members(idx->members, path, &ret);
+		if (ret == 0) {
+			/* a path repeated in the archive: the first one wins */
+			free(path);
+			continue;
+		}
+		kh_value(idx->members, k) = frame;
+		if (idx->payload == -1 && path[0] != '+')
+			idx->payload = frame;
+	}
+
+	return (EPKG_OK);
+}
+
+int
+pkg_archive_index_load(int fd, struct pkg_archive_index **idx_p)
+{
+	struct pkg_archive_index *idx;
+	unsigned char trailer[INDEX_TRAILER_SIZE];
+	unsigned char in[32768];
+	struct sbuf *buf;
+	struct stat st;
+	z_stream z;
+	int64_t off;
+	ssize_t r;
+	int i, ret;
+
+	*idx_p = NULL;
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) ||
+	    st.st_size < INDEX_TRAILER_SIZE)
+		return (EPKG_END);
+
+	if (pread(fd, trailer, sizeof(trailer),
+	    st.st_size - INDEX_TRAILER_SIZE) != sizeof(trailer))
+		return (EPKG_END);
+
+	if (trailer[0] != 0x1f || trailer[1] != 0x8b || trailer[3] != 4 ||
+	    trailer[10] != 12 || trailer[12] != 'P' || trailer[13] != 'K' ||
+	    trailer[14] != 8)
+		return (EPKG_END);
+
+	off = 0;
+	for (i = 7; i >= 0; i--)
+		off = (off << 8) | trailer[16 + i];
+	if (off < 0 || off >= st.st_size - INDEX_TRAILER_SIZE)
+		return (EPKG_END);
+
+	memset(&z, 0, sizeof(z));
+	if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK)
+		return (EPKG_FATAL);
+
+	buf = sbuf_new_auto();
+	ret = Z_OK;
+	while (ret != Z_STREAM_END) {
+		r = pread(fd, in, sizeof(in), off);
+		if (r <= 0)
+			break;
+		off += r;
+		z.next_in = in;
+		z.avail_in = r;
+		while (z.avail_in > 0 && ret != Z_STREAM_END) {
+			unsigned char out[32768];
+
+			z.next_out = out;
+			z.avail_out = sizeof(out);
+			ret = inflate(&z, Z_NO_FLUSH);
+			if (ret != Z_OK && ret != Z_STREAM_END)
+				break;
+			sbuf_bcat(buf, out, sizeof(out) - z.avail_out);
+		}
+		if (ret != Z_OK && ret != Z_STREAM_END)
+			break;
+	}
+	inflateEnd(&z);
+	sbuf_finish(buf);
+
+	if (ret != Z_STREAM_END) {
+		pkg_emit_error("corrupted archive index");
+		sbuf_delete(buf);
+		return (EPKG_FATAL);
+	}
+
+	if ((idx = calloc(1, sizeof(*idx))) == NULL) {
+		pkg_emit_errno("calloc", "pkg_archive_index");
+		sbuf_delete(buf);
+		return (EPKG_FATAL);
+	}
+	idx->fd = -1;
+	idx->payload = -1;
+	idx->members = kh_init_members();
+
+	if (index_parse(idx, sbuf_data(buf), sbuf_len(buf)) != EPKG_OK) {
+		pkg_emit_error("corrupted archive index");
+		sbuf_delete(buf);
+		pkg_archive_index_free(idx);
+		return (EPKG_FATAL);
+	}
+	sbuf_delete(buf);
+	*idx_p = idx;
+
+	return (EPKG_OK);
+}
+
+bool
+pkg_archive_index_has(struct pkg_archive_index *idx, const char *path)
+{
+
+	return (kh_get_members(idx->members, path) != kh_end(idx->members));
+}
+
+static ssize_t
+index_reader_read(struct archive *a __unused, void *data, const void **buf)
+{
+	struct index_reader *r = data;
+	ssize_t len;
+
+	*buf = r->buf;
+	while ((len = read(r->fd, r->buf, sizeof(r->buf))) == -1 &&
+	    errno == EINTR)
+		;
+
+	return (len);
+}
+
+static int
+index_reader_close(struct archive *a __unused, void *data)
+{
+	struct index_reader *r = data;
+
+	if (r->own)
+		close(r->fd);
+	free(r);
+
+	return (ARCHIVE_OK);
+}
+
+int
+pkg_archive_index_open(struct pkg_archive_index *idx, int fd, const char *path,
+    bool own, struct archive **a, struct archive_entry **ae)
+{
+	struct index_reader *r;
+	int64_t frame;
+	khint_t k;
+	int ret;
+
+	*a = NULL;
+	if (path != NULL) {
+		k = kh_get_members(idx->members, path);
+		if (k == kh_end(idx->members))
+			return (EPKG_END);
+		frame = kh_value(idx->members, k);
+	} else {
+		if (idx->payload == -1)
+			return (EPKG_END);
+		frame = idx->payload;
+	}
+
+	/* from here on an owned descriptor is always consumed */
+	if (lseek(fd, frame, SEEK_SET) == -1) {
+		pkg_emit_errno("lseek", "archive index");
+		if (own)
+			close(fd);
+		return (EPKG_FATAL);
+	}
+
+	if ((r = malloc(sizeof(*r))) == NULL) {
+		pkg_emit_errno("malloc", "archive index");
+		if (own)
+			close(fd);
+		return (EPKG_FATAL);
+	}
+	r->fd = fd;
+	r->own = own;
+
+	*a = archive_read_new();
+	archive_read_support_filter_gzip(*a);
+	archive_read_support_format_tar(*a);
+	if (archive_read_open(*a, r, NULL, index_reader_read,
+	    index_reader_close) != ARCHIVE_OK) {
+		pkg_emit_error("archive_read_open: %s",
+		    archive_error_string(*a));
+		archive_read_free(*a);
+		*a = NULL;
+		return (EPKG_FATAL);
+	}
+
+	while ((ret = archive_read_next_header(*a, ae)) == ARCHIVE_OK) {
+		if (path == NULL ? archive_entry_pathname(*ae)[0] != '+' :
+		    strcmp(archive_entry_pathname(*ae), path) == 0)
+			return (EPKG_OK);
+	}
+
+	pkg_emit_error("archive index: %s not found at offset %"PRId64,
+	    path != NULL ? path : "payload", frame);
+	archive_read_close(*a);
+	archive_read_free(*a);
+	*a = NULL;
+
+	return (EPKG_FATAL);
+}
+
+void
+pkg_archive_index_free(struct pkg_archive_index *idx)
+{
+	const char *path;
+	int64_t frame __unused;
+
+	if (idx == NULL)
+		return;
+
+	if (idx->members != NULL) {
+		kh_foreach(idx->members, path, frame, free((char *)path));
+		kh_destroy_members(idx->members);
+	}
+	if (idx->zinit)
+		deflateEnd(&idx->z);
+	if (idx->index != NULL)
+		sbuf_delete(idx->index);
+	free(idx);
+}
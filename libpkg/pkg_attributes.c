@@ -50,10 +50,6 @@ pkg_dep_free(struct pkg_dep *d)
 	if (d == NULL)
 		return;
 
-	free(d->origin);
-	free(d->name);
-	free(d->version);
-	free(d->uid);
 	free(d);
 }
 
@@ -95,6 +91,7 @@ pkg_file_new(struct pkg_file **file)
 {
 	if ((*file = calloc(1, sizeof(struct pkg_file))) == NULL)
 		return (EPKG_FATAL);
+	pkg_mem_alloc(PKG_MEM_FILES, sizeof(**file));
 
 	(*file)->perm = 0;
 	(*file)->fflags = 0;
@@ -105,6 +102,7 @@ pkg_file_new(struct pkg_file **file)
 void
 pkg_file_free(struct pkg_file *file)
 {
+	pkg_mem_free(PKG_MEM_FILES, sizeof(*file));
 	free(file->sum);
 	free(file);
 }
@@ -27,6 +27,7 @@
  */
 
 #include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <archive.h>
 #include <err.h>
@@ -34,6 +35,7 @@
 #include <fnmatch.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include <utlist.h>
 
 #include <expat.h>
@@ -97,7 +99,9 @@ struct pkg_audit_entry {
 	char *url;
 	char *desc;
 	char *id;
+	char *digest;
 	bool ref;
+	bool changed;
 	struct pkg_audit_entry *next;
 };
 
@@ -142,6 +146,14 @@ struct pkg_audit {
 	bool loaded;
 	void *map;
 	size_t len;
+	/* Delta audit, see pkg_audit_state_load() */
+	char *digest;
+	bool current;
+	ucl_object_t *state;
+	ucl_object_t *vulns;
+	ucl_object_t *results;
+	unsigned int added;
+	unsigned int resolved;
 };
 
 
@@ -185,6 +197,7 @@ pkg_audit_free_entry(struct pkg_audit_entry *e)
 			free(e->url);
 			free(e->desc);
 			free(e->id);
+			free(e->digest);
 	}
 	free(e);
 }
@@ -338,6 +351,7 @@ pkg_audit_expand_entry(struct pkg_audit_entry *entry, struct pkg_audit_entry **h
 			n->versions = pcur->versions;
 			n->url = entry->url;
 			n->id = entry->id;
+			n->digest = entry->digest;
 			LL_PREPEND(*head, n);
 		}
 	}
@@ -364,6 +378,8 @@ struct vulnxml_userdata {
 	struct pkg_audit *audit;
 	enum vulnxml_parse_state state;
 	int range_num;
+	XML_Parser parser;
+	XML_Index vuln_start;
 };
 
 static void
@@ -386,6 +402,7 @@ vulnxml_start_element(void *data, const char *element, const char **attributes)
 			}
 		}
 		ud->cur_entry->next = ud->audit->entries;
+		ud->vuln_start = XML_GetCurrentByteIndex(ud->parser);
 		ud->state = VULNXML_PARSE_VULN;
 	}
 	else if (ud->state == VULNXML_PARSE_VULN && strcasecmp(element, "topic") == 0) {
@@ -442,8 +459,15 @@ static void
 vulnxml_end_element(void *data, const char *element)
 {
 	struct vulnxml_userdata *ud = (struct vulnxml_userdata *)data;
+	XML_Index end;
 
 	if (ud->state == VULNXML_PARSE_VULN && strcasecmp(element, "vuln") == 0) {
+		/* The digest covers the whole entry, dates and references included */
+		end = XML_GetCurrentByteIndex(ud->parser);
+		if (ud->vuln_start >= 0 && end > ud->vuln_start)
+			ud->cur_entry->digest = (char *)pkg_checksum_data(
+			    (unsigned char *)ud->audit->map + ud->vuln_start,
+			    end - ud->vuln_start, PKG_HASH_TYPE_SHA256_HEX);
 		pkg_audit_expand_entry(ud->cur_entry, &ud->audit->entries);
 		ud->state = VULNXML_PARSE_INIT;
 	}
@@ -551,6 +575,8 @@ pkg_audit_parse_vulnxml(struct pkg_audit *audit)
 
 	ud.cur_entry = NULL;
 	ud.audit = audit;
+	ud.parser = parser;
+	ud.vuln_start = -1;
 	ud.range_num = 0;
 	ud.state = VULNXML_PARSE_INIT;
 
@@ -767,22 +793,21 @@ pkg_audit_print_entry(struct pkg_audit_entry *e, struct sbuf *sb,
 	}
 }
 
-bool
-pkg_audit_is_vulnerable(struct pkg_audit *audit, struct pkg *pkg,
-		bool quiet, struct sbuf **result)
+/*
+ * Calls `match` for every entry of `audit` affecting `pkg`, or only for the
+ * changed ones if `changed` is true, until it returns false.
+ */
+static bool
+pkg_audit_match(struct pkg_audit *audit, struct pkg *pkg, bool changed,
+    bool (*match)(struct pkg_audit_entry *, struct pkg *, void *), void *ud)
 {
 	struct pkg_audit_entry *e;
 	struct pkg_audit_versions_range *vers;
-	struct sbuf *sb;
 	struct pkg_audit_item *a;
 	bool res = false, res1, res2;
 
-	if (!audit->parsed)
-		return false;
-
 	a = audit->items;
 	a += audit_entry_first_byte_idx[(size_t)pkg->name[0]];
-	sb = sbuf_new_auto();
 
 	for (; (e = a->e) != NULL; a += a->next_pfx_incr) {
 		int cmp;
@@ -801,6 +826,8 @@ pkg_audit_is_vulnerable(struct pkg_audit *audit, struct pkg *pkg,
 
 		for (i = 0; i < a->next_pfx_incr; i++) {
 			e = a[i].e;
+			if (changed && !e->changed)
+				continue;
 			if (fnmatch(e->pkgname, pkg->name, 0) != 0)
 				continue;
 
@@ -809,7 +836,8 @@ pkg_audit_is_vulnerable(struct pkg_audit *audit, struct pkg *pkg,
 				 * Assume that all versions should be checked
 				 */
 				res = true;
-				pkg_audit_print_entry(e, sb, pkg->name, NULL, quiet);
+				if (!match(e, pkg, ud))
+					return (res);
 			}
 			else {
 				LL_FOREACH(e->versions, vers) {
@@ -818,24 +846,53 @@ pkg_audit_is_vulnerable(struct pkg_audit *audit, struct pkg *pkg,
 
 					if (res1 && res2) {
 						res = true;
-						pkg_audit_print_entry(e, sb, pkg->name, pkg->version, quiet);
+						if (!match(e, pkg, ud))
+							return (res);
 						break;
 					}
 				}
 			}
-
-			if (res && quiet)
-				goto out;
 		}
 	}
 
-out:
+	return (res);
+}
+
+struct pkg_audit_print_data {
+	struct sbuf *sb;
+	bool quiet;
+};
+
+static bool
+pkg_audit_print_match(struct pkg_audit_entry *e, struct pkg *pkg, void *ud)
+{
+	struct pkg_audit_print_data *pd = ud;
+
+	pkg_audit_print_entry(e, pd->sb, pkg->name, pkg->version, pd->quiet);
+
+	return (!pd->quiet);
+}
+
+bool
+pkg_audit_is_vulnerable(struct pkg_audit *audit, struct pkg *pkg,
+		bool quiet, struct sbuf **result)
+{
+	struct pkg_audit_print_data pd;
+	bool res;
+
+	if (!audit->parsed)
+		return false;
+
+	pd.sb = sbuf_new_auto();
+	pd.quiet = quiet;
+	res = pkg_audit_match(audit, pkg, false, pkg_audit_print_match, &pd);
+
 	if (res) {
-		sbuf_finish(sb);
-		*result = sb;
+		sbuf_finish(pd.sb);
+		*result = pd.sb;
 	}
 	else {
-		sbuf_delete(sb);
+		sbuf_delete(pd.sb);
 	}
 
 	return (res);
@@ -895,6 +952,287 @@ pkg_audit_process(struct pkg_audit *audit)
 	return (EPKG_OK);
 }
 
+/*
+ * Delta audit: the results of a run are saved along with the digest of the
+ * vulnxml and of each of its entries, and with the version and manifest
+ * digest of each package.  The next run reuses the results of the packages
+ * that did not change as long as the vulnxml did not either, and otherwise
+ * only matches them against the entries that changed.
+ */
+
+static const char *
+pkg_audit_state_string(const ucl_object_t *o, const char *key)
+{
+	if (o == NULL || key == NULL)
+		return (NULL);
+	o = ucl_object_find_key(o, key);
+
+	return (o != NULL ? ucl_object_tostring(o) : NULL);
+}
+
+static const ucl_object_t *
+pkg_audit_state_get(struct pkg_audit *audit, const char *section,
+    const char *key)
+{
+	const ucl_object_t *o;
+
+	if (audit->state == NULL || key == NULL)
+		return (NULL);
+	o = ucl_object_find_key(audit->state, section);
+
+	return (o != NULL ? ucl_object_find_key(o, key) : NULL);
+}
+
+static bool
+pkg_audit_state_eq(const char *s1, const char *s2)
+{
+	if (s1 == NULL || s2 == NULL)
+		return (s1 == s2);
+
+	return (strcmp(s1, s2) == 0);
+}
+
+int
+pkg_audit_state_load(struct pkg_audit *audit, int fd)
+{
+	struct ucl_parser *p;
+	struct stat st;
+	const char *digest;
+
+	if (!audit->loaded || audit->len == 0)
+		return (EPKG_FATAL);
+
+	audit->digest = (char *)pkg_checksum_data(audit->map, audit->len,
+	    PKG_HASH_TYPE_SHA256_HEX);
+	if (audit->digest == NULL)
+		return (EPKG_FATAL);
+	audit->results = ucl_object_typed_new(UCL_OBJECT);
+
+	if (fstat(fd, &st) == -1) {
+		pkg_emit_errno("fstat", "audit state");
+		return (EPKG_FATAL);
+	}
+	/* First run */
+	if (st.st_size == 0)
+		return (EPKG_OK);
+
+	p = ucl_parser_new(0);
+	if (!ucl_parser_add_fd(p, fd)) {
+		pkg_emit_error("Ignoring the invalid audit state: %s",
+		    ucl_parser_get_error(p));
+		ucl_parser_free(p);
+		return (EPKG_OK);
+	}
+	audit->state = ucl_parser_get_object(p);
+	ucl_parser_free(p);
+
+	if (audit->state != NULL &&
+	    ucl_object_type(audit->state) != UCL_OBJECT) {
+		pkg_emit_error("Ignoring the invalid audit state");
+		ucl_object_unref(audit->state);
+		audit->state = NULL;
+	}
+
+	digest = pkg_audit_state_string(audit->state, "vulnxml");
+	audit->current = pkg_audit_state_eq(digest, audit->digest);
+
+	return (EPKG_OK);
+}
+
+/*
+ * Parses the vulnxml, which is only needed if something changed since the
+ * previous run, and flags the entries that are new or were modified.
+ */
+static int
+pkg_audit_state_process(struct pkg_audit *audit)
+{
+	struct pkg_audit_entry *e;
+	const ucl_object_t *o;
+
+	if (audit->vulns != NULL)
+		return (EPKG_OK);
+
+	if (!audit->parsed && pkg_audit_process(audit) != EPKG_OK)
+		return (EPKG_FATAL);
+
+	audit->vulns = ucl_object_typed_new(UCL_OBJECT);
+	LL_FOREACH(audit->entries, e) {
+		if (e->id == NULL || e->digest == NULL) {
+			e->changed = true;
+			continue;
+		}
+		o = pkg_audit_state_get(audit, "vulns", e->id);
+		e->changed = (o == NULL ||
+		    strcmp(ucl_object_tostring(o), e->digest) != 0);
+		if (!e->ref)
+			ucl_object_replace_key(audit->vulns,
+			    ucl_object_fromstring(e->digest), e->id, 0, true);
+	}
+
+	return (EPKG_OK);
+}
+
+static bool
+pkg_audit_state_match(struct pkg_audit_entry *e, struct pkg *pkg __unused,
+    void *ud)
+{
+	ucl_object_t *vulns = ud;
+
+	if (e->id != NULL)
+		ucl_object_replace_key(vulns,
+		    ucl_object_fromstring(e->desc != NULL ? e->desc : ""),
+		    e->id, 0, true);
+
+	return (true);
+}
+
+static void
+pkg_audit_state_diff(struct sbuf *diff, char op, const char *name,
+    const char *version, const ucl_object_t *vuln)
+{
+	if (version != NULL)
+		sbuf_printf(diff, "%c %s-%s %s: %s\n", op, name, version,
+		    ucl_object_key(vuln), ucl_object_tostring(vuln));
+	else
+		sbuf_printf(diff, "%c %s %s: %s\n", op, name,
+		    ucl_object_key(vuln), ucl_object_tostring(vuln));
+}
+
+int
+pkg_audit_state_check(struct pkg_audit *audit, struct pkg *pkg,
+    struct sbuf *diff)
+{
+	const ucl_object_t *old, *ovulns, *cur, *o;
+	ucl_object_t *rec, *vulns;
+	ucl_object_iter_t it;
+	const char *oversion;
+	bool same;
+
+	if (audit->results == NULL)
+		return (EPKG_FATAL);
+
+	old = pkg_audit_state_get(audit, "packages", pkg->name);
+	ovulns = old != NULL ? ucl_object_find_key(old, "vulns") : NULL;
+	oversion = pkg_audit_state_string(old, "version");
+	same = old != NULL && pkg_audit_state_eq(oversion, pkg->version) &&
+	    pkg_audit_state_eq(pkg_audit_state_string(old, "digest"),
+	    pkg->digest);
+
+	if (same && audit->current) {
+		vulns = ovulns != NULL ? ucl_object_copy(ovulns) :
+		    ucl_object_typed_new(UCL_OBJECT);
+	} else {
+		if (pkg_audit_state_process(audit) != EPKG_OK)
+			return (EPKG_FATAL);
+
+		vulns = ucl_object_typed_new(UCL_OBJECT);
+		if (same) {
+			/* Only the entries that changed have to be matched */
+			it = NULL;
+			while ((cur = ucl_iterate_object(ovulns, &it, true))) {
+				o = pkg_audit_state_get(audit, "vulns",
+				    ucl_object_key(cur));
+				if (o != NULL && pkg_audit_state_eq(
+				    ucl_object_tostring(o), pkg_audit_state_string(
+				    audit->vulns, ucl_object_key(cur))))
+					ucl_object_insert_key(vulns,
+					    ucl_object_copy(cur),
+					    ucl_object_key(cur), 0, true);
+			}
+		}
+		pkg_audit_match(audit, pkg, same, pkg_audit_state_match, vulns);
+
+		it = NULL;
+		while ((cur = ucl_iterate_object(vulns, &it, true))) {
+			if (ovulns != NULL &&
+			    ucl_object_find_key(ovulns, ucl_object_key(cur)))
+				continue;
+			pkg_audit_state_diff(diff, '+', pkg->name, pkg->version,
+			    cur);
+			audit->added++;
+		}
+		it = NULL;
+		while ((cur = ucl_iterate_object(ovulns, &it, true))) {
+			if (ucl_object_find_key(vulns, ucl_object_key(cur)))
+				continue;
+			pkg_audit_state_diff(diff, '-', pkg->name, oversion, cur);
+			audit->resolved++;
+		}
+	}
+
+	rec = ucl_object_typed_new(UCL_OBJECT);
+	if (pkg->version != NULL)
+		ucl_object_insert_key(rec, ucl_object_fromstring(pkg->version),
+		    "version", 0, false);
+	if (pkg->digest != NULL)
+		ucl_object_insert_key(rec, ucl_object_fromstring(pkg->digest),
+		    "digest", 0, false);
+	ucl_object_insert_key(rec, vulns, "vulns", 0, false);
+	ucl_object_replace_key(audit->results, rec, pkg->name, 0, true);
+
+	return (EPKG_OK);
+}
+
+int
+pkg_audit_state_save(struct pkg_audit *audit, int fd, struct sbuf *diff,
+    unsigned int *added, unsigned int *resolved)
+{
+	const ucl_object_t *packages, *old, *cur;
+	ucl_object_t *top, *vulns;
+	ucl_object_iter_t it, vit;
+	struct sbuf *sb = NULL;
+	int ret = EPKG_OK;
+
+	if (audit->results == NULL)
+		return (EPKG_FATAL);
+
+	/* The vulnerabilities of the removed packages are resolved too */
+	packages = audit->state != NULL ?
+	    ucl_object_find_key(audit->state, "packages") : NULL;
+	it = NULL;
+	while ((old = ucl_iterate_object(packages, &it, true))) {
+		if (ucl_object_find_key(audit->results, ucl_object_key(old)))
+			continue;
+		vit = NULL;
+		while ((cur = ucl_iterate_object(
+		    ucl_object_find_key(old, "vulns"), &vit, true))) {
+			pkg_audit_state_diff(diff, '-', ucl_object_key(old),
+			    pkg_audit_state_string(old, "version"), cur);
+			audit->resolved++;
+		}
+	}
+
+	if (audit->vulns != NULL)
+		vulns = ucl_object_ref(audit->vulns);
+	else if (audit->state != NULL &&
+	    ucl_object_find_key(audit->state, "vulns") != NULL)
+		vulns = ucl_object_copy(
+		    ucl_object_find_key(audit->state, "vulns"));
+	else
+		vulns = ucl_object_typed_new(UCL_OBJECT);
+
+	top = ucl_object_typed_new(UCL_OBJECT);
+	ucl_object_insert_key(top, ucl_object_fromstring(audit->digest),
+	    "vulnxml", 0, false);
+	ucl_object_insert_key(top, vulns, "vulns", 0, false);
+	ucl_object_insert_key(top, ucl_object_ref(audit->results), "packages",
+	    0, false);
+	ucl_object_emit_sbuf(top, UCL_EMIT_JSON_COMPACT, &sb);
+	ucl_object_unref(top);
+
+	if (ftruncate(fd, 0) == -1 ||
+	    pwrite(fd, sbuf_data(sb), sbuf_len(sb), 0) != sbuf_len(sb)) {
+		pkg_emit_errno("write", "audit state");
+		ret = EPKG_FATAL;
+	}
+	sbuf_delete(sb);
+
+	*added = audit->added;
+	*resolved = audit->resolved;
+
+	return (ret);
+}
+
 void
 pkg_audit_free (struct pkg_audit *audit)
 {
@@ -906,6 +1244,13 @@ pkg_audit_free (struct pkg_audit *audit)
 		if (audit->loaded) {
 			munmap(audit->map, audit->len);
 		}
+		if (audit->state != NULL)
+			ucl_object_unref(audit->state);
+		if (audit->vulns != NULL)
+			ucl_object_unref(audit->vulns);
+		if (audit->results != NULL)
+			ucl_object_unref(audit->results);
+		free(audit->digest);
 		free(audit);
 	}
 }
@@ -0,0 +1,161 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "pkg_config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "pkg.h"
+#include "private/event.h"
+#include "private/pkg.h"
+
+/*
+ * Cancellation and budgets of the running jobs.
+ *
+ * pkg_jobs_solve() and pkg_jobs_apply() publish the token of their jobs
+ * while they run.  The code of each phase brackets itself with
+ * pkg_cancel_enter() and pkg_cancel_leave(), the time is accounted to the
+ * innermost phase, so a script run during the extraction only consumes
+ * the script budget.  Once the token is cancelled, every later check
+ * fails so the whole transaction unwinds.
+ */
+
+struct pkg_cancel *pkg_cancel_token = NULL;
+
+static const struct {
+	const char *name;
+	const char *time_key;
+	const char *bytes_key;
+} phases[PKG_JOBS_PHASE_NONE] = {
+	[PKG_JOBS_PHASE_FETCH] = { "fetch", "FETCH_TIME_BUDGET",
+	    "FETCH_BYTE_BUDGET" },
+	[PKG_JOBS_PHASE_SOLVE] = { "solve", "SOLVE_TIME_BUDGET", NULL },
+	[PKG_JOBS_PHASE_EXTRACT] = { "extract", "EXTRACT_TIME_BUDGET",
+	    "EXTRACT_BYTE_BUDGET" },
+	[PKG_JOBS_PHASE_SCRIPT] = { "script", "SCRIPT_TIME_BUDGET", NULL },
+};
+
+static int64_t
+pkg_cancel_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+void
+pkg_cancel_init(struct pkg_cancel *c)
+{
+	int i;
+
+	memset(c, 0, sizeof(*c));
+	c->phase = PKG_JOBS_PHASE_NONE;
+	for (i = 0; i < PKG_JOBS_PHASE_NONE; i++) {
+		c->time_budget[i] =
+		    pkg_object_int(pkg_config_get(phases[i].time_key));
+		if (phases[i].bytes_key != NULL)
+			c->byte_budget[i] =
+			    pkg_object_int(pkg_config_get(phases[i].bytes_key));
+	}
+}
+
+pkg_jobs_phase_t
+pkg_cancel_enter(pkg_jobs_phase_t phase)
+{
+	struct pkg_cancel *c = pkg_cancel_token;
+	pkg_jobs_phase_t prev;
+	int64_t now;
+
+	if (c == NULL)
+		return (PKG_JOBS_PHASE_NONE);
+
+	prev = c->phase;
+	now = pkg_cancel_now();
+	if (prev != PKG_JOBS_PHASE_NONE)
+		c->used[prev] += now - c->start;
+	c->phase = phase;
+	c->start = now;
+
+	return (prev);
+}
+
+void
+pkg_cancel_leave(pkg_jobs_phase_t prev)
+{
+
+	pkg_cancel_enter(prev);
+}
+
+int
+pkg_cancel_check(int64_t bytes)
+{
+	struct pkg_cancel *c = pkg_cancel_token;
+	pkg_jobs_phase_t p;
+	int64_t elapsed;
+
+	if (c == NULL)
+		return (EPKG_OK);
+
+	p = c->phase;
+	if (!c->cancelled && p != PKG_JOBS_PHASE_NONE) {
+		c->bytes[p] += bytes;
+		elapsed = c->used[p] + pkg_cancel_now() - c->start;
+		if (c->byte_budget[p] > 0 && c->bytes[p] > c->byte_budget[p]) {
+			pkg_emit_error("The %s phase ran over its budget of "
+			    "%jd bytes", phases[p].name,
+			    (intmax_t)c->byte_budget[p]);
+			c->reported = true;
+			c->cancelled = 1;
+		} else if (c->time_budget[p] > 0 &&
+		    elapsed > c->time_budget[p] * 1000) {
+			pkg_emit_error("The %s phase ran over its budget of "
+			    "%jd seconds", phases[p].name,
+			    (intmax_t)c->time_budget[p]);
+			c->reported = true;
+			c->cancelled = 1;
+		}
+	}
+
+	if (!c->cancelled)
+		return (EPKG_OK);
+
+	if (!c->reported) {
+		if (p != PKG_JOBS_PHASE_NONE)
+			pkg_emit_error("Cancelled during the %s phase",
+			    phases[p].name);
+		else
+			pkg_emit_error("Cancelled");
+		c->reported = true;
+	}
+
+	return (EPKG_CANCEL);
+}
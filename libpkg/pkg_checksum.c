@@ -33,17 +33,21 @@
 #include "private/event.h"
 #include "blake2.h"
 
+/*
+ * A field of the package as it is hashed, the strings are borrowed from the
+ * package; a dependency is hashed as "name~origin".
+ */
 struct pkg_checksum_entry {
 	const char *field;
-	char *value;
-	struct pkg_checksum_entry *next, *prev;
+	const char *value;
+	const char *origin;
 };
 
 /* Separate checksum parts */
 #define PKG_CKSUM_SEPARATOR '$'
 
-typedef void (*pkg_checksum_hash_func)(struct pkg_checksum_entry *entries,
-				unsigned char **out, size_t *outlen);
+typedef size_t (*pkg_checksum_hash_func)(struct pkg_checksum_entry *entries,
+				size_t nentries, unsigned char *out);
 typedef void (*pkg_checksum_hash_bulk_func)(const unsigned char *in, size_t inlen,
 				unsigned char **out, size_t *outlen);
 typedef void (*pkg_checksum_encode_func)(unsigned char *in, size_t inlen,
@@ -52,14 +56,14 @@ typedef void (*pkg_checksum_encode_func)(unsigned char *in, size_t inlen,
 typedef void (*pkg_checksum_hash_file_func)(int fd, unsigned char **out,
     size_t *outlen);
 
-static void pkg_checksum_hash_sha256(struct pkg_checksum_entry *entries,
-				unsigned char **out, size_t *outlen);
+static size_t pkg_checksum_hash_sha256(struct pkg_checksum_entry *entries,
+				size_t nentries, unsigned char *out);
 static void pkg_checksum_hash_sha256_bulk(const unsigned char *in, size_t inlen,
 				unsigned char **out, size_t *outlen);
 static void pkg_checksum_hash_sha256_file(int fd, unsigned char **out,
     size_t *outlen);
-static void pkg_checksum_hash_blake2(struct pkg_checksum_entry *entries,
-				unsigned char **out, size_t *outlen);
+static size_t pkg_checksum_hash_blake2(struct pkg_checksum_entry *entries,
+				size_t nentries, unsigned char *out);
 static void pkg_checksum_hash_blake2_bulk(const unsigned char *in, size_t inlen,
 				unsigned char **out, size_t *outlen);
 static void pkg_checksum_hash_blake2_file(int fd, unsigned char **out,
@@ -127,39 +131,41 @@ static const struct _pkg_cksum_type {
 };
 
 static void
-pkg_checksum_free_entry(struct pkg_checksum_entry *e)
+pkg_checksum_add_entry(const char *key, const char *value, const char *origin,
+	struct pkg_checksum_entry *entries, size_t *nentries)
 {
-	if (e != NULL) {
-		if (e->value) {
-			free(e->value);
-		}
-		free(e);
-	}
+	struct pkg_checksum_entry *e;
+
+	if (value == NULL)
+		return;
+
+	e = &entries[(*nentries)++];
+	e->field = key;
+	e->value = value;
+	e->origin = origin;
 }
 
-static void
-pkg_checksum_add_entry(const char *key,
-	const char *value,
-	struct pkg_checksum_entry **entries)
+/* Next character of the value as hashed, 0 at its end */
+static int
+pkg_checksum_entry_next(const struct pkg_checksum_entry *e, int *part,
+	const char **p)
 {
-	struct pkg_checksum_entry *e;
 
-	e = malloc(sizeof(*e));
-	if (e == NULL) {
-		pkg_emit_errno("malloc", "pkg_checksum_entry");
-		return;
+	while (**p == '\0') {
+		if (e->origin == NULL || *part == 2)
+			return (0);
+		*p = ++(*part) == 1 ? "~" : e->origin;
 	}
 
-	e->field = key;
-	e->value = strdup(value);
-	DL_APPEND(*entries, e);
+	return ((unsigned char)*(*p)++);
 }
 
 static int
-pkg_checksum_entry_cmp(struct pkg_checksum_entry *e1,
-	struct pkg_checksum_entry *e2)
+pkg_checksum_entry_cmp(const void *a, const void *b)
 {
-	int r;
+	const struct pkg_checksum_entry *e1 = a, *e2 = b;
+	const char *p1, *p2;
+	int r, part1 = 0, part2 = 0, c1, c2;
 
 	/* Compare field names first. */
 	r = strcmp(e1->field, e2->field);
@@ -167,7 +173,14 @@ pkg_checksum_entry_cmp(struct pkg_checksum_entry *e1,
 		return r;
 
 	/* If field names are the same, compare values. */
-	return (strcmp(e1->value, e2->value));
+	p1 = e1->value;
+	p2 = e2->value;
+	do {
+		c1 = pkg_checksum_entry_next(e1, &part1, &p1);
+		c2 = pkg_checksum_entry_next(e2, &part2, &p2);
+	} while (c1 == c2 && c1 != 0);
+
+	return (c1 - c2);
 }
 
 /*
@@ -189,10 +202,10 @@ int
 pkg_checksum_generate(struct pkg *pkg, char *dest, size_t destlen,
 	pkg_checksum_type_t type)
 {
-	unsigned char *bdigest;
-	char *olduid, *buf;
-	size_t blen;
-	struct pkg_checksum_entry *entries = NULL;
+	unsigned char bdigest[BLAKE2B_OUTBYTES];
+	char *buf;
+	size_t blen, nentries = 0;
+	struct pkg_checksum_entry *entries;
 	struct pkg_option *option = NULL;
 	struct pkg_dep *dep = NULL;
 	int i;
@@ -201,59 +214,73 @@ pkg_checksum_generate(struct pkg *pkg, char *dest, size_t destlen,
 					destlen < checksum_types[type].hlen)
 		return (EPKG_FATAL);
 
-	pkg_checksum_add_entry("name", pkg->name, &entries);
-	pkg_checksum_add_entry("origin", pkg->origin, &entries);
-	pkg_checksum_add_entry("version", pkg->version, &entries);
-	pkg_checksum_add_entry("arch", pkg->arch, &entries);
+	/* One array for every field, the values are not copied */
+	entries = malloc(sizeof(*entries) * (4 +
+	    pkg_list_count(pkg, PKG_OPTIONS) +
+	    pkg_list_count(pkg, PKG_SHLIBS_REQUIRED) +
+	    pkg_list_count(pkg, PKG_SHLIBS_PROVIDED) +
+	    pkg_list_count(pkg, PKG_USERS) +
+	    pkg_list_count(pkg, PKG_GROUPS) +
+	    pkg_list_count(pkg, PKG_DEPS) +
+	    pkg_list_count(pkg, PKG_PROVIDES) +
+	    pkg_list_count(pkg, PKG_REQUIRES)));
+	if (entries == NULL) {
+		pkg_emit_errno("malloc", "pkg_checksum_entry");
+		return (EPKG_FATAL);
+	}
+
+	pkg_checksum_add_entry("name", pkg->name, NULL, entries, &nentries);
+	pkg_checksum_add_entry("origin", pkg->origin, NULL, entries, &nentries);
+	pkg_checksum_add_entry("version", pkg->version, NULL, entries, &nentries);
+	pkg_checksum_add_entry("arch", pkg->arch, NULL, entries, &nentries);
 
 	while (pkg_options(pkg, &option) == EPKG_OK) {
-		pkg_checksum_add_entry(option->key, option->value, &entries);
+		pkg_checksum_add_entry(option->key, option->value, NULL,
+		    entries, &nentries);
 	}
 
 	buf = NULL;
 	while (pkg_shlibs_required(pkg, &buf) == EPKG_OK) {
-		pkg_checksum_add_entry("required_shlib", buf, &entries);
+		pkg_checksum_add_entry("required_shlib", buf, NULL,
+		    entries, &nentries);
 	}
 
 	buf = NULL;
 	while (pkg_shlibs_provided(pkg, &buf) == EPKG_OK) {
-		pkg_checksum_add_entry("provided_shlib", buf, &entries);
+		pkg_checksum_add_entry("provided_shlib", buf, NULL,
+		    entries, &nentries);
 	}
 
 	buf = NULL;
 	while (pkg_users(pkg, &buf) == EPKG_OK) {
-		pkg_checksum_add_entry("user", buf, &entries);
+		pkg_checksum_add_entry("user", buf, NULL, entries, &nentries);
 	}
 
 	buf = NULL;
 	while (pkg_groups(pkg, &buf) == EPKG_OK) {
-		pkg_checksum_add_entry("group", buf, &entries);
+		pkg_checksum_add_entry("group", buf, NULL, entries, &nentries);
 	}
 
 	while (pkg_deps(pkg, &dep) == EPKG_OK) {
-		asprintf(&olduid, "%s~%s", dep->name, dep->origin);
-		pkg_checksum_add_entry("depend", olduid, &entries);
-		free(olduid);
+		pkg_checksum_add_entry("depend", dep->name, dep->origin,
+		    entries, &nentries);
 	}
 
 	buf = NULL;
 	while (pkg_provides(pkg, &buf) == EPKG_OK) {
-		pkg_checksum_add_entry("provide", buf, &entries);
+		pkg_checksum_add_entry("provide", buf, NULL, entries, &nentries);
 	}
 
 	buf = NULL;
 	while (pkg_requires(pkg, &buf) == EPKG_OK) {
-		pkg_checksum_add_entry("require", buf, &entries);
+		pkg_checksum_add_entry("require", buf, NULL, entries, &nentries);
 	}
 
-	/* Sort before hashing */
-	DL_SORT(entries, pkg_checksum_entry_cmp);
+	/* The sets are unordered, sort before hashing */
+	qsort(entries, nentries, sizeof(*entries), pkg_checksum_entry_cmp);
 
-	checksum_types[type].hfunc(entries, &bdigest, &blen);
-	if (blen == 0 || bdigest == NULL) {
-		LL_FREE(entries, pkg_checksum_free_entry);
-		return (EPKG_FATAL);
-	}
+	blen = checksum_types[type].hfunc(entries, nentries, bdigest);
+	free(entries);
 
 	if (checksum_types[type].encfunc) {
 		i = snprintf(dest, destlen, "%d%c%d%c", PKG_CHECKSUM_CUR_VERSION,
@@ -267,9 +294,6 @@ pkg_checksum_generate(struct pkg *pkg, char *dest, size_t destlen,
 		memcpy(dest, bdigest, blen);
 	}
 
-	free(bdigest);
-	LL_FREE(entries, pkg_checksum_free_entry);
-
 	return (EPKG_OK);
 }
 
@@ -337,28 +361,29 @@ pkg_checksum_get_type(const char *cksum, size_t clen)
 	return (PKG_HASH_TYPE_UNKNOWN);
 }
 
-static void
-pkg_checksum_hash_sha256(struct pkg_checksum_entry *entries,
-		unsigned char **out, size_t *outlen)
+static size_t
+pkg_checksum_hash_sha256(struct pkg_checksum_entry *entries, size_t nentries,
+		unsigned char *out)
 {
 	SHA256_CTX sign_ctx;
+	size_t i;
 
 	SHA256_Init(&sign_ctx);
 
-	while(entries) {
-		SHA256_Update(&sign_ctx, entries->field, strlen(entries->field));
-		SHA256_Update(&sign_ctx, entries->value, strlen(entries->value));
-		entries = entries->next;
-	}
-	*out = malloc(SHA256_DIGEST_LENGTH);
-	if (*out != NULL) {
-		SHA256_Final(*out, &sign_ctx);
-		*outlen = SHA256_DIGEST_LENGTH;
-	}
-	else {
-		pkg_emit_errno("malloc", "pkg_checksum_hash_sha256");
-		*outlen = 0;
+	for (i = 0; i < nentries; i++) {
+		SHA256_Update(&sign_ctx, entries[i].field,
+		    strlen(entries[i].field));
+		SHA256_Update(&sign_ctx, entries[i].value,
+		    strlen(entries[i].value));
+		if (entries[i].origin != NULL) {
+			SHA256_Update(&sign_ctx, "~", 1);
+			SHA256_Update(&sign_ctx, entries[i].origin,
+			    strlen(entries[i].origin));
+		}
 	}
+	SHA256_Final(out, &sign_ctx);
+
+	return (SHA256_DIGEST_LENGTH);
 }
 
 static void
@@ -389,28 +414,27 @@ pkg_checksum_hash_sha256_file(int fd, unsigned char **out, size_t *outlen)
 	*outlen = SHA256_DIGEST_LENGTH;
 }
 
-static void
-pkg_checksum_hash_blake2(struct pkg_checksum_entry *entries,
-		unsigned char **out, size_t *outlen)
+static size_t
+pkg_checksum_hash_blake2(struct pkg_checksum_entry *entries, size_t nentries,
+		unsigned char *out)
 {
 	blake2b_state st;
+	size_t i;
 
 	blake2b_init (&st, BLAKE2B_OUTBYTES);
 
-	while(entries) {
-		blake2b_update (&st, entries->field, strlen(entries->field));
-		blake2b_update (&st, entries->value, strlen(entries->value));
-		entries = entries->next;
-	}
-	*out = malloc(BLAKE2B_OUTBYTES);
-	if (*out != NULL) {
-		blake2b_final (&st, *out, BLAKE2B_OUTBYTES);
-		*outlen = BLAKE2B_OUTBYTES;
-	}
-	else {
-		pkg_emit_errno("malloc", "pkg_checksum_hash_blake2");
-		*outlen = 0;
+	for (i = 0; i < nentries; i++) {
+		blake2b_update (&st, entries[i].field, strlen(entries[i].field));
+		blake2b_update (&st, entries[i].value, strlen(entries[i].value));
+		if (entries[i].origin != NULL) {
+			blake2b_update (&st, "~", 1);
+			blake2b_update (&st, entries[i].origin,
+			    strlen(entries[i].origin));
+		}
 	}
+	blake2b_final (&st, out, BLAKE2B_OUTBYTES);
+
+	return (BLAKE2B_OUTBYTES);
 }
 
 static void
@@ -508,6 +532,7 @@ static void
 pkg_checksum_encode_hex(unsigned char *in, size_t inlen,
 				char *out, size_t outlen)
 {
+	static const char hex[] = "0123456789abcdef";
 	int i;
 
 	if (outlen < inlen * 2) {
@@ -515,8 +540,10 @@ pkg_checksum_encode_hex(unsigned char *in, size_t inlen,
 		return;
 	}
 
-	for (i = 0; i < inlen; i++)
-		sprintf(out + (i * 2), "%02x", in[i]);
+	for (i = 0; i < inlen; i++) {
+		out[i * 2] = hex[in[i] >> 4];
+		out[i * 2 + 1] = hex[in[i] & 0xf];
+	}
 
 	out[inlen * 2] = '\0';
 }
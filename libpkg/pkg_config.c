@@ -45,6 +45,7 @@
 #include "pkg.h"
 #include "private/pkg.h"
 #include "private/event.h"
+#include "private/pkgdb.h"
 #include "pkg_repos.h"
 
 #ifndef PORTSDIR
@@ -64,6 +65,7 @@
 
 int eventpipe = -1;
 int64_t debug_level = 0;
+uint64_t debug_flags = PKG_DBG_ALL;
 bool developer_mode = false;
 const char *pkg_rootdir = NULL;
 int rootfd = -1;
@@ -236,6 +238,49 @@ static struct config_entry c[] = {
 		NULL,
 		"Send all events to the specified fifo or Unix socket",
 	},
+	{
+		PKG_INT,
+		"EVENT_PIPE_BUFFER",
+		"0",
+		"Number of events buffered for a dispatcher thread writing to "
+		"EVENT_PIPE, 0 writes them synchronously",
+	},
+	{
+		PKG_INT,
+		"FETCH_TIME_BUDGET",
+		"0",
+		"Seconds the fetch phase of a job may take, 0 for no limit",
+	},
+	{
+		PKG_INT,
+		"FETCH_BYTE_BUDGET",
+		"0",
+		"Bytes the fetch phase of a job may download, 0 for no limit",
+	},
+	{
+		PKG_INT,
+		"SOLVE_TIME_BUDGET",
+		"0",
+		"Seconds the solver may take, 0 for no limit",
+	},
+	{
+		PKG_INT,
+		"EXTRACT_TIME_BUDGET",
+		"0",
+		"Seconds the extraction of the packages may take, 0 for no limit",
+	},
+	{
+		PKG_INT,
+		"EXTRACT_BYTE_BUDGET",
+		"0",
+		"Bytes the extraction of the packages may write, 0 for no limit",
+	},
+	{
+		PKG_INT,
+		"SCRIPT_TIME_BUDGET",
+		"0",
+		"Seconds the package scripts may take, 0 for no limit",
+	},
 	{
 		PKG_INT,
 		"FETCH_TIMEOUT",
@@ -248,6 +293,12 @@ static struct config_entry c[] = {
 		"NO",
 		"Do not include timestamps in the package",
 	},
+	{
+		PKG_BOOL,
+		"ARCHIVE_INDEX",
+		"NO",
+		"Create tgz packages with a member index",
+	},
 	{
 		PKG_STRING,
 		"SSH_RESTRICT_DIR",
@@ -272,6 +323,12 @@ static struct config_entry c[] = {
 		"0",
 		"Level for debug messages",
 	},
+	{
+		PKG_ARRAY,
+		"DEBUG_FLAGS",
+		"ALL",
+		"Categories of debug messages",
+	},
 	{
 		PKG_OBJECT,
 		"ALIAS",
@@ -320,6 +377,12 @@ static struct config_entry c[] = {
 		"NO",
 		"Profile sqlite queries"
 	},
+	{
+		PKG_BOOL,
+		"MEMORY_STATS",
+		"NO",
+		"Account memory used by libpkg subsystems"
+	},
 	{
 		PKG_INT,
 		"WORKERS_COUNT",
@@ -508,7 +571,7 @@ add_repo(const ucl_object_t *obj, struct pkg_repo *r, const char *rname, pkg_ini
 	int use_ipvx = 0;
 	int priority = 0;
 
-	pkg_debug(1, "PkgConfig: parsing repository object %s", rname);
+	pkg_dbg(CONFIG, 1, "PkgConfig: parsing repository object %s", rname);
 
 	enabled = ucl_object_find_key(obj, "enabled");
 	if (enabled == NULL)
@@ -516,7 +579,7 @@ add_repo(const ucl_object_t *obj, struct pkg_repo *r, const char *rname, pkg_ini
 	if (enabled != NULL) {
 		enable = ucl_object_toboolean(enabled);
 		if (!enable && r == NULL) {
-			pkg_debug(1, "PkgConfig: skipping disabled repo %s", rname);
+			pkg_dbg(CONFIG, 1, "PkgConfig: skipping disabled repo %s", rname);
 			return;
 		}
 		else if (!enable && r != NULL) {
@@ -524,7 +587,7 @@ add_repo(const ucl_object_t *obj, struct pkg_repo *r, const char *rname, pkg_ini
 			 * We basically want to remove the existing repo r and
 			 * forget all stuff parsed
 			 */
-			pkg_debug(1, "PkgConfig: disabling repo %s", rname);
+			pkg_dbg(CONFIG, 1, "PkgConfig: disabling repo %s", rname);
 			HASH_DEL(repos, r);
 			pkg_repo_free(r);
 			return;
@@ -606,7 +669,7 @@ add_repo(const ucl_object_t *obj, struct pkg_repo *r, const char *rname, pkg_ini
 	}
 
 	if (r == NULL && url == NULL) {
-		pkg_debug(1, "No repo and no url for %s", rname);
+		pkg_dbg(CONFIG, 1, "No repo and no url for %s", rname);
 		return;
 	}
 
@@ -668,10 +731,10 @@ add_repo_obj(const ucl_object_t *obj, const char *file, pkg_init_flags flags)
 	const char *key;
 
 	key = ucl_object_key(obj);
-	pkg_debug(1, "PkgConfig: parsing repo key '%s' in file '%s'", key, file);
+	pkg_dbg(CONFIG, 1, "PkgConfig: parsing repo key '%s' in file '%s'", key, file);
 	r = pkg_repo_find(key);
 	if (r != NULL)
-		pkg_debug(1, "PkgConfig: overwriting repository %s", key);
+		pkg_dbg(CONFIG, 1, "PkgConfig: overwriting repository %s", key);
        add_repo(obj, r, key, flags);
 }
 
@@ -685,10 +748,10 @@ walk_repo_obj(const ucl_object_t *obj, const char *file, pkg_init_flags flags)
 
 	while ((cur = ucl_iterate_object(obj, &it, true))) {
 		key = ucl_object_key(cur);
-		pkg_debug(1, "PkgConfig: parsing key '%s'", key);
+		pkg_dbg(CONFIG, 1, "PkgConfig: parsing key '%s'", key);
 		r = pkg_repo_find(key);
 		if (r != NULL)
-			pkg_debug(1, "PkgConfig: overwriting repository %s", key);
+			pkg_dbg(CONFIG, 1, "PkgConfig: overwriting repository %s", key);
 		if (cur->type == UCL_OBJECT)
 			add_repo(cur, r, key, flags);
 		else
@@ -713,7 +776,7 @@ load_repo_file(const char *repofile, pkg_init_flags flags)
 	myarch_legacy = pkg_object_string(pkg_config_get("ALTABI"));
 	ucl_parser_register_variable (p, "ALTABI", myarch_legacy);
 
-	pkg_debug(1, "PKgConfig: loading %s", repofile);
+	pkg_dbg(CONFIG, 1, "PKgConfig: loading %s", repofile);
 	if (!ucl_parser_add_file(p, repofile)) {
 		pkg_emit_error("Error parsing: %s: %s", repofile,
 		    ucl_parser_get_error(p));
@@ -746,7 +809,7 @@ load_repo_files(const char *repodir, pkg_init_flags flags)
 	int nents, i;
 	char path[MAXPATHLEN];
 
-	pkg_debug(1, "PkgConfig: loading repositories in %s", repodir);
+	pkg_dbg(CONFIG, 1, "PkgConfig: loading repositories in %s", repodir);
 
 	nents = scandir(repodir, &ent, nodots, alphasort);
 	for (i = 0; i < nents; i++) {
@@ -1109,21 +1172,26 @@ pkg_ini(const char *path, const char *reposdir, pkg_init_flags flags)
 		return (EPKG_FATAL);
 	}
 
-	pkg_debug(1, "%s", "pkg initialized");
+	pkg_dbg(CONFIG, 1, "%s", "pkg initialized");
 
 	/* Start the event pipe */
 	evpipe = pkg_object_string(pkg_config_get("EVENT_PIPE"));
-	if (evpipe != NULL)
+	if (evpipe != NULL) {
 		connect_evpipe(evpipe);
+		pkg_event_async_start(
+		    pkg_object_int(pkg_config_get("EVENT_PIPE_BUFFER")));
+	}
 
 	debug_level = pkg_object_int(pkg_config_get("DEBUG_LEVEL"));
+	debug_flags = pkg_dbg_flags(pkg_config_get("DEBUG_FLAGS"));
 	developer_mode = pkg_object_bool(pkg_config_get("DEVELOPER_MODE"));
+	pkg_mem_enable(pkg_object_bool(pkg_config_get("MEMORY_STATS")));
 
 	it = NULL;
 	object = ucl_object_find_key(config, "PKG_ENV");
 	while ((cur = ucl_iterate_object(object, &it, true))) {
 		evkey = ucl_object_key(cur);
-		pkg_debug(1, "Setting env var: %s", evkey);
+		pkg_dbg(CONFIG, 1, "Setting env var: %s", evkey);
 		if (evkey != NULL && evkey[0] != '\0')
 			setenv(evkey, ucl_object_tostring_forced(cur), 1);
 	}
@@ -1256,8 +1324,13 @@ pkg_shutdown(void)
 		/* NOTREACHED */
 	}
 
+	pkgdb_profile_report();
+	pkg_mem_report();
+	pkg_event_async_stop();
+
 	ucl_object_unref(config);
 	HASH_FREE(repos, pkg_repo_free);
+	pkg_intern_free();
 
 	parsed = false;
 
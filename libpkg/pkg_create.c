@@ -57,8 +57,10 @@ pkg_create_from_dir(struct pkg *pkg, const char *root,
 	struct stat	 st;
 	int64_t		 flatsize = 0;
 	int64_t		 nfiles;
-	const char	*relocation;
+	const char	*relocation, *first;
 	hardlinks_t	*hardlinks;
+	kh_strings_t	*links = NULL;
+	struct pkg_file	*group;
 
 	if (pkg_is_valid(pkg) != EPKG_OK) {
 		pkg_emit_error("the package is not valid");
@@ -87,21 +89,32 @@ pkg_create_from_dir(struct pkg *pkg, const char *root,
 		if (lstat(fpath, &st) == -1) {
 			pkg_emit_error("file '%s' is missing", fpath);
 			kh_destroy_hardlinks(hardlinks);
+			kh_destroy_strings(links);
 			return (EPKG_FATAL);
 		}
 
 		if (file->size == 0)
 			file->size = (int64_t)st.st_size;
 
-		if (st.st_nlink == 1 || !check_for_hardlink(hardlinks, &st)) {
-			flatsize += file->size;
-		}
+		first = NULL;
+		if (st.st_nlink > 1)
+			first = first_hardlink(hardlinks, &st, file->path);
 
-		file->sum = pkg_checksum_generate_file(fpath,
-		    PKG_HASH_TYPE_SHA256_HEX);
-		if (file->sum == NULL) {
-			kh_destroy_hardlinks(hardlinks);
-			return (EPKG_FATAL);
+		if (first == NULL) {
+			flatsize += file->size;
+			file->sum = pkg_checksum_generate_file(fpath,
+			    PKG_HASH_TYPE_SHA256_HEX);
+			if (file->sum == NULL) {
+				kh_destroy_hardlinks(hardlinks);
+				kh_destroy_strings(links);
+				return (EPKG_FATAL);
+			}
+		} else {
+			/* The hardlinks of a group share their content */
+			group = pkg_get_file(pkg, first);
+			file->sum = strdup(group->sum);
+			kh_safe_add(strings, links, __DECONST(char *, first),
+			    file->path);
 		}
 
 		counter_count();
@@ -139,12 +152,28 @@ pkg_create_from_dir(struct pkg *pkg, const char *root,
 		snprintf(fpath, sizeof(fpath), "%s%s%s", root ? root : "",
 		    relocation, file->path);
 
-		ret = packing_append_file_attr(pkg_archive, fpath, file->path,
-		    file->uname, file->gname, file->perm, file->fflags);
-		if (developer_mode && ret != EPKG_OK)
+		/*
+		 * The hardlinks are linked to the first file of their group
+		 * in the plist order, not to the first one the link resolver
+		 * sees, so that the archive does not depend on the link
+		 * counts in the stage directory.
+		 */
+		kh_find(strings, links, file->path, first);
+		if (first != NULL)
+			ret = packing_append_hardlink(pkg_archive, fpath,
+			    file->path, first, file->uname, file->gname,
+			    file->perm, file->fflags);
+		else
+			ret = packing_append_file_attr(pkg_archive, fpath,
+			    file->path, file->uname, file->gname, file->perm,
+			    file->fflags);
+		if (developer_mode && ret != EPKG_OK) {
+			kh_destroy_strings(links);
 			return (ret);
+		}
 		counter_count();
 	}
+	kh_destroy_strings(links);
 
 	counter_end();
 
@@ -393,9 +422,9 @@ pkg_create_staged(const char *outdir, pkg_formats format, const char *rootdir,
 		    REG_EXTENDED|REG_ICASE|REG_NEWLINE);
 		if (regexec(&preg, pkg->desc, 2, pmatch, 0) == 0) {
 			size = pmatch[1].rm_eo - pmatch[1].rm_so;
-			pkg->www = strndup(&pkg->desc[pmatch[1].rm_so], size);
+			pkg->www = pkg_internn(&pkg->desc[pmatch[1].rm_so], size);
 		} else {
-			pkg->www = strdup("UNKNOWN");
+			pkg->www = pkg_intern("UNKNOWN");
 		}
 		regfree(&preg);
 	}
@@ -400,13 +400,13 @@ pkg_jobs_cudf_add_package(struct pkg_jobs *j, struct pkg_cudf_entry *entry)
 
 	if (n == 1) {
 		if (entry->installed && selected->pkg->type != PKG_INSTALLED) {
-			pkg_debug(3, "pkg_cudf: schedule installation of %s(%d)",
+			pkg_dbg(SOLVER, 3, "pkg_cudf: schedule installation of %s(%d)",
 					entry->uid, ver);
 			pkg_jobs_cudf_insert_res_job (&j->jobs, selected, NULL, PKG_SOLVED_INSTALL);
 			j->count ++;
 		}
 		else if (!entry->installed && selected->pkg->type == PKG_INSTALLED) {
-			pkg_debug(3, "pkg_cudf: schedule removing of %s(%d)",
+			pkg_dbg(SOLVER, 3, "pkg_cudf: schedule removing of %s(%d)",
 					entry->uid, ver);
 			pkg_jobs_cudf_insert_res_job (&j->jobs, selected, NULL, PKG_SOLVED_DELETE);
 			j->count ++;
@@ -420,11 +420,12 @@ pkg_jobs_cudf_add_package(struct pkg_jobs *j, struct pkg_cudf_entry *entry)
 				break;
 			}
 		}
-		pkg_debug(3, "pkg_cudf: schedule upgrade of %s(to %d)",
+		pkg_dbg(SOLVER, 3, "pkg_cudf: schedule upgrade of %s(to %d)",
 				entry->uid, ver);
 		assert(old != NULL);
 		/* XXX: this is a hack due to iterators stupidity */
-		selected->pkg->old_version = old->pkg->version;
+		free(selected->pkg->old_version);
+		selected->pkg->old_version = strdup(old->pkg->version);
 		pkg_jobs_cudf_insert_res_job (&j->jobs, selected, old, PKG_SOLVED_UPGRADE);
 		j->count ++;
 	}
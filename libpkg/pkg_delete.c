@@ -137,12 +137,40 @@ pkg_delete(struct pkg *pkg, struct pkgdb *db, unsigned flags)
 	return (pkgdb_unregister_pkg(db, pkg->id));
 }
 
+static void
+dir_to_del_append(struct pkg *pkg, const char *path)
+{
+	char *dir;
+	int absent;
+
+	if (pkg->dir_to_del_seen == NULL)
+		pkg->dir_to_del_seen = kh_init_strings();
+	if (kh_contains(strings, pkg->dir_to_del_seen, path))
+		return;
+
+	pkg_dbg(DELETE, 1, "Adding to deletion %s", path);
+
+	if (pkg->dir_to_del_len + 1 > pkg->dir_to_del_cap) {
+		pkg->dir_to_del_cap += 64;
+		pkg->dir_to_del = realloc(pkg->dir_to_del,
+		    pkg->dir_to_del_cap * sizeof(char *));
+	}
+
+	dir = strdup(path);
+	pkg->dir_to_del[pkg->dir_to_del_len++] = dir;
+	kh_put_strings(pkg->dir_to_del_seen, dir, &absent);
+}
+
+/*
+ * The parents of the directories are not recorded, they are all swept by
+ * pkg_effective_rmdir() anyway.
+ */
 void
 pkg_add_dir_to_del(struct pkg *pkg, const char *file, const char *dir)
 {
 	char path[MAXPATHLEN];
 	char *tmp;
-	size_t i, len, len2;
+	size_t len;
 
 	strlcpy(path, file != NULL ? file : dir, MAXPATHLEN);
 
@@ -160,38 +188,69 @@ pkg_add_dir_to_del(struct pkg *pkg, const char *file, const char *dir)
 		path[len] = '\0';
 	}
 
-	for (i = 0; i < pkg->dir_to_del_len ; i++) {
-		len2 = strlen(pkg->dir_to_del[i]);
-		if (len2 >= len && strncmp(path, pkg->dir_to_del[i], len) == 0)
-			return;
+	dir_to_del_append(pkg, path);
+}
 
-		if (strncmp(path, pkg->dir_to_del[i], len2) == 0) {
-			pkg_debug(1, "Replacing in deletion %s with %s",
-			    pkg->dir_to_del[i], path);
-			free(pkg->dir_to_del[i]);
-			pkg->dir_to_del[i] = strdup(path);
-			return;
-		}
-	}
+KHASH_MAP_INIT_STR(rmdirs, size_t);
 
-	pkg_debug(1, "Adding to deletion %s", path);
+static int
+rmdir_cmp(const void *a, const void *b)
+{
 
-	if (pkg->dir_to_del_len + 1 > pkg->dir_to_del_cap) {
-		pkg->dir_to_del_cap += 64;
-		pkg->dir_to_del = realloc(pkg->dir_to_del,
-		    pkg->dir_to_del_cap * sizeof(char *));
-	}
+	/* A directory sorts after all of its subdirectories */
+	return (strcmp(*(char * const *)b, *(char * const *)a));
+}
 
-	pkg->dir_to_del[pkg->dir_to_del_len++] = strdup(path);
+static void
+rmdir_add(kh_rmdirs_t *sweep, const char *dir)
+{
+	khint_t k;
+	int absent;
+	char *key;
+
+	if (kh_get_rmdirs(sweep, dir) != kh_end(sweep))
+		return;
+	key = strdup(dir);
+	k = kh_put_rmdirs(sweep, key, &absent);
+	kh_val(sweep, k) = 0;
 }
 
+/* Marks the parent of dirs[i] as not removable */
 static void
-rmdir_p(struct pkgdb *db, struct pkg *pkg, char *dir, const char *prefix_r)
+rmdir_keep_parent(kh_rmdirs_t *sweep, char **dirs, size_t i, bool *kept)
 {
+	char parent[MAXPATHLEN];
 	char *tmp;
-	int64_t cnt;
-	char fullpath[MAXPATHLEN];
-	size_t len;
+	khint_t k;
+
+	strlcpy(parent, dirs[i], sizeof(parent));
+	tmp = strrchr(parent, '/');
+	if (tmp == NULL || tmp == parent)
+		return;
+	*tmp = '\0';
+	k = kh_get_rmdirs(sweep, parent);
+	if (k != kh_end(sweep))
+		kept[kh_val(sweep, k)] = true;
+}
+
+/*
+ * Removes the directories left empty by the package and their parents up to
+ * the prefix.  They are gathered once, sorted so that every directory comes
+ * after its subdirectories, and their owners other than the package are
+ * looked up in one go.
+ */
+static void
+pkg_effective_rmdir(struct pkgdb *db, struct pkg *pkg)
+{
+	char prefix_r[MAXPATHLEN];
+	char path[MAXPATHLEN];
+	char *tmp, **dirs;
+	const char *key;
+	int64_t *refs;
+	bool *kept;
+	kh_rmdirs_t *sweep;
+	size_t i, n, len, plen;
+	khint_t k;
 #if defined(HAVE_CHFLAGS)
 	struct stat st;
 #if !defined(HAVE_CHFLAGSAT)
@@ -199,81 +258,101 @@ rmdir_p(struct pkgdb *db, struct pkg *pkg, char *dir, const char *prefix_r)
 #endif
 #endif
 
-	len = snprintf(fullpath, sizeof(fullpath), "/%s", dir);
-	while (fullpath[len -1] == '/') {
-		fullpath[len - 1] = '\0';
-		len--;
-	}
-	if (pkgdb_is_dir_used(db, pkg, fullpath, &cnt) != EPKG_OK)
+	if (pkg->dir_to_del_len == 0)
 		return;
 
-	pkg_debug(1, "Number of packages owning the directory '%s': %d",
-	    fullpath, cnt);
-	/*
-	 * At this moment the package we are removing have already been removed
-	 * from the local database so if anything else is owning the directory
-	 * that is another package meaning only remove the diretory is cnt == 0
-	 */
-	if (cnt > 0)
-		return;
+	snprintf(prefix_r, sizeof(prefix_r), "/%s", pkg->prefix + 1);
+	plen = strlen(prefix_r);
+	while (plen > 1 && prefix_r[plen - 1] == '/')
+		prefix_r[--plen] = '\0';
 
-	if (strcmp(prefix_r, fullpath + 1) == 0)
-		return;
+	sweep = kh_init_rmdirs();
+	for (i = 0; i < pkg->dir_to_del_len; i++) {
+		len = snprintf(path, sizeof(path), "/%s", pkg->dir_to_del[i]);
+		while (len > 1 && path[len - 1] == '/')
+			path[--len] = '\0';
+		rmdir_add(sweep, path);
+
+		/* No recursivity for packages out of the prefix */
+		if (strncmp(prefix_r, path, plen) != 0 || path[plen] != '/')
+			continue;
+		while ((tmp = strrchr(path, '/')) != NULL &&
+		    (size_t)(tmp - path) > plen) {
+			*tmp = '\0';
+			rmdir_add(sweep, path);
+		}
+	}
 
-	pkg_debug(1, "removing directory %s", fullpath);
+	n = kh_count(sweep);
+	dirs = calloc(n, sizeof(char *));
+	refs = calloc(n, sizeof(int64_t));
+	kept = calloc(n, sizeof(bool));
+	if (dirs == NULL || refs == NULL || kept == NULL) {
+		pkg_emit_errno("calloc", "pkg_effective_rmdir");
+		goto cleanup;
+	}
+	i = 0;
+	kh_each_key(sweep, key, dirs[i++] = __DECONST(char *, key));
+	qsort(dirs, n, sizeof(char *), rmdir_cmp);
+	for (i = 0; i < n; i++) {
+		k = kh_get_rmdirs(sweep, dirs[i]);
+		kh_val(sweep, k) = i;
+	}
+
+	if (pkgdb_dirs_refcount(db, pkg, dirs, n, refs) != EPKG_OK)
+		goto cleanup;
+
+	for (i = 0; i < n; i++) {
+		pkg_dbg(DELETE, 1, "Number of packages owning the directory "
+		    "'%s': %" PRId64, dirs[i], refs[i]);
+		/*
+		 * Only remove the directories no other package owns, and
+		 * not the parents of those which could not be removed.
+		 */
+		if (kept[i] || refs[i] > 0 || strcmp(prefix_r, dirs[i]) == 0) {
+			rmdir_keep_parent(sweep, dirs, i, kept);
+			continue;
+		}
+
+		pkg_dbg(DELETE, 1, "removing directory %s", dirs[i]);
 #ifdef HAVE_CHFLAGS
-	if (fstatat(pkg->rootfd, dir, &st, AT_SYMLINK_NOFOLLOW) != -1) {
-		if (st.st_flags & NOCHANGESFLAGS) {
+		if (fstatat(pkg->rootfd, dirs[i] + 1, &st,
+		    AT_SYMLINK_NOFOLLOW) != -1) {
+			if (st.st_flags & NOCHANGESFLAGS) {
 #ifdef HAVE_CHFLAGSAT
-			/* Disable all flags*/
-			chflagsat(pkg->rootfd, dir, 0, AT_SYMLINK_NOFOLLOW);
+				/* Disable all flags*/
+				chflagsat(pkg->rootfd, dirs[i] + 1, 0,
+				    AT_SYMLINK_NOFOLLOW);
 #else
-			fd = openat(pkg->rootfd, dir, O_NOFOLLOW);
-			if (fd > 0) {
-				fchflags(fd, 0);
-				close(fd);
-			}
+				fd = openat(pkg->rootfd, dirs[i] + 1,
+				    O_NOFOLLOW);
+				if (fd > 0) {
+					fchflags(fd, 0);
+					close(fd);
+				}
 #endif
+			}
 		}
-	}
 #endif
 
-	if (unlinkat(pkg->rootfd, dir, AT_REMOVEDIR) == -1) {
-		if (errno != ENOTEMPTY && errno != EBUSY)
-			pkg_emit_errno("unlinkat", dir);
-		/* If the directory was already removed by a bogus script, continue removing parents */
-		if (errno != ENOENT)
-			return;
+		/*
+		 * If the directory was already removed by a bogus script,
+		 * continue removing parents
+		 */
+		if (unlinkat(pkg->rootfd, dirs[i] + 1, AT_REMOVEDIR) == -1 &&
+		    errno != ENOENT) {
+			if (errno != ENOTEMPTY && errno != EBUSY)
+				pkg_emit_errno("unlinkat", dirs[i] + 1);
+			rmdir_keep_parent(sweep, dirs, i, kept);
+		}
 	}
 
-	/* No recursivity for packages out of the prefix */
-	if (strncmp(prefix_r, dir, strlen(prefix_r)) != 0)
-		return;
-
-	/* remove the trailing '/' */
-	tmp = strrchr(dir, '/');
-	if (tmp == dir)
-		return;
-
-	tmp[0] = '\0';
-	tmp = strrchr(dir, '/');
-	if (tmp == NULL)
-		return;
-
-	tmp[1] = '\0';
-
-	rmdir_p(db, pkg, dir, prefix_r);
-}
-
-static void
-pkg_effective_rmdir(struct pkgdb *db, struct pkg *pkg)
-{
-	char prefix_r[MAXPATHLEN];
-	size_t i;
-
-	snprintf(prefix_r, sizeof(prefix_r), "%s", pkg->prefix + 1);
-	for (i = 0; i < pkg->dir_to_del_len; i++)
-		rmdir_p(db, pkg, pkg->dir_to_del[i], prefix_r);
+cleanup:
+	free(dirs);
+	free(refs);
+	free(kept);
+	kh_each_key(sweep, key, free(__DECONST(char *, key)));
+	kh_destroy_rmdirs(sweep);
 }
 
 void
@@ -335,7 +414,7 @@ pkg_delete_file(struct pkg *pkg, struct pkg_file *file, unsigned force)
 		}
 	}
 #endif
-	pkg_debug(1, "Deleting file: '%s'", path);
+	pkg_dbg(DELETE, 1, "Deleting file: '%s'", path);
 	if (unlinkat(pkg->rootfd, path, 0) == -1) {
 		if (force < 2) {
 			if (errno == ENOENT)
@@ -403,12 +482,7 @@ pkg_delete_dir(struct pkg *pkg, struct pkg_dir *dir)
 	if ((strncmp(prefix_rel, path, len) == 0) && path[len] == '/') {
 		pkg_add_dir_to_del(pkg, NULL, path);
 	} else {
-		if (pkg->dir_to_del_len + 1 > pkg->dir_to_del_cap) {
-			pkg->dir_to_del_cap += 64;
-			pkg->dir_to_del = realloc(pkg->dir_to_del,
-			    pkg->dir_to_del_cap * sizeof(char *));
-		}
-		pkg->dir_to_del[pkg->dir_to_del_len++] = strdup(path);
+		dir_to_del_append(pkg, path);
 	}
 }
 
@@ -81,6 +81,13 @@
 static const char * elf_corres_to_string(const struct _elf_corres* m, int e);
 static int elf_string_to_corres(const struct _elf_corres* m, const char *s);
 
+/* The shared libraries of the system, see pkg_analyse_cache_shlibs() */
+static struct {
+	bool enabled;
+	bool loaded;
+	char *stage;
+} shlibs_cache = { false, false, NULL };
+
 static int
 filter_system_shlibs(const char *name, char *path, size_t pathlen)
 {
@@ -446,6 +453,23 @@ analyse_fpath(struct pkg *pkg, const char *fpath)
 	return (EPKG_OK);
 }
 
+static void
+shlibs_cache_free(void)
+{
+	shlib_list_free();
+	free(shlibs_cache.stage);
+	shlibs_cache.stage = NULL;
+	shlibs_cache.loaded = false;
+}
+
+void
+pkg_analyse_cache_shlibs(bool enabled)
+{
+	shlibs_cache.enabled = enabled;
+	if (!enabled)
+		shlibs_cache_free();
+}
+
 int
 pkg_analyse_files(struct pkgdb *db, struct pkg *pkg, const char *stage)
 {
@@ -465,16 +489,28 @@ pkg_analyse_files(struct pkgdb *db, struct pkg *pkg, const char *stage)
 	if (elf_version(EV_CURRENT) == EV_NONE)
 		return (EPKG_FATAL);
 
-	shlib_list_init();
+	if (shlibs_cache.loaded && (stage == NULL ? shlibs_cache.stage != NULL :
+	    shlibs_cache.stage == NULL || strcmp(stage, shlibs_cache.stage) != 0))
+		shlibs_cache_free();
 
-	if (stage != NULL && pkg_object_bool(pkg_config_get("ALLOW_BASE_SHLIBS"))) {
-		/* Do not check the return */
-		shlib_list_from_stage(stage);
-	}
+	if (!shlibs_cache.loaded) {
+		pkg_debug(1, "Scanning the shared libraries of the system");
+		shlib_list_init();
 
-	ret = shlib_list_from_elf_hints(_PATH_ELF_HINTS);
-	if (ret != EPKG_OK)
-		goto cleanup;
+		if (stage != NULL &&
+		    pkg_object_bool(pkg_config_get("ALLOW_BASE_SHLIBS"))) {
+			/* Do not check the return */
+			shlib_list_from_stage(stage);
+		}
+
+		ret = shlib_list_from_elf_hints(_PATH_ELF_HINTS);
+		if (ret != EPKG_OK)
+			goto cleanup;
+
+		shlibs_cache.loaded = true;
+		if (stage != NULL)
+			shlibs_cache.stage = strdup(stage);
+	}
 
 	/* Assume no architecture dependence, for contradiction */
 	if (developer_mode)
@@ -537,7 +573,8 @@ pkg_analyse_files(struct pkgdb *db, struct pkg *pkg, const char *stage)
 	ret = EPKG_OK;
 
 cleanup:
-	shlib_list_free();
+	if (!shlibs_cache.enabled || !shlibs_cache.loaded)
+		shlibs_cache_free();
 
 	return (ret);
 }
@@ -27,8 +27,14 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
 #include <string.h>
+#include <strings.h>
 #include <syslog.h>
+#include <unistd.h>
 
 #include "pkg.h"
 #include "private/pkg.h"
@@ -37,6 +43,198 @@
 static pkg_event_cb _cb = NULL;
 static void *_data = NULL;
 
+/*
+ * When EVENT_PIPE_BUFFER is set the messages for the event pipe are handed
+ * to a dispatcher thread through a bounded ring, so a slow reader does not
+ * stall the caller.  Progress ticks replace a tick still waiting in the
+ * ring, every other message waits for a free slot instead of being dropped.
+ */
+struct evmsg {
+	char *msg;
+	bool tick;
+};
+
+static struct {
+	bool active;
+	pid_t pid;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t notempty;
+	pthread_cond_t notfull;
+	pthread_cond_t drained;
+	struct evmsg *ring;
+	size_t size;
+	size_t head;
+	size_t count;
+	char *tick;
+	bool busy;
+	bool stop;
+} evq;
+
+static void
+evq_push(char *msg, bool tick)
+{
+	struct evmsg *m;
+
+	m = &evq.ring[(evq.head + evq.count) % evq.size];
+	m->msg = msg;
+	m->tick = tick;
+	evq.count++;
+}
+
+static void
+evq_write(const char *msg)
+{
+	size_t len = strlen(msg);
+	ssize_t w;
+
+	while (len > 0) {
+		w = write(eventpipe, msg, len);
+		if (w == -1) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		msg += w;
+		len -= w;
+	}
+}
+
+static void *
+evq_dispatch(void *arg __unused)
+{
+	struct evmsg m;
+
+	pthread_mutex_lock(&evq.lock);
+	for (;;) {
+		while (evq.count == 0 && !evq.stop)
+			pthread_cond_wait(&evq.notempty, &evq.lock);
+		if (evq.count == 0)
+			break;
+		m = evq.ring[evq.head];
+		evq.head = (evq.head + 1) % evq.size;
+		evq.count--;
+		if (evq.tick != NULL) {
+			evq_push(evq.tick, true);
+			evq.tick = NULL;
+		}
+		evq.busy = true;
+		pthread_cond_broadcast(&evq.notfull);
+		pthread_mutex_unlock(&evq.lock);
+
+		evq_write(m.msg);
+		free(m.msg);
+
+		pthread_mutex_lock(&evq.lock);
+		evq.busy = false;
+		if (evq.count == 0)
+			pthread_cond_broadcast(&evq.drained);
+	}
+	pthread_mutex_unlock(&evq.lock);
+
+	return (NULL);
+}
+
+static void
+evq_enqueue(char *msg, bool tick, bool wait)
+{
+	struct evmsg *last;
+
+	pthread_mutex_lock(&evq.lock);
+	if (tick) {
+		last = evq.count > 0 ?
+		    &evq.ring[(evq.head + evq.count - 1) % evq.size] : NULL;
+		if (evq.tick != NULL) {
+			free(evq.tick);
+			evq.tick = msg;
+		} else if (last != NULL && last->tick) {
+			free(last->msg);
+			last->msg = msg;
+		} else if (evq.count < evq.size) {
+			evq_push(msg, true);
+		} else {
+			evq.tick = msg;
+		}
+	} else {
+		while (evq.tick != NULL || evq.count == evq.size)
+			pthread_cond_wait(&evq.notfull, &evq.lock);
+		evq_push(msg, false);
+	}
+	pthread_cond_signal(&evq.notempty);
+
+	/* errors are often followed by an exit, make sure they went out */
+	while (wait && (evq.count > 0 || evq.busy))
+		pthread_cond_wait(&evq.drained, &evq.lock);
+	pthread_mutex_unlock(&evq.lock);
+}
+
+void
+pkg_event_async_start(int64_t size)
+{
+	sigset_t all, old;
+	int flags;
+
+	if (evq.active || eventpipe < 0 || size <= 0)
+		return;
+
+	if ((evq.ring = calloc(size, sizeof(struct evmsg))) == NULL) {
+		pkg_emit_errno("calloc", "event dispatcher");
+		return;
+	}
+	evq.size = size;
+	evq.head = evq.count = 0;
+	evq.tick = NULL;
+	evq.busy = evq.stop = false;
+	pthread_mutex_init(&evq.lock, NULL);
+	pthread_cond_init(&evq.notempty, NULL);
+	pthread_cond_init(&evq.notfull, NULL);
+	pthread_cond_init(&evq.drained, NULL);
+
+	/* signals are for the main thread */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	if (pthread_create(&evq.thread, NULL, evq_dispatch, NULL) != 0) {
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+		free(evq.ring);
+		evq.ring = NULL;
+		pkg_emit_errno("pthread_create", "event dispatcher");
+		return;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	evq.pid = getpid();
+	evq.active = true;
+
+	/* the dispatcher is allowed to block, the caller is not */
+	if ((flags = fcntl(eventpipe, F_GETFL)) != -1 && (flags & O_NONBLOCK))
+		fcntl(eventpipe, F_SETFL, flags & ~O_NONBLOCK);
+}
+
+void
+pkg_event_async_stop(void)
+{
+
+	if (!evq.active)
+		return;
+	evq.active = false;
+
+	/* a forked child does not own the dispatcher */
+	if (evq.pid != getpid())
+		return;
+
+	pthread_mutex_lock(&evq.lock);
+	evq.stop = true;
+	pthread_cond_signal(&evq.notempty);
+	pthread_mutex_unlock(&evq.lock);
+	pthread_join(evq.thread, NULL);
+
+	pthread_mutex_destroy(&evq.lock);
+	pthread_cond_destroy(&evq.notempty);
+	pthread_cond_destroy(&evq.notfull);
+	pthread_cond_destroy(&evq.drained);
+	free(evq.ring);
+	evq.ring = NULL;
+}
+
 static char *
 sbuf_json_escape(struct sbuf *buf, const char *str)
 {
@@ -59,6 +257,7 @@ pipeevent(struct pkg_event *ev)
 	struct pkg_dep *dep = NULL;
 	struct sbuf *msg, *buf;
 	struct pkg_event_conflict *cur_conflict;
+	char *copy;
 	if (eventpipe < 0)
 		return;
 
@@ -380,11 +579,55 @@ pipeevent(struct pkg_event *ev)
 	case PKG_EVENT_BACKUP:
 	case PKG_EVENT_RESTORE:
 		break;
+	case PKG_EVENT_SQL_PROFILE:
+		sbuf_printf(msg, "{ \"type\": \"INFO_SQL_PROFILE\", "
+		  "\"data\": { \"statements\": [");
+		for (i = 0; i < ev->e_sql_profile.count; i++) {
+			const struct pkg_sql_profile *p =
+			    &ev->e_sql_profile.stmts[i];
+
+			sbuf_printf(msg, "%s{ \"sql\": \"%s\", "
+			    "\"calls\": %" PRId64 ", "
+			    "\"total_ns\": %" PRId64 ", "
+			    "\"max_ns\": %" PRId64 ", "
+			    "\"rows\": %" PRId64 ", "
+			    "\"fullscan_steps\": %" PRId64 ", "
+			    "\"prepares\": %" PRId64 " }",
+			    i > 0 ? ", " : "",
+			    sbuf_json_escape(buf, p->sql),
+			    p->calls, p->total, p->max, p->rows,
+			    p->fullscan_steps, p->prepares);
+		}
+		sbuf_cat(msg, "]}}");
+		break;
+	case PKG_EVENT_MEMORY_STATS:
+		sbuf_printf(msg, "{ \"type\": \"INFO_MEMORY_STATS\", "
+		  "\"data\": { \"subsystems\": [");
+		for (i = 0; i < ev->e_memory_stats.count; i++) {
+			const struct pkg_mem_stat *m =
+			    &ev->e_memory_stats.stats[i];
+
+			sbuf_printf(msg, "%s{ \"tag\": \"%s\", "
+			    "\"current\": %" PRId64 ", "
+			    "\"peak\": %" PRId64 ", "
+			    "\"allocs\": %" PRId64 ", "
+			    "\"frees\": %" PRId64 " }",
+			    i > 0 ? ", " : "",
+			    m->tag, m->current, m->peak, m->allocs, m->frees);
+		}
+		sbuf_cat(msg, "]}}");
+		break;
 	default:
 		break;
 	}
+	sbuf_putc(msg, '\n');
 	sbuf_finish(msg);
-	dprintf(eventpipe, "%s\n", sbuf_data(msg));
+	if (evq.active && evq.pid == getpid() &&
+	    (copy = strdup(sbuf_data(msg))) != NULL)
+		evq_enqueue(copy, ev->type == PKG_EVENT_PROGRESS_TICK,
+		    ev->type == PKG_EVENT_ERROR || ev->type == PKG_EVENT_ERRNO);
+	else
+		dprintf(eventpipe, "%s", sbuf_data(msg));
 	sbuf_delete(msg);
 	sbuf_delete(buf);
 }
@@ -946,23 +1189,117 @@ pkg_emit_sandbox_call(pkg_sandbox_cb call, int fd, void *ud)
 	return ret;
 }
 
-void
-pkg_debug(int level, const char *fmt, ...)
+/*
+ * Debug messages are formatted in a buffer owned by the calling thread, so
+ * an enabled message neither allocates nor takes a lock.  A message that
+ * does not fit, or one emitted while the buffer is in use by a callback of
+ * the same thread, falls back to an allocated copy.
+ */
+static __thread char debug_buf[1024];
+static __thread bool debug_busy = false;
+
+static void
+pkg_debug_emit(int level, const char *fmt, va_list ap)
 {
 	struct pkg_event ev;
+	va_list aq;
+	char *msg = NULL;
+	int len = -1;
+
+	if (!debug_busy) {
+		va_copy(aq, ap);
+		len = vsnprintf(debug_buf, sizeof(debug_buf), fmt, aq);
+		va_end(aq);
+	}
+	if (len >= 0 && (size_t)len < sizeof(debug_buf))
+		ev.e_debug.msg = debug_buf;
+	else if (vasprintf(&msg, fmt, ap) != -1)
+		ev.e_debug.msg = msg;
+	else
+		return;
+
+	ev.type = PKG_EVENT_DEBUG;
+	ev.e_debug.level = level;
+
+	if (msg == NULL)
+		debug_busy = true;
+	pkg_emit_event(&ev);
+	if (msg == NULL)
+		debug_busy = false;
+	free(msg);
+}
+
+void
+(pkg_debug)(int level, const char *fmt, ...)
+{
 	va_list ap;
 
 	if (debug_level < level)
 		return;
 
-	ev.type = PKG_EVENT_DEBUG;
-	ev.e_debug.level = level;
 	va_start(ap, fmt);
-	vasprintf(&ev.e_debug.msg, fmt, ap);
+	pkg_debug_emit(level, fmt, ap);
 	va_end(ap);
+}
 
-	pkg_emit_event(&ev);
-	free(ev.e_debug.msg);
+void
+pkg_dbg_emit(pkg_dbg_t cat, int level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (debug_level < level || (debug_flags & cat) == 0)
+		return;
+
+	va_start(ap, fmt);
+	pkg_debug_emit(level, fmt, ap);
+	va_end(ap);
+}
+
+static const struct {
+	const char *name;
+	pkg_dbg_t flag;
+} debug_categories[] = {
+	{ "all",	PKG_DBG_ALL },
+	{ "fetch",	PKG_DBG_FETCH },
+	{ "config",	PKG_DBG_CONFIG },
+	{ "db",		PKG_DBG_DB },
+	{ "universe",	PKG_DBG_UNIVERSE },
+	{ "conflicts",	PKG_DBG_CONFLICTS },
+	{ "solver",	PKG_DBG_SOLVER },
+	{ "jobs",	PKG_DBG_JOBS },
+	{ "add",	PKG_DBG_ADD },
+	{ "delete",	PKG_DBG_DELETE },
+	{ "scripts",	PKG_DBG_SCRIPTS },
+};
+
+uint64_t
+pkg_dbg_flags(const ucl_object_t *names)
+{
+	const ucl_object_t *cur;
+	ucl_object_iter_t it = NULL;
+	const char *name;
+	uint64_t flags = 0;
+	unsigned int i;
+
+	if (names == NULL)
+		return (PKG_DBG_ALL);
+
+	while ((cur = ucl_iterate_object(names, &it, true)) != NULL) {
+		name = ucl_object_tostring(cur);
+		if (name == NULL)
+			continue;
+		for (i = 0; i < NELEM(debug_categories); i++) {
+			if (strcasecmp(debug_categories[i].name, name) == 0) {
+				flags |= debug_categories[i].flag;
+				break;
+			}
+		}
+		if (i == NELEM(debug_categories))
+			pkg_emit_error("Unknown debug category '%s', ignoring",
+			    name);
+	}
+
+	return (flags);
 }
 
 void
@@ -1058,3 +1395,25 @@ pkg_unregister_cleanup_callback(void (*cleanup_cb)(void *data), void *data)
 	ev.e_cleanup_callback.data = data;
 	pkg_emit_event(&ev);
 }
+
+void
+pkg_emit_sql_profile(const struct pkg_sql_profile *stmts, int count)
+{
+	struct pkg_event ev;
+
+	ev.type = PKG_EVENT_SQL_PROFILE;
+	ev.e_sql_profile.stmts = stmts;
+	ev.e_sql_profile.count = count;
+	pkg_emit_event(&ev);
+}
+
+void
+pkg_emit_memory_stats(const struct pkg_mem_stat *stats, int count)
+{
+	struct pkg_event ev;
+
+	ev.type = PKG_EVENT_MEMORY_STATS;
+	ev.e_memory_stats.stats = stats;
+	ev.e_memory_stats.count = count;
+	pkg_emit_event(&ev);
+}
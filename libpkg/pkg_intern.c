@@ -0,0 +1,200 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "pkg_config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pkg.h"
+#include "private/event.h"
+#include "private/pkg.h"
+#include "khash.h"
+
+/*
+ * Process wide string interner.
+ *
+ * Identity fields of packages (uid, name, origin, version, arch, ...) are
+ * repeated across every package of a universe and every dependency pointing
+ * to them. They are stored only once here and handed out as immutable atoms:
+ * two atoms are equal if and only if their pointers are equal.
+ *
+ * Atoms are never freed individually, they live in large chunks released
+ * all at once by pkg_intern_free() when libpkg is shut down, or by
+ * pkg_intern_reset() between the requests of a long running process.
+ *
+ * The interner is not thread safe: like the rest of libpkg it must only be
+ * used from one thread at a time.
+ */
+
+#define INTERN_CHUNK_SIZE	(64 * 1024)
+
+struct intern_chunk {
+	struct intern_chunk *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+KHASH_SET_INIT_STR(intern);
+
+static kh_intern_t *atoms = NULL;
+static struct intern_chunk *chunks = NULL;
+
+static char *
+intern_alloc(size_t len)
+{
+	struct intern_chunk *c;
+	size_t size;
+
+	if (chunks == NULL || chunks->size - chunks->used < len) {
+		size = len > INTERN_CHUNK_SIZE ? len : INTERN_CHUNK_SIZE;
+		c = malloc(sizeof(*c) + size);
+		if (c == NULL) {
+			pkg_emit_errno("malloc", "intern_chunk");
+			return (NULL);
+		}
+		pkg_mem_alloc(PKG_MEM_INTERN, sizeof(*c) + size);
+		c->size = size;
+		c->used = 0;
+		c->next = chunks;
+		chunks = c;
+	}
+
+	c = chunks;
+	c->used += len;
+
+	return (c->data + c->used - len);
+}
+
+const char *
+pkg_intern(const char *str)
+{
+	khint_t k;
+	char *atom;
+	size_t len;
+	int ret;
+
+	if (str == NULL)
+		return (NULL);
+
+	if (atoms == NULL)
+		atoms = kh_init_intern();
+
+	k = kh_get_intern(atoms, str);
+	if (k != kh_end(atoms))
+		return (kh_key(atoms, k));
+
+	len = strlen(str) + 1;
+	if ((atom = intern_alloc(len)) == NULL)
+		return (NULL);
+	memcpy(atom, str, len);
+	kh_put_intern(atoms, atom, &ret);
+
+	return (atom);
+}
+
+const char *
+pkg_internn(const char *str, size_t len)
+{
+	const char *atom;
+	char *tmp;
+
+	if (str == NULL)
+		return (NULL);
+
+	if (strlen(str) <= len)
+		return (pkg_intern(str));
+
+	if ((tmp = strndup(str, len)) == NULL) {
+		pkg_emit_errno("strndup", "pkg_internn");
+		return (NULL);
+	}
+	atom = pkg_intern(tmp);
+	free(tmp);
+
+	return (atom);
+}
+
+const char *
+pkg_intern_lookup(const char *str)
+{
+	khint_t k;
+
+	if (str == NULL || atoms == NULL)
+		return (NULL);
+
+	k = kh_get_intern(atoms, str);
+	if (k == kh_end(atoms))
+		return (NULL);
+
+	return (kh_key(atoms, k));
+}
+
+void
+pkg_intern_stats(size_t *count, size_t *bytes)
+{
+	struct intern_chunk *c;
+
+	if (count != NULL)
+		*count = atoms != NULL ? kh_size(atoms) : 0;
+
+	if (bytes != NULL) {
+		*bytes = 0;
+		for (c = chunks; c != NULL; c = c->next)
+			*bytes += sizeof(*c) + c->size;
+		if (atoms != NULL)
+			*bytes += kh_n_buckets(atoms) * sizeof(*atoms->keys) +
+			    __ac_fsize(kh_n_buckets(atoms)) * sizeof(khint32_t);
+	}
+}
+
+void
+pkg_intern_free(void)
+{
+	struct intern_chunk *c;
+
+	while (chunks != NULL) {
+		c = chunks;
+		chunks = c->next;
+		pkg_mem_free(PKG_MEM_INTERN, sizeof(*c) + c->size);
+		free(c);
+	}
+
+	if (atoms != NULL) {
+		kh_destroy_intern(atoms);
+		atoms = NULL;
+	}
+}
+
+void
+pkg_intern_reset(void)
+{
+
+	pkg_intern_free();
+}
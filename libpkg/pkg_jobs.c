@@ -94,6 +94,7 @@ pkg_jobs_new(struct pkg_jobs **j, pkg_jobs_t t, struct pkgdb *db)
 	(*j)->solved = 0;
 	(*j)->flags = PKG_FLAG_NONE;
 	(*j)->conservative = pkg_object_bool(pkg_config_get("CONSERVATIVE_UPGRADE"));
+	pkg_cancel_init(&(*j)->cancel);
 
 	return (EPKG_OK);
 }
@@ -134,6 +135,25 @@ pkg_jobs_destdir(struct pkg_jobs *j)
 	return (j->destdir);
 }
 
+int
+pkg_jobs_set_budget(struct pkg_jobs *j, pkg_jobs_phase_t phase,
+    int64_t seconds, int64_t bytes)
+{
+	if (phase >= PKG_JOBS_PHASE_NONE || seconds < 0 || bytes < 0)
+		return (EPKG_FATAL);
+
+	j->cancel.time_budget[phase] = seconds;
+	j->cancel.byte_budget[phase] = bytes;
+
+	return (EPKG_OK);
+}
+
+void
+pkg_jobs_cancel(struct pkg_jobs *j)
+{
+	j->cancel.cancelled = 1;
+}
+
 static void
 pkg_jobs_pattern_free(struct job_pattern *jp)
 {
@@ -174,6 +194,7 @@ pkg_jobs_free(struct pkg_jobs *j)
 	}
 
 	pkg_jobs_universe_free(j->universe);
+	pkg_conflicts_items_free(j);
 	LL_FREE(j->jobs, free);
 	HASH_FREE(j->patterns, pkg_jobs_pattern_free);
 	free(j);
@@ -202,7 +223,7 @@ pkg_jobs_maybe_match_file(struct job_pattern *jp, const char *pattern)
 				/* Dot pos is one character after the dot */
 				int len = dot_pos - pattern;
 
-				pkg_debug(1, "Jobs> Adding file: %s", pattern);
+				pkg_dbg(JOBS, 1, "Jobs> Adding file: %s", pattern);
 				jp->is_file = true;
 				jp->path = pkg_path;
 				jp->pattern = malloc(len);
@@ -302,7 +323,7 @@ pkg_jobs_add_req_from_universe(struct pkg_job_request **head,
 		}
 		new_req = true;
 		req->automatic = automatic;
-		pkg_debug(4, "add new uid %s to the request", un->pkg->uid);
+		pkg_dbg(JOBS, 4, "add new uid %s to the request", un->pkg->uid);
 	}
 	else {
 		if (req->item->unit == un) {
@@ -358,7 +379,7 @@ pkg_jobs_add_req(struct pkg_jobs *j, struct pkg *pkg)
 		assert(pkg->type == PKG_INSTALLED);
 	}
 
-	pkg_debug(4, "universe: add package %s-%s to the request", pkg->name,
+	pkg_dbg(JOBS, 4, "universe: add package %s-%s to the request", pkg->name,
 			pkg->version);
 	rc = pkg_jobs_universe_add_pkg(j->universe, pkg, false, &un);
 
@@ -470,7 +491,7 @@ pkg_jobs_process_add_request(struct pkg_jobs *j)
 			if (found != NULL)
 				continue;
 
-			pkg_debug(4, "adding dependency %s to request", d->uid);
+			pkg_dbg(JOBS, 4, "adding dependency %s to request", d->uid);
 			lp = pkg_jobs_universe_get_local(j->universe,
 				d->uid, 0);
 			/*
@@ -563,54 +584,39 @@ pkg_jobs_process_delete_request(struct pkg_jobs *j)
 }
 
 static int
-pkg_jobs_set_execute_priority(struct pkg_jobs *j, struct pkg_solved *solved)
+pkg_jobs_split_conflicting_upgrade(struct pkg_jobs *j, struct pkg_solved *solved)
 {
 	struct pkg_solved *ts;
 
-	if (solved->type == PKG_SOLVED_UPGRADE
-			&& solved->items[1]->pkg->conflicts != NULL) {
-		/*
-		 * We have an upgrade request that has some conflicting packages, therefore
-		 * update priorities of local packages and try to update priorities of remote ones
-		 */
-		if (solved->items[0]->priority == 0)
-			pkg_jobs_update_conflict_priority(j->universe, solved);
+	if (solved->type != PKG_SOLVED_UPGRADE ||
+	    solved->items[1]->pkg->conflicts == NULL || solved->already_deleted)
+		return (EPKG_OK);
 
-		if (solved->items[1]->priority > solved->items[0]->priority &&
-				!solved->already_deleted) {
-			/*
-			 * Split conflicting upgrade request into delete -> upgrade request
-			 */
-			ts = calloc(1, sizeof(struct pkg_solved));
-			if (ts == NULL) {
-				pkg_emit_errno("calloc", "pkg_solved");
-				return (EPKG_FATAL);
-			}
+	/*
+	 * We have an upgrade request that has some conflicting packages, if the
+	 * local package has to be removed before installing one of them, split
+	 * the request into delete -> upgrade request
+	 */
+	if (solved->items[1]->priority <= solved->items[0]->priority)
+		return (EPKG_OK);
 
-			ts->type = PKG_SOLVED_UPGRADE_REMOVE;
-			ts->items[0] = solved->items[1];
-			solved->items[1] = NULL;
-			solved->type = PKG_SOLVED_UPGRADE_INSTALL;
-			DL_APPEND(j->jobs, ts);
-			j->count ++;
-			solved->already_deleted = true;
-			pkg_debug(2, "split upgrade request for %s",
-			   ts->items[0]->pkg->uid);
-			return (EPKG_CONFLICT);
-		}
-	}
-	else if (solved->type == PKG_SOLVED_DELETE) {
-		if (solved->items[0]->priority == 0)
-			pkg_jobs_update_universe_priority(j->universe, solved->items[0],
-					PKG_PRIORITY_UPDATE_DELETE);
-	}
-	else {
-		if (solved->items[0]->priority == 0)
-			pkg_jobs_update_universe_priority(j->universe, solved->items[0],
-					PKG_PRIORITY_UPDATE_REQUEST);
+	ts = calloc(1, sizeof(struct pkg_solved));
+	if (ts == NULL) {
+		pkg_emit_errno("calloc", "pkg_solved");
+		return (EPKG_FATAL);
 	}
 
-	return (EPKG_OK);
+	ts->type = PKG_SOLVED_UPGRADE_REMOVE;
+	ts->items[0] = solved->items[1];
+	solved->items[1] = NULL;
+	solved->type = PKG_SOLVED_UPGRADE_INSTALL;
+	DL_APPEND(j->jobs, ts);
+	j->count ++;
+	solved->already_deleted = true;
+	pkg_dbg(JOBS, 2, "split upgrade request for %s",
+	   ts->items[0]->pkg->uid);
+
+	return (EPKG_CONFLICT);
 }
 
 static int
@@ -633,13 +639,9 @@ pkg_jobs_set_priorities(struct pkg_jobs *j)
 	struct pkg_solved *req;
 
 iter_again:
+	pkg_jobs_universe_order(j->universe, j->jobs);
 	LL_FOREACH(j->jobs, req) {
-		req->items[0]->priority = 0;
-		if (req->items[1] != NULL)
-			req->items[1]->priority = 0;
-	}
-	LL_FOREACH(j->jobs, req) {
-		if (pkg_jobs_set_execute_priority(j, req) == EPKG_CONFLICT)
+		if (pkg_jobs_split_conflicting_upgrade(j, req) == EPKG_CONFLICT)
 			goto iter_again;
 	}
 
@@ -813,7 +815,7 @@ pkg_jobs_try_remote_candidate(struct pkg_jobs *j, const char *pattern,
 
 	while (it != NULL && pkgdb_it_next(it, &p, flags) == EPKG_OK) {
 		if (pkg_jobs_has_replacement(j, p->uid)) {
-			pkg_debug(1, "replacement %s is already used", p->uid);
+			pkg_dbg(JOBS, 1, "replacement %s is already used", p->uid);
 			continue;
 		}
 
@@ -832,10 +834,6 @@ pkg_jobs_try_remote_candidate(struct pkg_jobs *j, const char *pattern,
 
 			rc = EPKG_OK;
 			pkg_jobs_process_remote_pkg(j, p, NULL, 0);
-			if (rc == EPKG_OK) {
-				/* Avoid freeing */
-				p = NULL;
-			}
 			break;
 		}
 		sbuf_reset(qmsg);
@@ -935,10 +933,10 @@ pkg_jobs_find_upgrade(struct pkg_jobs *j, const char *pattern, match_t m)
 			break;
 		else if (rc == EPKG_OK)
 			found = true;
-
-		p = NULL;
 	}
 
+	pkg_free(p);
+	p = NULL;
 	pkgdb_it_free(it);
 
 	if (!found && rc != EPKG_INSTALLED) {
@@ -960,7 +958,7 @@ pkg_jobs_find_upgrade(struct pkg_jobs *j, const char *pattern, match_t m)
 				return (EPKG_END);
 		}
 
-		pkg_debug(2, "non-automatic package with pattern %s has not been found in "
+		pkg_dbg(JOBS, 2, "non-automatic package with pattern %s has not been found in "
 				"remote repo", pattern);
 		rc = pkg_jobs_universe_add_pkg(j->universe, p, false, &unit);
 		if (rc == EPKG_OK) {
@@ -1024,7 +1022,7 @@ pkg_jobs_find_remote_pattern(struct pkg_jobs *j, struct job_pattern *jp)
 		} else if (pkg_validate(pkg, j->db) == EPKG_OK) {
 			if (j->type == PKG_JOBS_UPGRADE) {
 				jfp.match = MATCH_EXACT;
-				jfp.pattern = pkg->name;
+				jfp.pattern = __DECONST(char *, pkg->name);
 				if (pkg_jobs_check_local_pkg (j, &jfp) != EPKG_OK) {
 					pkg_emit_error("%s is not installed, therefore upgrade is impossible",
 							jfp.pattern);
@@ -1230,7 +1228,7 @@ pkg_jobs_need_upgrade(struct pkg *rp, struct pkg *lp)
 			if (strcmp(rb, lb) != 0) {
 				free(rp->reason);
 				rp->reason = strdup("provided shared library changed");
-				pkg_debug(1, "provided shlib changed %s -> %s",
+				pkg_dbg(JOBS, 1, "provided shlib changed %s -> %s",
 				    lb, rb);
 				return (true);
 			}
@@ -1252,7 +1250,7 @@ pkg_jobs_need_upgrade(struct pkg *rp, struct pkg *lp)
 			if (strcmp(rb, lb) != 0) {
 				free(rp->reason);
 				rp->reason = strdup("needed shared library changed");
-				pkg_debug(1, "Required shlib changed %s -> %s",
+				pkg_dbg(JOBS, 1, "Required shlib changed %s -> %s",
 				    lb, rb);
 				return (true);
 			}
@@ -1281,7 +1279,7 @@ pkg_jobs_propagate_automatic(struct pkg_jobs *j)
 			if ((req == NULL || req->automatic) &&
 			    unit->pkg->type != PKG_INSTALLED) {
 				automatic = true;
-				pkg_debug(2, "set automatic flag for %s", unit->pkg->uid);
+				pkg_dbg(JOBS, 2, "set automatic flag for %s", unit->pkg->uid);
 				unit->pkg->automatic = automatic;
 			}
 			else {
@@ -1325,7 +1323,7 @@ pkg_jobs_propagate_automatic(struct pkg_jobs *j)
 				HASH_FIND_STR(j->request_add, unit->pkg->uid, req);
 				if ((req == NULL || req->automatic)) {
 					automatic = true;
-					pkg_debug(2, "set automatic flag for %s", unit->pkg->uid);
+					pkg_dbg(JOBS, 2, "set automatic flag for %s", unit->pkg->uid);
 					LL_FOREACH(unit, cur) {
 						cur->pkg->automatic = automatic;
 					}
@@ -1345,7 +1343,7 @@ pkg_jobs_find_deinstall_request(struct pkg_job_universe_item *item,
 	struct pkg *pkg = item->pkg;
 
 	if (rec_level > 128) {
-		pkg_debug(2, "cannot find deinstall request after 128 iterations for %s,"
+		pkg_dbg(JOBS, 2, "cannot find deinstall request after 128 iterations for %s,"
 		    "circular dependency maybe", pkg->uid);
 		return (NULL);
 	}
@@ -1703,7 +1701,7 @@ pkg_jobs_apply_replacements(struct pkg_jobs *j)
 	sqlite3_stmt *stmt;
 	int ret;
 
-	pkg_debug(4, "jobs: running '%s'", sql);
+	pkg_dbg(JOBS, 4, "jobs: running '%s'", sql);
 	ret = sqlite3_prepare_v2(j->db->sqlite, sql, -1, &stmt, NULL);
 	if (ret != SQLITE_OK) {
 		ERROR_SQLITE(j->db->sqlite, sql);
@@ -1711,11 +1709,11 @@ pkg_jobs_apply_replacements(struct pkg_jobs *j)
 	}
 
 	LL_FOREACH(j->universe->uid_replaces, r) {
-		pkg_debug(4, "changing uid %s -> %s", r->old_uid, r->new_uid);
+		pkg_dbg(JOBS, 4, "changing uid %s -> %s", r->old_uid, r->new_uid);
 		sqlite3_bind_text(stmt, 1, r->new_uid, -1, SQLITE_TRANSIENT);
 		sqlite3_bind_text(stmt, 2, r->old_uid, -1, SQLITE_TRANSIENT);
 
-		if (sqlite3_step(stmt) != SQLITE_DONE)
+		if (pkgdb_step(stmt) != SQLITE_DONE)
 			ERROR_SQLITE(j->db->sqlite, sql);
 
 		sqlite3_reset(stmt);
@@ -1724,8 +1722,8 @@ pkg_jobs_apply_replacements(struct pkg_jobs *j)
 	sqlite3_finalize(stmt);
 }
 
-int
-pkg_jobs_solve(struct pkg_jobs *j)
+static int
+pkg_jobs_run_solver(struct pkg_jobs *j)
 {
 	int ret, pstatus;
 	struct pkg_solve_problem *problem;
@@ -1755,6 +1753,9 @@ pkg_jobs_solve(struct pkg_jobs *j)
 		return (EPKG_FATAL);
 	}
 
+	if (ret == EPKG_OK)
+		ret = pkg_cancel_check(0);
+
 	if (ret == EPKG_OK) {
 		if ((solver = pkg_object_string(pkg_config_get("CUDF_SOLVER"))) != NULL) {
 			pchild = process_spawn_pipe(spipe, solver);
@@ -1769,6 +1770,8 @@ pkg_jobs_solve(struct pkg_jobs *j)
 
 			fclose(spipe[0]);
 			waitpid(pchild, &pstatus, WNOHANG);
+			if (pkg_cancel_check(0) != EPKG_OK)
+				ret = EPKG_CANCEL;
 		}
 		else {
 again:
@@ -1790,6 +1793,8 @@ again:
 
 					fclose(spipe[0]);
 					waitpid(pchild, &pstatus, WNOHANG);
+					if (pkg_cancel_check(0) != EPKG_OK)
+						ret = EPKG_CANCEL;
 				}
 				else {
 					if ((dotfile = pkg_object_string(pkg_config_get("DOT_FILE")))
@@ -1818,6 +1823,10 @@ again:
 						pkg_solve_problem_free(problem);
 						goto again;
 					}
+					else if (ret == EPKG_CANCEL) {
+						pkg_solve_problem_free(problem);
+						j->solved = 0;
+					}
 					else {
 						ret = pkg_solve_sat_to_jobs(problem);
 
@@ -1886,6 +1895,24 @@ again:
 	return (ret);
 }
 
+int
+pkg_jobs_solve(struct pkg_jobs *j)
+{
+	struct pkg_cancel *token = pkg_cancel_token;
+	pkg_jobs_phase_t prev;
+	int ret;
+
+	pkg_cancel_token = &j->cancel;
+	prev = pkg_cancel_enter(PKG_JOBS_PHASE_SOLVE);
+	ret = pkg_cancel_check(0);
+	if (ret == EPKG_OK)
+		ret = pkg_jobs_run_solver(j);
+	pkg_cancel_leave(prev);
+	pkg_cancel_token = token;
+
+	return (ret);
+}
+
 int
 pkg_jobs_count(struct pkg_jobs *j)
 {
@@ -1929,8 +1956,7 @@ pkg_jobs_handle_install(struct pkg_solved *ps, struct pkg_jobs *j,
 		 * We have package as a file, set special repository name
 		 */
 		target = req->item->jp->path;
-		free(new->reponame);
-		new->reponame = strdup("local file");
+		new->reponame = pkg_intern("local file");
 	}
 	else {
 		pkg_snprintf(path, sizeof(path), "%R", new);
@@ -1991,6 +2017,8 @@ pkg_jobs_execute(struct pkg_jobs *j)
 	pkg_jobs_set_priorities(j);
 
 	DL_FOREACH(j->jobs, ps) {
+		if ((retcode = pkg_cancel_check(0)) != EPKG_OK)
+			goto cleanup;
 		switch (ps->type) {
 		case PKG_SOLVED_DELETE:
 		case PKG_SOLVED_UPGRADE_REMOVE:
@@ -2046,18 +2074,13 @@ cleanup:
 	return (retcode);
 }
 
-int
-pkg_jobs_apply(struct pkg_jobs *j)
+static int
+pkg_jobs_run_apply(struct pkg_jobs *j)
 {
 	int rc;
 	pkg_plugin_hook_t pre, post;
 	bool has_conflicts = false;
 
-	if (!j->solved) {
-		pkg_emit_error("The jobs hasn't been solved");
-		return (EPKG_FATAL);
-	}
-
 	if (j->type == PKG_JOBS_INSTALL) {
 		pre = PKG_PLUGIN_HOOK_PRE_INSTALL;
 		post = PKG_PLUGIN_HOOK_POST_INSTALL;
@@ -2140,6 +2163,26 @@ pkg_jobs_apply(struct pkg_jobs *j)
 	return (rc);
 }
 
+int
+pkg_jobs_apply(struct pkg_jobs *j)
+{
+	struct pkg_cancel *token = pkg_cancel_token;
+	int rc;
+
+	if (!j->solved) {
+		pkg_emit_error("The jobs hasn't been solved");
+		return (EPKG_FATAL);
+	}
+
+	pkg_cancel_token = &j->cancel;
+	rc = pkg_cancel_check(0);
+	if (rc == EPKG_OK)
+		rc = pkg_jobs_run_apply(j);
+	pkg_cancel_token = token;
+
+	return (rc);
+}
+
 
 static int
 pkg_jobs_fetch(struct pkg_jobs *j)
@@ -2151,6 +2194,8 @@ pkg_jobs_fetch(struct pkg_jobs *j)
 	const char *cachedir = NULL;
 	char cachedpath[MAXPATHLEN];
 	bool mirror = (j->flags & PKG_FLAG_FETCH_MIRROR) ? true : false;
+	pkg_jobs_phase_t prev;
+	int rc = EPKG_OK;
 
 
 	if (j->destdir == NULL || !mirror)
@@ -2224,6 +2269,7 @@ pkg_jobs_fetch(struct pkg_jobs *j)
 		return (EPKG_OK); /* don't download anything */
 
 	/* Fetch */
+	prev = pkg_cancel_enter(PKG_JOBS_PHASE_FETCH);
 	DL_FOREACH(j->jobs, ps) {
 		if (ps->type != PKG_SOLVED_DELETE
 						&& ps->type != PKG_SOLVED_UPGRADE_REMOVE) {
@@ -2231,18 +2277,22 @@ pkg_jobs_fetch(struct pkg_jobs *j)
 			if (p->type != PKG_REMOTE)
 				continue;
 
-			if (mirror) {
-				if (pkg_repo_mirror_package(p, cachedir) != EPKG_OK)
-					return (EPKG_FATAL);
-			}
-			else {
-				if (pkg_repo_fetch_package(p) != EPKG_OK)
-					return (EPKG_FATAL);
-			}
+			if ((rc = pkg_cancel_check(0)) != EPKG_OK)
+				break;
+			if (mirror)
+				rc = pkg_repo_mirror_package(p, cachedir);
+			else
+				rc = pkg_repo_fetch_package(p);
+			if (rc != EPKG_OK)
+				break;
 		}
 	}
+	pkg_cancel_leave(prev);
 
-	return (EPKG_OK);
+	if (rc != EPKG_OK && rc != EPKG_CANCEL)
+		rc = EPKG_FATAL;
+
+	return (rc);
 }
 
 static int
@@ -2271,7 +2321,7 @@ pkg_jobs_check_conflicts(struct pkg_jobs *j)
 			added ++;
 	}
 
-	pkg_debug(1, "check integrity for %d items added", added);
+	pkg_dbg(JOBS, 1, "check integrity for %d items added", added);
 
 	pkg_emit_integritycheck_finished(j->conflicts_registered);
 	if (j->conflicts_registered > 0)
@@ -102,7 +102,7 @@ pkg_conflicts_request_resolve_chain(struct pkg *req, struct pkg_conflict_chain *
 		selected = chain;
 	}
 
-	pkg_debug(2, "select %s in the chain of conflicts for %s",
+	pkg_dbg(CONFLICTS, 2, "select %s in the chain of conflicts for %s",
 	    selected->req->item->pkg->name, req->name);
 	/* Disable conflicts from a request */
 	LL_FOREACH(chain, elt) {
@@ -183,7 +183,7 @@ pkg_conflicts_register(struct pkg *p1, struct pkg *p2, enum pkg_conflict_type ty
 	if (test == NULL) {
 		c1->uid = strdup(p2->uid);
 		HASH_ADD_KEYPTR(hh, p1->conflicts, c1->uid, strlen(c1->uid), c1);
-		pkg_debug(2, "registering conflict between %s(%s) and %s(%s)",
+		pkg_dbg(CONFLICTS, 2, "registering conflict between %s(%s) and %s(%s)",
 				p1->uid, p1->type == PKG_INSTALLED ? "l" : "r",
 				p2->uid, p2->type == PKG_INSTALLED ? "l" : "r");
 	} else {
@@ -194,7 +194,7 @@ pkg_conflicts_register(struct pkg *p1, struct pkg *p2, enum pkg_conflict_type ty
 	if (test == NULL) {
 		c2->uid = strdup(p1->uid);
 		HASH_ADD_KEYPTR(hh, p2->conflicts, c2->uid, strlen(c2->uid), c2);
-		pkg_debug(2, "registering conflict between %s(%s) and %s(%s)",
+		pkg_dbg(CONFLICTS, 2, "registering conflict between %s(%s) and %s(%s)",
 				p2->uid, p2->type == PKG_INSTALLED ? "l" : "r",
 				p1->uid, p1->type == PKG_INSTALLED ? "l" : "r");
 	} else {
@@ -227,7 +227,7 @@ pkg_conflicts_need_conflict(struct pkg_jobs *j, struct pkg *p1, struct pkg *p2)
 		 * If some of packages are not loaded we could silently and safely
 		 * ignore them
 		 */
-		pkg_debug(1, "cannot load files from %s and %s to check conflicts",
+		pkg_dbg(CONFLICTS, 1, "cannot load files from %s and %s to check conflicts",
 			p1->name, p2->name);
 
 		return (false);
@@ -297,7 +297,7 @@ pkg_conflicts_register_unsafe(struct pkg *p1, struct pkg *p2,
 		HASH_ADD_KEYPTR(hh, p2->conflicts, c2->uid, strlen(c2->uid), c2);
 	}
 
-	pkg_debug(2, "registering conflict between %s(%s) and %s(%s) on path %s",
+	pkg_dbg(CONFLICTS, 2, "registering conflict between %s(%s) and %s(%s) on path %s",
 			p1->uid, p1->type == PKG_INSTALLED ? "l" : "r",
 			p2->uid, p2->type == PKG_INSTALLED ? "l" : "r", path);
 }
@@ -370,7 +370,7 @@ pkg_conflicts_check_local_path(const char *path, const char *uid,
 	struct pkg *p = NULL;
 	struct pkg_conflict *c;
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql_local_conflict);
+	pkg_dbg(CONFLICTS, 4, "Pkgdb: running '%s'", sql_local_conflict);
 	ret = sqlite3_prepare_v2(j->db->sqlite, sql_local_conflict, -1,
 		&stmt, NULL);
 	if (ret != SQLITE_OK) {
@@ -383,7 +383,7 @@ pkg_conflicts_check_local_path(const char *path, const char *uid,
 	sqlite3_bind_text(stmt, 2,
 		uid, -1, SQLITE_STATIC);
 
-	if (sqlite3_step(stmt) == SQLITE_ROW) {
+	if (pkgdb_step(stmt) == SQLITE_ROW) {
 		/*
 		 * We have found the conflict with some other chain, so find that chain
 		 * or update the universe
@@ -428,6 +428,7 @@ pkg_conflicts_check_all_paths(struct pkg_jobs *j, const char *path,
 			pkg_emit_errno("malloc failed", "pkg_conflicts_check_all_paths");
 		}
 		else {
+			pkg_mem_alloc(PKG_MEM_CONFLICTS, sizeof(*cit));
 			cit->hash = hv;
 			cit->item = it;
 			TREE_INSERT(j->conflict_items, pkg_jobs_conflict_item, entry, cit);
@@ -455,7 +456,7 @@ pkg_conflicts_check_all_paths(struct pkg_jobs *j, const char *path,
 			 */
 			struct sipkey nk;
 
-			pkg_debug(2, "found a collision on path %s between %s and %s, key: %lu",
+			pkg_dbg(CONFLICTS, 2, "found a collision on path %s between %s and %s, key: %lu",
 				path, uid1, uid2, (unsigned long)k->k[0]);
 
 			nk = *k;
@@ -490,7 +491,7 @@ pkg_conflicts_check_chain_conflict(struct pkg_job_universe_item *it,
 		}
 		/* Check for local conflict in db */
 		p = pkg_conflicts_check_local_path(fcur->path, it->pkg->uid, j);
-		pkg_debug(4, "integrity: check path %s of package %s", fcur->path,
+		pkg_dbg(CONFLICTS, 4, "integrity: check path %s of package %s", fcur->path,
 			it->pkg->uid);
 
 		if (p != NULL) {
@@ -532,6 +533,7 @@ pkg_conflicts_append_chain(struct pkg_job_universe_item *it,
 	if (j->conflict_items == NULL) {
 		j->conflict_items = malloc(sizeof(*j->conflict_items));
 		TREE_INIT(j->conflict_items, pkg_conflicts_item_cmp);
+		pkg_mem_alloc(PKG_MEM_CONFLICTS, sizeof(*j->conflict_items));
 	}
 
 	/* Find local package */
@@ -563,7 +565,7 @@ pkg_conflicts_append_chain(struct pkg_job_universe_item *it,
 				 * ignore this conflict, since we are not going to install it
 				 * anyway
 				 */
-				pkg_debug (3, "cannot load files from %s to check integrity",
+				pkg_dbg(CONFLICTS, 3, "cannot load files from %s to check integrity",
 					cur->pkg->name);
 			}
 			else {
@@ -576,3 +578,29 @@ pkg_conflicts_append_chain(struct pkg_job_universe_item *it,
 
 	return (EPKG_OK);
 }
+
+static void
+pkg_conflicts_item_free(struct pkg_jobs_conflict_item *cit)
+{
+
+	if (cit == NULL)
+		return;
+
+	pkg_conflicts_item_free(cit->entry.avl_left);
+	pkg_conflicts_item_free(cit->entry.avl_right);
+	pkg_mem_free(PKG_MEM_CONFLICTS, sizeof(*cit));
+	free(cit);
+}
+
+void
+pkg_conflicts_items_free(struct pkg_jobs *j)
+{
+
+	if (j->conflict_items == NULL)
+		return;
+
+	pkg_conflicts_item_free(j->conflict_items->th_root);
+	pkg_mem_free(PKG_MEM_CONFLICTS, sizeof(*j->conflict_items));
+	free(j->conflict_items);
+	j->conflict_items = NULL;
+}
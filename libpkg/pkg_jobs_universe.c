@@ -49,6 +49,27 @@
 
 typedef kvec_t(struct pkg *) pkg_chain_t;
 
+/*
+ * The universe is keyed by the interned uid of the packages, lookups by an
+ * atom (pkg->uid, dep->uid) only compare pointers. Any other string has to
+ * be resolved to its atom first: if it has never been interned, no package
+ * can have it as uid.
+ */
+#define UNIVERSE_FIND_ATOM(universe, atom, unit)			\
+	HASH_FIND_PTR((universe)->items, &(atom), (unit))
+
+static struct pkg_job_universe_item *
+pkg_jobs_universe_lookup(struct pkg_jobs_universe *universe, const char *uid)
+{
+	struct pkg_job_universe_item *unit = NULL;
+	const char *atom;
+
+	if ((atom = pkg_intern_lookup(uid)) != NULL)
+		UNIVERSE_FIND_ATOM(universe, atom, unit);
+
+	return (unit);
+}
+
 struct pkg *
 pkg_jobs_universe_get_local(struct pkg_jobs_universe *universe,
 	const char *uid, unsigned flag)
@@ -67,7 +88,7 @@ pkg_jobs_universe_get_local(struct pkg_jobs_universe *universe,
 			flag = PKG_LOAD_BASIC|PKG_LOAD_RDEPS|PKG_LOAD_DEPS|PKG_LOAD_ANNOTATIONS;
 	}
 
-	HASH_FIND(hh, universe->items, uid, strlen(uid), unit);
+	unit = pkg_jobs_universe_lookup(universe, uid);
 	if (unit != NULL) {
 		/* Search local in a universe chain */
 		cur = unit;
@@ -113,7 +134,7 @@ pkg_jobs_universe_get_remote(struct pkg_jobs_universe *universe,
 				PKG_LOAD_ANNOTATIONS|PKG_LOAD_CONFLICTS;
 	}
 
-	HASH_FIND(hh, universe->items, uid, strlen(uid), unit);
+	unit = pkg_jobs_universe_lookup(universe, uid);
 	if (unit != NULL && unit->pkg->type != PKG_INSTALLED) {
 		/* Search local in a universe chain */
 		cur = unit;
@@ -161,7 +182,7 @@ pkg_jobs_universe_add_pkg(struct pkg_jobs_universe *universe, struct pkg *pkg,
 	pkg_validate(pkg, universe->j->db);
 
 	if (pkg->digest == NULL) {
-		pkg_debug(3, "no digest found for package %s (%s-%s)",
+		pkg_dbg(UNIVERSE, 3, "no digest found for package %s (%s-%s)",
 		    pkg->uid, pkg->name, pkg->version);
 		if (pkg_checksum_calculate(pkg, universe->j->db) != EPKG_OK) {
 			*found = NULL;
@@ -180,7 +201,7 @@ pkg_jobs_universe_add_pkg(struct pkg_jobs_universe *universe, struct pkg *pkg,
 		if (seen->pkg->type != PKG_INSTALLED && pkg->type != PKG_INSTALLED) {
 			if (pkg->reponame && seen->pkg->reponame) {
 				other_candidate =
-						(strcmp(pkg->reponame, seen->pkg->reponame) != 0);
+						(pkg->reponame != seen->pkg->reponame);
 			}
 		}
 
@@ -197,7 +218,7 @@ pkg_jobs_universe_add_pkg(struct pkg_jobs_universe *universe, struct pkg *pkg,
 		return (EPKG_LOCKED);
 	}
 
-	pkg_debug(2, "universe: add new %s pkg: %s, (%s-%s:%s)",
+	pkg_dbg(UNIVERSE, 2, "universe: add new %s pkg: %s, (%s-%s:%s)",
 	    (pkg->type == PKG_INSTALLED ? "local" : "remote"), pkg->uid,
 	    pkg->name, pkg->version, pkg->digest);
 
@@ -206,13 +227,14 @@ pkg_jobs_universe_add_pkg(struct pkg_jobs_universe *universe, struct pkg *pkg,
 		pkg_emit_errno("pkg_jobs_pkg_insert_universe", "calloc: struct pkg_job_universe_item");
 		return (EPKG_FATAL);
 	}
+	pkg_mem_alloc(PKG_MEM_UNIVERSE, sizeof(*item));
 
 	item->pkg = pkg;
+	item->uid = pkg->uid;
 
-
-	HASH_FIND_STR(universe->items, pkg->uid, tmp);
+	UNIVERSE_FIND_ATOM(universe, pkg->uid, tmp);
 	if (tmp == NULL)
-		HASH_ADD_KEYPTR(hh, universe->items, pkg->uid, strlen(pkg->uid), item);
+		HASH_ADD_PTR(universe->items, uid, item);
 
 	DL_APPEND(tmp, item);
 
@@ -256,7 +278,7 @@ pkg_jobs_universe_process_deps(struct pkg_jobs_universe *universe,
 	}
 
 	while (deps_func(pkg, &d) == EPKG_OK) {
-		HASH_FIND_STR(universe->items, d->uid, unit);
+		UNIVERSE_FIND_ATOM(universe, d->uid, unit);
 		if (unit != NULL) {
 			continue;
 		}
@@ -315,8 +337,7 @@ pkg_jobs_universe_process_deps(struct pkg_jobs_universe *universe,
 			for (int i = 0; i < kv_size(*rpkgs); i++) {
 				rpkg = kv_A(*rpkgs, i);
 
-				if (pkg->reponame && rpkg->reponame &&
-						strcmp (pkg->reponame, rpkg->reponame) == 0) {
+				if (pkg->reponame && pkg->reponame == rpkg->reponame) {
 					found = true;
 					break;
 				}
@@ -394,8 +415,7 @@ pkg_jobs_universe_handle_provide(struct pkg_jobs_universe *universe,
 	 * - if there is no such a package, then go through all possible provides
 	 */
 	while (pkgdb_it_next(it, &rpkg, flags) == EPKG_OK) {
-		if (parent->reponame && rpkg->reponame && strcmp(parent->reponame,
-				rpkg->reponame) == 0) {
+		if (parent->reponame && parent->reponame == rpkg->reponame) {
 			selected = rpkg;
 			break;
 		}
@@ -410,7 +430,7 @@ pkg_jobs_universe_handle_provide(struct pkg_jobs_universe *universe,
 			rpkg = selected;
 		}
 		/* Check for local packages */
-		HASH_FIND_STR(universe->items, rpkg->uid, unit);
+		UNIVERSE_FIND_ATOM(universe, rpkg->uid, unit);
 		if (unit != NULL) {
 			/* Remote provide is newer, so we can add it */
 			if (pkg_jobs_universe_process_item(universe, rpkg,
@@ -445,7 +465,7 @@ pkg_jobs_universe_handle_provide(struct pkg_jobs_universe *universe,
 		/* Skip seen packages */
 		if (unit == NULL) {
 			if (rpkg->digest == NULL) {
-				pkg_debug(3, "no digest found for package %s", rpkg->uid);
+				pkg_dbg(UNIVERSE, 3, "no digest found for package %s", rpkg->uid);
 				if (pkg_checksum_calculate(rpkg, universe->j->db) != EPKG_OK) {
 					return (EPKG_FATAL);
 				}
@@ -467,6 +487,7 @@ pkg_jobs_universe_handle_provide(struct pkg_jobs_universe *universe,
 					"struct pkg_job_provide");
 			return (EPKG_FATAL);
 		}
+		pkg_mem_alloc(PKG_MEM_UNIVERSE, sizeof(*pr));
 
 		pr->un = unit;
 		pr->provide = name;
@@ -476,14 +497,14 @@ pkg_jobs_universe_handle_provide(struct pkg_jobs_universe *universe,
 			DL_APPEND(prhead, pr);
 			HASH_ADD_KEYPTR(hh, universe->provides, pr->provide,
 					strlen(pr->provide), prhead);
-			pkg_debug (4, "universe: add new provide %s-%s(%s) for require %s",
+			pkg_dbg(UNIVERSE, 4, "universe: add new provide %s-%s(%s) for require %s",
 					pr->un->pkg->name, pr->un->pkg->version,
 					pr->un->pkg->type == PKG_INSTALLED ? "l" : "r",
 					pr->provide);
 		}
 		else {
 			DL_APPEND(prhead, pr);
-			pkg_debug (4, "universe: append provide %s-%s(%s) for require %s",
+			pkg_dbg(UNIVERSE, 4, "universe: append provide %s-%s(%s) for require %s",
 					pr->un->pkg->name, pr->un->pkg->version,
 					pr->un->pkg->type == PKG_INSTALLED ? "l" : "r",
 					pr->provide);
@@ -519,7 +540,7 @@ pkg_jobs_universe_process_shlibs(struct pkg_jobs_universe *universe,
 			pkgdb_it_free(it);
 
 			if (rc != EPKG_OK) {
-				pkg_debug(1, "cannot find local packages that provide library %s "
+				pkg_dbg(UNIVERSE, 1, "cannot find local packages that provide library %s "
 						"required for %s",
 						buf, pkg->name);
 			}
@@ -533,7 +554,7 @@ pkg_jobs_universe_process_shlibs(struct pkg_jobs_universe *universe,
 			pkgdb_it_free(it);
 
 			if (rc != EPKG_OK) {
-				pkg_debug(1, "cannot find remote packages that provide library %s "
+				pkg_dbg(UNIVERSE, 1, "cannot find remote packages that provide library %s "
 						"required for %s",
 				    buf, pkg->name);
 			}
@@ -564,7 +585,7 @@ pkg_jobs_universe_process_provides_requires(struct pkg_jobs_universe *universe,
 			pkgdb_it_free(it);
 
 			if (rc != EPKG_OK) {
-				pkg_debug(1, "cannot find local packages that provide %s "
+				pkg_dbg(UNIVERSE, 1, "cannot find local packages that provide %s "
 						"required for %s",
 						buf, pkg->name);
 			}
@@ -579,7 +600,7 @@ pkg_jobs_universe_process_provides_requires(struct pkg_jobs_universe *universe,
 			pkgdb_it_free(it);
 
 			if (rc != EPKG_OK) {
-				pkg_debug(1, "cannot find remote packages that provide %s "
+				pkg_dbg(UNIVERSE, 1, "cannot find remote packages that provide %s "
 						"required for %s",
 				    buf, pkg->name);
 				return (rc);
@@ -671,154 +692,426 @@ pkg_jobs_universe_process(struct pkg_jobs_universe *universe,
 	return (pkg_jobs_universe_process_item(universe, pkg, NULL));
 }
 
-#define RECURSION_LIMIT 1024
+/*
+ * Execution order of the jobs.
+ *
+ * Every universe item related to a job is a node of a graph where an edge
+ * n -> m means that m has to be processed before n: the dependencies of a
+ * package to install, the reverse dependencies of a package to remove and
+ * the installed packages conflicting with a new one. The priority of a node
+ * is the length of the longest path leading to it and the jobs are executed
+ * by decreasing priority.
+ *
+ * The strongly connected components of the graph are found by an iterative
+ * Tarjan walk, which yields them in reverse topological order, so that a
+ * single pass over them in the opposite order computes all the priorities.
+ * The members of a component are ordered by uid and the edges going
+ * backward in that order are ignored: a cycle is always broken the same way.
+ */
+
+typedef kvec_t(size_t) universe_order_vec;
+
+struct universe_order_node {
+	struct pkg_job_universe_item *item;
+	unsigned reached;
+	universe_order_vec before;
+	size_t index;
+	size_t lowlink;
+	size_t component;
+	size_t rank;
+	bool onstack;
+};
+
+struct universe_order_step {
+	size_t node;
+	enum pkg_priority_update_type type;
+};
+
+struct universe_order_frame {
+	size_t node;
+	size_t edge;
+};
+
+KHASH_MAP_INIT_INT64(universe_order_nodes, size_t);
+
+struct universe_order {
+	struct pkg_jobs_universe *universe;
+	kh_universe_order_nodes_t *nodemap;
+	kvec_t(struct universe_order_node) nodes;
+	kvec_t(struct universe_order_step) queue;
+};
+
+#define ORDER_NODE(o, n) kv_A((o)->nodes, (n))
+
+static size_t
+universe_order_node(struct universe_order *o, struct pkg_job_universe_item *item)
+{
+	struct universe_order_node node;
+	khint_t k;
+	int ret;
+
+	k = kh_put_universe_order_nodes(o->nodemap, (int64_t)(uintptr_t)item,
+	    &ret);
+	if (ret == 0)
+		return (kh_value(o->nodemap, k));
+
+	memset(&node, 0, sizeof(node));
+	node.item = item;
+	kv_init(node.before);
+	kv_push(struct universe_order_node, o->nodes, node);
+	kh_value(o->nodemap, k) = kv_size(o->nodes) - 1;
+
+	return (kv_size(o->nodes) - 1);
+}
+
+static bool
+universe_order_skip(struct pkg_job_universe_item *item,
+	enum pkg_priority_update_type type)
+{
+	/*
+	 * We do not order the remote part of a conflict or of a removal, as we
+	 * know that remote packages should not contain conflicts (they should
+	 * be resolved in request prior to calling of this function)
+	 */
+	return ((type == PKG_PRIORITY_UPDATE_CONFLICT ||
+	    type == PKG_PRIORITY_UPDATE_DELETE) &&
+	    item->pkg->type != PKG_INSTALLED);
+}
+
+static size_t
+universe_order_reach(struct universe_order *o,
+	struct pkg_job_universe_item *item, enum pkg_priority_update_type type)
+{
+	struct universe_order_step step;
+	size_t n;
+
+	n = universe_order_node(o, item);
+	/*
+	 * A package to remove is only ordered as such, whatever the other
+	 * requests leading to it
+	 */
+	if (type != PKG_PRIORITY_UPDATE_DELETE &&
+	    (ORDER_NODE(o, n).reached & (1U << PKG_PRIORITY_UPDATE_DELETE)))
+		return (n);
+	if ((ORDER_NODE(o, n).reached & (1U << type)) == 0) {
+		ORDER_NODE(o, n).reached |= 1U << type;
+		step.node = n;
+		step.type = type;
+		kv_push(struct universe_order_step, o->queue, step);
+	}
+
+	return (n);
+}
+
+static void
+universe_order_edge(struct universe_order *o, size_t from, size_t to)
+{
+	kv_push(size_t, ORDER_NODE(o, from).before, to);
+}
 
 static void
-pkg_jobs_update_universe_item_priority(struct pkg_jobs_universe *universe,
-		struct pkg_job_universe_item *item, int priority,
-		enum pkg_priority_update_type type)
+universe_order_expand(struct universe_order *o, size_t n,
+	enum pkg_priority_update_type type)
 {
 	struct pkg_dep *d = NULL;
 	struct pkg_conflict *c = NULL;
-	struct pkg_job_universe_item *found, *cur, *it;
-	const char *is_local;
-	int maxpri;
+	struct pkg_job_universe_item *found, *cur;
+	struct pkg *pkg = ORDER_NODE(o, n).item->pkg;
+	size_t m;
 
 	int (*deps_func)(const struct pkg *pkg, struct pkg_dep **d);
 	int (*rdeps_func)(const struct pkg *pkg, struct pkg_dep **d);
 
-	if (priority > RECURSION_LIMIT) {
-		pkg_debug(1, "recursion limit has been reached, something is bad"
-					" with dependencies/conflicts graph");
-		return;
+	if (type == PKG_PRIORITY_UPDATE_DELETE) {
+		/*
+		 * For delete requests we inverse deps and rdeps logic
+		 */
+		deps_func = pkg_rdeps;
+		rdeps_func = pkg_deps;
 	}
-	else if (priority + 10 > RECURSION_LIMIT) {
-		pkg_debug(2, "approaching recursion limit at %d, while processing of"
-		    " package %s", priority, item->pkg->uid);
+	else {
+		deps_func = pkg_deps;
+		rdeps_func = pkg_rdeps;
 	}
 
-	LL_FOREACH(item, it) {
-		if ((item->next != NULL || item->prev != NULL) &&
-		    it->pkg->type != PKG_INSTALLED &&
-		    (type == PKG_PRIORITY_UPDATE_CONFLICT ||
-		     type == PKG_PRIORITY_UPDATE_DELETE)) {
-			/*
-			 * We do not update priority of a remote part of conflict, as we know
-			 * that remote packages should not contain conflicts (they should be
-			 * resolved in request prior to calling of this function)
-			 */
-			pkg_debug(4, "skip update priority for %s-%s",
-			    it->pkg->uid, it->pkg->digest);
-			continue;
+	while (deps_func(pkg, &d) == EPKG_OK) {
+		UNIVERSE_FIND_ATOM(o->universe, d->uid, found);
+		LL_FOREACH(found, cur) {
+			if (universe_order_skip(cur, type))
+				continue;
+			m = universe_order_reach(o, cur, type);
+			universe_order_edge(o, n, m);
 		}
-		if (it->priority > priority)
-			continue;
+	}
 
-		is_local = it->pkg->type == PKG_INSTALLED ? "local" : "remote";
-		pkg_debug(2, "universe: update %s priority of %s(%s): %d -> %d, reason: %d",
-		    is_local, it->pkg->uid, it->pkg->digest, it->priority, priority, type);
-		it->priority = priority;
+	d = NULL;
+	while (rdeps_func(pkg, &d) == EPKG_OK) {
+		UNIVERSE_FIND_ATOM(o->universe, d->uid, found);
+		LL_FOREACH(found, cur) {
+			m = universe_order_node(o, cur);
+			universe_order_edge(o, m, n);
+		}
+	}
 
-		if (type == PKG_PRIORITY_UPDATE_DELETE) {
+	if (pkg->type == PKG_INSTALLED)
+		return;
+
+	while (pkg_conflicts(pkg, &c) == EPKG_OK) {
+		found = pkg_jobs_universe_lookup(o->universe, c->uid);
+		LL_FOREACH(found, cur) {
+			if (cur->pkg->type != PKG_INSTALLED)
+				continue;
 			/*
-			 * For delete requests we inverse deps and rdeps logic
+			 * Move delete requests to be done before installing
 			 */
-			deps_func = pkg_rdeps;
-			rdeps_func = pkg_deps;
-		}
-		else {
-			deps_func = pkg_deps;
-			rdeps_func = pkg_rdeps;
+			m = universe_order_reach(o, cur, PKG_PRIORITY_UPDATE_CONFLICT);
+			universe_order_edge(o, n, m);
 		}
+	}
+}
 
-		while (deps_func(it->pkg, &d) == EPKG_OK) {
-			HASH_FIND_STR(universe->items, d->uid, found);
-			if (found == NULL)
-				continue;
-			LL_FOREACH(found, cur) {
-				if (cur->priority < priority + 1)
-					pkg_jobs_update_universe_item_priority(universe, cur,
-					    priority + 1, type);
-			}
-		}
+static void
+universe_order_conflicts(struct universe_order *o, struct pkg_solved *req)
+{
+	struct pkg_conflict *c = NULL;
+	struct pkg_job_universe_item *found, *cur, *rit;
+	size_t n;
 
-		d = NULL;
-		maxpri = priority;
-		while (rdeps_func(it->pkg, &d) == EPKG_OK) {
-			HASH_FIND_STR(universe->items, d->uid, found);
-			if (found == NULL)
-				continue;
-			LL_FOREACH(found, cur) {
-				if (cur->priority >= maxpri) {
-					maxpri = cur->priority + 1;
-				}
+	while (pkg_conflicts(req->items[1]->pkg, &c) == EPKG_OK) {
+		rit = NULL;
+		found = pkg_jobs_universe_lookup(o->universe, c->uid);
+		LL_FOREACH(found, cur) {
+			if (cur->pkg->type != PKG_INSTALLED) {
+				rit = cur;
+				break;
 			}
 		}
-		if (maxpri != priority) {
-			pkg_jobs_update_universe_item_priority(universe, it,
-					maxpri, type);
-			return;
-		}
-		if (it->pkg->type == PKG_INSTALLED)
+		if (rit == NULL)
 			continue;
 
-		while (pkg_conflicts(it->pkg, &c) == EPKG_OK) {
-			HASH_FIND_STR(universe->items, c->uid, found);
-			if (found == NULL)
+		/*
+		 * The local part of the upgrade has to be removed before the
+		 * remote package it conflicts with is installed
+		 */
+		n = universe_order_reach(o, req->items[1],
+		    PKG_PRIORITY_UPDATE_CONFLICT);
+		universe_order_edge(o, universe_order_node(o, rit), n);
+	}
+}
+
+static void
+universe_order_components(struct universe_order *o, universe_order_vec *emitted,
+	universe_order_vec *bounds)
+{
+	struct universe_order_frame frame;
+	kvec_t(struct universe_order_frame) frames;
+	universe_order_vec stack;
+	size_t s, v, w, p, counter = 0;
+
+	kv_init(frames);
+	kv_init(stack);
+
+	for (s = 0; s < kv_size(o->nodes); s++) {
+		if (ORDER_NODE(o, s).index != 0)
+			continue;
+
+		ORDER_NODE(o, s).index = ORDER_NODE(o, s).lowlink = ++counter;
+		ORDER_NODE(o, s).onstack = true;
+		kv_push(size_t, stack, s);
+		frame.node = s;
+		frame.edge = 0;
+		kv_push(struct universe_order_frame, frames, frame);
+
+		while (kv_size(frames) > 0) {
+			v = kv_A(frames, kv_size(frames) - 1).node;
+			w = kv_A(frames, kv_size(frames) - 1).edge;
+			if (w < kv_size(ORDER_NODE(o, v).before)) {
+				kv_A(frames, kv_size(frames) - 1).edge++;
+				w = kv_A(ORDER_NODE(o, v).before, w);
+				if (ORDER_NODE(o, w).index == 0) {
+					ORDER_NODE(o, w).index = ++counter;
+					ORDER_NODE(o, w).lowlink = counter;
+					ORDER_NODE(o, w).onstack = true;
+					kv_push(size_t, stack, w);
+					frame.node = w;
+					frame.edge = 0;
+					kv_push(struct universe_order_frame, frames,
+					    frame);
+				}
+				else if (ORDER_NODE(o, w).onstack &&
+				    ORDER_NODE(o, w).index < ORDER_NODE(o, v).lowlink)
+					ORDER_NODE(o, v).lowlink = ORDER_NODE(o, w).index;
 				continue;
-			LL_FOREACH(found, cur) {
-				if (cur->pkg->type != PKG_INSTALLED)
-					continue;
-				/*
-				 * Move delete requests to be done before installing
-				 */
-				if (cur->priority <= it->priority)
-					pkg_jobs_update_universe_item_priority(universe, cur,
-					    it->priority + 1, PKG_PRIORITY_UPDATE_CONFLICT);
 			}
+
+			kv_size(frames)--;
+			if (kv_size(frames) > 0) {
+				p = kv_A(frames, kv_size(frames) - 1).node;
+				if (ORDER_NODE(o, v).lowlink < ORDER_NODE(o, p).lowlink)
+					ORDER_NODE(o, p).lowlink = ORDER_NODE(o, v).lowlink;
+			}
+			if (ORDER_NODE(o, v).lowlink != ORDER_NODE(o, v).index)
+				continue;
+
+			/* v is the root of a component, pop it from the stack */
+			kv_push(size_t, *bounds, kv_size(*emitted));
+			do {
+				w = kv_pop(stack);
+				ORDER_NODE(o, w).onstack = false;
+				ORDER_NODE(o, w).component = kv_size(*bounds) - 1;
+				kv_push(size_t, *emitted, w);
+			} while (w != v);
 		}
 	}
+
+	kv_destroy(frames);
+	kv_destroy(stack);
 }
 
-void
-pkg_jobs_update_conflict_priority(struct pkg_jobs_universe *universe,
-	struct pkg_solved *req)
+static int
+universe_order_cmp(const void *a, const void *b)
 {
-	struct pkg_conflict *c = NULL;
-	struct pkg *lp = req->items[1]->pkg;
-	struct pkg_job_universe_item *found, *cur, *rit = NULL;
+	const struct universe_order_node *na = *(const struct universe_order_node **)a;
+	const struct universe_order_node *nb = *(const struct universe_order_node **)b;
+	const struct pkg *pa = na->item->pkg, *pb = nb->item->pkg;
+	int ret;
 
-	while (pkg_conflicts(lp, &c) == EPKG_OK) {
-		rit = NULL;
-		HASH_FIND_STR(universe->items, c->uid, found);
-		assert(found != NULL);
+	if ((ret = strcmp(pa->uid, pb->uid)) != 0)
+		return (ret);
+	if (pa->type != pb->type)
+		return (pa->type == PKG_INSTALLED ? -1 : 1);
 
-		LL_FOREACH(found, cur) {
-			if (cur->pkg->type != PKG_INSTALLED) {
-				rit = cur;
-				break;
+	return (strcmp(pa->digest, pb->digest));
+}
+
+/*
+ * The jobs are ordered again each time an upgrade is split, only report a
+ * cycle the first time it is met.
+ */
+static void
+universe_order_report(struct pkg_jobs_universe *universe,
+    struct universe_order_node **members, size_t count)
+{
+	struct sbuf *sb;
+	char *cycle;
+	size_t i;
+
+	sb = sbuf_new_auto();
+	for (i = 0; i < count; i++) {
+		sbuf_printf(sb, "%s%s-%s", i > 0 ? ", " : "",
+		    members[i]->item->pkg->name, members[i]->item->pkg->version);
+	}
+	sbuf_finish(sb);
+	if (!kh_contains(strings, universe->cycles, sbuf_data(sb))) {
+		pkg_emit_notice("Dependency cycle between %s, ordering it by "
+		    "package name", sbuf_data(sb));
+		cycle = strdup(sbuf_data(sb));
+		kh_add(strings, universe->cycles, cycle, cycle, free);
+	}
+	sbuf_delete(sb);
+}
+
+int
+pkg_jobs_universe_order(struct pkg_jobs_universe *universe,
+	struct pkg_solved *jobs)
+{
+	struct universe_order o;
+	struct universe_order_step step;
+	struct universe_order_node *v, *w;
+	struct pkg_job_universe_item *cur;
+	struct pkg_solved *req;
+	universe_order_vec emitted, bounds;
+	kvec_t(struct universe_order_node *) members;
+	enum pkg_priority_update_type type;
+	size_t b, i, e, start, end;
+	int pass, cycles = 0;
+
+	memset(&o, 0, sizeof(o));
+	o.universe = universe;
+	o.nodemap = kh_init_universe_order_nodes();
+	kv_init(o.nodes);
+	kv_init(o.queue);
+	kv_init(emitted);
+	kv_init(bounds);
+	kv_init(members);
+
+	/*
+	 * The removals are expanded first, they only lead to other removals.
+	 * Each node is expanded at most once per reason.
+	 */
+	for (pass = 0; pass < 2; pass++) {
+		DL_FOREACH(jobs, req) {
+			if ((req->type == PKG_SOLVED_DELETE) != (pass == 0))
+				continue;
+			if (req->type == PKG_SOLVED_DELETE)
+				type = PKG_PRIORITY_UPDATE_DELETE;
+			else
+				type = PKG_PRIORITY_UPDATE_REQUEST;
+			LL_FOREACH(req->items[0], cur) {
+				if (!universe_order_skip(cur, type))
+					universe_order_reach(&o, cur, type);
 			}
+			if (req->type == PKG_SOLVED_UPGRADE &&
+			    req->items[1]->pkg->conflicts != NULL)
+				universe_order_conflicts(&o, req);
 		}
 
-		assert(rit != NULL);
-		if (rit->priority >= req->items[1]->priority) {
-			pkg_jobs_update_universe_item_priority(universe, req->items[1],
-					rit->priority + 1, PKG_PRIORITY_UPDATE_CONFLICT);
-			/*
-			 * Update priorities for a remote part as well
-			 */
-			pkg_jobs_update_universe_item_priority(universe, req->items[0],
-					req->items[0]->priority, PKG_PRIORITY_UPDATE_REQUEST);
+		while (kv_size(o.queue) > 0) {
+			step = kv_pop(o.queue);
+			universe_order_expand(&o, step.node, step.type);
 		}
 	}
-}
 
+	universe_order_components(&o, &emitted, &bounds);
+
+	for (i = 0; i < kv_size(o.nodes); i++)
+		ORDER_NODE(&o, i).item->priority = 0;
+
+	/* Sources first: walk the components in topological order */
+	for (b = kv_size(bounds); b > 0; b--) {
+		start = kv_A(bounds, b - 1);
+		end = b < kv_size(bounds) ? kv_A(bounds, b) : kv_size(emitted);
+
+		kv_size(members) = 0;
+		for (i = start; i < end; i++)
+			kv_push(struct universe_order_node *, members,
+			    &ORDER_NODE(&o, kv_A(emitted, i)));
+		if (end - start > 1) {
+			qsort(members.a, kv_size(members), sizeof(members.a[0]),
+			    universe_order_cmp);
+			universe_order_report(universe, members.a,
+			    kv_size(members));
+			cycles++;
+		}
+		for (i = 0; i < kv_size(members); i++)
+			kv_A(members, i)->rank = i;
+
+		for (i = 0; i < kv_size(members); i++) {
+			v = kv_A(members, i);
+			for (e = 0; e < kv_size(v->before); e++) {
+				w = &ORDER_NODE(&o, kv_A(v->before, e));
+				if (w->component == v->component && w->rank <= v->rank)
+					continue;
+				if (w->item->priority < v->item->priority + 1)
+					w->item->priority = v->item->priority + 1;
+			}
+			pkg_dbg(UNIVERSE, 2, "universe: %s priority of %s(%s): %d",
+			    v->item->pkg->type == PKG_INSTALLED ? "local" : "remote",
+			    v->item->pkg->uid, v->item->pkg->digest,
+			    v->item->priority);
+		}
+	}
 
-void
-pkg_jobs_update_universe_priority(struct pkg_jobs_universe *universe,
-	struct pkg_job_universe_item *it, enum pkg_priority_update_type type)
-{
-	pkg_jobs_update_universe_item_priority(universe, it, 0, type);
+	for (i = 0; i < kv_size(o.nodes); i++)
+		kv_destroy(ORDER_NODE(&o, i).before);
+	kv_destroy(o.nodes);
+	kv_destroy(o.queue);
+	kv_destroy(emitted);
+	kv_destroy(bounds);
+	kv_destroy(members);
+	kh_destroy_universe_order_nodes(o.nodemap);
+
+	return (cycles);
 }
 
 static void
@@ -827,6 +1120,7 @@ pkg_jobs_universe_provide_free(struct pkg_job_provide *pr)
 	struct pkg_job_provide *cur, *tmp;
 
 	DL_FOREACH_SAFE(pr, cur, tmp) {
+		pkg_mem_free(PKG_MEM_UNIVERSE, sizeof(*cur));
 		free (cur);
 	}
 }
@@ -834,6 +1128,7 @@ pkg_jobs_universe_provide_free(struct pkg_job_provide *pr)
 static void
 pkg_jobs_universe_replacement_free(struct pkg_job_replace *r)
 {
+	pkg_mem_free(PKG_MEM_UNIVERSE, sizeof(*r));
 	free(r->new_uid);
 	free(r->old_uid);
 	free(r);
@@ -849,12 +1144,16 @@ pkg_jobs_universe_free(struct pkg_jobs_universe *universe)
 
 		LL_FOREACH_SAFE(un, cur, curtmp) {
 			pkg_free(cur->pkg);
+			pkg_mem_free(PKG_MEM_UNIVERSE, sizeof(*cur));
 			free(cur);
 		}
 	}
 	kh_destroy_pkg_jobs_seen(universe->seen);
 	HASH_FREE(universe->provides, pkg_jobs_universe_provide_free);
 	LL_FREE(universe->uid_replaces, pkg_jobs_universe_replacement_free);
+	kh_free(strings, universe->cycles, char, free);
+	pkg_mem_free(PKG_MEM_UNIVERSE, sizeof(*universe));
+	free(universe);
 }
 
 struct pkg_jobs_universe *
@@ -867,6 +1166,7 @@ pkg_jobs_universe_new(struct pkg_jobs *j)
 		pkg_emit_errno("pkg_jobs_universe_new", "calloc");
 		return (NULL);
 	}
+	pkg_mem_alloc(PKG_MEM_UNIVERSE, sizeof(*universe));
 
 	universe->j = j;
 
@@ -876,11 +1176,8 @@ pkg_jobs_universe_new(struct pkg_jobs *j)
 struct pkg_job_universe_item *
 pkg_jobs_universe_find(struct pkg_jobs_universe *universe, const char *uid)
 {
-	struct pkg_job_universe_item *unit;
-
-	HASH_FIND_STR(universe->items, uid, unit);
 
-	return (unit);
+	return (pkg_jobs_universe_lookup(universe, uid));
 }
 
 void
@@ -907,10 +1204,8 @@ pkg_jobs_universe_change_uid(struct pkg_jobs_universe *universe,
 
 			if (found != NULL) {
 				while (pkg_deps(found->pkg, &d) == EPKG_OK) {
-					if (strcmp(d->uid, unit->pkg->uid) == 0) {
-						free(d->uid);
-						d->uid = strdup(new_uid);
-					}
+					if (d->uid == unit->pkg->uid)
+						d->uid = pkg_internn(new_uid, uidlen);
 				}
 			}
 		}
@@ -918,20 +1213,21 @@ pkg_jobs_universe_change_uid(struct pkg_jobs_universe *universe,
 
 	replacement = calloc(1, sizeof(*replacement));
 	if (replacement != NULL) {
+		pkg_mem_alloc(PKG_MEM_UNIVERSE, sizeof(*replacement));
 		replacement->old_uid = strdup(unit->pkg->uid);
 		replacement->new_uid = strdup(new_uid);
 		LL_PREPEND(universe->uid_replaces, replacement);
 	}
 
 	HASH_DELETE(hh, universe->items, unit);
-	free(unit->pkg->uid);
-	unit->pkg->uid = strdup(new_uid);
+	unit->pkg->uid = pkg_internn(new_uid, uidlen);
+	unit->uid = unit->pkg->uid;
 
-	HASH_FIND(hh, universe->items, new_uid, uidlen, found);
+	UNIVERSE_FIND_ATOM(universe, unit->uid, found);
 	if (found != NULL)
 		DL_APPEND(found, unit);
 	else
-		HASH_ADD_KEYPTR(hh, universe->items, new_uid, uidlen, unit);
+		HASH_ADD_PTR(universe->items, uid, unit);
 
 }
 
@@ -1109,7 +1405,7 @@ pkg_jobs_universe_process_upgrade_chains(struct pkg_jobs *j)
 		}
 
 		if (local != NULL && local->pkg->locked) {
-			pkg_debug(1, "removing %s from the request as it is locked",
+			pkg_dbg(UNIVERSE, 1, "removing %s from the request as it is locked",
 				cur->pkg->uid);
 			HASH_DEL(j->request_add, req);
 			pkg_jobs_request_free(req);
@@ -1146,7 +1442,7 @@ pkg_jobs_universe_process_upgrade_chains(struct pkg_jobs *j)
 			if (local != NULL && strcmp(local->pkg->digest,
 				selected->pkg->digest) == 0 &&
 				(j->flags & PKG_FLAG_FORCE) == 0) {
-				pkg_debug (1, "removing %s from the request as it is the "
+				pkg_dbg(UNIVERSE, 1, "removing %s from the request as it is the "
 								"same as local", selected->pkg->uid);
 				continue;
 			}
@@ -1181,7 +1477,7 @@ pkg_jobs_universe_get_upgrade_candidates(struct pkg_jobs_universe *universe,
 					PKG_LOAD_ANNOTATIONS|PKG_LOAD_CONFLICTS;
 	kvec_t(struct pkg *) candidates;
 
-	HASH_FIND(hh, universe->items, uid, strlen(uid), unit);
+	unit = pkg_jobs_universe_lookup(universe, uid);
 	if (unit != NULL) {
 		/*
 		 * If a unit has been found, we have already found the potential
@@ -1248,7 +1544,7 @@ pkg_jobs_universe_get_upgrade_candidates(struct pkg_jobs_universe *universe,
 		return (NULL);
 	}
 
-	HASH_FIND(hh, universe->items, uid, strlen(uid), unit);
+	unit = pkg_jobs_universe_lookup(universe, uid);
 	kv_destroy(candidates);
 
 	return (unit);
@@ -79,7 +79,8 @@ static int pkg_set_dirs_from_object(struct pkg *, const ucl_object_t *);
 #define TYPE_SHIFT(x) (1 << (x))
 #define STRING_FLAG_LICENSE (1U << 31)
 #define STRING_FLAG_URLDECODE (1U << 30)
-#define STRING_FLAG_MASK ~(STRING_FLAG_LICENSE|STRING_FLAG_URLDECODE)
+#define STRING_FLAG_INTERN (1U << 29)
+#define STRING_FLAG_MASK ~(STRING_FLAG_LICENSE|STRING_FLAG_URLDECODE|STRING_FLAG_INTERN)
 
 static struct pkg_manifest_key {
 	const char *key;
@@ -94,7 +95,7 @@ static struct pkg_manifest_key {
 	{ "abi",                 offsetof(struct pkg, abi),
 			TYPE_SHIFT(UCL_STRING), pkg_string},
 
-	{ "arch",                offsetof(struct pkg, arch),
+	{ "arch",                offsetof(struct pkg, arch) | STRING_FLAG_INTERN,
 			TYPE_SHIFT(UCL_STRING), pkg_string},
 
 	{ "categories",          PKG_CATEGORIES,
@@ -139,7 +140,7 @@ static struct pkg_manifest_key {
 	{ "licenses",            PKG_LICENSES,
 			TYPE_SHIFT(UCL_ARRAY),  pkg_array},
 
-	{ "maintainer",          offsetof(struct pkg, maintainer),
+	{ "maintainer",          offsetof(struct pkg, maintainer) | STRING_FLAG_INTERN,
 			TYPE_SHIFT(UCL_STRING), pkg_string},
 
 	{ "messages",            PKG_MESSAGE_NEW,
@@ -148,7 +149,7 @@ static struct pkg_manifest_key {
 	{ "message",             PKG_MESSAGE_LEGACY,
 			TYPE_SHIFT(UCL_STRING)|TYPE_SHIFT(UCL_ARRAY), pkg_message},
 
-	{ "name",                offsetof(struct pkg, name),
+	{ "name",                offsetof(struct pkg, name) | STRING_FLAG_INTERN,
 			TYPE_SHIFT(UCL_STRING)|TYPE_SHIFT(UCL_INT), pkg_string},
 
 	{ "options",             PKG_OPTIONS,
@@ -160,7 +161,7 @@ static struct pkg_manifest_key {
 	{ "option_descriptions", PKG_OPTION_DESCRIPTIONS,
 			TYPE_SHIFT(UCL_OBJECT), pkg_obj},
 
-	{ "origin",              offsetof(struct pkg, origin),
+	{ "origin",              offsetof(struct pkg, origin) | STRING_FLAG_INTERN,
 			TYPE_SHIFT(UCL_STRING), pkg_string},
 
 	{ "path",                offsetof(struct pkg, repopath),
@@ -172,7 +173,7 @@ static struct pkg_manifest_key {
 	{ "pkgsize",             offsetof(struct pkg, pkgsize),
 			TYPE_SHIFT(UCL_INT),    pkg_int},
 
-	{ "prefix",              offsetof(struct pkg, prefix),
+	{ "prefix",              offsetof(struct pkg, prefix) | STRING_FLAG_INTERN,
 			TYPE_SHIFT(UCL_STRING), pkg_string},
 
 	{ "provides",            PKG_PROVIDES,
@@ -199,13 +200,13 @@ static struct pkg_manifest_key {
 	{ "users",               PKG_USERS,
 			TYPE_SHIFT(UCL_ARRAY),  pkg_array},
 
-	{ "version",             offsetof(struct pkg, version),
+	{ "version",             offsetof(struct pkg, version) | STRING_FLAG_INTERN,
 			TYPE_SHIFT(UCL_STRING)|TYPE_SHIFT(UCL_INT), pkg_string},
 
 	{ "vital",            offsetof(struct pkg, vital),
 			TYPE_SHIFT(UCL_BOOLEAN),    pkg_boolean},
 
-	{ "www",                 offsetof(struct pkg, www),
+	{ "www",                 offsetof(struct pkg, www) | STRING_FLAG_INTERN,
 			TYPE_SHIFT(UCL_STRING), pkg_string},
 
 	{ NULL, -99, -99, NULL}
@@ -339,6 +340,7 @@ static int
 pkg_string(struct pkg *pkg, const ucl_object_t *obj, uint32_t offset)
 {
 	const char *str;
+	const char **atom;
 	char **dest;
 	struct sbuf *buf = NULL;
 
@@ -366,10 +368,16 @@ pkg_string(struct pkg *pkg, const ucl_object_t *obj, uint32_t offset)
 			str = sbuf_data(buf);
 		}
 
-		/* Remove flags from the offset */
-		offset &= STRING_FLAG_MASK;
-		dest = (char **) ((unsigned char *)pkg + offset);
-		*dest = strdup(str);
+		if (offset & STRING_FLAG_INTERN) {
+			offset &= STRING_FLAG_MASK;
+			atom = (const char **) ((unsigned char *)pkg + offset);
+			*atom = pkg_intern(str);
+		} else {
+			/* Remove flags from the offset */
+			offset &= STRING_FLAG_MASK;
+			dest = (char **) ((unsigned char *)pkg + offset);
+			*dest = strdup(str);
+		}
 
 		if (buf) {
 			sbuf_delete(buf);
@@ -954,7 +962,7 @@ pkg_emit_object(struct pkg *pkg, short flags)
 	if (pkg->abi == NULL && pkg->arch != NULL)
 		pkg->abi = strdup(pkg->arch);
 	pkg_arch_to_legacy(pkg->abi, legacyarch, BUFSIZ);
-	pkg->arch = strdup(legacyarch);
+	pkg->arch = pkg_intern(legacyarch);
 	pkg_debug(4, "Emitting basic metadata");
 	ucl_object_insert_key(top, ucl_object_fromstring_common(pkg->name, 0,
 	    UCL_STRING_TRIM), "name", 4, false);
@@ -0,0 +1,113 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "pkg_config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include "pkg.h"
+#include "private/event.h"
+#include "private/pkg.h"
+
+/*
+ * Memory accounting per subsystem.
+ *
+ * Allocation sites of the big consumers declare what they allocate and
+ * release through pkg_mem_alloc() and pkg_mem_free() with the size of the
+ * object, no header is added to the allocations themselves. Accounting is
+ * switched on by MEMORY_STATS when libpkg is initialized: objects allocated
+ * before that are not accounted and must not be released afterwards.
+ */
+
+bool pkg_mem_enabled = false;
+
+static const char *mem_tags[PKG_MEM_NTAGS] = {
+	[PKG_MEM_PKG] = "pkg",
+	[PKG_MEM_FILES] = "files",
+	[PKG_MEM_UNIVERSE] = "universe",
+	[PKG_MEM_SOLVER] = "solver",
+	[PKG_MEM_CONFLICTS] = "conflicts",
+	[PKG_MEM_INTERN] = "intern",
+};
+
+static struct pkg_mem_stat mem_stats[PKG_MEM_NTAGS];
+
+void
+pkg_mem_account(pkg_mem_tag tag, int64_t size)
+{
+	struct pkg_mem_stat *m = &mem_stats[tag];
+
+	m->current += size;
+	if (size >= 0) {
+		m->allocs++;
+		if (m->current > m->peak)
+			m->peak = m->current;
+	} else {
+		m->frees++;
+	}
+}
+
+void
+pkg_mem_enable(bool enable)
+{
+
+	if (enable && !pkg_mem_enabled)
+		memset(mem_stats, 0, sizeof(mem_stats));
+	pkg_mem_enabled = enable;
+}
+
+void
+pkg_mem_stats(struct pkg_mem_stat *stats)
+{
+	int i;
+
+	for (i = 0; i < PKG_MEM_NTAGS; i++) {
+		stats[i] = mem_stats[i];
+		stats[i].tag = mem_tags[i];
+	}
+}
+
+void
+pkg_mem_report(void)
+{
+	struct pkg_mem_stat stats[PKG_MEM_NTAGS];
+	int i;
+
+	if (!pkg_mem_enabled)
+		return;
+
+	pkg_mem_stats(stats);
+	for (i = 0; i < PKG_MEM_NTAGS; i++) {
+		pkg_debug(1, "Memory %s: %jd bytes in use, %jd bytes peak, "
+		    "%jd allocations, %jd releases", stats[i].tag,
+		    (intmax_t)stats[i].current, (intmax_t)stats[i].peak,
+		    (intmax_t)stats[i].allocs, (intmax_t)stats[i].frees);
+	}
+	pkg_emit_memory_stats(stats, PKG_MEM_NTAGS);
+}
@@ -194,7 +194,7 @@ setprefix(struct plist *p, char *line, struct file_attr *a)
 		strlcpy(p->prefix, line, sizeof(p->prefix));
 
 	if (p->pkg->prefix == NULL)
-		p->pkg->prefix = strdup(line);
+		p->pkg->prefix = pkg_intern(line);
 
 	p->slash = p->prefix[strlen(p->prefix) -1] == '/' ? "" : "/";
 
@@ -220,8 +220,8 @@ name_key(struct plist *p, char *line, struct file_attr *a)
 	tmp = strrchr(line, '-');
 	tmp[0] = '\0';
 	tmp++;
-	p->pkg->name = strdup(line);
-	p->pkg->version = strdup(tmp);
+	p->pkg->name = pkg_intern(line);
+	p->pkg->version = pkg_intern(tmp);
 
 	free_file_attr(a);
 
@@ -507,8 +507,7 @@ comment_key(struct plist *p, char *line, struct file_attr *a)
 		p->pkgdep = NULL;
 	} else if (strncmp(line, "ORIGIN:", 7) == 0) {
 		line += 7;
-		free(p->pkg->origin);
-		p->pkg->origin = strdup(line);
+		p->pkg->origin = pkg_intern(line);
 	} else if (strncmp(line, "OPTIONS:", 8) == 0) {
 		line += 8;
 		/* OPTIONS:+OPTION -OPTION */
@@ -237,7 +237,7 @@ pkg_repo_meta_extract_signature_pubkey(int fd, void *ud)
 	void *sig;
 	int rc = EPKG_FATAL;
 
-	pkg_debug(1, "PkgRepo: extracting signature of repo in a sandbox");
+	pkg_dbg(FETCH, 1, "PkgRepo: extracting signature of repo in a sandbox");
 
 	a = archive_read_new();
 	archive_read_support_filter_all(a);
@@ -303,7 +303,7 @@ pkg_repo_meta_extract_signature_fingerprints(int fd, void *ud)
 	char key[MAXPATHLEN], t;
 	struct iovec iov[5];
 
-	pkg_debug(1, "PkgRepo: extracting signature of repo in a sandbox");
+	pkg_dbg(FETCH, 1, "PkgRepo: extracting signature of repo in a sandbox");
 
 	a = archive_read_new();
 	archive_read_support_filter_all(a);
@@ -548,7 +548,7 @@ pkg_repo_archive_extract_archive(int fd, const char *file,
 	int64_t siglen = 0;
 
 
-	pkg_debug(1, "PkgRepo: extracting %s of repo %s", file, pkg_repo_name(repo));
+	pkg_dbg(FETCH, 1, "PkgRepo: extracting %s of repo %s", file, pkg_repo_name(repo));
 
 	/* Seek to the begin of file */
 	(void)lseek(fd, 0, SEEK_SET);
@@ -0,0 +1,474 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "pkg_config.h"
+#endif
+
+#include <assert.h>
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sqlite3.h>
+
+#include "pkg.h"
+#include "private/event.h"
+#include "private/pkg.h"
+#include "private/pkgdb.h"
+#include "private/utils.h"
+#include "kvec.h"
+
+/*
+ * In memory view of the shlibs, pkg_shlibs_provided and pkg_shlibs_required
+ * tables: every installed package linked to the libraries it provides and
+ * requires, and every library linked to its providers and consumers.
+ */
+
+struct shlib_graph_lib;
+
+struct shlib_graph_pkg {
+	int64_t id;
+	char *name;
+	char *version;
+	kvec_t(struct shlib_graph_lib *) provided;
+	kvec_t(struct shlib_graph_lib *) required;
+	/* transient state used by the breakage walk */
+	bool broken;
+	int depth;
+	struct shlib_graph_lib *cause;
+};
+
+struct shlib_graph_lib {
+	char *name;
+	kvec_t(struct shlib_graph_pkg *) providers;
+	kvec_t(struct shlib_graph_pkg *) consumers;
+	/* transient state used by the breakage walk */
+	bool gone;
+	size_t alive;
+};
+
+KHASH_MAP_INIT_INT64(shlib_graph_pkgs, struct shlib_graph_pkg *);
+KHASH_MAP_INIT_STR(shlib_graph_libs, struct shlib_graph_lib *);
+
+struct pkg_shlib_graph {
+	kh_shlib_graph_pkgs_t *pkgs;
+	kh_shlib_graph_libs_t *libs;
+};
+
+static void
+shlib_graph_pkg_free(struct shlib_graph_pkg *p)
+{
+	if (p == NULL)
+		return;
+
+	free(p->name);
+	free(p->version);
+	kv_destroy(p->provided);
+	kv_destroy(p->required);
+	free(p);
+}
+
+static void
+shlib_graph_lib_free(struct shlib_graph_lib *l)
+{
+	if (l == NULL)
+		return;
+
+	free(l->name);
+	kv_destroy(l->providers);
+	kv_destroy(l->consumers);
+	free(l);
+}
+
+static struct shlib_graph_pkg *
+shlib_graph_get_pkg(struct pkg_shlib_graph *g, int64_t id, const char *name,
+    const char *version)
+{
+	struct shlib_graph_pkg *p;
+	khint_t k;
+	int ret;
+
+	k = kh_get_shlib_graph_pkgs(g->pkgs, id);
+	if (k != kh_end(g->pkgs))
+		return (kh_value(g->pkgs, k));
+
+	p = calloc(1, sizeof(*p));
+	if (p == NULL) {
+		pkg_emit_errno("calloc", "shlib_graph_pkg");
+		return (NULL);
+	}
+	p->id = id;
+	p->name = strdup(name);
+	p->version = strdup(version);
+	kv_init(p->provided);
+	kv_init(p->required);
+
+	k = kh_put_shlib_graph_pkgs(g->pkgs, id, &ret);
+	kh_value(g->pkgs, k) = p;
+
+	return (p);
+}
+
+static struct shlib_graph_lib *
+shlib_graph_get_lib(struct pkg_shlib_graph *g, const char *name)
+{
+	struct shlib_graph_lib *l;
+	khint_t k;
+	int ret;
+
+	k = kh_get_shlib_graph_libs(g->libs, name);
+	if (k != kh_end(g->libs))
+		return (kh_value(g->libs, k));
+
+	l = calloc(1, sizeof(*l));
+	if (l == NULL) {
+		pkg_emit_errno("calloc", "shlib_graph_lib");
+		return (NULL);
+	}
+	l->name = strdup(name);
+	kv_init(l->providers);
+	kv_init(l->consumers);
+
+	k = kh_put_shlib_graph_libs(g->libs, l->name, &ret);
+	kh_value(g->libs, k) = l;
+
+	return (l);
+}
+
+static int
+shlib_graph_lib_cmp(const void *a, const void *b)
+{
+	const struct shlib_graph_lib *la = *(const struct shlib_graph_lib **)a;
+	const struct shlib_graph_lib *lb = *(const struct shlib_graph_lib **)b;
+
+	return (strcmp(la->name, lb->name));
+}
+
+static int
+shlib_graph_pkg_cmp(const void *a, const void *b)
+{
+	const struct shlib_graph_pkg *pa = *(const struct shlib_graph_pkg **)a;
+	const struct shlib_graph_pkg *pb = *(const struct shlib_graph_pkg **)b;
+
+	return (strcmp(pa->name, pb->name));
+}
+
+static int
+shlib_graph_pkg_depth_cmp(const void *a, const void *b)
+{
+	const struct shlib_graph_pkg *pa = *(const struct shlib_graph_pkg **)a;
+	const struct shlib_graph_pkg *pb = *(const struct shlib_graph_pkg **)b;
+
+	if (pa->depth != pb->depth)
+		return (pa->depth - pb->depth);
+
+	return (strcmp(pa->name, pb->name));
+}
+
+int
+pkg_shlib_graph_new(struct pkg_shlib_graph **graph, struct pkgdb *db)
+{
+	struct pkg_shlib_graph *g;
+	struct shlib_graph_pkg *p;
+	struct shlib_graph_lib *l;
+	sqlite3_stmt *stmt;
+	int ret;
+	const char sql[] = ""
+		"SELECT p.id, p.name, p.version, s.name, 0 "
+		"FROM packages AS p, pkg_shlibs_provided AS ps, shlibs AS s "
+		"WHERE p.id = ps.package_id AND ps.shlib_id = s.id "
+		"UNION ALL "
+		"SELECT p.id, p.name, p.version, s.name, 1 "
+		"FROM packages AS p, pkg_shlibs_required AS ps, shlibs AS s "
+		"WHERE p.id = ps.package_id AND ps.shlib_id = s.id;";
+
+	assert(db != NULL);
+
+	g = calloc(1, sizeof(*g));
+	if (g == NULL) {
+		pkg_emit_errno("calloc", "pkg_shlib_graph");
+		return (EPKG_FATAL);
+	}
+	g->pkgs = kh_init_shlib_graph_pkgs();
+	g->libs = kh_init_shlib_graph_libs();
+
+	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	if (sqlite3_prepare_v2(db->sqlite, sql, -1, &stmt, NULL) != SQLITE_OK) {
+		ERROR_SQLITE(db->sqlite, sql);
+		pkg_shlib_graph_free(g);
+		return (EPKG_FATAL);
+	}
+
+	while ((ret = pkgdb_step(stmt)) == SQLITE_ROW) {
+		p = shlib_graph_get_pkg(g, sqlite3_column_int64(stmt, 0),
+		    sqlite3_column_text(stmt, 1),
+		    sqlite3_column_text(stmt, 2));
+		l = shlib_graph_get_lib(g, sqlite3_column_text(stmt, 3));
+		if (p == NULL || l == NULL) {
+			ret = SQLITE_NOMEM;
+			break;
+		}
+		if (sqlite3_column_int(stmt, 4) == 0) {
+			kv_push(struct shlib_graph_lib *, p->provided, l);
+			kv_push(struct shlib_graph_pkg *, l->providers, p);
+		} else {
+			kv_push(struct shlib_graph_lib *, p->required, l);
+			kv_push(struct shlib_graph_pkg *, l->consumers, p);
+		}
+	}
+
+	if (ret != SQLITE_DONE) {
+		if (ret != SQLITE_NOMEM)
+			ERROR_SQLITE(db->sqlite, sql);
+		sqlite3_finalize(stmt);
+		pkg_shlib_graph_free(g);
+		return (EPKG_FATAL);
+	}
+	sqlite3_finalize(stmt);
+
+	/* Keep the output independent from the database layout */
+	kh_each_value(g->libs, l, {
+		qsort(l->providers.a, kv_size(l->providers), sizeof(p),
+		    shlib_graph_pkg_cmp);
+		qsort(l->consumers.a, kv_size(l->consumers), sizeof(p),
+		    shlib_graph_pkg_cmp);
+	});
+
+	pkg_debug(2, "shlib graph: %d packages, %d libraries",
+	    kh_count(g->pkgs), kh_count(g->libs));
+
+	*graph = g;
+
+	return (EPKG_OK);
+}
+
+void
+pkg_shlib_graph_free(struct pkg_shlib_graph *g)
+{
+	if (g == NULL)
+		return;
+
+	kh_free(shlib_graph_pkgs, g->pkgs, struct shlib_graph_pkg,
+	    shlib_graph_pkg_free);
+	kh_free(shlib_graph_libs, g->libs, struct shlib_graph_lib,
+	    shlib_graph_lib_free);
+	free(g);
+}
+
+/*
+ * Collect all the libraries matching the glob pattern, sorted by name so
+ * that the output does not depend on the hash layout.
+ * A NULL pattern matches everything.
+ */
+static size_t
+shlib_graph_match(struct pkg_shlib_graph *g, const char *pattern,
+    struct shlib_graph_lib ***res)
+{
+	kvec_t(struct shlib_graph_lib *) matches;
+	struct shlib_graph_lib *l;
+
+	kv_init(matches);
+	kh_each_value(g->libs, l, {
+		if (pattern == NULL || fnmatch(pattern, l->name, 0) == 0)
+			kv_push(struct shlib_graph_lib *, matches, l);
+	});
+
+	if (kv_size(matches) > 1)
+		qsort(matches.a, kv_size(matches), sizeof(l),
+		    shlib_graph_lib_cmp);
+
+	*res = matches.a;
+
+	return (kv_size(matches));
+}
+
+static int
+shlib_graph_links(struct pkg_shlib_graph *g, const char *pattern,
+    bool provided, pkg_shlib_graph_cb cb, void *data)
+{
+	struct shlib_graph_lib **libs, *l;
+	struct shlib_graph_pkg *p;
+	size_t nlibs;
+	int ret = EPKG_OK;
+
+	nlibs = shlib_graph_match(g, pattern, &libs);
+	for (size_t i = 0; i < nlibs && ret == EPKG_OK; i++) {
+		l = libs[i];
+		if (provided) {
+			for (size_t j = 0; j < kv_size(l->providers); j++) {
+				p = kv_A(l->providers, j);
+				ret = cb(data, p->name, p->version, l->name, 0);
+				if (ret != EPKG_OK)
+					break;
+			}
+		} else {
+			for (size_t j = 0; j < kv_size(l->consumers); j++) {
+				p = kv_A(l->consumers, j);
+				ret = cb(data, p->name, p->version, l->name, 0);
+				if (ret != EPKG_OK)
+					break;
+			}
+		}
+	}
+	free(libs);
+
+	return (ret);
+}
+
+/*
+ * Packages requiring a library nobody provides
+ */
+static int
+shlib_graph_dangling(struct pkg_shlib_graph *g, const char *pattern,
+    pkg_shlib_graph_cb cb, void *data)
+{
+	struct shlib_graph_lib **libs, *l;
+	struct shlib_graph_pkg *p;
+	size_t nlibs;
+	int ret = EPKG_OK;
+
+	nlibs = shlib_graph_match(g, pattern, &libs);
+	for (size_t i = 0; i < nlibs && ret == EPKG_OK; i++) {
+		l = libs[i];
+		if (kv_size(l->providers) > 0)
+			continue;
+		for (size_t j = 0; j < kv_size(l->consumers); j++) {
+			p = kv_A(l->consumers, j);
+			ret = cb(data, p->name, p->version, l->name, 0);
+			if (ret != EPKG_OK)
+				break;
+		}
+	}
+	free(libs);
+
+	return (ret);
+}
+
+/*
+ * Transitive breakage: the libraries matching the pattern disappear, every
+ * package requiring one of them is broken.  A library all of whose
+ * providers are broken is considered gone as well, which in turn breaks its
+ * consumers.  Each package and library is visited once, so the walk is
+ * linear in the number of edges.
+ */
+static int
+shlib_graph_broken(struct pkg_shlib_graph *g, const char *pattern,
+    pkg_shlib_graph_cb cb, void *data)
+{
+	kvec_t(struct shlib_graph_pkg *) queue;
+	kvec_t(struct shlib_graph_lib *) gone;
+	struct shlib_graph_lib **libs, *l;
+	struct shlib_graph_pkg *p, *c;
+	size_t nlibs, head = 0;
+	int ret = EPKG_OK;
+
+	kh_each_value(g->pkgs, p, {
+		p->broken = false;
+		p->depth = 0;
+		p->cause = NULL;
+	});
+	kh_each_value(g->libs, l, {
+		l->gone = false;
+		l->alive = kv_size(l->providers);
+	});
+
+	kv_init(queue);
+	kv_init(gone);
+
+	nlibs = shlib_graph_match(g, pattern, &libs);
+	for (size_t i = 0; i < nlibs; i++) {
+		libs[i]->gone = true;
+		kv_push(struct shlib_graph_lib *, gone, libs[i]);
+	}
+	free(libs);
+
+	for (size_t i = 0; i < kv_size(gone); i++) {
+		l = kv_A(gone, i);
+		for (size_t j = 0; j < kv_size(l->consumers); j++) {
+			c = kv_A(l->consumers, j);
+			if (c->broken)
+				continue;
+			c->broken = true;
+			c->cause = l;
+			kv_push(struct shlib_graph_pkg *, queue, c);
+		}
+	}
+
+	while (head < kv_size(queue)) {
+		p = kv_A(queue, head++);
+		for (size_t i = 0; i < kv_size(p->provided); i++) {
+			l = kv_A(p->provided, i);
+			if (l->gone || --l->alive > 0)
+				continue;
+			l->gone = true;
+			for (size_t j = 0; j < kv_size(l->consumers); j++) {
+				c = kv_A(l->consumers, j);
+				if (c->broken)
+					continue;
+				c->broken = true;
+				c->depth = p->depth + 1;
+				c->cause = l;
+				kv_push(struct shlib_graph_pkg *, queue, c);
+			}
+		}
+	}
+
+	if (kv_size(queue) > 1)
+		qsort(queue.a, kv_size(queue), sizeof(p),
+		    shlib_graph_pkg_depth_cmp);
+
+	for (size_t i = 0; i < kv_size(queue) && ret == EPKG_OK; i++) {
+		p = kv_A(queue, i);
+		ret = cb(data, p->name, p->version, p->cause->name, p->depth);
+	}
+
+	kv_destroy(queue);
+	kv_destroy(gone);
+
+	return (ret);
+}
+
+int
+pkg_shlib_graph_query(struct pkg_shlib_graph *g, pkg_shlib_query_t type,
+    const char *pattern, pkg_shlib_graph_cb cb, void *data)
+{
+	assert(g != NULL);
+	assert(cb != NULL);
+
+	switch (type) {
+	case PKG_SHLIB_QUERY_PROVIDED:
+		return (shlib_graph_links(g, pattern, true, cb, data));
+	case PKG_SHLIB_QUERY_REQUIRED:
+		return (shlib_graph_links(g, pattern, false, cb, data));
+	case PKG_SHLIB_QUERY_BROKEN:
+		return (shlib_graph_broken(g, pattern, cb, data));
+	case PKG_SHLIB_QUERY_DANGLING:
+		return (shlib_graph_dangling(g, pattern, cb, data));
+	}
+
+	return (EPKG_FATAL);
+}
@@ -118,8 +118,6 @@ struct pkg_solve_impl_graph {
 #define PKG_SOLVE_CHECK_ITEM(item)				\
 	((item)->var->to_install ^ (item)->inverse)
 
-#define PKG_SOLVE_VAR_NEXT(a, e) ((e) == NULL ? &a[0] : (e + 1))
-
 /*
  * Utilities to convert jobs to SAT rule
  */
@@ -135,6 +133,7 @@ pkg_solve_item_new(struct pkg_solve_variable *var)
 		pkg_emit_errno("calloc", "pkg_solve_item");
 		return (NULL);
 	}
+	pkg_mem_alloc(PKG_MEM_SOLVER, sizeof(*result));
 
 	result->var = var;
 	result->inverse = 1;
@@ -153,6 +152,7 @@ pkg_solve_rule_new(enum pkg_solve_rule_type reason)
 		pkg_emit_errno("calloc", "pkg_solve_rule");
 		return (NULL);
 	}
+	pkg_mem_alloc(PKG_MEM_SOLVER, sizeof(*result));
 
 	result->reason = reason;
 
@@ -176,8 +176,10 @@ pkg_solve_rule_free(struct pkg_solve_rule *rule)
 	struct pkg_solve_item *it, *tmp;
 
 	LL_FOREACH_SAFE(rule->items, it, tmp) {
+		pkg_mem_free(PKG_MEM_SOLVER, sizeof(*it));
 		free(it);
 	}
+	pkg_mem_free(PKG_MEM_SOLVER, sizeof(*rule));
 	free(rule);
 }
 
@@ -196,6 +198,8 @@ pkg_solve_problem_free(struct pkg_solve_problem *problem)
 	}
 
 	picosat_reset(problem->sat);
+	pkg_mem_free(PKG_MEM_SOLVER,
+	    problem->nvars * sizeof(*problem->variables) + sizeof(*problem));
 	free(problem->variables);
 	free(problem);
 }
@@ -282,14 +286,14 @@ pkg_debug_print_rule(struct pkg_solve_rule *rule)
 {
 	struct sbuf *sb;
 
-	if (debug_level < 3)
+	if (!pkg_dbg_enabled(SOLVER, 3))
 		return;
 
 	sb = sbuf_new_auto();
 
 	pkg_print_rule_sbuf(rule, sb);
 
-	pkg_debug(2, "%s", sbuf_data(sb));
+	pkg_dbg(SOLVER, 2, "%s", sbuf_data(sb));
 	sbuf_delete(sb);
 }
 
@@ -325,7 +329,7 @@ pkg_solve_handle_provide (struct pkg_solve_problem *problem,
 			libfound = kh_contains(strings, pkg->shlibs_provided, pr->provide);
 			/* Skip incompatible ABI as well */
 			if (libfound && strcmp(pkg->arch, orig->arch) != 0) {
-				pkg_debug(2, "solver: require %s: package %s-%s(%c) provides wrong ABI %s, "
+				pkg_dbg(SOLVER, 2, "solver: require %s: package %s-%s(%c) provides wrong ABI %s, "
 					"wanted %s", pr->provide, pkg->name, pkg->version,
 					pkg->type == PKG_INSTALLED ? 'l' : 'r', orig->arch, pkg->arch);
 				continue;
@@ -336,12 +340,12 @@ pkg_solve_handle_provide (struct pkg_solve_problem *problem,
 		}
 
 		if (!providefound && !libfound) {
-			pkg_debug(4, "solver: %s provide is not satisfied by %s-%s(%c)", pr->provide,
+			pkg_dbg(SOLVER, 4, "solver: %s provide is not satisfied by %s-%s(%c)", pr->provide,
 					pkg->name, pkg->version, pkg->type == PKG_INSTALLED ?
 							'l' : 'r');
 			continue;
 		}
-		pkg_debug(4, "solver: %s provide is satisfied by %s-%s(%c)", pr->provide,
+		pkg_dbg(SOLVER, 4, "solver: %s provide is satisfied by %s-%s(%c)", pr->provide,
 				pkg->name, pkg->version, pkg->type == PKG_INSTALLED ?
 				'l' : 'r');
 
@@ -371,7 +375,7 @@ pkg_solve_add_depend_rule(struct pkg_solve_problem *problem,
 	uid = dep->uid;
 	HASH_FIND_STR(problem->variables_by_uid, uid, depvar);
 	if (depvar == NULL) {
-		pkg_debug(2, "cannot find variable dependency %s", uid);
+		pkg_dbg(SOLVER, 2, "cannot find variable dependency %s", uid);
 		return (EPKG_END);
 	}
 	/* Dependency rule: (!A | B) */
@@ -421,7 +425,7 @@ pkg_solve_add_conflict_rule(struct pkg_solve_problem *problem,
 	uid = conflict->uid;
 	HASH_FIND_STR(problem->variables_by_uid, uid, confvar);
 	if (confvar == NULL) {
-		pkg_debug(2, "cannot find conflict %s", uid);
+		pkg_dbg(SOLVER, 2, "cannot find conflict %s", uid);
 		return (EPKG_END);
 	}
 
@@ -499,7 +503,7 @@ pkg_solve_add_require_rule(struct pkg_solve_problem *problem,
 
 	HASH_FIND_STR(problem->j->universe->provides, requirement, prhead);
 	if (prhead != NULL) {
-		pkg_debug(4, "solver: Add require rule: %s-%s(%c) wants %s",
+		pkg_dbg(SOLVER, 4, "solver: Add require rule: %s-%s(%c) wants %s",
 			pkg->name, pkg->version, pkg->type == PKG_INSTALLED ? 'l' : 'r',
 			requirement);
 		/* Require rule !A | P1 | P2 | P3 ... */
@@ -519,8 +523,7 @@ pkg_solve_add_require_rule(struct pkg_solve_problem *problem,
 		cnt = 1;
 		LL_FOREACH(prhead, pr) {
 			if (pkg_solve_handle_provide(problem, pr, rule, pkg, &cnt) != EPKG_OK) {
-				free(it);
-				free(rule);
+				pkg_solve_rule_free(rule);
 				return (EPKG_FATAL);
 			}
 		}
@@ -530,8 +533,7 @@ pkg_solve_add_require_rule(struct pkg_solve_problem *problem,
 		}
 		else {
 			/* Missing dependencies... */
-			free(it);
-			free(rule);
+			pkg_solve_rule_free(rule);
 		}
 	}
 	else {
@@ -540,7 +542,7 @@ pkg_solve_add_require_rule(struct pkg_solve_problem *problem,
 		 * This is terribly broken now so ignore till provides/requires
 		 * are really fixed.
 		 */
-		pkg_debug(1, "solver: for package: %s cannot find provide for requirement: %s",
+		pkg_dbg(SOLVER, 1, "solver: for package: %s cannot find provide for requirement: %s",
 		    pkg->name, requirement);
 	}
 
@@ -573,7 +575,7 @@ pkg_solve_add_request_rule(struct pkg_solve_problem *problem,
 	struct pkg_solve_variable *confvar, *curvar;
 	int cnt;
 
-	pkg_debug(4, "solver: add variable from %s request with uid %s-%s",
+	pkg_dbg(SOLVER, 4, "solver: add variable from %s request with uid %s-%s",
 		inverse < 0 ? "delete" : "install", var->uid, var->digest);
 
 	/*
@@ -800,7 +802,7 @@ pkg_solve_add_variable(struct pkg_job_universe_item *un,
 		pkg_solve_variable_set(var, ucur);
 
 		if (tvar == NULL) {
-			pkg_debug(4, "solver: add variable from universe with uid %s", var->uid);
+			pkg_dbg(SOLVER, 4, "solver: add variable from universe with uid %s", var->uid);
 			HASH_ADD_KEYPTR(hh, problem->variables_by_uid,
 				var->uid, strlen(var->uid), var);
 			tvar = var;
@@ -845,6 +847,8 @@ pkg_solve_jobs_to_sat(struct pkg_jobs *j)
 		pkg_emit_errno("calloc", "variables");
 		return (NULL);
 	}
+	pkg_mem_alloc(PKG_MEM_SOLVER,
+	    problem->nvars * sizeof(*problem->variables) + sizeof(*problem));
 
 	picosat_adjust(problem->sat, problem->nvars);
 
@@ -871,7 +875,7 @@ pkg_solve_jobs_to_sat(struct pkg_jobs *j)
 	}
 
 	if (kv_size(problem->rules) == 0) {
-		pkg_debug(1, "problem has no requests");
+		pkg_dbg(SOLVER, 1, "problem has no requests");
 		return (problem);
 	}
 
@@ -970,12 +974,12 @@ pkg_solve_set_initial_assumption(struct pkg_solve_problem *problem,
 			 * We are interested merely in dependencies of top variables
 			 * or of previously assumed dependencies
 			 */
-			pkg_debug(4, "solver: not interested in dependencies for %s-%s",
+			pkg_dbg(SOLVER, 4, "solver: not interested in dependencies for %s-%s",
 					var->unit->pkg->name, var->unit->pkg->version);
 			return;
 		}
 		else {
-			pkg_debug(4, "solver: examine dependencies for %s-%s",
+			pkg_dbg(SOLVER, 4, "solver: examine dependencies for %s-%s",
 					var->unit->pkg->name, var->unit->pkg->version);
 		}
 
@@ -1022,13 +1026,13 @@ pkg_solve_set_initial_assumption(struct pkg_solve_problem *problem,
 			LL_FOREACH(var, cvar) {
 				if (cvar->unit == selected) {
 					picosat_set_default_phase_lit(problem->sat, cvar->order, 1);
-					pkg_debug(4, "solver: assumed %s-%s(%s) to be installed",
+					pkg_dbg(SOLVER, 4, "solver: assumed %s-%s(%s) to be installed",
 							selected->pkg->name, selected->pkg->version,
 							selected->pkg->type == PKG_INSTALLED ? "l" : "r");
 					cvar->flags |= PKG_VAR_ASSUMED_TRUE;
 				}
 				else {
-					pkg_debug(4, "solver: assumed %s-%s(%s) to be NOT installed",
+					pkg_dbg(SOLVER, 4, "solver: assumed %s-%s(%s) to be NOT installed",
 							cvar->unit->pkg->name, cvar->unit->pkg->version,
 							cvar->unit->pkg->type == PKG_INSTALLED ? "l" : "r");
 					picosat_set_default_phase_lit(problem->sat, cvar->order, -1);
@@ -1078,6 +1082,9 @@ pkg_solve_sat_problem(struct pkg_solve_problem *problem)
 
 reiterate:
 
+	if (pkg_cancel_check(0) != EPKG_OK)
+		return (EPKG_CANCEL);
+
 	res = pkg_solve_picosat_iter(problem, iter);
 
 	if (res != PICOSAT_SATISFIABLE) {
@@ -1165,7 +1172,7 @@ reiterate:
 			else
 				var->flags &= ~PKG_VAR_INSTALL;
 
-			pkg_debug(2, "decided %s %s-%s to %s",
+			pkg_dbg(SOLVER, 2, "decided %s %s-%s to %s",
 					var->unit->pkg->type == PKG_INSTALLED ? "local" : "remote",
 							var->uid, var->digest,
 							var->flags & PKG_VAR_INSTALL ? "install" : "delete");
@@ -1195,7 +1202,7 @@ reiterate:
 				 * iteration to ensure that we have no other choices
 				 */
 				if (failed_var) {
-					pkg_debug (1, "trying to delete local package %s-%s on install/upgrade,"
+					pkg_dbg(SOLVER, 1, "trying to delete local package %s-%s on install/upgrade,"
 							" reiterate on SAT",
 							var->unit->pkg->name, var->unit->pkg->version);
 					need_reiterate = true;
@@ -1318,8 +1325,8 @@ pkg_solve_dimacs_export(struct pkg_solve_problem *problem, FILE *f)
 	int cur_ord = 1;
 
 	/* Order variables */
-	var = NULL;
-	while ((var = PKG_SOLVE_VAR_NEXT(problem->variables, var))) {
+	for (size_t i = 0; i < problem->nvars; i++) {
+		var = &problem->variables[i];
 		nord = calloc(1, sizeof(struct pkg_solve_ordered_variable));
 		nord->order = cur_ord ++;
 		nord->var = var;
@@ -1384,7 +1391,7 @@ pkg_solve_insert_res_job (struct pkg_solve_variable *var,
 				res->type = (j->type == PKG_JOBS_FETCH) ?
 								PKG_SOLVED_FETCH : PKG_SOLVED_INSTALL;
 				DL_APPEND(j->jobs, res);
-				pkg_debug(3, "pkg_solve: schedule installation of %s %s",
+				pkg_dbg(SOLVER, 3, "pkg_solve: schedule installation of %s %s",
 					add_var->uid, add_var->digest);
 			}
 			else {
@@ -1393,7 +1400,7 @@ pkg_solve_insert_res_job (struct pkg_solve_variable *var,
 				res->items[1] = del_var->unit;
 				res->type = PKG_SOLVED_UPGRADE;
 				DL_APPEND(j->jobs, res);
-				pkg_debug(3, "pkg_solve: schedule upgrade of %s from %s to %s",
+				pkg_dbg(SOLVER, 3, "pkg_solve: schedule upgrade of %s from %s to %s",
 					del_var->uid, del_var->digest, add_var->digest);
 			}
 			j->count ++;
@@ -1418,14 +1425,14 @@ pkg_solve_insert_res_job (struct pkg_solve_variable *var,
 				res->items[0] = cur_var->unit;
 				res->type = PKG_SOLVED_DELETE;
 				DL_APPEND(j->jobs, res);
-				pkg_debug(3, "pkg_solve: schedule deletion of %s %s",
+				pkg_dbg(SOLVER, 3, "pkg_solve: schedule deletion of %s %s",
 					cur_var->uid, cur_var->digest);
 				j->count ++;
 			}
 		}
 	}
 	else {
-		pkg_debug(2, "solver: ignoring package %s(%s) as its state has not been changed",
+		pkg_dbg(SOLVER, 2, "solver: ignoring package %s(%s) as its state has not been changed",
 				var->uid, var->digest);
 	}
 }
@@ -1436,7 +1443,7 @@ pkg_solve_sat_to_jobs(struct pkg_solve_problem *problem)
 	struct pkg_solve_variable *var, *tvar;
 
 	HASH_ITER(hh, problem->variables_by_uid, var, tvar) {
-		pkg_debug(4, "solver: check variable with uid %s", var->uid);
+		pkg_dbg(SOLVER, 4, "solver: check variable with uid %s", var->uid);
 		pkg_solve_insert_res_job(var, problem);
 	}
 
@@ -1455,8 +1462,8 @@ pkg_solve_parse_sat_output(FILE *f, struct pkg_solve_problem *problem)
 	bool got_sat = false, done = false;
 
 	/* Order variables */
-	var = NULL;
-	while ((var = PKG_SOLVE_VAR_NEXT(problem->variables, var))) {
+	for (size_t i = 0; i < problem->nvars; i++) {
+		var = &problem->variables[i];
 		nord = calloc(1, sizeof(struct pkg_solve_ordered_variable));
 		nord->order = cur_ord ++;
 		nord->var = var;
@@ -89,7 +89,7 @@
 */
 
 #define DB_SCHEMA_MAJOR	0
-#define DB_SCHEMA_MINOR	33
+#define DB_SCHEMA_MINOR	36
 
 #define DBVERSION (DB_SCHEMA_MAJOR * 1000 + DB_SCHEMA_MINOR)
 
@@ -98,6 +98,13 @@ static int prstmt_initialize(struct pkgdb *db);
 /* static int run_prstmt(sql_prstmt_index s, ...); */
 static void prstmt_finalize(struct pkgdb *db);
 static int pkgdb_insert_scripts(struct pkg *pkg, int64_t package_id, sqlite3 *s);
+static int pkgdb_add_config_content(struct pkg_config_file *cf, sqlite3 *s,
+    char **sum);
+
+/* pristine config contents no config file refers to anymore */
+#define CONFIG_CONTENT_UNUSED "config_content WHERE id NOT IN "	\
+	"(SELECT content_id FROM config_files WHERE content_id IS NOT NULL)"
+
 
 
 extern int sqlite3_shell(int, char**);
@@ -274,6 +281,31 @@ pkgdb_vercmp(sqlite3_context *ctx, int argc, sqlite3_value **argv)
 	sqlite3_result_int(ctx, ret);
 }
 
+static void
+pkgdb_sha256(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+	const unsigned char	*in;
+	char			*sum;
+
+	if (argc != 1) {
+		sqlite3_result_error(ctx, "Invalid usage of sha256\n", -1);
+		return;
+	}
+
+	if ((in = sqlite3_value_text(argv[0])) == NULL) {
+		sqlite3_result_null(ctx);
+		return;
+	}
+
+	sum = pkg_checksum_data(in, sqlite3_value_bytes(argv[0]),
+	    PKG_HASH_TYPE_SHA256_HEX);
+	if (sum == NULL) {
+		sqlite3_result_error_nomem(ctx);
+		return;
+	}
+	sqlite3_result_text(ctx, sum, -1, free);
+}
+
 static int
 pkgdb_upgrade(struct pkgdb *db)
 {
@@ -466,7 +498,8 @@ pkgdb_init(sqlite3 *sdb)
 	");"
 	"CREATE TABLE directories ("
 		"id INTEGER PRIMARY KEY,"
-		"path TEXT NOT NULL UNIQUE"
+		"path TEXT NOT NULL UNIQUE,"
+		"refcount INTEGER NOT NULL DEFAULT 0"
 	");"
 	"CREATE TABLE pkg_directories ("
 		"package_id INTEGER REFERENCES packages(id) ON DELETE CASCADE"
@@ -577,9 +610,16 @@ pkgdb_init(sqlite3 *sdb)
 	    "  ON DELETE RESTRICT ON UPDATE RESTRICT,"
 	    "UNIQUE(package_id, provide_id)"
 	");"
+	/* pristine config files, shared by checksum */
+	"CREATE TABLE config_content ("
+		"id INTEGER PRIMARY KEY, "
+		"sum TEXT NOT NULL UNIQUE, "
+		"content TEXT NOT NULL"
+	");"
 	"CREATE TABLE config_files ("
 		"path TEXT NOT NULL UNIQUE, "
-		"content TEXT, "
+		"content_id INTEGER REFERENCES config_content(id)"
+			" ON DELETE RESTRICT ON UPDATE CASCADE, "
 		"package_id INTEGER REFERENCES packages(id) ON DELETE CASCADE"
 			" ON UPDATE CASCADE"
 	");"
@@ -607,6 +647,7 @@ pkgdb_init(sqlite3 *sdb)
 	"CREATE INDEX pkg_conflicts_pid ON pkg_conflicts(package_id);"
 	"CREATE INDEX pkg_conflicts_cid ON pkg_conflicts(conflict_id);"
 	"CREATE INDEX pkg_provides_id ON pkg_provides(package_id);"
+	"CREATE INDEX config_files_content_id ON config_files(content_id);"
 	"CREATE INDEX packages_origin ON packages(origin COLLATE NOCASE);"
 	"CREATE INDEX packages_name ON packages(name COLLATE NOCASE);"
 
@@ -714,6 +755,72 @@ pkgdb_init(sqlite3 *sdb)
 	    "  ON DELETE RESTRICT ON UPDATE RESTRICT,"
 	    "UNIQUE(package_id, require_id)"
 	");"
+	/*
+	 * Aggregates for pkgdb_stats(), kept current by triggers.
+	 * INSERT OR REPLACE does not fire delete triggers, so the replaced
+	 * row is removed from the counters before the insert.
+	 */
+	"CREATE TABLE pkg_stats ("
+		"packages INTEGER NOT NULL,"
+		"flatsize INTEGER NOT NULL,"
+		"locked INTEGER NOT NULL,"
+		"automatic INTEGER NOT NULL"
+	");"
+	"INSERT INTO pkg_stats VALUES(0, 0, 0, 0);"
+	"CREATE TRIGGER pkg_stats_replace "
+		"BEFORE INSERT ON packages "
+	"FOR EACH ROW BEGIN "
+		"UPDATE pkg_stats SET "
+		"packages = packages - "
+			"(SELECT COUNT(*) FROM packages WHERE name = new.name), "
+		"flatsize = flatsize - "
+			"(SELECT COALESCE(SUM(flatsize), 0) FROM packages "
+			"WHERE name = new.name), "
+		"locked = locked - "
+			"(SELECT COUNT(*) FROM packages "
+			"WHERE name = new.name AND locked != 0), "
+		"automatic = automatic - "
+			"(SELECT COUNT(*) FROM packages "
+			"WHERE name = new.name AND automatic != 0);"
+	"END;"
+	"CREATE TRIGGER pkg_stats_insert "
+		"AFTER INSERT ON packages "
+	"FOR EACH ROW BEGIN "
+		"UPDATE pkg_stats SET packages = packages + 1, "
+		"flatsize = flatsize + new.flatsize, "
+		"locked = locked + (new.locked != 0), "
+		"automatic = automatic + (new.automatic != 0);"
+	"END;"
+	"CREATE TRIGGER pkg_stats_delete "
+		"AFTER DELETE ON packages "
+	"FOR EACH ROW BEGIN "
+		"UPDATE pkg_stats SET packages = packages - 1, "
+		"flatsize = flatsize - old.flatsize, "
+		"locked = locked - (old.locked != 0), "
+		"automatic = automatic - (old.automatic != 0);"
+	"END;"
+	"CREATE TRIGGER pkg_stats_update "
+		"AFTER UPDATE OF flatsize, locked, automatic ON packages "
+	"FOR EACH ROW BEGIN "
+		"UPDATE pkg_stats SET "
+		"flatsize = flatsize - old.flatsize + new.flatsize, "
+		"locked = locked - (old.locked != 0) + (new.locked != 0), "
+		"automatic = automatic - (old.automatic != 0) "
+			"+ (new.automatic != 0);"
+	"END;"
+	/* Number of packages owning each directory */
+	"CREATE TRIGGER pkg_directories_insert "
+		"AFTER INSERT ON pkg_directories "
+	"FOR EACH ROW BEGIN "
+		"UPDATE directories SET refcount = refcount + 1 "
+		"WHERE id = new.directory_id;"
+	"END;"
+	"CREATE TRIGGER pkg_directories_delete "
+		"AFTER DELETE ON pkg_directories "
+	"FOR EACH ROW BEGIN "
+		"UPDATE directories SET refcount = refcount - 1 "
+		"WHERE id = old.directory_id;"
+	"END;"
 
 	"PRAGMA user_version = %d;"
 	"COMMIT;"
@@ -920,14 +1027,141 @@ pkgdb_access(unsigned mode, unsigned database)
 	return (retval);
 }
 
+/*
+ * In resident mode the database closed last stays open and is handed to the
+ * next pkgdb_open_all() on the same repositories, unless one of the files
+ * behind it was changed or replaced in between.
+ */
+static struct {
+	bool		 enabled;
+	struct pkgdb	*db;
+} resident;
+
+static void
+pkgdb_fingerprint_add(struct sbuf *sb, const struct stat *st)
+{
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+	sbuf_printf(sb, "%ju:%ju:%jd.%ld:%jd;", (uintmax_t)st->st_dev,
+	    (uintmax_t)st->st_ino, (intmax_t)st->st_mtim.tv_sec,
+	    (long)st->st_mtim.tv_nsec, (intmax_t)st->st_size);
+#else
+	sbuf_printf(sb, "%ju:%ju:%jd:%jd;", (uintmax_t)st->st_dev,
+	    (uintmax_t)st->st_ino, (intmax_t)st->st_mtime,
+	    (intmax_t)st->st_size);
+#endif
+}
+
+static char *
+pkgdb_fingerprint(struct pkgdb *db)
+{
+	struct _pkg_repo_list_item *cur;
+	struct stat st;
+	struct sbuf *sb;
+	const char *path;
+	char *ret = NULL;
+
+	path = sqlite3_db_filename(db->sqlite, "main");
+	if (path == NULL || stat(path, &st) == -1)
+		return (NULL);
+
+	sb = sbuf_new_auto();
+	pkgdb_fingerprint_add(sb, &st);
+	LL_FOREACH(db->repos, cur) {
+		if (cur->repo->ops->filestat == NULL ||
+		    cur->repo->ops->filestat(cur->repo, &st) != EPKG_OK)
+			goto out;
+		pkgdb_fingerprint_add(sb, &st);
+	}
+	sbuf_finish(sb);
+	ret = strdup(sbuf_data(sb));
+out:
+	sbuf_delete(sb);
+
+	return (ret);
+}
+
+static char *
+pkgdb_repokey(pkgdb_t type, const char *reponame)
+{
+	char *key;
+
+	if (type == PKGDB_DEFAULT ||
+	    (reponame == NULL && pkg_repos_activated_count() == 0))
+		return (strdup("-"));
+	if (reponame == NULL)
+		return (strdup("*"));
+	asprintf(&key, "=%s", reponame);
+
+	return (key);
+}
+
 static void
-pkgdb_profile_callback(void *ud __unused, const char *req, sqlite3_uint64 nsec)
+pkgdb_free(struct pkgdb *db)
 {
-	/* According to sqlite3 documentation, nsec has milliseconds accuracy */
-	nsec /= 1000000LLU;
-	if (nsec > 0)
-		pkg_debug(1, "Sqlite request %s was executed in %lu milliseconds",
-			req, (unsigned long)nsec);
+	struct _pkg_repo_list_item *cur, *tmp;
+
+	if (db->prstmt_initialized)
+		prstmt_finalize(db);
+
+	pkgdb_catalog_close(db);
+
+	if (db->sqlite != NULL) {
+
+		LL_FOREACH_SAFE(db->repos, cur, tmp) {
+			cur->repo->ops->close(cur->repo, false);
+			free(cur);
+		}
+
+		if (!sqlite3_db_readonly(db->sqlite, "main"))
+			pkg_plugins_hook_run(PKG_PLUGIN_HOOK_PKGDB_CLOSE_RW, NULL, db);
+
+		sqlite3_close(db->sqlite);
+	}
+
+	sqlite3_shutdown();
+	free(db->repokey);
+	free(db->fingerprint);
+	free(db);
+}
+
+/* Take the resident database if it is still what would be opened */
+static struct pkgdb *
+pkgdb_resident_take(pkgdb_t type, const char *reponame)
+{
+	struct pkgdb *db = resident.db;
+	char *key, *fingerprint;
+	bool reuse;
+
+	if (db == NULL)
+		return (NULL);
+	resident.db = NULL;
+
+	key = pkgdb_repokey(type, reponame);
+	fingerprint = pkgdb_fingerprint(db);
+	reuse = (key != NULL && fingerprint != NULL &&
+	    strcmp(key, db->repokey) == 0 &&
+	    strcmp(fingerprint, db->fingerprint) == 0);
+	free(key);
+	free(fingerprint);
+
+	if (!reuse) {
+		pkg_dbg(DB, 1, "pkgdb: resident database is stale, reopening");
+		pkgdb_free(db);
+		return (NULL);
+	}
+
+	return (db);
+}
+
+void
+pkgdb_set_resident(bool enabled)
+{
+
+	resident.enabled = enabled;
+	if (!enabled && resident.db != NULL) {
+		pkgdb_free(resident.db);
+		resident.db = NULL;
+	}
 }
 
 int
@@ -969,7 +1203,6 @@ pkgdb_open_all(struct pkgdb **db_p, pkgdb_t type, const char *reponame)
 {
 	struct pkgdb	*db = NULL;
 	bool		 reopen = false;
-	bool		 profile = false;
 	char		 localpath[MAXPATHLEN];
 	const char	*dbdir;
 	bool		 create = false;
@@ -979,7 +1212,9 @@ pkgdb_open_all(struct pkgdb **db_p, pkgdb_t type, const char *reponame)
 	if (*db_p != NULL) {
 		reopen = true;
 		db = *db_p;
-	}
+	} else if (resident.enabled &&
+	    (*db_p = pkgdb_resident_take(type, reponame)) != NULL)
+		return (EPKG_OK);
 
 	dbdir = pkg_object_string(pkg_config_get("PKG_DBDIR"));
 	if (!reopen && (db = calloc(1, sizeof(struct pkgdb))) == NULL) {
@@ -1078,6 +1313,7 @@ pkgdb_open_all(struct pkgdb **db_p, pkgdb_t type, const char *reponame)
 
 	if (type == PKGDB_REMOTE || type == PKGDB_MAYBE_REMOTE) {
 		if (reponame != NULL || pkg_repos_activated_count() > 0) {
+			pkgdb_catalog_close(db);
 			ret = pkgdb_open_repos(db, reponame);
 			if (ret != EPKG_OK) {
 				pkgdb_close(db);
@@ -1097,10 +1333,13 @@ pkgdb_open_all(struct pkgdb **db_p, pkgdb_t type, const char *reponame)
 	}
 
 
-	profile = pkg_object_bool(pkg_config_get("SQLITE_PROFILE"));
-	if (profile) {
-		pkg_debug(1, "pkgdb profiling is enabled");
-		sqlite3_profile(db->sqlite, pkgdb_profile_callback, NULL);
+	pkgdb_profile_attach(db->sqlite);
+
+	if (resident.enabled) {
+		free(db->repokey);
+		free(db->fingerprint);
+		db->repokey = pkgdb_repokey(type, reponame);
+		db->fingerprint = pkgdb_fingerprint(db);
 	}
 
 	*db_p = db;
@@ -1110,29 +1349,19 @@ pkgdb_open_all(struct pkgdb **db_p, pkgdb_t type, const char *reponame)
 void
 pkgdb_close(struct pkgdb *db)
 {
-	struct _pkg_repo_list_item *cur, *tmp;
 
 	if (db == NULL)
 		return;
 
-	if (db->prstmt_initialized)
-		prstmt_finalize(db);
-
-	if (db->sqlite != NULL) {
-
-		LL_FOREACH_SAFE(db->repos, cur, tmp) {
-			cur->repo->ops->close(cur->repo, false);
-			free(cur);
-		}
-
-		if (!sqlite3_db_readonly(db->sqlite, "main"))
-			pkg_plugins_hook_run(PKG_PLUGIN_HOOK_PKGDB_CLOSE_RW, NULL, db);
-
-		sqlite3_close(db->sqlite);
+	if (resident.enabled && db->repokey != NULL &&
+	    db->fingerprint != NULL && sqlite3_get_autocommit(db->sqlite)) {
+		if (resident.db != NULL)
+			pkgdb_free(resident.db);
+		resident.db = db;
+		return;
 	}
 
-	sqlite3_shutdown();
-	free(db);
+	pkgdb_free(db);
 }
 
 /* How many times to try COMMIT or ROLLBACK if the DB is busy */ 
@@ -1165,12 +1394,12 @@ run_transaction(sqlite3 *sqlite, const char *query, const char *savepoint)
 		return (EPKG_FATAL);
 	}
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 	ret = sqlite3_prepare_v2(sqlite, sql, strlen(sql) + 1, &stmt, NULL);
 
 	if (ret == SQLITE_OK) {
 		PKGDB_SQLITE_RETRY_ON_BUSY(ret)
-			ret = sqlite3_step(stmt);
+			ret = pkgdb_step(stmt);
 	}
 
 	sqlite3_finalize(stmt);
@@ -1287,6 +1516,7 @@ typedef enum _sql_prstmt_index {
 	PROVIDE,
 	FTS_APPEND,
 	UPDATE_DIGEST,
+	CONFIG_CONTENT,
 	CONFIG_FILES,
 	UPDATE_CONFIG_FILE,
 	PKG_REQUIRE,
@@ -1499,15 +1729,22 @@ static sql_prstmt sql_prepared_statements[PRSTMT_LAST] = {
 		"UPDATE packages SET manifestdigest=?1 WHERE id=?2;",
 		"TI"
 	},
+	[CONFIG_CONTENT] = {
+		NULL,
+		"INSERT OR IGNORE INTO config_content(sum, content) "
+		"VALUES (?1, ?2);",
+		"TT"
+	},
 	[CONFIG_FILES] = {
 		NULL,
-		"INSERT INTO config_files(path, content, package_id) "
-		"VALUES (?1, ?2, ?3);",
+		"INSERT INTO config_files(path, content_id, package_id) "
+		"VALUES (?1, (SELECT id FROM config_content WHERE sum = ?2), ?3);",
 		"TTI"
 	},
 	[UPDATE_CONFIG_FILE] = {
 		NULL,
-		"UPDATE config_files SET content=?1 WHERE path=?2;",
+		"UPDATE config_files SET content_id = "
+		"(SELECT id FROM config_content WHERE sum = ?1) WHERE path = ?2;",
 		"TT"
 	},
 	[PKG_REQUIRE] = {
@@ -1538,7 +1775,7 @@ prstmt_initialize(struct pkgdb *db)
 
 		for (i = 0; i < PRSTMT_LAST; i++)
 		{
-			pkg_debug(4, "Pkgdb: preparing statement '%s'", SQL(i));
+			pkg_dbg(DB, 4, "Pkgdb: preparing statement '%s'", SQL(i));
 			ret = sqlite3_prepare_v2(sqlite, SQL(i), -1, &STMT(i), NULL);
 			if (ret != SQLITE_OK) {
 				ERROR_SQLITE(sqlite, SQL(i));
@@ -1582,7 +1819,7 @@ run_prstmt(sql_prstmt_index s, ...)
 
 	va_end(ap);
 
-	retcode = sqlite3_step(stmt);
+	retcode = pkgdb_step(stmt);
 
 	return (retcode);
 }
@@ -1615,6 +1852,7 @@ pkgdb_register_pkg(struct pkgdb *db, struct pkg *pkg, int forced)
 	struct pkg_config_file	*cf = NULL;
 	struct pkgdb_it		*it = NULL;
 	char			*buf, *msg = NULL;
+	char			*sum;
 
 	sqlite3			*s;
 
@@ -1633,8 +1871,10 @@ pkgdb_register_pkg(struct pkgdb *db, struct pkg *pkg, int forced)
 
 	s = db->sqlite;
 
-	if (pkgdb_transaction_begin_sqlite(s, NULL) != EPKG_OK)
+	if (pkgdb_transaction_begin_sqlite(s,
+	    db->regnested ? "REGISTER" : NULL) != EPKG_OK)
 		return (EPKG_FATAL);
+	db->regopen = true;
 
 	/* Prefer new ABI over old one */
 	arch = pkg->abi != NULL ? pkg->abi : pkg->arch;
@@ -1753,8 +1993,11 @@ pkgdb_register_pkg(struct pkgdb *db, struct pkg *pkg, int forced)
 	 * Insert config files
 	 */
 	while (pkg_config_files(pkg, &cf) == EPKG_OK) {
-		if ((ret = run_prstmt(CONFIG_FILES, cf->path, cf->content, package_id)
-		    != SQLITE_DONE)) {
+		if (pkgdb_add_config_content(cf, s, &sum) != EPKG_OK)
+			goto cleanup;
+		ret = run_prstmt(CONFIG_FILES, cf->path, sum, package_id);
+		free(sum);
+		if (ret != SQLITE_DONE) {
 			if (ret == SQLITE_CONSTRAINT) {
 				pkg_emit_error("Another package already owns :%s",
 				    cf->path);
@@ -1950,20 +2193,57 @@ pkgdb_update_shlibs_required(struct pkg *pkg, int64_t package_id, sqlite3 *s)
 	return (EPKG_OK);
 }
 
+/*
+ * Store the pristine content of a config file once per checksum, sum is
+ * set to the key to reference it with, or NULL if there is no content.
+ */
+static int
+pkgdb_add_config_content(struct pkg_config_file *cf, sqlite3 *s, char **sum)
+{
+	*sum = NULL;
+	if (cf->content == NULL)
+		return (EPKG_OK);
+
+	*sum = pkg_checksum_data(cf->content, strlen(cf->content),
+	    PKG_HASH_TYPE_SHA256_HEX);
+	if (*sum == NULL) {
+		pkg_emit_error("Cannot checksum the content of %s", cf->path);
+		return (EPKG_FATAL);
+	}
+
+	if (run_prstmt(CONFIG_CONTENT, *sum, cf->content) != SQLITE_DONE) {
+		ERROR_SQLITE(s, SQL(CONFIG_CONTENT));
+		free(*sum);
+		*sum = NULL;
+		return (EPKG_FATAL);
+	}
+
+	return (EPKG_OK);
+}
+
 int
 pkgdb_update_config_file_content(struct pkg *p, sqlite3 *s)
 {
 	struct pkg_config_file	*cf = NULL;
+	char			*sum;
+	int			 ret;
 
 	while (pkg_config_files(p, &cf) == EPKG_OK) {
-		if (run_prstmt(UPDATE_CONFIG_FILE, cf->content, cf->path)
-		    != SQLITE_DONE) {
-			ERROR_SQLITE(s, SQL(SHLIBS_REQD));
+		if (pkgdb_add_config_content(cf, s, &sum) != EPKG_OK)
+			return (EPKG_FATAL);
+		ret = run_prstmt(UPDATE_CONFIG_FILE, sum, cf->path);
+		free(sum);
+		if (ret != SQLITE_DONE) {
+			ERROR_SQLITE(s, SQL(UPDATE_CONFIG_FILE));
 			return (EPKG_FATAL);
 		}
 	}
 
-	return (EPKG_OK);
+	/*
+	 * the version replaced may have left its pristine copies behind, even
+	 * when this one has no configuration file
+	 */
+	return (sql_exec(s, "DELETE FROM " CONFIG_CONTENT_UNUSED ";"));
 }
 
 int
@@ -2079,7 +2359,7 @@ pkgdb_reanalyse_shlibs(struct pkgdb *db, struct pkg *pkg)
 
 		for (i = 0; i < 2; i++) {
 			/* Clean out old shlibs first */
-			pkg_debug(4, "Pkgdb: running '%s'", sql[i]);
+			pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql[i]);
 			if (sqlite3_prepare_v2(db->sqlite, sql[i], -1,
 					       &stmt_del, NULL)
 			    != SQLITE_OK) {
@@ -2089,7 +2369,7 @@ pkgdb_reanalyse_shlibs(struct pkgdb *db, struct pkg *pkg)
 
 			sqlite3_bind_int64(stmt_del, 1, package_id);
 
-			ret = sqlite3_step(stmt_del);
+			ret = pkgdb_step(stmt_del);
 			sqlite3_finalize(stmt_del);
 
 			if (ret != SQLITE_DONE) {
@@ -2228,18 +2508,37 @@ pkgdb_delete_annotation(struct pkgdb *db, struct pkg *pkg, const char *tag)
 int
 pkgdb_register_finale(struct pkgdb *db, int retcode)
 {
-	int	ret = EPKG_OK;
+	const char	*savepoint;
+	int		 ret = EPKG_OK;
 
 	assert(db != NULL);
 
+	savepoint = db->regnested ? "REGISTER" : NULL;
+
+	/* Do not roll the whole batch back for an invalid package */
+	if (db->regnested && !db->regopen)
+		return (EPKG_OK);
+	db->regopen = false;
+
 	if (retcode == EPKG_OK) 
-		ret = pkgdb_transaction_commit_sqlite(db->sqlite, NULL);
-	else
-		ret = pkgdb_transaction_rollback_sqlite(db->sqlite, NULL);
+		ret = pkgdb_transaction_commit_sqlite(db->sqlite, savepoint);
+	else {
+		ret = pkgdb_transaction_rollback_sqlite(db->sqlite, savepoint);
+		/* ROLLBACK TO keeps the savepoint on the stack */
+		if (ret == EPKG_OK && savepoint != NULL)
+			ret = pkgdb_transaction_commit_sqlite(db->sqlite,
+			    savepoint);
+	}
 
 	return (ret);
 }
 
+void
+pkgdb_set_register_nested(struct pkgdb *db, bool nested)
+{
+	db->regnested = nested;
+}
+
 int
 pkgdb_register_ports(struct pkgdb *db, struct pkg *pkg)
 {
@@ -2265,8 +2564,7 @@ pkgdb_unregister_pkg(struct pkgdb *db, int64_t id)
 	const char	 sql[] = ""
 		"DELETE FROM packages WHERE id = ?1;";
 	const char	*deletions[] = {
-		"directories WHERE id NOT IN "
-			"(SELECT DISTINCT directory_id FROM pkg_directories)",
+		"directories WHERE refcount = 0",
 		"categories WHERE id NOT IN "
 			"(SELECT DISTINCT category_id FROM pkg_categories)",
 		"licenses WHERE id NOT IN "
@@ -2285,11 +2583,12 @@ pkgdb_unregister_pkg(struct pkgdb *db, int64_t id)
 			"(SELECT DISTINCT shlib_id FROM pkg_shlibs_provided)",
 		"script WHERE script_id NOT IN "
 		        "(SELECT DISTINCT script_id FROM pkg_script)",
+		CONFIG_CONTENT_UNUSED,
 	};
 
 	assert(db != NULL);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 	if (sqlite3_prepare_v2(db->sqlite, sql, -1, &stmt_del, NULL)
 	    != SQLITE_OK){
 		ERROR_SQLITE(db->sqlite, sql);
@@ -2298,7 +2597,7 @@ pkgdb_unregister_pkg(struct pkgdb *db, int64_t id)
 
 	sqlite3_bind_int64(stmt_del, 1, id);
 
-	ret = sqlite3_step(stmt_del);
+	ret = pkgdb_step(stmt_del);
 	sqlite3_finalize(stmt_del);
 
 	if (ret != SQLITE_DONE) {
@@ -2335,7 +2634,7 @@ sql_exec(sqlite3 *s, const char *sql, ...)
 		sql_to_exec = sql;
 	}
 
-	pkg_debug(4, "Pkgdb: executing '%s'", sql_to_exec);
+	pkg_dbg(DB, 4, "Pkgdb: executing '%s'", sql_to_exec);
 	if (sqlite3_exec(s, sql_to_exec, NULL, NULL, &errmsg) != SQLITE_OK) {
 		ERROR_SQLITE(s, sql_to_exec);
 		sqlite3_free(errmsg);
@@ -2359,7 +2658,7 @@ get_pragma(sqlite3 *s, const char *sql, int64_t *res, bool silence)
 
 	assert(s != NULL && sql != NULL);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 	if (sqlite3_prepare_v2(s, sql, -1, &stmt, NULL) != SQLITE_OK) {
 		if (!silence)
 			ERROR_SQLITE(s, sql);
@@ -2367,7 +2666,7 @@ get_pragma(sqlite3 *s, const char *sql, int64_t *res, bool silence)
 	}
 
 	PKGDB_SQLITE_RETRY_ON_BUSY(ret)
-		ret = sqlite3_step(stmt);
+		ret = pkgdb_step(stmt);
 
 	if (ret == SQLITE_ROW)
 		*res = sqlite3_column_int64(stmt, 0);
@@ -2391,13 +2690,13 @@ get_sql_string(sqlite3 *s, const char *sql, char **res)
 
 	assert(s != NULL && sql != NULL);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 	if (sqlite3_prepare_v2(s, sql, -1, &stmt, NULL) != SQLITE_OK) {
 		ERROR_SQLITE(s, sql);
 		return (EPKG_OK);
 	}
 
-	ret = sqlite3_step(stmt);
+	ret = pkgdb_step(stmt);
 
 	if (ret == SQLITE_ROW) {
 		const unsigned char *tmp;
@@ -2463,7 +2762,7 @@ pkgdb_integrity_conflict_local(struct pkgdb *db, const char *uniqueid)
 		"AND i.uid = ?1 AND "
 		"i.uid != p.name" ;
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql_conflicts);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql_conflicts);
 	ret = sqlite3_prepare_v2(db->sqlite, sql_conflicts, -1, &stmt, NULL);
 	if (ret != SQLITE_OK) {
 		ERROR_SQLITE(db->sqlite, sql_conflicts);
@@ -2511,7 +2810,7 @@ pkgdb_vset(struct pkgdb *db, int64_t id, va_list ap)
 	};
 
 	while ((attr = va_arg(ap, int)) > 0) {
-		pkg_debug(4, "Pkgdb: running '%s'", sql[attr]);
+		pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql[attr]);
 		if (sqlite3_prepare_v2(db->sqlite, sql[attr], -1, &stmt, NULL)
 		    != SQLITE_OK) {
 			ERROR_SQLITE(db->sqlite, sql[attr]);
@@ -2555,7 +2854,7 @@ pkgdb_vset(struct pkgdb *db, int64_t id, va_list ap)
 			break;
 		}
 
-		if (sqlite3_step(stmt) != SQLITE_DONE) {
+		if (pkgdb_step(stmt) != SQLITE_DONE) {
 			ERROR_SQLITE(db->sqlite, sql[attr]);
 			sqlite3_finalize(stmt);
 			return (EPKG_FATAL);
@@ -2590,7 +2889,7 @@ pkgdb_file_set_cksum(struct pkgdb *db, struct pkg_file *file,
 		"UPDATE files SET sha256 = ?1 WHERE path = ?2";
 	int		 ret;
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql_file_update);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql_file_update);
 	ret = sqlite3_prepare_v2(db->sqlite, sql_file_update, -1, &stmt, NULL);
 	if (ret != SQLITE_OK) {
 		ERROR_SQLITE(db->sqlite, sql_file_update);
@@ -2599,7 +2898,7 @@ pkgdb_file_set_cksum(struct pkgdb *db, struct pkg_file *file,
 	sqlite3_bind_text(stmt, 1, sum, -1, SQLITE_STATIC);
 	sqlite3_bind_text(stmt, 2, file->path, -1, SQLITE_STATIC);
 
-	if (sqlite3_step(stmt) != SQLITE_DONE) {
+	if (pkgdb_step(stmt) != SQLITE_DONE) {
 		ERROR_SQLITE(db->sqlite, sql_file_update);
 		sqlite3_finalize(stmt);
 		return (EPKG_FATAL);
@@ -2630,6 +2929,8 @@ pkgdb_sqlcmd_init(sqlite3 *db, __unused const char **err,
 	    pkgdb_split_version, NULL, NULL);
 	sqlite3_create_function(db, "vercmp", 3, SQLITE_ANY|SQLITE_DETERMINISTIC, NULL,
 	    pkgdb_vercmp, NULL, NULL);
+	sqlite3_create_function(db, "sha256", 1, SQLITE_ANY|SQLITE_DETERMINISTIC, NULL,
+	    pkgdb_sha256, NULL, NULL);
 
 	return SQLITE_OK;
 }
@@ -2670,7 +2971,7 @@ pkgdb_write_lock_pid(struct pkgdb *db)
 	}
 	sqlite3_bind_int64(stmt, 1, (int64_t)getpid());
 
-	if (sqlite3_step(stmt) != SQLITE_DONE) {
+	if (pkgdb_step(stmt) != SQLITE_DONE) {
 		ERROR_SQLITE(db->sqlite, lock_pid_sql);
 		sqlite3_finalize(stmt);
 		return (EPKG_FATAL);
@@ -2695,7 +2996,7 @@ pkgdb_remove_lock_pid(struct pkgdb *db, int64_t pid)
 	}
 	sqlite3_bind_int64(stmt, 1, pid);
 
-	if (sqlite3_step(stmt) != SQLITE_DONE) {
+	if (pkgdb_step(stmt) != SQLITE_DONE) {
 		ERROR_SQLITE(db->sqlite, lock_pid_sql);
 		sqlite3_finalize(stmt);
 		return (EPKG_FATAL);
@@ -2722,11 +3023,11 @@ pkgdb_check_lock_pid(struct pkgdb *db)
 
 	lpid = getpid();
 
-	while (sqlite3_step(stmt) != SQLITE_DONE) {
+	while (pkgdb_step(stmt) != SQLITE_DONE) {
 		pid = sqlite3_column_int64(stmt, 0);
 		if (pid != lpid) {
 			if (kill((pid_t)pid, 0) == -1) {
-				pkg_debug(1, "found stale pid %lld in lock database, my pid is: %lld",
+				pkg_dbg(DB, 1, "found stale pid %lld in lock database, my pid is: %lld",
 						(long long)pid, (long long)lpid);
 				if (pkgdb_remove_lock_pid(db, pid) != EPKG_OK){
 					sqlite3_finalize(stmt);
@@ -2787,7 +3088,7 @@ pkgdb_try_lock(struct pkgdb *db, const char *lock_sql, pkgdb_lock_t type,
 		ret = sqlite3_exec(db->sqlite, lock_sql, NULL, NULL, NULL);
 		if (ret != SQLITE_OK) {
 			if (ret == SQLITE_READONLY && type == PKGDB_LOCK_READONLY) {
-				pkg_debug(1, "want read lock but cannot write to database, "
+				pkg_dbg(DB, 1, "want read lock but cannot write to database, "
 						"slightly ignore this error for now");
 				return (EPKG_OK);
 			}
@@ -2798,7 +3099,7 @@ pkgdb_try_lock(struct pkgdb *db, const char *lock_sql, pkgdb_lock_t type,
 		if (sqlite3_changes(db->sqlite) == 0) {
 			if (pkgdb_check_lock_pid(db) == EPKG_END) {
 				/* No live processes found, so we can safely reset lock */
-				pkg_debug(1, "no concurrent processes found, cleanup the lock");
+				pkg_dbg(DB, 1, "no concurrent processes found, cleanup the lock");
 				pkgdb_reset_lock(db);
 
 				if (upgrade) {
@@ -2822,8 +3123,9 @@ pkgdb_try_lock(struct pkgdb *db, const char *lock_sql, pkgdb_lock_t type,
 			else if (num_timeout > 0) {
 				ts.tv_sec = (int)num_timeout;
 				ts.tv_nsec = (num_timeout - (int)num_timeout) * 1000000000.;
-				pkg_debug(1, "waiting for database lock for %d times, "
-						"next try in %.2f seconds", tries, num_timeout);
+				pkg_dbg(DB, 1, "waiting for database lock for %d times, "
+						"next try in %.2f seconds", tries,
+						(double)num_timeout);
 				(void)nanosleep(&ts, NULL);
 			}
 			else {
@@ -2864,14 +3166,14 @@ pkgdb_obtain_lock(struct pkgdb *db, pkgdb_lock_t type)
 		if (!ucl_object_toboolean(pkg_config_get("READ_LOCK")))
 				return (EPKG_OK);
 		lock_sql = readonly_lock_sql;
-		pkg_debug(1, "want to get a read only lock on a database");
+		pkg_dbg(DB, 1, "want to get a read only lock on a database");
 		break;
 	case PKGDB_LOCK_ADVISORY:
 		lock_sql = advisory_lock_sql;
-		pkg_debug(1, "want to get an advisory lock on a database");
+		pkg_dbg(DB, 1, "want to get an advisory lock on a database");
 		break;
 	case PKGDB_LOCK_EXCLUSIVE:
-		pkg_debug(1, "want to get an exclusive lock on a database");
+		pkg_dbg(DB, 1, "want to get an exclusive lock on a database");
 		lock_sql = exclusive_lock_sql;
 		break;
 	}
@@ -2891,7 +3193,7 @@ pkgdb_upgrade_lock(struct pkgdb *db, pkgdb_lock_t old_type, pkgdb_lock_t new_typ
 	assert(db != NULL);
 
 	if (old_type == PKGDB_LOCK_ADVISORY && new_type == PKGDB_LOCK_EXCLUSIVE) {
-		pkg_debug(1, "want to upgrade advisory to exclusive lock");
+		pkg_dbg(DB, 1, "want to upgrade advisory to exclusive lock");
 		ret = pkgdb_try_lock(db, advisory_exclusive_lock_sql,
 				new_type, true);
 	}
@@ -2912,7 +3214,7 @@ pkgdb_downgrade_lock(struct pkgdb *db, pkgdb_lock_t old_type,
 
 	if (old_type == PKGDB_LOCK_EXCLUSIVE &&
 	    new_type == PKGDB_LOCK_ADVISORY) {
-		pkg_debug(1, "want to downgrade exclusive to advisory lock");
+		pkg_dbg(DB, 1, "want to downgrade exclusive to advisory lock");
 		ret = pkgdb_try_lock(db, downgrade_exclusive_lock_sql,
 		    new_type, true);
 	}
@@ -2941,15 +3243,15 @@ pkgdb_release_lock(struct pkgdb *db, pkgdb_lock_t type)
 			return (EPKG_OK);
 
 		unlock_sql = readonly_unlock_sql;
-		pkg_debug(1, "release a read only lock on a database");
+		pkg_dbg(DB, 1, "release a read only lock on a database");
 
 		break;
 	case PKGDB_LOCK_ADVISORY:
 		unlock_sql = advisory_unlock_sql;
-		pkg_debug(1, "release an advisory lock on a database");
+		pkg_dbg(DB, 1, "release an advisory lock on a database");
 		break;
 	case PKGDB_LOCK_EXCLUSIVE:
-		pkg_debug(1, "release an exclusive lock on a database");
+		pkg_dbg(DB, 1, "release an exclusive lock on a database");
 		unlock_sql = exclusive_unlock_sql;
 		break;
 	}
@@ -2968,62 +3270,93 @@ int64_t
 pkgdb_stats(struct pkgdb *db, pkg_stats_t type)
 {
 	sqlite3_stmt	*stmt = NULL;
-	int64_t		 stats = 0;
-	struct sbuf	*sql = NULL;
+	int64_t		 stats = 0, val;
+	const char	*sql = NULL;
 	int		 ret;
 	struct _pkg_repo_list_item *rit;
 
 	assert(db != NULL);
 
-	sql = sbuf_new_auto();
-
 	switch(type) {
 	case PKG_STATS_LOCAL_COUNT:
-		sbuf_printf(sql, "SELECT COUNT(id) FROM main.packages;");
+		sql = "SELECT packages FROM main.pkg_stats;";
 		break;
 	case PKG_STATS_LOCAL_SIZE:
-		sbuf_printf(sql, "SELECT SUM(flatsize) FROM main.packages;");
+		sql = "SELECT flatsize FROM main.pkg_stats;";
+		break;
+	case PKG_STATS_LOCAL_LOCKED:
+		sql = "SELECT locked FROM main.pkg_stats;";
+		break;
+	case PKG_STATS_LOCAL_AUTOMATIC:
+		sql = "SELECT automatic FROM main.pkg_stats;";
 		break;
 	case PKG_STATS_REMOTE_UNIQUE:
 	case PKG_STATS_REMOTE_COUNT:
 	case PKG_STATS_REMOTE_SIZE:
+	case PKG_STATS_REMOTE_FLATSIZE:
 		LL_FOREACH(db->repos, rit) {
 			struct pkg_repo *repo = rit->repo;
 
 			if (repo->ops->stat != NULL)
 				stats += repo->ops->stat(repo, type);
 		}
-		goto remote;
-		break;
+		return (stats);
+	case PKG_STATS_REMOTE_UPDATED:
+		/* The most recently updated repository */
+		LL_FOREACH(db->repos, rit) {
+			struct pkg_repo *repo = rit->repo;
+
+			if (repo->ops->stat == NULL)
+				continue;
+			val = repo->ops->stat(repo, type);
+			if (val > stats)
+				stats = val;
+		}
+		return (stats);
 	case PKG_STATS_REMOTE_REPOS:
 		LL_FOREACH(db->repos, rit) {
 			stats ++;
 		}
-		goto remote;
-		break;
+		return (stats);
 	}
 
-	sbuf_finish(sql);
-	pkg_debug(4, "Pkgdb: running '%s'", sbuf_data(sql));
-	ret = sqlite3_prepare_v2(db->sqlite, sbuf_data(sql), -1, &stmt, NULL);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
+	ret = sqlite3_prepare_v2(db->sqlite, sql, -1, &stmt, NULL);
 	if (ret != SQLITE_OK) {
-		ERROR_SQLITE(db->sqlite, sbuf_data(sql));
-		sbuf_free(sql);
+		ERROR_SQLITE(db->sqlite, sql);
 		return (-1);
 	}
 
-	while (sqlite3_step(stmt) != SQLITE_DONE) {
+	if (pkgdb_step(stmt) == SQLITE_ROW)
 		stats = sqlite3_column_int64(stmt, 0);
-	}
 
 	sqlite3_finalize(stmt);
 
-remote:
-	sbuf_free(sql);
-
 	return (stats);
 }
 
+int64_t
+pkgdb_repo_stats(struct pkgdb *db, const char *reponame, pkg_stats_t type)
+{
+	struct _pkg_repo_list_item *rit;
+
+	assert(db != NULL);
+
+	LL_FOREACH(db->repos, rit) {
+		struct pkg_repo *repo = rit->repo;
+
+		if (strcmp(pkg_repo_name(repo), reponame) != 0)
+			continue;
+		if (type == PKG_STATS_REMOTE_REPOS)
+			return (1);
+		if (repo->ops->stat == NULL)
+			return (0);
+		return (repo->ops->stat(repo, type));
+	}
+
+	return (-1);
+}
+
 
 int
 pkgdb_begin_solver(struct pkgdb *db)
@@ -3106,33 +3439,44 @@ pkgdb_end_solver(struct pkgdb *db)
 	return (sql_exec(db->sqlite, solver_sql));
 }
 
+/*
+ * Sets refs[i] to the number of packages other than `p` owning the directory
+ * dirs[i], as counted by the triggers on pkg_directories.
+ */
 int
-pkgdb_is_dir_used(struct pkgdb *db, struct pkg *p, const char *dir, int64_t *res)
+pkgdb_dirs_refcount(struct pkgdb *db, struct pkg *p, char **dirs,
+    size_t ndirs, int64_t *refs)
 {
 	sqlite3_stmt *stmt;
-	int ret;
+	size_t i;
+	int ret = SQLITE_DONE;
 
 	const char sql[] = ""
-		"SELECT count(package_id) FROM pkg_directories, directories "
-		"WHERE directory_id = directories.id AND directories.path = ?1 "
-		"AND package_id != ?2;";
+		"SELECT refcount - EXISTS(SELECT 1 FROM pkg_directories "
+		"WHERE package_id = ?2 AND directory_id = directories.id) "
+		"FROM directories WHERE path = ?1;";
 
 	if (sqlite3_prepare_v2(db->sqlite, sql, -1, &stmt, NULL) != SQLITE_OK) {
 		ERROR_SQLITE(db->sqlite, sql);
 		return (EPKG_FATAL);
 	}
 
-	sqlite3_bind_text(stmt, 1, dir, -1, SQLITE_TRANSIENT);
 	sqlite3_bind_int64(stmt, 2, p->id);
-
-	ret = sqlite3_step(stmt);
-
-	if (ret == SQLITE_ROW)
-		*res = sqlite3_column_int64(stmt, 0);
+	for (i = 0; i < ndirs; i++) {
+		sqlite3_bind_text(stmt, 1, dirs[i], -1, SQLITE_STATIC);
+		ret = pkgdb_step(stmt);
+		if (ret == SQLITE_ROW)
+			refs[i] = sqlite3_column_int64(stmt, 0);
+		else if (ret == SQLITE_DONE)
+			refs[i] = 0;
+		else
+			break;
+		sqlite3_reset(stmt);
+	}
 
 	sqlite3_finalize(stmt);
 
-	if (ret != SQLITE_ROW) {
+	if (ret != SQLITE_ROW && ret != SQLITE_DONE) {
 		ERROR_SQLITE(db->sqlite, sql);
 		return (EPKG_FATAL);
 	}
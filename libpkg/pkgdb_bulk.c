@@ -0,0 +1,332 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "pkg_config.h"
+#endif
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sqlite3.h>
+#include <ucl.h>
+
+#include "pkg.h"
+#include "private/event.h"
+#include "private/pkg.h"
+#include "private/pkgdb.h"
+#include "private/utils.h"
+
+/*
+ * Bulk updates of the local database.
+ *
+ * The (package, attribute, value) tuples are first loaded into a temporary
+ * table, only the last tuple for a given package and attribute is kept, and
+ * each kind of attribute is then applied to all the packages at once.
+ */
+
+static const char *bulk_flags[] = {
+	"automatic",
+	"locked",
+	"vital",
+};
+
+#define BULK_ANNOTATION	"annotation:"
+
+static int
+bulk_insert(sqlite3_stmt *stmt, int line, const char *name,
+    const char *attr, const char *value)
+{
+	const char *tag = NULL;
+	unsigned int i;
+
+	if (name == NULL || *name == '\0') {
+		pkg_emit_error("line %d: no package name", line);
+		return (EPKG_FATAL);
+	}
+	if (attr == NULL) {
+		pkg_emit_error("line %d: no attribute", line);
+		return (EPKG_FATAL);
+	}
+
+	sqlite3_reset(stmt);
+	sqlite3_bind_int64(stmt, 1, line);
+	sqlite3_bind_text(stmt, 2, name, -1, SQLITE_STATIC);
+
+	if (strncmp(attr, BULK_ANNOTATION, strlen(BULK_ANNOTATION)) == 0) {
+		tag = attr + strlen(BULK_ANNOTATION);
+		if (*tag == '\0') {
+			pkg_emit_error("line %d: no annotation tag", line);
+			return (EPKG_FATAL);
+		}
+		sqlite3_bind_text(stmt, 3, "annotation", -1, SQLITE_STATIC);
+		sqlite3_bind_text(stmt, 4, tag, -1, SQLITE_STATIC);
+		/* No value deletes the annotation */
+		if (value != NULL && *value != '\0')
+			sqlite3_bind_text(stmt, 5, value, -1, SQLITE_STATIC);
+		else
+			sqlite3_bind_null(stmt, 5);
+	} else {
+		for (i = 0; i < NELEM(bulk_flags); i++) {
+			if (strcmp(attr, bulk_flags[i]) == 0)
+				break;
+		}
+		if (i == NELEM(bulk_flags)) {
+			pkg_emit_error("line %d: unknown attribute '%s'", line,
+			    attr);
+			return (EPKG_FATAL);
+		}
+		if (value == NULL || (strcmp(value, "0") != 0 &&
+		    strcmp(value, "1") != 0)) {
+			pkg_emit_error("line %d: %s expects 0 or 1", line,
+			    attr);
+			return (EPKG_FATAL);
+		}
+		sqlite3_bind_text(stmt, 3, bulk_flags[i], -1, SQLITE_STATIC);
+		sqlite3_bind_null(stmt, 4);
+		sqlite3_bind_int64(stmt, 5, value[0] - '0');
+	}
+
+	if (pkgdb_step(stmt) != SQLITE_DONE) {
+		ERROR_SQLITE(sqlite3_db_handle(stmt), sqlite3_sql(stmt));
+		return (EPKG_FATAL);
+	}
+
+	return (EPKG_OK);
+}
+
+/* {"package": "name", "attribute": "automatic", "value": 1} */
+static int
+bulk_parse_json(sqlite3_stmt *stmt, int line, const char *buf, size_t len)
+{
+	struct ucl_parser *parser;
+	ucl_object_t *obj;
+	const ucl_object_t *name, *attr, *value;
+	const char *val = NULL;
+	char num[32];
+	int ret;
+
+	parser = ucl_parser_new(0);
+	if (!ucl_parser_add_chunk(parser, (const unsigned char *)buf, len)) {
+		pkg_emit_error("line %d: %s", line,
+		    ucl_parser_get_error(parser));
+		ucl_parser_free(parser);
+		return (EPKG_FATAL);
+	}
+	obj = ucl_parser_get_object(parser);
+	ucl_parser_free(parser);
+
+	name = ucl_object_find_key(obj, "package");
+	attr = ucl_object_find_key(obj, "attribute");
+	value = ucl_object_find_key(obj, "value");
+
+	if (value != NULL) {
+		switch (ucl_object_type(value)) {
+		case UCL_BOOLEAN:
+			val = ucl_object_toboolean(value) ? "1" : "0";
+			break;
+		case UCL_INT:
+			snprintf(num, sizeof(num), "%jd",
+			    (intmax_t)ucl_object_toint(value));
+			val = num;
+			break;
+		case UCL_NULL:
+			break;
+		default:
+			val = ucl_object_tostring_forced(value);
+			break;
+		}
+	}
+
+	ret = bulk_insert(stmt, line,
+	    name != NULL ? ucl_object_tostring(name) : NULL,
+	    attr != NULL ? ucl_object_tostring(attr) : NULL, val);
+	ucl_object_unref(obj);
+
+	return (ret);
+}
+
+/* package<TAB>attribute<TAB>value */
+static int
+bulk_parse_tsv(sqlite3_stmt *stmt, int line, char *buf)
+{
+	char *name, *attr;
+
+	name = strsep(&buf, "\t");
+	attr = strsep(&buf, "\t");
+
+	return (bulk_insert(stmt, line, name, attr, buf));
+}
+
+static int
+bulk_load(sqlite3 *s, FILE *in, pkg_bulk_t format)
+{
+	sqlite3_stmt *stmt;
+	char *line = NULL;
+	size_t linecap = 0;
+	ssize_t linelen;
+	int ret = EPKG_OK, nline = 0;
+	const char sql[] = ""
+		"INSERT INTO temp.bulk_set(line, name, attr, tag, value) "
+		"VALUES (?1, ?2, ?3, ?4, ?5);";
+
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
+	if (sqlite3_prepare_v2(s, sql, -1, &stmt, NULL) != SQLITE_OK) {
+		ERROR_SQLITE(s, sql);
+		return (EPKG_FATAL);
+	}
+
+	while (ret == EPKG_OK && (linelen = getline(&line, &linecap, in)) > 0) {
+		nline++;
+		if (line[linelen - 1] == '\n')
+			line[--linelen] = '\0';
+		if (linelen == 0 || line[0] == '#')
+			continue;
+		if (format == PKG_BULK_JSON)
+			ret = bulk_parse_json(stmt, nline, line, linelen);
+		else
+			ret = bulk_parse_tsv(stmt, nline, line);
+	}
+
+	free(line);
+	sqlite3_finalize(stmt);
+
+	return (ret);
+}
+
+static int
+bulk_unmatched(sqlite3 *s)
+{
+	sqlite3_stmt *stmt;
+	int ret = EPKG_OK;
+	const char sql[] = ""
+		"SELECT DISTINCT name FROM temp.bulk_set "
+		"WHERE name NOT IN (SELECT name FROM main.packages) "
+		"ORDER BY name;";
+
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
+	if (sqlite3_prepare_v2(s, sql, -1, &stmt, NULL) != SQLITE_OK) {
+		ERROR_SQLITE(s, sql);
+		return (EPKG_FATAL);
+	}
+
+	while (pkgdb_step(stmt) == SQLITE_ROW) {
+		pkg_emit_error("%s: not installed",
+		    sqlite3_column_text(stmt, 0));
+		ret = EPKG_WARN;
+	}
+	sqlite3_finalize(stmt);
+
+	return (ret);
+}
+
+static int
+bulk_apply(sqlite3 *s)
+{
+	unsigned int i;
+
+	/* The last tuple wins */
+	if (sql_exec(s, "DELETE FROM temp.bulk_set WHERE line NOT IN "
+	    "(SELECT MAX(line) FROM temp.bulk_set "
+	    "GROUP BY name, attr, tag);") != EPKG_OK)
+		return (EPKG_FATAL);
+
+	for (i = 0; i < NELEM(bulk_flags); i++) {
+		if (sql_exec(s, "UPDATE main.packages SET %s = "
+		    "(SELECT value FROM temp.bulk_set b "
+		    "WHERE b.name = packages.name AND b.attr = '%s') "
+		    "WHERE name IN "
+		    "(SELECT name FROM temp.bulk_set WHERE attr = '%s');",
+		    bulk_flags[i], bulk_flags[i], bulk_flags[i]) != EPKG_OK)
+			return (EPKG_FATAL);
+	}
+
+	return (sql_exec(s, ""
+	    "INSERT OR IGNORE INTO main.annotation(annotation) "
+	    "SELECT tag FROM temp.bulk_set WHERE attr = 'annotation' "
+	    "AND value IS NOT NULL "
+	    "UNION SELECT value FROM temp.bulk_set WHERE attr = 'annotation' "
+	    "AND value IS NOT NULL;"
+	    "INSERT OR REPLACE INTO main.pkg_annotation"
+	    "(package_id, tag_id, value_id) "
+	    "SELECT p.id, t.annotation_id, v.annotation_id "
+	    "FROM temp.bulk_set b "
+	    "JOIN main.packages p ON p.name = b.name "
+	    "JOIN main.annotation t ON t.annotation = b.tag "
+	    "JOIN main.annotation v ON v.annotation = b.value "
+	    "WHERE b.attr = 'annotation';"
+	    "DELETE FROM main.pkg_annotation WHERE EXISTS "
+	    "(SELECT 1 FROM temp.bulk_set b "
+	    "JOIN main.packages p ON p.name = b.name "
+	    "JOIN main.annotation t ON t.annotation = b.tag "
+	    "WHERE b.attr = 'annotation' AND b.value IS NULL "
+	    "AND p.id = pkg_annotation.package_id "
+	    "AND t.annotation_id = pkg_annotation.tag_id);"
+	    "DELETE FROM main.annotation WHERE "
+	    "annotation_id NOT IN (SELECT tag_id FROM main.pkg_annotation) "
+	    "AND annotation_id NOT IN "
+	    "(SELECT value_id FROM main.pkg_annotation);"));
+}
+
+int
+pkgdb_set_bulk(struct pkgdb *db, FILE *in, pkg_bulk_t format)
+{
+	sqlite3 *s;
+	int ret, unmatched = EPKG_OK;
+
+	assert(db != NULL);
+	assert(in != NULL);
+
+	s = db->sqlite;
+
+	if (pkgdb_transaction_begin_sqlite(s, NULL) != EPKG_OK)
+		return (EPKG_FATAL);
+
+	ret = sql_exec(s, "CREATE TEMP TABLE bulk_set ("
+	    "line INTEGER PRIMARY KEY, name TEXT NOT NULL, "
+	    "attr TEXT NOT NULL, tag TEXT, value);");
+	if (ret == EPKG_OK)
+		ret = bulk_load(s, in, format);
+	if (ret == EPKG_OK && (unmatched = bulk_unmatched(s)) == EPKG_FATAL)
+		ret = EPKG_FATAL;
+	if (ret == EPKG_OK)
+		ret = bulk_apply(s);
+	if (ret == EPKG_OK)
+		ret = sql_exec(s, "DROP TABLE temp.bulk_set;");
+
+	if (ret != EPKG_OK) {
+		pkgdb_transaction_rollback_sqlite(s, NULL);
+		return (EPKG_FATAL);
+	}
+
+	if (pkgdb_transaction_commit_sqlite(s, NULL) != EPKG_OK)
+		return (EPKG_FATAL);
+
+	return (unmatched);
+}
@@ -0,0 +1,543 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "pkg_config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <sqlite3.h>
+
+#include "pkg.h"
+#include "private/event.h"
+#include "private/pkg.h"
+#include "private/pkgdb.h"
+#include "khash.h"
+
+/*
+ * Catalog of the remote repositories.
+ *
+ * When several repositories are opened, their databases are attached to a
+ * private in-memory connection as repo0, repo1, ... in the order the
+ * repositories have always been walked. A lookup across all the
+ * repositories is then a single statement: the lookup is expanded once per
+ * attached schema, each branch using the indexes of its own database, and
+ * the branches are chained with UNION ALL and sorted as a whole, see
+ * pkgdb_catalog_lookup().
+ *
+ * Preparing the expanded statement costs more than running it, so the
+ * statements are kept once their iterator is freed and reused by the next
+ * lookup with the same text. A statement is taken out of the cache while an
+ * iterator runs it, nested lookups prepare their own.
+ *
+ * The catalog is only used when every repository can be attached, otherwise
+ * the repositories are queried one by one.
+ */
+
+#define CATALOG_COLUMNS \
+	"p.id, p.origin, p.name, p.name AS uniqueid, p.version, p.comment, " \
+	"p.prefix, p.desc, p.arch, p.maintainer, p.www, " \
+	"p.licenselogic, p.flatsize, p.pkgsize, " \
+	"p.cksum, p.manifestdigest, p.path AS repopath"
+
+KHASH_MAP_INIT_STR(catalog_stmts, sqlite3_stmt *);
+
+struct pkgdb_catalog {
+	sqlite3 *sqlite;
+	kh_catalog_stmts_t *stmts;
+};
+
+struct pkgdb_catalog_it {
+	struct pkgdb *db;
+	struct pkgdb_it *it;
+	sqlite3_stmt *stmt;
+};
+
+static int pkgdb_catalog_it_next(struct pkg_repo_it *it, struct pkg **pkg_p,
+    unsigned flags);
+static void pkgdb_catalog_it_free(struct pkg_repo_it *it);
+static void pkgdb_catalog_it_reset(struct pkg_repo_it *it);
+
+static struct pkg_repo_it_ops pkgdb_catalog_it_ops = {
+	.next = pkgdb_catalog_it_next,
+	.free = pkgdb_catalog_it_free,
+	.reset = pkgdb_catalog_it_reset
+};
+
+/* Repositories are walked in the reverse order of db->repos */
+static struct pkg_repo *
+pkgdb_catalog_repo(struct pkgdb *db, int idx)
+{
+	struct _pkg_repo_list_item *cur;
+	int n;
+
+	n = pkgdb_repo_count(db);
+	LL_FOREACH(db->repos, cur) {
+		if (--n == idx)
+			return (cur->repo);
+	}
+
+	return (NULL);
+}
+
+static int
+pkgdb_catalog_open(struct pkgdb *db)
+{
+	struct pkg_repo *r;
+	sqlite3 *s;
+	char schema[32];
+	int i, n;
+
+	n = pkgdb_repo_count(db);
+	if (n < 2)
+		return (EPKG_FATAL);
+
+	for (i = 0; i < n; i++) {
+		if (pkgdb_catalog_repo(db, i)->ops->attach == NULL)
+			return (EPKG_FATAL);
+	}
+
+	if (sqlite3_open_v2(":memory:", &s,
+	    SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE, NULL) != SQLITE_OK) {
+		ERROR_SQLITE(s, "catalog open");
+		sqlite3_close(s);
+		return (EPKG_FATAL);
+	}
+
+	if (n > sqlite3_limit(s, SQLITE_LIMIT_ATTACHED, -1)) {
+		pkg_dbg(DB, 1, "Catalog: %d repositories, too many to be attached",
+		    n);
+		sqlite3_close(s);
+		return (EPKG_FATAL);
+	}
+
+	for (i = 0; i < n; i++) {
+		r = pkgdb_catalog_repo(db, i);
+		snprintf(schema, sizeof(schema), "repo%d", i);
+		if (r->ops->attach(r, s, schema) != EPKG_OK) {
+			sqlite3_close(s);
+			return (EPKG_FATAL);
+		}
+	}
+
+	if ((db->catalog = malloc(sizeof(*db->catalog))) == NULL) {
+		pkg_emit_errno("malloc", "pkgdb_catalog");
+		sqlite3_close(s);
+		return (EPKG_FATAL);
+	}
+	db->catalog->sqlite = s;
+	db->catalog->stmts = kh_init_catalog_stmts();
+
+	pkgdb_sqlcmd_init(s, NULL, NULL);
+	pkgdb_profile_attach(s);
+	pkg_dbg(DB, 1, "Catalog: %d repositories attached", n);
+
+	return (EPKG_OK);
+}
+
+static struct pkgdb_catalog *
+pkgdb_catalog(struct pkgdb *db, const char *repo)
+{
+
+	if (repo != NULL || db->catalog_failed)
+		return (NULL);
+
+	if (db->catalog == NULL && pkgdb_catalog_open(db) != EPKG_OK)
+		db->catalog_failed = true;
+
+	return (db->catalog);
+}
+
+void
+pkgdb_catalog_close(struct pkgdb *db)
+{
+
+	struct pkgdb_catalog *c = db->catalog;
+	sqlite3_stmt *stmt;
+	const char *sql;
+
+	if (c != NULL) {
+		kh_foreach(c->stmts, sql, stmt, {
+			sqlite3_finalize(stmt);
+			free((char *)sql);
+		});
+		kh_destroy_catalog_stmts(c->stmts);
+		sqlite3_close(c->sqlite);
+		free(c);
+		db->catalog = NULL;
+	}
+	db->catalog_failed = false;
+}
+
+static int
+pkgdb_catalog_it_next(struct pkg_repo_it *rit, struct pkg **pkg_p,
+    unsigned flags)
+{
+	struct pkgdb_catalog_it *cit = rit->data;
+	struct _pkg_repo_list_item *cur;
+	struct pkg *pkg;
+	int ret;
+
+	/* Everything but the row comes from the repository of the row */
+	ret = pkgdb_it_next(cit->it, pkg_p, 0);
+	if (ret != EPKG_OK)
+		return (ret);
+
+	pkg = *pkg_p;
+	LL_FOREACH(cit->db->repos, cur) {
+		if (strcmp(cur->repo->name, pkg->reponame) == 0)
+			break;
+	}
+	if (cur == NULL) {
+		pkg_emit_error("catalog: unknown repository %s", pkg->reponame);
+		return (EPKG_FATAL);
+	}
+
+	pkg->repo = cur->repo;
+	if (flags == 0)
+		return (EPKG_OK);
+
+	return (cur->repo->ops->ensure_loaded(cur->repo, pkg, flags));
+}
+
+static sqlite3_stmt *
+pkgdb_catalog_stmt_get(struct pkgdb_catalog *c, const char *sql)
+{
+	sqlite3_stmt *stmt;
+	khint_t k;
+	char *key;
+	int ret;
+
+	k = kh_get_catalog_stmts(c->stmts, sql);
+	if (k != kh_end(c->stmts) && kh_value(c->stmts, k) != NULL) {
+		stmt = kh_value(c->stmts, k);
+		kh_value(c->stmts, k) = NULL;
+		return (stmt);
+	}
+
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
+	if (sqlite3_prepare_v2(c->sqlite, sql, -1, &stmt, NULL) != SQLITE_OK) {
+		ERROR_SQLITE(c->sqlite, sql);
+		return (NULL);
+	}
+
+	if (k == kh_end(c->stmts) && (key = strdup(sql)) != NULL) {
+		k = kh_put_catalog_stmts(c->stmts, key, &ret);
+		kh_value(c->stmts, k) = NULL;
+	}
+
+	return (stmt);
+}
+
+static void
+pkgdb_catalog_stmt_release(struct pkgdb_catalog *c, sqlite3_stmt *stmt)
+{
+	khint_t k;
+
+	/* the catalog may have been reopened while the iterator was alive */
+	if (c != NULL && sqlite3_db_handle(stmt) == c->sqlite) {
+		k = kh_get_catalog_stmts(c->stmts, sqlite3_sql(stmt));
+		if (k != kh_end(c->stmts) && kh_value(c->stmts, k) == NULL) {
+			sqlite3_reset(stmt);
+			sqlite3_clear_bindings(stmt);
+			kh_value(c->stmts, k) = stmt;
+			return;
+		}
+	}
+
+	sqlite3_finalize(stmt);
+}
+
+static void
+pkgdb_catalog_it_free(struct pkg_repo_it *rit)
+{
+	struct pkgdb_catalog_it *cit = rit->data;
+
+	/* the statement goes back to the cache instead of being finalized */
+	cit->it->un.local.stmt = NULL;
+	pkgdb_it_free(cit->it);
+	pkgdb_catalog_stmt_release(cit->db->catalog, cit->stmt);
+	free(cit);
+	free(rit);
+}
+
+static void
+pkgdb_catalog_it_reset(struct pkg_repo_it *rit)
+{
+	struct pkgdb_catalog_it *cit = rit->data;
+
+	pkgdb_it_reset(cit->it);
+}
+
+static struct pkgdb_it *
+pkgdb_catalog_it_new(struct pkgdb *db, struct sbuf *sql, const char *arg)
+{
+	struct pkgdb fakedb;
+	struct pkgdb_it *it;
+	struct pkg_repo_it *rit;
+	struct pkgdb_catalog_it *cit;
+	sqlite3_stmt *stmt;
+
+	if ((stmt = pkgdb_catalog_stmt_get(db->catalog, sbuf_data(sql))) == NULL)
+		return (NULL);
+
+	if (arg != NULL)
+		sqlite3_bind_text(stmt, 1, arg, -1, SQLITE_TRANSIENT);
+
+	rit = malloc(sizeof(*rit));
+	cit = malloc(sizeof(*cit));
+	if (rit == NULL || cit == NULL) {
+		pkg_emit_errno("malloc", "pkgdb_catalog_it");
+		pkgdb_catalog_stmt_release(db->catalog, stmt);
+		free(rit);
+		free(cit);
+		return (NULL);
+	}
+
+	fakedb.sqlite = db->catalog->sqlite;
+	cit->db = db;
+	cit->stmt = stmt;
+	cit->it = pkgdb_it_new_sqlite(&fakedb, stmt, PKG_REMOTE,
+	    PKGDB_IT_FLAG_ONCE);
+	if (cit->it == NULL) {
+		free(rit);
+		free(cit);
+		return (NULL);
+	}
+
+	rit->ops = &pkgdb_catalog_it_ops;
+	rit->flags = PKGDB_IT_FLAG_ONCE;
+	rit->repo = NULL;
+	rit->data = cit;
+
+	if ((it = pkgdb_it_new_repo(db)) == NULL) {
+		pkgdb_catalog_it_free(rit);
+		return (NULL);
+	}
+	pkgdb_it_repo_attach(it, rit);
+
+	return (it);
+}
+
+/*
+ * Expand a lookup once per attached repository, %1$s being the schema in
+ * the from clause.  The where clause is appended as is, it is never taken
+ * for a format: a condition may hold a '%' of its own.  Every branch carries the name, the priority and the
+ * walk order of its repository, and the whole union is sorted by sqlite:
+ * repositories by decreasing priority, then in the order they have always
+ * been walked, then the packages by the given order.
+ *
+ * None of the lookups served here takes a limit, so no LIMIT clause is
+ * generated; it would go after the ORDER BY of the whole union.
+ */
+static struct pkgdb_it *
+pkgdb_catalog_lookup(struct pkgdb *db, const char *columns, const char *from,
+    const char *where, const char *order, bool url, const char *arg)
+{
+	struct pkgdb_it *it;
+	struct pkg_repo *r;
+	struct sbuf *sql;
+	char schema[32];
+	char *lit;
+	int i, n;
+
+	n = pkgdb_repo_count(db);
+	sql = sbuf_new_auto();
+	sbuf_cat(sql, "SELECT * FROM (");
+	for (i = 0; i < n; i++) {
+		r = pkgdb_catalog_repo(db, i);
+		snprintf(schema, sizeof(schema), "repo%d", i);
+		if (i > 0)
+			sbuf_cat(sql, " UNION ALL ");
+		lit = sqlite3_mprintf("%Q AS dbname, %u AS priority, "
+		    "%d AS repoorder", r->name, r->priority, i);
+		sbuf_printf(sql, "SELECT %s, %s", columns, lit);
+		sqlite3_free(lit);
+		if (url) {
+			lit = sqlite3_mprintf("%Q", r->url);
+			sbuf_printf(sql, ", %s AS repourl", lit);
+			sqlite3_free(lit);
+		}
+		sbuf_cat(sql, " ");
+		sbuf_printf(sql, from, schema);
+		if (where != NULL)
+			sbuf_cat(sql, where);
+	}
+	sbuf_cat(sql, ") ORDER BY priority DESC, repoorder");
+	if (order != NULL)
+		sbuf_printf(sql, ", %s", order);
+	sbuf_cat(sql, ";");
+	sbuf_finish(sql);
+
+	it = pkgdb_catalog_it_new(db, sql, arg);
+	sbuf_delete(sql);
+
+	return (it);
+}
+
+struct pkgdb_it *
+pkgdb_catalog_query(struct pkgdb *db, const char *pattern, match_t match,
+    const char *repo)
+{
+	if (pkgdb_catalog(db, repo) == NULL)
+		return (NULL);
+
+	if (match != MATCH_ALL && (pattern == NULL || pattern[0] == '\0'))
+		return (pkgdb_it_new_repo(db));
+
+	return (pkgdb_catalog_lookup(db, CATALOG_COLUMNS,
+	    "FROM %1$s.packages AS p", pkgdb_get_pattern_query(pattern, match),
+	    "name", false,
+	    match != MATCH_ALL && match != MATCH_CONDITION ? pattern : NULL));
+}
+
+struct pkgdb_it *
+pkgdb_catalog_shlib_provide(struct pkgdb *db, const char *require,
+    const char *repo)
+{
+
+	if (pkgdb_catalog(db, repo) == NULL)
+		return (NULL);
+
+	return (pkgdb_catalog_lookup(db, CATALOG_COLUMNS,
+	    "FROM %1$s.packages AS p INNER JOIN %1$s.pkg_shlibs_provided AS ps "
+	    "ON p.id = ps.package_id "
+	    "WHERE ps.shlib_id IN (SELECT id FROM %1$s.shlibs WHERE "
+	    "name BETWEEN ?1 AND ?1 || '.9')", NULL, NULL, false, require));
+}
+
+struct pkgdb_it *
+pkgdb_catalog_shlib_require(struct pkgdb *db, const char *provide,
+    const char *repo)
+{
+
+	if (pkgdb_catalog(db, repo) == NULL)
+		return (NULL);
+
+	return (pkgdb_catalog_lookup(db, CATALOG_COLUMNS,
+	    "FROM %1$s.packages AS p INNER JOIN %1$s.pkg_shlibs_required AS ps "
+	    "ON p.id = ps.package_id "
+	    "WHERE ps.shlib_id = (SELECT id FROM %1$s.shlibs WHERE name = ?1)",
+	    NULL, NULL, false, provide));
+}
+
+struct pkgdb_it *
+pkgdb_catalog_provide(struct pkgdb *db, const char *require, const char *repo)
+{
+
+	if (pkgdb_catalog(db, repo) == NULL)
+		return (NULL);
+
+	return (pkgdb_catalog_lookup(db, CATALOG_COLUMNS,
+	    "FROM %1$s.packages AS p INNER JOIN %1$s.pkg_provides AS ps "
+	    "ON p.id = ps.package_id "
+	    "WHERE ps.provide_id IN (SELECT id FROM %1$s.provides WHERE "
+	    "provide = ?1)", NULL, NULL, false, require));
+}
+
+struct pkgdb_it *
+pkgdb_catalog_require(struct pkgdb *db, const char *provide, const char *repo)
+{
+
+	if (pkgdb_catalog(db, repo) == NULL)
+		return (NULL);
+
+	return (pkgdb_catalog_lookup(db, CATALOG_COLUMNS,
+	    "FROM %1$s.packages AS p INNER JOIN %1$s.pkg_requires AS ps "
+	    "ON p.id = ps.package_id "
+	    "WHERE ps.require_id = (SELECT id FROM %1$s.requires WHERE "
+	    "require = ?1)", NULL, NULL, false, provide));
+}
+
+static const char *
+pkgdb_catalog_field(pkgdb_field field)
+{
+
+	switch (field) {
+	case FIELD_ORIGIN:
+		return ("origin");
+	case FIELD_NAME:
+		return ("name");
+	case FIELD_NAMEVER:
+		return ("name || '-' || version");
+	case FIELD_COMMENT:
+		return ("comment");
+	case FIELD_DESC:
+		return ("desc");
+	default:
+		return (NULL);
+	}
+}
+
+struct pkgdb_it *
+pkgdb_catalog_search(struct pkgdb *db, const char *pattern, match_t match,
+    pkgdb_field field, pkgdb_field sort, const char *repo)
+{
+	struct pkgdb_it *it;
+	struct sbuf *from;
+	const char *what, *how = NULL;
+
+	/* full text search goes through per repository indexes */
+	if (match == MATCH_FTS || pkgdb_catalog(db, repo) == NULL)
+		return (NULL);
+
+	if (pattern == NULL || pattern[0] == '\0')
+		return (pkgdb_it_new_repo(db));
+
+	switch (match) {
+	case MATCH_EXACT:
+		how = pkgdb_case_sensitive() ? "%s = ?1" : "%s = ?1 COLLATE NOCASE";
+		break;
+	case MATCH_GLOB:
+		how = "%s GLOB ?1";
+		break;
+	case MATCH_REGEX:
+		how = "%s REGEXP ?1";
+		break;
+	default:
+		break;
+	}
+
+	/* let the repositories deal with what the catalog cannot express */
+	if ((what = pkgdb_catalog_field(field)) == NULL || how == NULL)
+		return (NULL);
+
+	from = sbuf_new_auto();
+	sbuf_cat(from, "FROM %1$s.packages AS p WHERE ");
+	sbuf_printf(from, how, what);
+	sbuf_finish(from);
+
+	it = pkgdb_catalog_lookup(db, "id, origin, name, version, comment, "
+	    "prefix, desc, arch, maintainer, www, "
+	    "licenselogic, flatsize, pkgsize, "
+	    "cksum, path AS repopath", sbuf_data(from), NULL,
+	    pkgdb_catalog_field(sort), true, pattern);
+	sbuf_delete(from);
+
+	return (it);
+}
@@ -0,0 +1,228 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "pkg_config.h"
+#endif
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sqlite3.h>
+
+#include "pkg.h"
+#include "private/event.h"
+#include "private/pkg.h"
+#include "private/pkgdb.h"
+#include "private/utils.h"
+
+/*
+ * Bulk export of the local database.
+ *
+ * Each table is a single statement whose rows are written as they are
+ * stepped, so the memory used does not depend on the number of packages.
+ * The rows of a package are contiguous: the CROSS JOINs force sqlite to
+ * walk the packages in the order of their name index and to look their
+ * rows up by package_id, so only the rows of one package are sorted at a
+ * time instead of the whole table.
+ */
+
+static const char *export_sql[] = {
+	[PKG_EXPORT_PACKAGES] = ""
+		"SELECT name, origin, version, comment, desc, arch, maintainer, "
+		"www, prefix, flatsize, automatic, locked, vital, licenselogic, "
+		"time AS timestamp, manifestdigest AS digest "
+		"FROM packages ORDER BY name;",
+	[PKG_EXPORT_DEPS] = ""
+		"SELECT p.name AS package, d.name, d.origin, d.version "
+		"FROM packages AS p CROSS JOIN deps AS d ON d.package_id = p.id "
+		"ORDER BY p.name, d.name;",
+	[PKG_EXPORT_FILES] = ""
+		"SELECT p.name AS package, f.path, f.sha256 "
+		"FROM packages AS p CROSS JOIN files AS f ON f.package_id = p.id "
+		"ORDER BY p.name, f.path;",
+	[PKG_EXPORT_OPTIONS] = ""
+		"SELECT p.name AS package, o.option, po.value "
+		"FROM packages AS p CROSS JOIN pkg_option AS po "
+		"ON po.package_id = p.id "
+		"JOIN option AS o USING(option_id) "
+		"ORDER BY p.name, o.option;",
+	[PKG_EXPORT_ANNOTATIONS] = ""
+		"SELECT p.name AS package, t.annotation AS tag, "
+		"v.annotation AS value "
+		"FROM packages AS p CROSS JOIN pkg_annotation AS pa "
+		"ON pa.package_id = p.id "
+		"JOIN annotation AS t ON t.annotation_id = pa.tag_id "
+		"JOIN annotation AS v ON v.annotation_id = pa.value_id "
+		"ORDER BY p.name, t.annotation;",
+};
+
+static void
+export_json_string(FILE *out, const unsigned char *str)
+{
+	fputc('"', out);
+	for (; *str != '\0'; str++) {
+		switch (*str) {
+		case '"':
+		case '\\':
+			fputc('\\', out);
+			fputc(*str, out);
+			break;
+		case '\n':
+			fputs("\\n", out);
+			break;
+		case '\r':
+			fputs("\\r", out);
+			break;
+		case '\t':
+			fputs("\\t", out);
+			break;
+		default:
+			if (*str < 0x20)
+				fprintf(out, "\\u%04x", *str);
+			else
+				fputc(*str, out);
+			break;
+		}
+	}
+	fputc('"', out);
+}
+
+static void
+export_csv_string(FILE *out, const char *str)
+{
+	const char *c;
+
+	if (strpbrk(str, ",\"\r\n") == NULL) {
+		fputs(str, out);
+		return;
+	}
+
+	fputc('"', out);
+	for (c = str; *c != '\0'; c++) {
+		if (*c == '"')
+			fputc('"', out);
+		fputc(*c, out);
+	}
+	fputc('"', out);
+}
+
+static void
+export_ndjson_row(FILE *out, sqlite3_stmt *stmt, int ncols)
+{
+	int i;
+
+	fputc('{', out);
+	for (i = 0; i < ncols; i++) {
+		if (i > 0)
+			fputc(',', out);
+		export_json_string(out,
+		    (const unsigned char *)sqlite3_column_name(stmt, i));
+		fputc(':', out);
+		switch (sqlite3_column_type(stmt, i)) {
+		case SQLITE_NULL:
+			fputs("null", out);
+			break;
+		case SQLITE_INTEGER:
+			fprintf(out, "%jd",
+			    (intmax_t)sqlite3_column_int64(stmt, i));
+			break;
+		default:
+			export_json_string(out, sqlite3_column_text(stmt, i));
+			break;
+		}
+	}
+	fputs("}\n", out);
+}
+
+static void
+export_csv_row(FILE *out, sqlite3_stmt *stmt, int ncols)
+{
+	const char *val;
+	int i;
+
+	for (i = 0; i < ncols; i++) {
+		if (i > 0)
+			fputc(',', out);
+		val = (const char *)sqlite3_column_text(stmt, i);
+		if (val != NULL)
+			export_csv_string(out, val);
+	}
+	fputc('\n', out);
+}
+
+int
+pkgdb_export(struct pkgdb *db, pkg_export_table_t table,
+    pkg_export_format_t format, FILE *out)
+{
+	sqlite3_stmt *stmt;
+	const char *sql;
+	int i, ncols, ret;
+
+	assert(db != NULL);
+	assert(out != NULL);
+	assert(table < NELEM(export_sql));
+
+	sql = export_sql[table];
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
+	if (sqlite3_prepare_v2(db->sqlite, sql, -1, &stmt, NULL) != SQLITE_OK) {
+		ERROR_SQLITE(db->sqlite, sql);
+		return (EPKG_FATAL);
+	}
+
+	ncols = sqlite3_column_count(stmt);
+	if (format == PKG_EXPORT_CSV) {
+		for (i = 0; i < ncols; i++)
+			fprintf(out, "%s%s", i > 0 ? "," : "",
+			    sqlite3_column_name(stmt, i));
+		fputc('\n', out);
+	}
+
+	while ((ret = pkgdb_step(stmt)) == SQLITE_ROW) {
+		if (format == PKG_EXPORT_CSV)
+			export_csv_row(out, stmt, ncols);
+		else
+			export_ndjson_row(out, stmt, ncols);
+		if (ferror(out))
+			break;
+	}
+
+	if (ret != SQLITE_ROW && ret != SQLITE_DONE) {
+		ERROR_SQLITE(db->sqlite, sql);
+		sqlite3_finalize(stmt);
+		return (EPKG_FATAL);
+	}
+	sqlite3_finalize(stmt);
+
+	if (fflush(out) != 0 || ferror(out)) {
+		pkg_emit_errno("pkgdb_export", "write");
+		return (EPKG_FATAL);
+	}
+
+	return (EPKG_OK);
+}
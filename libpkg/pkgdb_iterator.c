@@ -79,6 +79,7 @@ static struct column_mapping {
 	{ "comment",	PKG_COMMENT, PKG_SQLITE_STRING },
 	{ "dbname",	PKG_REPONAME, PKG_SQLITE_STRING },
 	{ "dep_formula",	PKG_DEP_FORMULA, PKG_SQLITE_STRING },
+	{ "depth",	PKG_DEPTH, PKG_SQLITE_INT64 },
 	{ "desc",	PKG_DESC, PKG_SQLITE_STRING },
 	{ "flatsize",	PKG_FLATSIZE, PKG_SQLITE_INT64 },
 	{ "id",		PKG_ROWID, PKG_SQLITE_INT64 },
@@ -93,12 +94,15 @@ static struct column_mapping {
 	{ "origin",	PKG_ORIGIN, PKG_SQLITE_STRING },
 	{ "pkgsize",	PKG_PKGSIZE, PKG_SQLITE_INT64 },
 	{ "prefix",	PKG_PREFIX, PKG_SQLITE_STRING },
+	{ "priority",	-1, PKG_SQLITE_INT64 },
+	{ "repoorder",	-1, PKG_SQLITE_INT64 },
 	{ "repopath",	PKG_REPOPATH, PKG_SQLITE_STRING },
 	{ "repourl",	PKG_REPOURL, PKG_SQLITE_STRING },
 	{ "rowid",	PKG_ROWID, PKG_SQLITE_INT64 },
 	{ "time",	PKG_TIME, PKG_SQLITE_INT64 },
 	{ "uniqueid",	PKG_UNIQUEID, PKG_SQLITE_STRING },
 	{ "version",	PKG_VERSION, PKG_SQLITE_STRING },
+	{ "via",		PKG_VIA, PKG_SQLITE_STRING },
 	{ "vital",	PKG_VITAL, PKG_SQLITE_BOOL },
 	{ "weight",	-1, PKG_SQLITE_INT64 },
 	{ "www",	PKG_WWW, PKG_SQLITE_STRING },
@@ -135,7 +139,7 @@ load_val(sqlite3 *db, struct pkg *pkg, const char *sql, unsigned flags,
 	if (pkg->flags & flags)
 		return (EPKG_OK);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 	if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
 		ERROR_SQLITE(db, sql);
 		return (EPKG_FATAL);
@@ -143,7 +147,7 @@ load_val(sqlite3 *db, struct pkg *pkg, const char *sql, unsigned flags,
 
 	sqlite3_bind_int64(stmt, 1, pkg->id);
 
-	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+	while ((ret = pkgdb_step(stmt)) == SQLITE_ROW) {
 		pkg_adddata(pkg, sqlite3_column_text(stmt, 0));
 	}
 
@@ -173,7 +177,7 @@ load_tag_val(sqlite3 *db, struct pkg *pkg, const char *sql, unsigned flags,
 	if (pkg->flags & flags)
 		return (EPKG_OK);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 	if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
 		ERROR_SQLITE(db, sql);
 		return (EPKG_FATAL);
@@ -181,7 +185,7 @@ load_tag_val(sqlite3 *db, struct pkg *pkg, const char *sql, unsigned flags,
 
 	sqlite3_bind_int64(stmt, 1, pkg->id);
 
-	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+	while ((ret = pkgdb_step(stmt)) == SQLITE_ROW) {
 		pkg_addtagval(pkg, sqlite3_column_text(stmt, 0),
 			      sqlite3_column_text(stmt, 1));
 	}
@@ -240,7 +244,7 @@ pkgdb_load_deps(sqlite3 *sqlite, struct pkg *pkg)
 		return (EPKG_OK);
 
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 	ret = sqlite3_prepare_v2(sqlite, sql, -1, &stmt, NULL);
 
 	if (ret != SQLITE_OK) {
@@ -251,7 +255,7 @@ pkgdb_load_deps(sqlite3 *sqlite, struct pkg *pkg)
 	sqlite3_bind_int64(stmt, 1, pkg->id);
 
 	/* XXX: why we used locked here ? */
-	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+	while ((ret = pkgdb_step(stmt)) == SQLITE_ROW) {
 		pkg_adddep(pkg, sqlite3_column_text(stmt, 0),
 			   sqlite3_column_text(stmt, 1),
 			   sqlite3_column_text(stmt, 2),
@@ -266,7 +270,7 @@ pkgdb_load_deps(sqlite3 *sqlite, struct pkg *pkg)
 	}
 
 	if (pkg->dep_formula) {
-		pkg_debug(4, "Pkgdb: reading package formula '%s'", pkg->dep_formula);
+		pkg_dbg(DB, 4, "Pkgdb: reading package formula '%s'", pkg->dep_formula);
 
 		f = pkg_deps_parse_formula (pkg->dep_formula);
 
@@ -276,7 +280,7 @@ pkgdb_load_deps(sqlite3 *sqlite, struct pkg *pkg)
 
 				if (clause) {
 					asprintf(&formula_sql, "%s%s", formula_preamble, clause);
-					pkg_debug(4, "Pkgdb: running '%s'", sql);
+					pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 					ret = sqlite3_prepare_v2(sqlite, sql, -1, &stmt, NULL);
 
 					if (ret != SQLITE_OK) {
@@ -288,7 +292,7 @@ pkgdb_load_deps(sqlite3 *sqlite, struct pkg *pkg)
 					}
 
 					/* Fetch matching packages */
-					while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+					while ((ret = pkgdb_step(stmt)) == SQLITE_ROW) {
 						/*
 						 * Load options for a package and check
 						 * if they are compatible
@@ -296,7 +300,7 @@ pkgdb_load_deps(sqlite3 *sqlite, struct pkg *pkg)
 						options_match = true;
 
 						if (fit->options) {
-							pkg_debug(4, "Pkgdb: running '%s'", options_sql);
+							pkg_dbg(DB, 4, "Pkgdb: running '%s'", options_sql);
 							if (sqlite3_prepare_v2(sqlite, options_sql, -1,
 									&opt_stmt, NULL) != SQLITE_OK) {
 								ERROR_SQLITE(sqlite, options_sql);
@@ -306,7 +310,7 @@ pkgdb_load_deps(sqlite3 *sqlite, struct pkg *pkg)
 							sqlite3_bind_int64(opt_stmt, 1,
 									sqlite3_column_int64(stmt, 0));
 
-							while ((ret = sqlite3_step(opt_stmt))
+							while ((ret = pkgdb_step(opt_stmt))
 									== SQLITE_ROW) {
 								DL_FOREACH(fit->options, optit) {
 									if(strcmp(optit->opt,
@@ -318,7 +322,7 @@ pkgdb_load_deps(sqlite3 *sqlite, struct pkg *pkg)
 											|| (strcmp(
 												sqlite3_column_text(opt_stmt, 1),
 												"off") && optit->on)) {
-											pkg_debug(4, "incompatible option for"
+											pkg_dbg(DB, 4, "incompatible option for"
 													"%s: %s",
 													sqlite3_column_text(opt_stmt, 1),
 													optit->opt);
@@ -372,7 +376,7 @@ pkgdb_load_rdeps(sqlite3 *sqlite, struct pkg *pkg)
 		return (EPKG_OK);
 
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 	ret = sqlite3_prepare_v2(sqlite, sql, -1, &stmt, NULL);
 
 	if (ret != SQLITE_OK) {
@@ -383,7 +387,7 @@ pkgdb_load_rdeps(sqlite3 *sqlite, struct pkg *pkg)
 	sqlite3_bind_text(stmt, 1, pkg->uid, -1, SQLITE_STATIC);
 
 	/* XXX: why we used locked here ? */
-	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+	while ((ret = pkgdb_step(stmt)) == SQLITE_ROW) {
 		pkg_addrdep(pkg, sqlite3_column_text(stmt, 0),
 			    sqlite3_column_text(stmt, 1),
 			    sqlite3_column_text(stmt, 2),
@@ -412,7 +416,7 @@ pkgdb_load_files(sqlite3 *sqlite, struct pkg *pkg)
 		"  WHERE package_id = ?1"
 		"  ORDER BY PATH ASC";
 	const char	 sql2[] = ""
-		"SELECT path, content"
+		"SELECT path"
 		"  FROM config_files"
 		"  WHERE package_id = ?1"
 		"  ORDER BY PATH ASC";
@@ -423,7 +427,7 @@ pkgdb_load_files(sqlite3 *sqlite, struct pkg *pkg)
 	if (pkg->flags & PKG_LOAD_FILES)
 		return (EPKG_OK);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 	if (sqlite3_prepare_v2(sqlite, sql, -1, &stmt, NULL) != SQLITE_OK) {
 		ERROR_SQLITE(sqlite, sql);
 		return (EPKG_FATAL);
@@ -431,13 +435,13 @@ pkgdb_load_files(sqlite3 *sqlite, struct pkg *pkg)
 
 	sqlite3_bind_int64(stmt, 1, pkg->id);
 
-	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+	while ((ret = pkgdb_step(stmt)) == SQLITE_ROW) {
 		pkg_addfile(pkg, sqlite3_column_text(stmt, 0),
 		    sqlite3_column_text(stmt, 1), false);
 	}
 	sqlite3_finalize(stmt);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql2);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql2);
 	if (sqlite3_prepare_v2(sqlite, sql2, -1, &stmt, NULL) != SQLITE_OK) {
 		ERROR_SQLITE(sqlite, sql2);
 		return (EPKG_FATAL);
@@ -445,9 +449,8 @@ pkgdb_load_files(sqlite3 *sqlite, struct pkg *pkg)
 
 	sqlite3_bind_int64(stmt, 1, pkg->id);
 
-	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
-		pkg_addconfig_file(pkg, sqlite3_column_text(stmt, 0),
-		    sqlite3_column_text(stmt, 1));
+	while ((ret = pkgdb_step(stmt)) == SQLITE_ROW) {
+		pkg_addconfig_file(pkg, sqlite3_column_text(stmt, 0), NULL);
 	}
 
 	sqlite3_finalize(stmt);
@@ -461,6 +464,53 @@ pkgdb_load_files(sqlite3 *sqlite, struct pkg *pkg)
 	return (EPKG_OK);
 }
 
+/*
+ * The pristine content of the config files is only needed to merge them
+ * on upgrade, so PKG_LOAD_FILES only loads their paths and the content is
+ * fetched here, for the config files already loaded.
+ */
+int
+pkgdb_load_config_contents(sqlite3 *sqlite, struct pkg *pkg)
+{
+	sqlite3_stmt		*stmt = NULL;
+	struct pkg_config_file	*cf;
+	int			 ret;
+	const char		 sql[] = ""
+		"SELECT f.path, c.content"
+		"  FROM config_files AS f, config_content AS c"
+		"  WHERE f.package_id = ?1"
+		"    AND c.id = f.content_id";
+
+	assert(pkg != NULL);
+	assert(pkg->type == PKG_INSTALLED);
+
+	if (pkg_list_count(pkg, PKG_CONFIG_FILES) == 0)
+		return (EPKG_OK);
+
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
+	if (sqlite3_prepare_v2(sqlite, sql, -1, &stmt, NULL) != SQLITE_OK) {
+		ERROR_SQLITE(sqlite, sql);
+		return (EPKG_FATAL);
+	}
+
+	sqlite3_bind_int64(stmt, 1, pkg->id);
+
+	while ((ret = pkgdb_step(stmt)) == SQLITE_ROW) {
+		kh_find(pkg_config_files, pkg->config_files,
+		    sqlite3_column_text(stmt, 0), cf);
+		if (cf != NULL && cf->content == NULL)
+			cf->content = strdup(sqlite3_column_text(stmt, 1));
+	}
+
+	sqlite3_finalize(stmt);
+	if (ret != SQLITE_DONE) {
+		ERROR_SQLITE(sqlite, sql);
+		return (EPKG_FATAL);
+	}
+
+	return (EPKG_OK);
+}
+
 static int
 pkgdb_load_dirs(sqlite3 *sqlite, struct pkg *pkg)
 {
@@ -479,7 +529,7 @@ pkgdb_load_dirs(sqlite3 *sqlite, struct pkg *pkg)
 	if (pkg->flags & PKG_LOAD_DIRS)
 		return (EPKG_OK);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 	if (sqlite3_prepare_v2(sqlite, sql, -1, &stmt, NULL) != SQLITE_OK) {
 		ERROR_SQLITE(sqlite, sql);
 		return (EPKG_FATAL);
@@ -487,7 +537,7 @@ pkgdb_load_dirs(sqlite3 *sqlite, struct pkg *pkg)
 
 	sqlite3_bind_int64(stmt, 1, pkg->id);
 
-	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+	while ((ret = pkgdb_step(stmt)) == SQLITE_ROW) {
 		pkg_adddir(pkg, sqlite3_column_text(stmt, 0), false);
 	}
 
@@ -640,7 +690,7 @@ pkgdb_load_scripts(sqlite3 *sqlite, struct pkg *pkg)
 	if (pkg->flags & PKG_LOAD_SCRIPTS)
 		return (EPKG_OK);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 	if (sqlite3_prepare_v2(sqlite, sql, -1, &stmt, NULL) != SQLITE_OK) {
 		ERROR_SQLITE(sqlite, sql);
 		return (EPKG_FATAL);
@@ -648,7 +698,7 @@ pkgdb_load_scripts(sqlite3 *sqlite, struct pkg *pkg)
 
 	sqlite3_bind_int64(stmt, 1, pkg->id);
 
-	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+	while ((ret = pkgdb_step(stmt)) == SQLITE_ROW) {
 		pkg_addscript(pkg, sqlite3_column_text(stmt, 0),
 		    sqlite3_column_int64(stmt, 1));
 	}
@@ -717,7 +767,7 @@ pkgdb_load_options(sqlite3 *sqlite, struct pkg *pkg)
 		opt_sql       = optionsql[i].sql;
 		pkg_addtagval = optionsql[i].pkg_addtagval;
 
-		pkg_debug(4, "Pkgdb> adding option");
+		pkg_dbg(DB, 4, "Pkgdb> adding option");
 		ret = load_tag_val(sqlite, pkg, opt_sql, PKG_LOAD_OPTIONS,
 				   pkg_addtagval, PKG_OPTIONS);
 		if (ret != EPKG_OK)
@@ -805,13 +855,13 @@ populate_pkg(sqlite3_stmt *stmt, struct pkg *pkg) {
 				pkg->comment = strdup(sqlite3_column_text(stmt, icol));
 				break;
 			case PKG_REPONAME:
-				pkg->reponame = strdup(sqlite3_column_text(stmt, icol));
+				pkg->reponame = pkg_intern(sqlite3_column_text(stmt, icol));
 				break;
 			case PKG_DESC:
 				pkg->desc = strdup(sqlite3_column_text(stmt, icol));
 				break;
 			case PKG_MAINTAINER:
-				pkg->maintainer = strdup(sqlite3_column_text(stmt, icol));
+				pkg->maintainer = pkg_intern(sqlite3_column_text(stmt, icol));
 				break;
 			case PKG_DIGEST:
 				pkg->digest = strdup(sqlite3_column_text(stmt, icol));
@@ -833,16 +883,16 @@ populate_pkg(sqlite3_stmt *stmt, struct pkg *pkg) {
 				}
 				break;
 			case PKG_NAME:
-				pkg->name = strdup(sqlite3_column_text(stmt, icol));
+				pkg->name = pkg_intern(sqlite3_column_text(stmt, icol));
 				break;
 			case PKG_OLD_VERSION:
 				pkg->old_version = strdup(sqlite3_column_text(stmt, icol));
 				break;
 			case PKG_ORIGIN:
-				pkg->origin = strdup(sqlite3_column_text(stmt, icol));
+				pkg->origin = pkg_intern(sqlite3_column_text(stmt, icol));
 				break;
 			case PKG_PREFIX:
-				pkg->prefix = strdup(sqlite3_column_text(stmt, icol));
+				pkg->prefix = pkg_intern(sqlite3_column_text(stmt, icol));
 				break;
 			case PKG_REPOPATH:
 				pkg->repopath = strdup(sqlite3_column_text(stmt, icol));
@@ -851,17 +901,20 @@ populate_pkg(sqlite3_stmt *stmt, struct pkg *pkg) {
 				pkg->repourl = strdup(sqlite3_column_text(stmt, icol));
 				break;
 			case PKG_UNIQUEID:
-				pkg->uid = strdup(sqlite3_column_text(stmt, icol));
+				pkg->uid = pkg_intern(sqlite3_column_text(stmt, icol));
 				break;
 			case PKG_VERSION:
-				pkg->version = strdup(sqlite3_column_text(stmt, icol));
+				pkg->version = pkg_intern(sqlite3_column_text(stmt, icol));
 				break;
 			case PKG_WWW:
-				pkg->www = strdup(sqlite3_column_text(stmt, icol));
+				pkg->www = pkg_intern(sqlite3_column_text(stmt, icol));
 				break;
 			case PKG_DEP_FORMULA:
 				pkg->dep_formula = strdup(sqlite3_column_text(stmt, icol));
 				break;
+			case PKG_VIA:
+				pkg->via = pkg_intern(sqlite3_column_text(stmt, icol));
+				break;
 			default:
 				pkg_emit_error("Unexpected text value for %s", colname);
 				break;
@@ -874,6 +927,9 @@ populate_pkg(sqlite3_stmt *stmt, struct pkg *pkg) {
 				pkg_emit_error("Unknown column %s", colname);
 				continue;
 			}
+			/* only used to sort the rows */
+			if ((int)column->type == -1)
+				continue;
 
 			switch (column->type) {
 			case PKG_AUTOMATIC:
@@ -903,6 +959,9 @@ populate_pkg(sqlite3_stmt *stmt, struct pkg *pkg) {
 			case PKG_TIME:
 				pkg->timestamp = sqlite3_column_int64(stmt, icol);
 				break;
+			case PKG_DEPTH:
+				pkg->depth = sqlite3_column_int64(stmt, icol);
+				break;
 			default:
 				pkg_emit_error("Unexpected integer value for %s", colname);
 				break;
@@ -920,7 +979,7 @@ populate_pkg(sqlite3_stmt *stmt, struct pkg *pkg) {
 	}
 
 	pkg_arch_to_legacy(pkg->abi, legacyarch, BUFSIZ);
-	pkg->arch = strdup(legacyarch);
+	pkg->arch = pkg_intern(legacyarch);
 }
 
 static struct load_on_flag {
@@ -987,7 +1046,7 @@ pkgdb_sqlite_it_next(struct pkgdb_sqlite_it *it,
 	if (it->finished && (it->flags & PKGDB_IT_FLAG_ONCE))
 		return (EPKG_END);
 
-	switch (sqlite3_step(it->stmt)) {
+	switch (pkgdb_step(it->stmt)) {
 	case SQLITE_ROW:
 		pkg_free(*pkg_p);
 		ret = pkg_new(pkg_p, it->pkg_type);
@@ -1065,7 +1124,7 @@ pkgdb_it_next(struct pkgdb_it *it, struct pkg **pkg_p, unsigned flags)
 				return (pkgdb_it_next(it, pkg_p, flags));
 			}
 
-			if (*pkg_p != NULL)
+			if (*pkg_p != NULL && rit->repo != NULL)
 				(*pkg_p)->repo = rit->repo;
 
 			return (EPKG_OK);
@@ -1095,7 +1154,7 @@ pkgdb_it_count(struct pkgdb_it *it)
 	if (sit == NULL)
 		return (0);
 
-	while ((ret = sqlite3_step(sit->stmt))) {
+	while ((ret = pkgdb_step(sit->stmt))) {
 		switch (ret) {
 		case SQLITE_ROW:
 			++i;
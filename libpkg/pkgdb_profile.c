@@ -0,0 +1,300 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "pkg_config.h"
+#endif
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sqlite3.h>
+
+#include "pkg.h"
+#include "private/event.h"
+#include "private/pkg.h"
+#include "private/pkgdb.h"
+#include "private/utils.h"
+#include "khash.h"
+#include "kvec.h"
+
+/*
+ * Statement level aggregation of the sqlite profile callback.
+ *
+ * Statements are keyed by their normalized text: whitespace is collapsed
+ * and literals are replaced by '?', so that the same query built with
+ * sqlite3_mprintf() for different packages ends up in the same bucket.
+ * The report is emitted as a PKG_EVENT_SQL_PROFILE event by
+ * pkgdb_profile_report(), sorted by total time.
+ *
+ * The rows are counted by pkgdb_step() against the statement handle, and
+ * moved to the entry of the statement when its execution completes.
+ */
+
+struct sql_profile_entry {
+	struct pkg_sql_profile p;
+	sqlite3_stmt *last;
+	const char *last_sql;
+};
+
+KHASH_MAP_INIT_STR(sql_profile, struct sql_profile_entry *);
+KHASH_MAP_INIT_INT64(sql_profile_rows, int64_t);
+
+static kh_sql_profile_t *profile_by_sql = NULL;
+static kh_sql_profile_rows_t *profile_rows = NULL;
+static kvec_t(struct sql_profile_entry *) profile_entries;
+
+static void
+sql_normalize(struct sbuf *b, const char *sql)
+{
+	const char *p = sql;
+	char quote;
+	bool space = false;
+
+	sbuf_clear(b);
+	while (*p != '\0') {
+		if (isspace((unsigned char)*p)) {
+			space = true;
+			p++;
+			continue;
+		}
+		if (space && sbuf_len(b) > 0)
+			sbuf_putc(b, ' ');
+		space = false;
+
+		if (*p == '\'') {
+			/* string literal, '' is an escaped quote */
+			quote = *p++;
+			while (*p != '\0') {
+				if (*p == quote && p[1] == quote)
+					p += 2;
+				else if (*p++ == quote)
+					break;
+			}
+			sbuf_putc(b, '?');
+			continue;
+		}
+		if (*p == '?') {
+			/* keep numbered parameters as they are */
+			sbuf_putc(b, *p++);
+			while (isdigit((unsigned char)*p))
+				sbuf_putc(b, *p++);
+			continue;
+		}
+		if (isdigit((unsigned char)*p) || (*p == '-' &&
+		    isdigit((unsigned char)p[1]) && sbuf_len(b) > 0 &&
+		    strchr("=<>(, ", sbuf_data(b)[sbuf_len(b) - 1]) != NULL)) {
+			/* numeric literal */
+			p++;
+			while (isalnum((unsigned char)*p) || *p == '.')
+				p++;
+			sbuf_putc(b, '?');
+			continue;
+		}
+		if (isalpha((unsigned char)*p) || *p == '_') {
+			/* identifier or keyword, may contain digits */
+			while (isalnum((unsigned char)*p) || *p == '_' ||
+			    *p == '$')
+				sbuf_putc(b, *p++);
+			continue;
+		}
+		sbuf_putc(b, *p++);
+	}
+	sbuf_finish(b);
+}
+
+static sqlite3_stmt *
+sql_profile_find_stmt(sqlite3 *s, const char *req)
+{
+	sqlite3_stmt *stmt = NULL;
+
+	/*
+	 * The callback receives the text owned by the statement, the
+	 * statement itself is found back by comparing the pointers.
+	 */
+	while ((stmt = sqlite3_next_stmt(s, stmt)) != NULL) {
+		if (sqlite3_sql(stmt) == req)
+			return (stmt);
+	}
+
+	return (NULL);
+}
+
+static void
+pkgdb_profile_callback(void *ud, const char *req, sqlite3_uint64 nsec)
+{
+	sqlite3 *s = ud;
+	struct sql_profile_entry *e;
+	struct sbuf *b;
+	sqlite3_stmt *stmt;
+	khint_t k;
+	int ret;
+
+	/* According to sqlite3 documentation, nsec has milliseconds accuracy */
+	if (nsec / 1000000LLU > 0)
+		pkg_dbg(DB, 1, "Sqlite request %s was executed in %lu milliseconds",
+			req, (unsigned long)(nsec / 1000000LLU));
+
+	if (profile_by_sql == NULL)
+		profile_by_sql = kh_init_sql_profile();
+
+	b = sbuf_new_auto();
+	sql_normalize(b, req);
+
+	k = kh_get_sql_profile(profile_by_sql, sbuf_data(b));
+	if (k == kh_end(profile_by_sql)) {
+		e = calloc(1, sizeof(*e));
+		if (e == NULL) {
+			pkg_emit_errno("calloc", "sql_profile_entry");
+			sbuf_delete(b);
+			return;
+		}
+		e->p.sql = strdup(sbuf_data(b));
+		k = kh_put_sql_profile(profile_by_sql, e->p.sql, &ret);
+		kh_value(profile_by_sql, k) = e;
+		kv_push(struct sql_profile_entry *, profile_entries, e);
+	} else {
+		e = kh_value(profile_by_sql, k);
+	}
+	sbuf_delete(b);
+
+	e->p.calls++;
+	e->p.total += nsec;
+	if ((int64_t)nsec > e->p.max)
+		e->p.max = nsec;
+
+	stmt = sql_profile_find_stmt(s, req);
+	if (stmt == NULL)
+		return;
+	/*
+	 * The callback runs once at the end of each execution: taking the
+	 * rows and reading the counters with their reset flag gives this
+	 * execution alone, whether the handle is reused or was just prepared.
+	 */
+	k = kh_get_sql_profile_rows(profile_rows, (int64_t)(intptr_t)stmt);
+	if (k != kh_end(profile_rows)) {
+		e->p.rows += kh_value(profile_rows, k);
+		kh_del_sql_profile_rows(profile_rows, k);
+	}
+	e->p.fullscan_steps += sqlite3_stmt_status(stmt,
+	    SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+	/*
+	 * The bundled sqlite has no SQLITE_STMTSTATUS_REPREPARE: a statement
+	 * is counted as prepared again when its handle or the copy of its
+	 * text it owns differ from the previous execution.  Only a statement
+	 * finalized and prepared again with both at the same addresses is
+	 * mistaken for a reuse.
+	 */
+	if (stmt != e->last || req != e->last_sql) {
+		e->p.prepares++;
+		e->last = stmt;
+		e->last_sql = req;
+	}
+}
+
+void
+pkgdb_profile_attach(sqlite3 *s)
+{
+
+	if (!pkg_object_bool(pkg_config_get("SQLITE_PROFILE")))
+		return;
+
+	pkg_dbg(DB, 1, "pkgdb profiling is enabled");
+	if (profile_rows == NULL)
+		profile_rows = kh_init_sql_profile_rows();
+	sqlite3_profile(s, pkgdb_profile_callback, s);
+}
+
+/* sqlite3_step(), counting the rows of the profiled statements */
+int
+pkgdb_step(sqlite3_stmt *stmt)
+{
+	khint_t k;
+	int ret, absent;
+
+	ret = sqlite3_step(stmt);
+	if (ret != SQLITE_ROW || profile_rows == NULL)
+		return (ret);
+
+	k = kh_put_sql_profile_rows(profile_rows, (int64_t)(intptr_t)stmt,
+	    &absent);
+	if (absent)
+		kh_value(profile_rows, k) = 0;
+	kh_value(profile_rows, k)++;
+
+	return (ret);
+}
+
+static int
+sql_profile_cmp(const void *a, const void *b)
+{
+	const struct pkg_sql_profile *pa =
+	    &(*(struct sql_profile_entry * const *)a)->p;
+	const struct pkg_sql_profile *pb =
+	    &(*(struct sql_profile_entry * const *)b)->p;
+
+	if (pa->total != pb->total)
+		return (pa->total > pb->total ? -1 : 1);
+	if (pa->calls != pb->calls)
+		return (pa->calls > pb->calls ? -1 : 1);
+
+	return (strcmp(pa->sql, pb->sql));
+}
+
+void
+pkgdb_profile_report(void)
+{
+	struct pkg_sql_profile *report;
+	struct sql_profile_entry *e;
+	size_t i, n;
+
+	n = kv_size(profile_entries);
+	if (n == 0)
+		return;
+
+	qsort(profile_entries.a, n, sizeof(profile_entries.a[0]),
+	    sql_profile_cmp);
+	report = calloc(n, sizeof(*report));
+	if (report == NULL) {
+		pkg_emit_errno("calloc", "pkg_sql_profile");
+	} else {
+		for (i = 0; i < n; i++)
+			report[i] = kv_A(profile_entries, i)->p;
+		pkg_emit_sql_profile(report, n);
+		free(report);
+	}
+
+	for (i = 0; i < n; i++) {
+		e = kv_A(profile_entries, i);
+		free((char *)e->p.sql);
+		free(e);
+	}
+	kv_destroy(profile_entries);
+	kv_init(profile_entries);
+	kh_destroy_sql_profile(profile_by_sql);
+	profile_by_sql = NULL;
+}
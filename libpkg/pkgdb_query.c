@@ -159,7 +159,7 @@ pkgdb_query(struct pkgdb *db, const char *pattern, match_t match)
 			"FROM packages AS p%s "
 			"ORDER BY p.name;", comp);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 	if (sqlite3_prepare_v2(db->sqlite, sql, -1, &stmt, NULL) != SQLITE_OK) {
 		ERROR_SQLITE(db->sqlite, sql);
 		return (NULL);
@@ -171,6 +171,130 @@ pkgdb_query(struct pkgdb *db, const char *pattern, match_t match)
 	return (pkgdb_it_new_sqlite(db, stmt, PKG_INSTALLED, PKGDB_IT_FLAG_ONCE));
 }
 
+/*
+ * The closure is walked breadth first, one level at a time, into a
+ * temporary table keyed by package: INSERT OR IGNORE keeps the first depth
+ * a package is reached at, so every package is expanded once whatever the
+ * number of paths leading to it, and cycles end the walk.  Within a level
+ * the predecessors are visited by name, the lowest one is recorded as via
+ * to keep the output stable.
+ */
+sqlite3_stmt *
+pkgdb_deps_closure_stmt(sqlite3 *s, const char *columns, const char *pattern,
+    match_t match, bool reverse, int maxdepth)
+{
+	sqlite3_stmt	*stmt = NULL;
+	struct sbuf	*sql;
+	const char	*comp;
+	int		 depth, ret;
+
+	comp = pkgdb_get_pattern_query(pattern, match);
+	sql = sbuf_new_auto();
+
+	/* A new closure replaces the previous one of the connection */
+	if (sql_exec(s, "DROP TABLE IF EXISTS temp.closure;"
+	    "CREATE TEMPORARY TABLE closure ("
+		"id INTEGER PRIMARY KEY, "
+		"depth INTEGER NOT NULL, "
+		"via TEXT"
+	    ");") != EPKG_OK)
+		goto cleanup;
+
+	sbuf_printf(sql, "INSERT OR IGNORE INTO temp.closure "
+	    "SELECT id, 0, NULL FROM packages AS p%s;", comp);
+	sbuf_finish(sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sbuf_data(sql));
+	if (sqlite3_prepare_v2(s, sbuf_data(sql), -1, &stmt, NULL) !=
+	    SQLITE_OK) {
+		ERROR_SQLITE(s, sbuf_data(sql));
+		goto cleanup;
+	}
+	if (match != MATCH_ALL && match != MATCH_CONDITION)
+		sqlite3_bind_text(stmt, 1, pattern, -1, SQLITE_TRANSIENT);
+	ret = pkgdb_step(stmt);
+	sqlite3_finalize(stmt);
+	stmt = NULL;
+	if (ret != SQLITE_DONE) {
+		ERROR_SQLITE(s, sbuf_data(sql));
+		goto cleanup;
+	}
+
+	sbuf_clear(sql);
+	sbuf_printf(sql, "INSERT OR IGNORE INTO temp.closure "
+	    "SELECT n.id, ?1, u.name FROM temp.closure AS c "
+	    "JOIN packages AS u ON u.id = c.id %s "
+	    "WHERE c.depth = ?1 - 1 ORDER BY u.name;",
+	    reverse ?
+	    "JOIN deps AS d ON d.name = u.name "
+	    "JOIN packages AS n ON n.id = d.package_id" :
+	    "JOIN deps AS d ON d.package_id = u.id "
+	    "JOIN packages AS n ON n.name = d.name");
+	sbuf_finish(sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sbuf_data(sql));
+	if (sqlite3_prepare_v2(s, sbuf_data(sql), -1, &stmt, NULL) !=
+	    SQLITE_OK) {
+		ERROR_SQLITE(s, sbuf_data(sql));
+		goto cleanup;
+	}
+	for (depth = 1; maxdepth <= 0 || depth <= maxdepth; depth++) {
+		sqlite3_bind_int(stmt, 1, depth);
+		ret = pkgdb_step(stmt);
+		sqlite3_reset(stmt);
+		if (ret != SQLITE_DONE) {
+			ERROR_SQLITE(s, sbuf_data(sql));
+			sqlite3_finalize(stmt);
+			stmt = NULL;
+			goto cleanup;
+		}
+		/* No new package, the next levels would be empty as well */
+		if (sqlite3_changes(s) == 0)
+			break;
+	}
+	sqlite3_finalize(stmt);
+	stmt = NULL;
+
+	sbuf_clear(sql);
+	sbuf_printf(sql, "SELECT %s, c.depth AS depth, c.via AS via "
+	    "FROM temp.closure AS c JOIN packages AS p ON p.id = c.id "
+	    "WHERE c.depth > 0 ORDER BY c.depth, p.name;", columns);
+	sbuf_finish(sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sbuf_data(sql));
+	if (sqlite3_prepare_v2(s, sbuf_data(sql), -1, &stmt, NULL) !=
+	    SQLITE_OK) {
+		ERROR_SQLITE(s, sbuf_data(sql));
+		stmt = NULL;
+	}
+
+cleanup:
+	sbuf_delete(sql);
+
+	return (stmt);
+}
+
+struct pkgdb_it *
+pkgdb_query_deps_closure(struct pkgdb *db, const char *pattern, match_t match,
+    bool reverse, int maxdepth)
+{
+	sqlite3_stmt	*stmt;
+
+	assert(db != NULL);
+
+	if (match != MATCH_ALL && (pattern == NULL || pattern[0] == '\0'))
+		return (NULL);
+
+	stmt = pkgdb_deps_closure_stmt(db->sqlite,
+	    "p.id, p.origin, p.name, p.name as uniqueid, "
+	    "p.version, p.comment, p.desc, "
+	    "p.message, p.arch, p.maintainer, p.www, "
+	    "p.prefix, p.flatsize, p.licenselogic, p.automatic, "
+	    "p.locked, p.time, p.manifestdigest, p.vital",
+	    pattern, match, reverse, maxdepth);
+	if (stmt == NULL)
+		return (NULL);
+
+	return (pkgdb_it_new_sqlite(db, stmt, PKG_INSTALLED, PKGDB_IT_FLAG_ONCE));
+}
+
 struct pkgdb_it *
 pkgdb_query_which(struct pkgdb *db, const char *path, bool glob)
 {
@@ -191,7 +315,7 @@ pkgdb_query_which(struct pkgdb *db, const char *path, bool glob)
 			"LEFT JOIN files AS f ON p.id = f.package_id "
 			"WHERE f.path %s ?1 GROUP BY p.id;", glob ? "GLOB" : "=");
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 	if (sqlite3_prepare_v2(db->sqlite, sql, -1, &stmt, NULL) != SQLITE_OK) {
 		ERROR_SQLITE(db->sqlite, sql);
 		return (NULL);
@@ -218,7 +342,7 @@ pkgdb_query_shlib_require(struct pkgdb *db, const char *shlib)
 
 	assert(db != NULL);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 	if (sqlite3_prepare_v2(db->sqlite, sql, -1, &stmt, NULL) != SQLITE_OK) {
 		ERROR_SQLITE(db->sqlite, sql);
 		return (NULL);
@@ -245,7 +369,7 @@ pkgdb_query_shlib_provide(struct pkgdb *db, const char *shlib)
 
 	assert(db != NULL);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 	if (sqlite3_prepare_v2(db->sqlite, sql, -1, &stmt, NULL) != SQLITE_OK) {
 		ERROR_SQLITE(db->sqlite, sql);
 		return (NULL);
@@ -272,7 +396,7 @@ pkgdb_query_require(struct pkgdb *db, const char *req)
 
 	assert(db != NULL);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 	if (sqlite3_prepare_v2(db->sqlite, sql, -1, &stmt, NULL) != SQLITE_OK) {
 		ERROR_SQLITE(db->sqlite, sql);
 		return (NULL);
@@ -299,7 +423,7 @@ pkgdb_query_provide(struct pkgdb *db, const char *req)
 
 	assert(db != NULL);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sql);
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sql);
 	if (sqlite3_prepare_v2(db->sqlite, sql, -1, &stmt, NULL) != SQLITE_OK) {
 		ERROR_SQLITE(db->sqlite, sql);
 		return (NULL);
@@ -318,6 +442,9 @@ pkgdb_repo_query(struct pkgdb *db, const char *pattern, match_t match,
 	struct pkg_repo_it *rit;
 	struct _pkg_repo_list_item *cur;
 
+	if ((it = pkgdb_catalog_query(db, pattern, match, repo)) != NULL)
+		return (it);
+
 	it = pkgdb_it_new_repo(db);
 	if (it == NULL)
 		return (NULL);
@@ -333,6 +460,32 @@ pkgdb_repo_query(struct pkgdb *db, const char *pattern, match_t match,
 	return (it);
 }
 
+struct pkgdb_it *
+pkgdb_repo_query_deps_closure(struct pkgdb *db, const char *pattern,
+    match_t match, bool reverse, int maxdepth, const char *repo)
+{
+	struct pkgdb_it *it;
+	struct pkg_repo_it *rit;
+	struct _pkg_repo_list_item *cur;
+
+	it = pkgdb_it_new_repo(db);
+	if (it == NULL)
+		return (NULL);
+
+	LL_FOREACH(db->repos, cur) {
+		if (repo == NULL || strcasecmp(cur->repo->name, repo) == 0) {
+			if (cur->repo->ops->deps_closure != NULL) {
+				rit = cur->repo->ops->deps_closure(cur->repo,
+				    pattern, match, reverse, maxdepth);
+				if (rit != NULL)
+					pkgdb_it_repo_attach(it, rit);
+			}
+		}
+	}
+
+	return (it);
+}
+
 struct pkgdb_it *
 pkgdb_repo_shlib_require(struct pkgdb *db, const char *require, const char *repo)
 {
@@ -340,6 +493,9 @@ pkgdb_repo_shlib_require(struct pkgdb *db, const char *require, const char *repo
 	struct pkg_repo_it *rit;
 	struct _pkg_repo_list_item *cur;
 
+	if ((it = pkgdb_catalog_shlib_require(db, require, repo)) != NULL)
+		return (it);
+
 	it = pkgdb_it_new_repo(db);
 	if (it == NULL)
 		return (NULL);
@@ -364,6 +520,9 @@ pkgdb_repo_shlib_provide(struct pkgdb *db, const char *require, const char *repo
 	struct pkg_repo_it *rit;
 	struct _pkg_repo_list_item *cur;
 
+	if ((it = pkgdb_catalog_shlib_provide(db, require, repo)) != NULL)
+		return (it);
+
 	it = pkgdb_it_new_repo(db);
 	if (it == NULL)
 		return (NULL);
@@ -388,6 +547,9 @@ pkgdb_repo_require(struct pkgdb *db, const char *require, const char *repo)
 	struct pkg_repo_it *rit;
 	struct _pkg_repo_list_item *cur;
 
+	if ((it = pkgdb_catalog_require(db, require, repo)) != NULL)
+		return (it);
+
 	it = pkgdb_it_new_repo(db);
 	if (it == NULL)
 		return (NULL);
@@ -412,6 +574,9 @@ pkgdb_repo_provide(struct pkgdb *db, const char *require, const char *repo)
 	struct pkg_repo_it *rit;
 	struct _pkg_repo_list_item *cur;
 
+	if ((it = pkgdb_catalog_provide(db, require, repo)) != NULL)
+		return (it);
+
 	it = pkgdb_it_new_repo(db);
 	if (it == NULL)
 		return (NULL);
@@ -436,6 +601,10 @@ pkgdb_repo_search(struct pkgdb *db, const char *pattern, match_t match,
 	struct pkg_repo_it *rit;
 	struct _pkg_repo_list_item *cur;
 
+	if ((it = pkgdb_catalog_search(db, pattern, match, field, sort,
+	    repo)) != NULL)
+		return (it);
+
 	it = pkgdb_it_new_repo(db);
 	if (it == NULL)
 		return (NULL);
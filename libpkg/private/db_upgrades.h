@@ -674,6 +674,100 @@ static struct db_upgrades {
 	{33,
 	"ALTER TABLE packages ADD COLUMN vital INTEGER NOT NULL DEFAULT 0;"
 	},
+	{34,
+	"CREATE TABLE pkg_stats ("
+		"packages INTEGER NOT NULL,"
+		"flatsize INTEGER NOT NULL,"
+		"locked INTEGER NOT NULL,"
+		"automatic INTEGER NOT NULL"
+	");"
+	"INSERT INTO pkg_stats SELECT COUNT(*), COALESCE(SUM(flatsize), 0), "
+		"COUNT(NULLIF(locked, 0)), COUNT(NULLIF(automatic, 0)) "
+		"FROM packages;"
+	"CREATE TRIGGER pkg_stats_replace "
+		"BEFORE INSERT ON packages "
+	"FOR EACH ROW BEGIN "
+		"UPDATE pkg_stats SET "
+		"packages = packages - "
+			"(SELECT COUNT(*) FROM packages WHERE name = new.name), "
+		"flatsize = flatsize - "
+			"(SELECT COALESCE(SUM(flatsize), 0) FROM packages "
+			"WHERE name = new.name), "
+		"locked = locked - "
+			"(SELECT COUNT(*) FROM packages "
+			"WHERE name = new.name AND locked != 0), "
+		"automatic = automatic - "
+			"(SELECT COUNT(*) FROM packages "
+			"WHERE name = new.name AND automatic != 0);"
+	"END;"
+	"CREATE TRIGGER pkg_stats_insert "
+		"AFTER INSERT ON packages "
+	"FOR EACH ROW BEGIN "
+		"UPDATE pkg_stats SET packages = packages + 1, "
+		"flatsize = flatsize + new.flatsize, "
+		"locked = locked + (new.locked != 0), "
+		"automatic = automatic + (new.automatic != 0);"
+	"END;"
+	"CREATE TRIGGER pkg_stats_delete "
+		"AFTER DELETE ON packages "
+	"FOR EACH ROW BEGIN "
+		"UPDATE pkg_stats SET packages = packages - 1, "
+		"flatsize = flatsize - old.flatsize, "
+		"locked = locked - (old.locked != 0), "
+		"automatic = automatic - (old.automatic != 0);"
+	"END;"
+	"CREATE TRIGGER pkg_stats_update "
+		"AFTER UPDATE OF flatsize, locked, automatic ON packages "
+	"FOR EACH ROW BEGIN "
+		"UPDATE pkg_stats SET "
+		"flatsize = flatsize - old.flatsize + new.flatsize, "
+		"locked = locked - (old.locked != 0) + (new.locked != 0), "
+		"automatic = automatic - (old.automatic != 0) "
+			"+ (new.automatic != 0);"
+	"END;"
+	},
+	{35,
+	"ALTER TABLE directories ADD COLUMN refcount INTEGER NOT NULL DEFAULT 0;"
+	"UPDATE directories SET refcount = "
+		"(SELECT COUNT(*) FROM pkg_directories "
+		"WHERE directory_id = directories.id);"
+	"CREATE TRIGGER pkg_directories_insert "
+		"AFTER INSERT ON pkg_directories "
+	"FOR EACH ROW BEGIN "
+		"UPDATE directories SET refcount = refcount + 1 "
+		"WHERE id = new.directory_id;"
+	"END;"
+	"CREATE TRIGGER pkg_directories_delete "
+		"AFTER DELETE ON pkg_directories "
+	"FOR EACH ROW BEGIN "
+		"UPDATE directories SET refcount = refcount - 1 "
+		"WHERE id = old.directory_id;"
+	"END;"
+	},
+	{36,
+	"CREATE TABLE config_content ("
+		"id INTEGER PRIMARY KEY, "
+		"sum TEXT NOT NULL UNIQUE, "
+		"content TEXT NOT NULL"
+	");"
+	"INSERT OR IGNORE INTO config_content(sum, content) "
+		"SELECT sha256(content), content FROM config_files "
+		"WHERE content IS NOT NULL;"
+	"ALTER TABLE config_files RENAME TO config_files_old;"
+	"CREATE TABLE config_files ("
+		"path TEXT NOT NULL UNIQUE, "
+		"content_id INTEGER REFERENCES config_content(id)"
+			" ON DELETE RESTRICT ON UPDATE CASCADE, "
+		"package_id INTEGER REFERENCES packages(id) ON DELETE CASCADE"
+			" ON UPDATE CASCADE"
+	");"
+	"INSERT INTO config_files(path, content_id, package_id) "
+		"SELECT path, (SELECT id FROM config_content "
+			"WHERE sum = sha256(content)), package_id "
+		"FROM config_files_old;"
+	"DROP TABLE config_files_old;"
+	"CREATE INDEX config_files_content_id ON config_files(content_id);"
+	},
 	/* Mark the end of the array */
 	{ -1, NULL }
 
@@ -30,6 +30,54 @@
 #ifndef _PKG_EVENT
 #define _PKG_EVENT
 
+/*
+ * Debug messages.
+ *
+ * The level and the category are tested at the call site, so a disabled
+ * message costs a couple of comparisons: its arguments are not evaluated
+ * and nothing is formatted.  Messages of a level above PKG_DBG_MAX_LEVEL
+ * are removed at compile time.  pkg_dbg() only accepts the categories
+ * below, by their short name, and constant levels from 1 to 4.
+ */
+#ifndef PKG_DBG_MAX_LEVEL
+#define PKG_DBG_MAX_LEVEL	4
+#endif
+
+typedef enum {
+	PKG_DBG_FETCH = (1U << 0),
+	PKG_DBG_CONFIG = (1U << 1),
+	PKG_DBG_DB = (1U << 2),
+	PKG_DBG_UNIVERSE = (1U << 3),
+	PKG_DBG_CONFLICTS = (1U << 4),
+	PKG_DBG_SOLVER = (1U << 5),
+	PKG_DBG_JOBS = (1U << 6),
+	PKG_DBG_ADD = (1U << 7),
+	PKG_DBG_DELETE = (1U << 8),
+	PKG_DBG_SCRIPTS = (1U << 9),
+	PKG_DBG_ALL = (1U << 10) - 1,
+} pkg_dbg_t;
+
+extern int64_t debug_level;
+extern uint64_t debug_flags;
+
+#define pkg_dbg_enabled(cat, level)					\
+	((level) <= PKG_DBG_MAX_LEVEL && debug_level >= (level) &&	\
+	 (debug_flags & PKG_DBG_##cat) != 0)
+
+#define pkg_dbg(cat, level, ...) do {					\
+	(void)sizeof(struct {						\
+	    int level_1_to_4 : ((level) >= 1 && (level) <= 4) ? 1 : -1;	\
+	});								\
+	if (pkg_dbg_enabled(cat, level))				\
+		pkg_dbg_emit(PKG_DBG_##cat, (level), __VA_ARGS__);	\
+} while (0)
+
+/* Messages without a category */
+#define pkg_debug(level, ...) do {					\
+	if ((level) <= PKG_DBG_MAX_LEVEL && debug_level >= (level))	\
+		(pkg_debug)((level), __VA_ARGS__);			\
+} while (0)
+
 void pkg_emit_error(const char *fmt, ...);
 void pkg_emit_notice(const char *fmt, ...);
 void pkg_emit_errno(const char *func, const char *arg);
@@ -60,13 +108,18 @@ void pkg_emit_package_not_found(const char *);
 void pkg_emit_incremental_update(const char *reponame, int processed);
 void pkg_emit_backup(void);
 void pkg_emit_restore(void);
-void pkg_debug(int level, const char *fmt, ...);
+void (pkg_debug)(int level, const char *fmt, ...);
+void pkg_dbg_emit(pkg_dbg_t cat, int level, const char *fmt, ...)
+    __attribute__((__format__(__printf__, 3, 4)));
 int pkg_emit_sandbox_call(pkg_sandbox_cb call, int fd, void *ud);
 int pkg_emit_sandbox_get_string(pkg_sandbox_cb call, void *ud, char **str, int64_t *len);
 
 bool pkg_emit_query_yesno(bool deft, const char *msg);
 int pkg_emit_query_select(const char *msg, const char **items, int ncnt, int deft);
 
+void pkg_event_async_start(int64_t size);
+void pkg_event_async_stop(void);
+
 void pkg_emit_progress_start(const char *fmt, ...);
 void pkg_emit_progress_tick(int64_t current, int64_t total);
 
@@ -81,5 +134,7 @@ void pkg_emit_message(const char *msg);
 void pkg_emit_file_missing(struct pkg *p, struct pkg_file *f);
 void pkg_register_cleanup_callback(void (*cleanup_cb)(void *data), void *data);
 void pkg_unregister_cleanup_callback(void (*cleanup_cb)(void *data), void *data);
+void pkg_emit_sql_profile(const struct pkg_sql_profile *stmts, int count);
+void pkg_emit_memory_stats(const struct pkg_mem_stat *stats, int count);
 
 #endif
@@ -38,6 +38,7 @@
 #include <sys/types.h>
 
 #include <archive.h>
+#include <signal.h>
 #include <sqlite3.h>
 #include <stdbool.h>
 #include <uthash.h>
@@ -182,6 +183,13 @@
 		code;									\
 	}
 
+#define kh_each_key(h, kvar, code)							\
+	for (khint_t __i = kh_begin(h); h != NULL && __i != kh_end(h); __i++) {		\
+		if (!kh_exist(h, __i)) continue;					\
+		(kvar) = kh_key(h, __i);						\
+		code;									\
+	}
+
 #define kh_count(h) ((h)?((h)->size):0)
 
 #define kh_safe_add(name, h, val, k) do {		\
@@ -219,6 +227,7 @@
 
 extern int eventpipe;
 extern int64_t debug_level;
+extern uint64_t debug_flags;
 extern bool developer_mode;
 extern const char *pkg_rootdir;
 extern int rootfd;
@@ -240,24 +249,25 @@ struct pkg {
 	bool		 vital;
 	int64_t		 id;
 	struct sbuf	*scripts[PKG_NUM_SCRIPTS];
-	char			*name;
-	char			*origin;
-	char			*version;
+	/* const char * fields are interned atoms, see pkg_intern() */
+	const char		*name;
+	const char		*origin;
+	const char		*version;
 	char			*old_version;
-	char			*maintainer;
-	char			*www;
-	char			*arch;
+	const char		*maintainer;
+	const char		*www;
+	const char		*arch;
 	char			*abi;
-	char			*uid;
+	const char		*uid;
 	char			*digest;
 	char			*old_digest;
 	struct pkg_message	*message;
-	char			*prefix;
+	const char		*prefix;
 	char			*comment;
 	char			*desc;
 	char			*sum;
 	char			*repopath;
-	char			*reponame;
+	const char		*reponame;
 	char			*repourl;
 	char			*reason;
 	char			*dep_formula;
@@ -266,6 +276,8 @@ struct pkg {
 	int64_t			 flatsize;
 	int64_t			 old_flatsize;
 	int64_t			 timestamp;
+	int64_t			 depth;
+	const char		*via;
 	kh_pkg_deps_t		*deps;
 	kh_pkg_deps_t		*rdeps;
 	kh_strings_t		*categories;
@@ -287,18 +299,20 @@ struct pkg {
 	unsigned			flags;
 	int		rootfd;
 	char		rootpath[MAXPATHLEN];
+	int		archivefd;
 	char		**dir_to_del;
 	size_t		dir_to_del_cap;
 	size_t		dir_to_del_len;
+	kh_strings_t	*dir_to_del_seen;
 	pkg_t		 type;
 	struct pkg_repo		*repo;
 };
 
 struct pkg_dep {
-	char		*origin;
-	char		*name;
-	char		*version;
-	char		*uid;
+	const char	*origin;
+	const char	*name;
+	const char	*version;
+	const char	*uid;
 	bool		 locked;
 };
 
@@ -473,11 +487,18 @@ struct pkg_repo_ops {
 					const char *);
 	struct pkg_repo_it * (*search)(struct pkg_repo *, const char *, match_t,
 					pkgdb_field field, pkgdb_field sort);
+	struct pkg_repo_it * (*deps_closure)(struct pkg_repo *, const char *,
+					match_t, bool reverse, int maxdepth);
 
 	int64_t (*stat)(struct pkg_repo *, pkg_stats_t type);
 
 	int (*ensure_loaded)(struct pkg_repo *repo, struct pkg *pkg, unsigned flags);
 
+	/* Attach the repo database to a shared connection, see pkgdb_catalog */
+	int (*attach)(struct pkg_repo *, sqlite3 *, const char *);
+	/* Stat the repo database, see pkgdb_set_resident() */
+	int (*filestat)(struct pkg_repo *, struct stat *);
+
 	/* Fetch package from repo */
 	int (*get_cached_name)(struct pkg_repo *, struct pkg *,
 					char *dest, size_t destlen);
@@ -679,6 +700,9 @@ int packing_init(struct packing **pack, const char *path, pkg_formats format,
 int packing_append_file_attr(struct packing *pack, const char *filepath,
      const char *newpath, const char *uname, const char *gname, mode_t perm,
      u_long fflags);
+int packing_append_hardlink(struct packing *pack, const char *filepath,
+     const char *newpath, const char *hardlink, const char *uname,
+     const char *gname, mode_t perm, u_long fflags);
 int packing_append_buffer(struct packing *pack, const char *buffer,
 			  const char *path, int size);
 int packing_append_tree(struct packing *pack, const char *treepath,
@@ -687,6 +711,19 @@ void packing_finish(struct packing *pack);
 pkg_formats packing_format_from_string(const char *str);
 const char* packing_format_to_string(pkg_formats format);
 
+struct pkg_archive_index;
+
+struct pkg_archive_index *pkg_archive_index_new(int fd);
+int pkg_archive_index_write(struct pkg_archive_index *idx, const void *buf,
+    size_t len);
+int pkg_archive_index_member(struct pkg_archive_index *idx, const char *path);
+int pkg_archive_index_finish(struct pkg_archive_index *idx);
+int pkg_archive_index_load(int fd, struct pkg_archive_index **idx);
+bool pkg_archive_index_has(struct pkg_archive_index *idx, const char *path);
+int pkg_archive_index_open(struct pkg_archive_index *idx, int fd,
+    const char *path, bool own, struct archive **a, struct archive_entry **ae);
+void pkg_archive_index_free(struct pkg_archive_index *idx);
+
 int pkg_delete_files(struct pkg *pkg, unsigned force);
 int pkg_delete_dirs(struct pkgdb *db, struct pkg *pkg, struct pkg *p);
 
@@ -703,7 +740,8 @@ int pkgdb_update_requires(struct pkg *pkg, int64_t package_id, sqlite3 *s);
 int pkgdb_insert_annotations(struct pkg *pkg, int64_t package_id, sqlite3 *s);
 int pkgdb_register_finale(struct pkgdb *db, int retcode);
 int pkgdb_set_pkg_digest(struct pkgdb *db, struct pkg *pkg);
-int pkgdb_is_dir_used(struct pkgdb *db, struct pkg *p, const char *dir, int64_t *res);
+int pkgdb_dirs_refcount(struct pkgdb *db, struct pkg *p, char **dirs,
+    size_t ndirs, int64_t *refs);
 int pkgdb_file_set_cksum(struct pkgdb *db, struct pkg_file *file, const char *sha256);
 
 
@@ -793,10 +831,71 @@ int pkg_addoption_default(struct pkg *pkg, const char *key, const char *default_
 int pkg_addoption_description(struct pkg *pkg, const char *key, const char *description);
 
 int pkg_arch_to_legacy(const char *arch, char *dest, size_t sz);
+
+/* String interner, not thread safe, see pkg_intern.c */
+const char *pkg_intern(const char *str);
+const char *pkg_internn(const char *str, size_t len);
+const char *pkg_intern_lookup(const char *str);
+void pkg_intern_stats(size_t *count, size_t *bytes);
+void pkg_intern_free(void);
+
+/*
+ * Memory accounting per subsystem, see pkg_mem.c. The macros only cost a
+ * test of pkg_mem_enabled when MEMORY_STATS is off.
+ */
+typedef enum {
+	PKG_MEM_PKG = 0,
+	PKG_MEM_FILES,
+	PKG_MEM_UNIVERSE,
+	PKG_MEM_SOLVER,
+	PKG_MEM_CONFLICTS,
+	PKG_MEM_INTERN,
+	PKG_MEM_NTAGS
+} pkg_mem_tag;
+
+extern bool pkg_mem_enabled;
+
+#define pkg_mem_alloc(tag, size) do {				\
+	if (pkg_mem_enabled)					\
+		pkg_mem_account((tag), (int64_t)(size));	\
+} while (0)
+#define pkg_mem_free(tag, size) do {				\
+	if (pkg_mem_enabled)					\
+		pkg_mem_account((tag), -(int64_t)(size));	\
+} while (0)
+
+void pkg_mem_account(pkg_mem_tag tag, int64_t size);
+void pkg_mem_enable(bool enable);
+void pkg_mem_stats(struct pkg_mem_stat *stats);
+void pkg_mem_report(void);
+
+/*
+ * Cancellation token of the running jobs, see pkg_cancel.c.  The fetch,
+ * solve, extract and script code polls pkg_cancel_check() at its safe
+ * points, it is a no-op when no jobs are running.
+ */
+struct pkg_cancel {
+	volatile sig_atomic_t cancelled;
+	pkg_jobs_phase_t phase;
+	int64_t start;
+	int64_t used[PKG_JOBS_PHASE_NONE];
+	int64_t bytes[PKG_JOBS_PHASE_NONE];
+	int64_t time_budget[PKG_JOBS_PHASE_NONE];
+	int64_t byte_budget[PKG_JOBS_PHASE_NONE];
+	bool reported;
+};
+
+extern struct pkg_cancel *pkg_cancel_token;
+
+void pkg_cancel_init(struct pkg_cancel *c);
+pkg_jobs_phase_t pkg_cancel_enter(pkg_jobs_phase_t phase);
+void pkg_cancel_leave(pkg_jobs_phase_t prev);
+int pkg_cancel_check(int64_t bytes);
 bool pkg_is_config_file(struct pkg *p, const char *path, const struct pkg_file **file, struct pkg_config_file **cfile);
 int pkg_message_from_ucl(struct pkg *pkg, const ucl_object_t *obj);
 int pkg_message_from_str(struct pkg *pkg, const char *str, size_t len);
 ucl_object_t* pkg_message_to_ucl(const struct pkg *pkg);
 char* pkg_message_to_str(struct pkg *pkg);
+uint64_t pkg_dbg_flags(const ucl_object_t *names);
 
 #endif
@@ -42,6 +42,7 @@ struct job_pattern;
 
 struct pkg_job_universe_item {
 	struct pkg *pkg;
+	const char *uid;	/* interned, key of the universe hash */
 	int priority;
 	bool processed;
 	UT_hash_handle hh;
@@ -90,6 +91,7 @@ struct pkg_jobs_universe {
 	kh_pkg_jobs_seen_t *seen;
 	struct pkg_job_provide *provides;
 	struct pkg_job_replace *uid_replaces;
+	kh_strings_t *cycles;
 	struct pkg_jobs *j;
 	size_t nitems;
 };
@@ -118,6 +120,7 @@ struct pkg_jobs {
 	TREE_HEAD(, pkg_jobs_conflict_item) *conflict_items;
 	struct job_pattern *patterns;
 	bool conservative;
+	struct pkg_cancel cancel;
 };
 
 struct job_pattern {
@@ -136,15 +139,12 @@ enum pkg_priority_update_type {
 };
 
 /*
- * Update priorities for all items related with the specified item
+ * Set the priorities of all items related with the jobs, the jobs with the
+ * highest priority are executed first. Returns the number of dependency
+ * cycles broken.
  */
-void pkg_jobs_update_universe_priority(struct pkg_jobs_universe *universe,
-	struct pkg_job_universe_item *it, enum pkg_priority_update_type type);
-/*
- * Update priority as the conflict was found
- */
-void pkg_jobs_update_conflict_priority(struct pkg_jobs_universe *universe,
-	struct pkg_solved *req);
+int pkg_jobs_universe_order(struct pkg_jobs_universe *universe,
+	struct pkg_solved *jobs);
 
 /*
  * Free universe
@@ -214,6 +214,10 @@ int pkg_conflicts_integrity_check(struct pkg_jobs *j);
  */
 void pkg_conflicts_register(struct pkg *p1, struct pkg *p2,
 		enum pkg_conflict_type type);
+/*
+ * Free the paths registered by pkg_conflicts_append_chain
+ */
+void pkg_conflicts_items_free(struct pkg_jobs *j);
 
 /*
  * Check whether `rp` is an upgrade for `lp`
@@ -32,9 +32,17 @@
 
 #include "sqlite3.h"
 
+struct pkgdb_catalog;
+
 struct pkgdb {
 	sqlite3		*sqlite;
 	bool		 prstmt_initialized;
+	struct pkgdb_catalog *catalog;
+	bool		 catalog_failed;
+	char		*repokey;
+	char		*fingerprint;
+	bool		 regnested;
+	bool		 regopen;
 
 	struct _pkg_repo_list_item {
 		struct pkg_repo *repo;
@@ -95,6 +103,12 @@ void pkgdb_it_repo_attach(struct pkgdb_it *it, struct pkg_repo_it *rit);
 int pkgdb_ensure_loaded(struct pkgdb *db, struct pkg *pkg, unsigned flags);
 int pkgdb_ensure_loaded_sqlite(sqlite3 *sqlite, struct pkg *pkg, unsigned flags);
 
+/**
+ * Load the pristine content of the config files of an installed package,
+ * which PKG_LOAD_FILES leaves out
+ */
+int pkgdb_load_config_contents(sqlite3 *sqlite, struct pkg *pkg);
+
 void pkgshell_open(const char **r);
 
 /**
@@ -116,6 +130,19 @@ int pkgdb_repo_register_conflicts(const char *origin, char **conflicts,
  */
 const char * pkgdb_get_pattern_query(const char *pattern, match_t match);
 
+/**
+ * Walk the dependency graph from the packages matching pattern into the
+ * temporary closure table of the connection, shared by the local database
+ * and the binary repositories
+ * @param columns the packages columns to select, prefixed by p.
+ * @param reverse follow the reverse dependencies
+ * @param maxdepth the longest path to follow, 0 for no limit
+ * @return the statement selecting the packages of the closure with their
+ * depth and via, by distance, or NULL on error
+ */
+sqlite3_stmt *pkgdb_deps_closure_stmt(sqlite3 *s, const char *columns,
+		const char *pattern, match_t match, bool reverse, int maxdepth);
+
 /**
  * Find provides for a specified require in repos
  * @param db
@@ -186,4 +213,29 @@ void pkgdb_myarch(sqlite3_context *ctx, int argc, sqlite3_value **argv);
 int pkgdb_sqlcmd_init(sqlite3 *db, const char **err, const void *noused);
 int pkgdb_update_config_file_content(struct pkg *pkg, sqlite3 *s);
 
+/*
+ * Single statement lookups across all the repositories, NULL if the
+ * repositories have to be queried one by one
+ */
+struct pkgdb_it *pkgdb_catalog_query(struct pkgdb *db, const char *pattern,
+    match_t match, const char *repo);
+struct pkgdb_it *pkgdb_catalog_search(struct pkgdb *db, const char *pattern,
+    match_t match, pkgdb_field field, pkgdb_field sort, const char *repo);
+struct pkgdb_it *pkgdb_catalog_shlib_provide(struct pkgdb *db,
+    const char *require, const char *repo);
+struct pkgdb_it *pkgdb_catalog_shlib_require(struct pkgdb *db,
+    const char *provide, const char *repo);
+struct pkgdb_it *pkgdb_catalog_provide(struct pkgdb *db, const char *require,
+    const char *repo);
+struct pkgdb_it *pkgdb_catalog_require(struct pkgdb *db, const char *provide,
+    const char *repo);
+void pkgdb_catalog_close(struct pkgdb *db);
+
+/*
+ * Statement profiling, enabled by SQLITE_PROFILE
+ */
+void pkgdb_profile_attach(sqlite3 *s);
+void pkgdb_profile_report(void);
+int pkgdb_step(sqlite3_stmt *stmt);
+
 #endif
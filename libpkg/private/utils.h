@@ -47,7 +47,19 @@
 	__FILE__, __LINE__, sqlite3_errmsg(db));									 \
 } while(0)
 
-KHASH_MAP_INIT_INT(hardlinks, int)
+/* Files are hardlinks of each other only on the same device */
+struct hardlink {
+	dev_t dev;
+	ino_t ino;
+};
+
+#define hardlink_hash(k) \
+	kh_int64_hash_func(((uint64_t)(k).dev << 32) ^ (uint64_t)(k).ino)
+#define hardlink_equal(a, b) ((a).dev == (b).dev && (a).ino == (b).ino)
+
+/* The value is the first path of each group of hardlinks */
+KHASH_INIT(hardlinks, struct hardlink, const char *, 1, hardlink_hash,
+    hardlink_equal)
 typedef khash_t(hardlinks) hardlinks_t;
 
 struct dns_srvinfo {
@@ -90,6 +102,7 @@ int rsa_verify_cert(const char *path, unsigned char *cert,
     int certlen, unsigned char *sig, int sig_len, int fd);
 
 bool check_for_hardlink(hardlinks_t *hl, struct stat *st);
+const char *first_hardlink(hardlinks_t *hl, struct stat *st, const char *path);
 bool is_valid_abi(const char *arch, bool emit_error);
 
 struct dns_srvinfo *
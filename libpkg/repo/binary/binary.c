@@ -37,9 +37,12 @@ struct pkg_repo_ops pkg_repo_binary_ops = {
 	.provided = pkg_repo_binary_provide,
 	.required = pkg_repo_binary_require,
 	.search = pkg_repo_binary_search,
+	.deps_closure = pkg_repo_binary_deps_closure,
 	.fetch_pkg = pkg_repo_binary_fetch,
 	.mirror_pkg = pkg_repo_binary_mirror,
 	.get_cached_name = pkg_repo_binary_get_cached_name,
 	.ensure_loaded = pkg_repo_binary_ensure_loaded,
+	.attach = pkg_repo_binary_attach,
+	.filestat = pkg_repo_binary_filestat,
 	.stat = pkg_repo_binary_stat
 };
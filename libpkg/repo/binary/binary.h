@@ -35,6 +35,9 @@ int pkg_repo_binary_update(struct pkg_repo *repo, bool force);
 int pkg_repo_binary_init(struct pkg_repo *repo);
 int pkg_repo_binary_close(struct pkg_repo *repo, bool commit);
 int pkg_repo_binary_access(struct pkg_repo *repo, unsigned mode);
+int pkg_repo_binary_attach(struct pkg_repo *repo, sqlite3 *sqlite,
+	const char *schema);
+int pkg_repo_binary_filestat(struct pkg_repo *repo, struct stat *st);
 
 int pkg_repo_binary_create(struct pkg_repo *repo);
 int pkg_repo_binary_open(struct pkg_repo *repo, unsigned mode);
@@ -52,6 +55,8 @@ struct pkg_repo_it *pkg_repo_binary_require(struct pkg_repo *repo,
 struct pkg_repo_it *pkg_repo_binary_search(struct pkg_repo *repo,
 	const char *pattern, match_t match,
     pkgdb_field field, pkgdb_field sort);
+struct pkg_repo_it *pkg_repo_binary_deps_closure(struct pkg_repo *repo,
+	const char *pattern, match_t match, bool reverse, int maxdepth);
 int pkg_repo_binary_ensure_loaded(struct pkg_repo *repo,
 	struct pkg *pkg, unsigned flags);
 int64_t pkg_repo_binary_stat(struct pkg_repo *repo, pkg_stats_t type);
@@ -185,6 +185,71 @@ static const char binary_repo_initsql[] = ""
 	"CREATE UNIQUE INDEX packages_digest ON packages(manifestdigest);"*/
 	/* FTS search table */
 	"CREATE VIRTUAL TABLE pkg_search USING fts4(id, name, origin);"
+	/* Aggregates for pkg stats, kept current by triggers */
+	"CREATE TABLE repo_stats ("
+	    "packages INTEGER NOT NULL,"
+	    "names INTEGER NOT NULL,"
+	    "pkgsize INTEGER NOT NULL,"
+	    "flatsize INTEGER NOT NULL,"
+	    "updated INTEGER NOT NULL"
+	");"
+	"CREATE TABLE repo_stats_names ("
+	    "name TEXT PRIMARY KEY,"
+	    "packages INTEGER NOT NULL"
+	");"
+	"INSERT INTO repo_stats VALUES (0, 0, 0, 0, 0);"
+	/*
+	 * INSERT OR REPLACE does not fire delete triggers, so a package
+	 * replaced for its origin is removed from the counters first.
+	 */
+	"CREATE TRIGGER repo_stats_replace "
+	    "BEFORE INSERT ON packages "
+	"FOR EACH ROW BEGIN "
+	    "UPDATE repo_stats SET "
+	    "packages = packages - "
+		"(SELECT COUNT(*) FROM packages WHERE origin = new.origin), "
+	    "pkgsize = pkgsize - "
+		"(SELECT COALESCE(SUM(pkgsize), 0) FROM packages "
+		"WHERE origin = new.origin), "
+	    "flatsize = flatsize - "
+		"(SELECT COALESCE(SUM(flatsize), 0) FROM packages "
+		"WHERE origin = new.origin);"
+	    "UPDATE repo_stats_names SET packages = packages - 1 "
+	    "WHERE name = (SELECT name FROM packages "
+		"WHERE origin = new.origin);"
+	    "DELETE FROM repo_stats_names WHERE packages <= 0;"
+	"END;"
+	"CREATE TRIGGER repo_stats_insert "
+	    "AFTER INSERT ON packages "
+	"FOR EACH ROW BEGIN "
+	    "INSERT OR IGNORE INTO repo_stats_names VALUES (new.name, 0);"
+	    "UPDATE repo_stats_names SET packages = packages + 1 "
+	    "WHERE name = new.name;"
+	    "UPDATE repo_stats SET packages = packages + 1, "
+	    "pkgsize = pkgsize + new.pkgsize, "
+	    "flatsize = flatsize + new.flatsize;"
+	"END;"
+	"CREATE TRIGGER repo_stats_delete "
+	    "AFTER DELETE ON packages "
+	"FOR EACH ROW BEGIN "
+	    "UPDATE repo_stats_names SET packages = packages - 1 "
+	    "WHERE name = old.name;"
+	    "DELETE FROM repo_stats_names "
+	    "WHERE name = old.name AND packages <= 0;"
+	    "UPDATE repo_stats SET packages = packages - 1, "
+	    "pkgsize = pkgsize - old.pkgsize, "
+	    "flatsize = flatsize - old.flatsize;"
+	"END;"
+	"CREATE TRIGGER repo_stats_names_insert "
+	    "AFTER INSERT ON repo_stats_names "
+	"FOR EACH ROW BEGIN "
+	    "UPDATE repo_stats SET names = names + 1;"
+	"END;"
+	"CREATE TRIGGER repo_stats_names_delete "
+	    "AFTER DELETE ON repo_stats_names "
+	"FOR EACH ROW BEGIN "
+	    "UPDATE repo_stats SET names = names - 1;"
+	"END;"
 
 	"PRAGMA user_version=%d;"
 	;
@@ -376,6 +441,95 @@ static const struct repo_changes repo_upgrades[] = {
 
 	 "ALTER TABLE packages ADD COLUMN vital INTEGER NOT NULL DEFAULT 0;"
 	},
+	{2013,
+	 2014,
+	 "Add trigger maintained statistics",
+
+	 "CREATE TABLE repo_stats ("
+		"packages INTEGER NOT NULL,"
+		"names INTEGER NOT NULL,"
+		"pkgsize INTEGER NOT NULL,"
+		"flatsize INTEGER NOT NULL,"
+		"updated INTEGER NOT NULL"
+	 ");"
+	 "CREATE TABLE repo_stats_names ("
+		"name TEXT PRIMARY KEY,"
+		"packages INTEGER NOT NULL"
+	 ");"
+	 "INSERT INTO repo_stats_names "
+		"SELECT name, COUNT(*) FROM packages GROUP BY name;"
+	 "INSERT INTO repo_stats SELECT COUNT(*), "
+		"(SELECT COUNT(*) FROM repo_stats_names), "
+		"COALESCE(SUM(pkgsize), 0), COALESCE(SUM(flatsize), 0), 0 "
+		"FROM packages;"
+	 "CREATE TRIGGER repo_stats_insert "
+		"AFTER INSERT ON packages "
+	 "FOR EACH ROW BEGIN "
+		"INSERT OR IGNORE INTO repo_stats_names VALUES (new.name, 0);"
+		"UPDATE repo_stats_names SET packages = packages + 1 "
+		"WHERE name = new.name;"
+		"UPDATE repo_stats SET packages = packages + 1, "
+		"pkgsize = pkgsize + new.pkgsize, "
+		"flatsize = flatsize + new.flatsize;"
+	 "END;"
+	 "CREATE TRIGGER repo_stats_delete "
+		"AFTER DELETE ON packages "
+	 "FOR EACH ROW BEGIN "
+		"UPDATE repo_stats_names SET packages = packages - 1 "
+		"WHERE name = old.name;"
+		"DELETE FROM repo_stats_names "
+		"WHERE name = old.name AND packages <= 0;"
+		"UPDATE repo_stats SET packages = packages - 1, "
+		"pkgsize = pkgsize - old.pkgsize, "
+		"flatsize = flatsize - old.flatsize;"
+	 "END;"
+	 "CREATE TRIGGER repo_stats_names_insert "
+		"AFTER INSERT ON repo_stats_names "
+	 "FOR EACH ROW BEGIN "
+		"UPDATE repo_stats SET names = names + 1;"
+	 "END;"
+	 "CREATE TRIGGER repo_stats_names_delete "
+		"AFTER DELETE ON repo_stats_names "
+	 "FOR EACH ROW BEGIN "
+		"UPDATE repo_stats SET names = names - 1;"
+	 "END;"
+	},
+	{2014,
+	 2015,
+	 "Index the dependencies by name",
+
+	 "CREATE INDEX IF NOT EXISTS deps_name ON deps(name);"
+	},
+	{2015,
+	 2016,
+	 "Count replaced packages once in the statistics",
+
+	 "DELETE FROM repo_stats_names;"
+	 "INSERT INTO repo_stats_names "
+		"SELECT name, COUNT(*) FROM packages GROUP BY name;"
+	 "UPDATE repo_stats SET "
+		"packages = (SELECT COUNT(*) FROM packages), "
+		"names = (SELECT COUNT(*) FROM repo_stats_names), "
+		"pkgsize = (SELECT COALESCE(SUM(pkgsize), 0) FROM packages), "
+		"flatsize = (SELECT COALESCE(SUM(flatsize), 0) FROM packages);"
+	 "CREATE TRIGGER repo_stats_replace "
+		"BEFORE INSERT ON packages "
+	 "FOR EACH ROW BEGIN "
+		"UPDATE repo_stats SET "
+		"packages = packages - "
+			"(SELECT COUNT(*) FROM packages WHERE origin = new.origin), "
+		"pkgsize = pkgsize - "
+			"(SELECT COALESCE(SUM(pkgsize), 0) FROM packages "
+			"WHERE origin = new.origin), "
+		"flatsize = flatsize - "
+			"(SELECT COALESCE(SUM(flatsize), 0) FROM packages "
+			"WHERE origin = new.origin);"
+		"UPDATE repo_stats_names SET packages = packages - 1 "
+		"WHERE name = (SELECT name FROM packages "
+			"WHERE origin = new.origin);"
+		"DELETE FROM repo_stats_names WHERE packages <= 0;"
+	 "END;"
+	},
 	/* Mark the end of the array */
 	{ -1, -1, NULL, NULL, }
 
@@ -384,6 +538,27 @@ static const struct repo_changes repo_upgrades[] = {
 /* How to downgrade a newer repo to match what the current system
    expects */
 static const struct repo_changes repo_downgrades[] = {
+	{2016,
+	 2015,
+	 "Drop the replaced packages statistics trigger",
+
+	 "DROP TRIGGER repo_stats_replace;"
+	},
+	{2015,
+	 2014,
+	 "Drop the dependencies name index",
+
+	 "DROP INDEX IF EXISTS deps_name;"
+	},
+	{2014,
+	 2013,
+	 "Drop trigger maintained statistics",
+
+	 "DROP TRIGGER repo_stats_insert;"
+	 "DROP TRIGGER repo_stats_delete;"
+	 "DROP TABLE repo_stats_names;"
+	 "DROP TABLE repo_stats;"
+	},
 	{2013,
 	 2012,
 	 "Drop vital column",
@@ -629,7 +804,7 @@ static const struct repo_changes repo_downgrades[] = {
 /* The package repo schema minor revision.
    Minor schema changes don't prevent older pkgng
    versions accessing the repo. */
-#define REPO_SCHEMA_MINOR 13
+#define REPO_SCHEMA_MINOR 16
 
 #define REPO_SCHEMA_VERSION (REPO_SCHEMA_MAJOR * 1000 + REPO_SCHEMA_MINOR)
 
@@ -669,5 +844,6 @@ void pkg_repo_binary_finalize_prstatements(void);
  * Warning: returns a pointer to static array
  */
 const char * pkg_repo_binary_get_filename(const char *name);
+int pkg_repo_binary_parse_conflicts(FILE *f, sqlite3 *sqlite);
 
 #endif /* INIT_PRIVATE_H_ */
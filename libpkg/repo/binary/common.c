@@ -231,7 +231,7 @@ pkg_repo_binary_run_prstatement(sql_prstmt_index s, ...)
 
 	va_end(ap);
 
-	retcode = sqlite3_step(stmt);
+	retcode = pkgdb_step(stmt);
 
 	return (retcode);
 }
@@ -159,7 +159,7 @@ pkg_repo_binary_try_fetch(struct pkg_repo *repo, struct pkg *pkg,
 		/* try to resume */
 		if (pkg->pkgsize > st.st_size) {
 			offset = st.st_size;
-			pkg_debug(1, "Resuming fetch");
+			pkg_dbg(FETCH, 1, "Resuming fetch");
 		} else {
 			goto checksum;
 		}
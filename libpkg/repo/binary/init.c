@@ -92,7 +92,7 @@ pkg_repo_binary_get_user_version(sqlite3 *sqlite, int *reposcver)
 		return (EPKG_FATAL);
 	}
 
-	if (sqlite3_step(stmt) == SQLITE_ROW) {
+	if (pkgdb_step(stmt) == SQLITE_ROW) {
 		*reposcver = sqlite3_column_int64(stmt, 0);
 		retcode = EPKG_OK;
 	} else {
@@ -146,7 +146,7 @@ pkg_repo_binary_apply_change(struct pkg_repo *repo, sqlite3 *sqlite,
 
 	/* apply change */
 	if (ret == EPKG_OK) {
-		pkg_debug(4, "Pkgdb: running '%s'", change->sql);
+		pkg_dbg(DB, 4, "Pkgdb: running '%s'", change->sql);
 		ret = sqlite3_exec(sqlite, change->sql, NULL, NULL, &errmsg);
 		if (ret != SQLITE_OK) {
 			pkg_emit_error("sqlite: %s", errmsg);
@@ -193,7 +193,7 @@ pkg_repo_binary_upgrade(struct pkg_repo *repo, sqlite3 *sqlite, int current_vers
 					"upgrade", version, &next_version);
 		if (ret != EPKG_OK)
 			break;
-		pkg_debug(1, "Upgrading repo database schema from %d to %d",
+		pkg_dbg(DB, 1, "Upgrading repo database schema from %d to %d",
 				version, next_version);
 	}
 	return (ret);
@@ -214,7 +214,7 @@ pkg_repo_binary_downgrade(struct pkg_repo *repo, sqlite3 *sqlite, int current_ve
 					"downgrade", version, &next_version);
 		if (ret != EPKG_OK)
 			break;
-		pkg_debug(1, "Downgrading repo database schema from %d to %d",
+		pkg_dbg(DB, 1, "Downgrading repo database schema from %d to %d",
 				version, next_version);
 	}
 	return (ret);
@@ -481,7 +481,7 @@ pkg_repo_binary_create(struct pkg_repo *repo)
 
 		sqlite3_bind_text(stmt, 1, pkg_repo_url(repo), -1, SQLITE_STATIC);
 
-		if (sqlite3_step(stmt) != SQLITE_DONE) {
+		if (pkgdb_step(stmt) != SQLITE_DONE) {
 			ERROR_SQLITE(sqlite, sql);
 			sqlite3_finalize(stmt);
 			retcode = EPKG_FATAL;
@@ -514,6 +514,7 @@ pkg_repo_binary_init(struct pkg_repo *repo)
 		return (retcode);
 
 	pkgdb_sqlcmd_init(sqlite, NULL, NULL);
+	pkgdb_profile_attach(sqlite);
 
 	retcode = pkg_repo_binary_init_prstatements(sqlite);
 	if (retcode != EPKG_OK)
@@ -561,3 +562,33 @@ pkg_repo_binary_access(struct pkg_repo *repo, unsigned mode)
 
 	return (ret);
 }
+
+int
+pkg_repo_binary_attach(struct pkg_repo *repo, sqlite3 *sqlite,
+	const char *schema)
+{
+	char filepath[MAXPATHLEN];
+	const char *dbdir;
+
+	dbdir = pkg_object_string(pkg_config_get("PKG_DBDIR"));
+	snprintf(filepath, sizeof(filepath), "%s/%s",
+		dbdir, pkg_repo_binary_get_filename(pkg_repo_name(repo)));
+
+	return (sql_exec(sqlite, "ATTACH DATABASE %Q AS %s;", filepath, schema));
+}
+
+int
+pkg_repo_binary_filestat(struct pkg_repo *repo, struct stat *st)
+{
+	char filepath[MAXPATHLEN];
+	const char *dbdir;
+
+	dbdir = pkg_object_string(pkg_config_get("PKG_DBDIR"));
+	snprintf(filepath, sizeof(filepath), "%s/%s",
+		dbdir, pkg_repo_binary_get_filename(pkg_repo_name(repo)));
+
+	if (stat(filepath, st) == -1)
+		return (EPKG_FATAL);
+
+	return (EPKG_OK);
+}
@@ -108,7 +108,7 @@ pkg_repo_binary_query(struct pkg_repo *repo, const char *pattern, match_t match)
 	struct sbuf	*sql = NULL;
 	const char	*comp = NULL;
 	int		 ret;
-	char		 basesql[BUFSIZ] = ""
+	const char	*basesql = ""
 		"SELECT id, origin, name, name as uniqueid, version, comment, "
 		"prefix, desc, arch, maintainer, www, "
 		"licenselogic, flatsize, pkgsize, "
@@ -119,16 +119,16 @@ pkg_repo_binary_query(struct pkg_repo *repo, const char *pattern, match_t match)
 		return (NULL);
 
 	sql = sbuf_new_auto();
+	sbuf_printf(sql, basesql, repo->name);
+
 	comp = pkgdb_get_pattern_query(pattern, match);
 	if (comp && comp[0])
-		strlcat(basesql, comp, sizeof(basesql));
-
-	sbuf_printf(sql, basesql, repo->name);
+		sbuf_cat(sql, comp);
 
 	sbuf_cat(sql, " ORDER BY name;");
 	sbuf_finish(sql);
 
-	pkg_debug(4, "Pkgdb: running '%s' query for %s", sbuf_data(sql),
+	pkg_dbg(DB, 4, "Pkgdb: running '%s' query for %s", sbuf_data(sql),
 	     pattern == NULL ? "all": pattern);
 	ret = sqlite3_prepare_v2(sqlite, sbuf_data(sql), sbuf_len(sql), &stmt,
 	    NULL);
@@ -146,6 +146,33 @@ pkg_repo_binary_query(struct pkg_repo *repo, const char *pattern, match_t match)
 	return (pkg_repo_binary_it_new(repo, stmt, PKGDB_IT_FLAG_ONCE));
 }
 
+struct pkg_repo_it *
+pkg_repo_binary_deps_closure(struct pkg_repo *repo, const char *pattern,
+    match_t match, bool reverse, int maxdepth)
+{
+	sqlite3 *sqlite = PRIV_GET(repo);
+	sqlite3_stmt	*stmt;
+	char		*columns;
+
+	if (match != MATCH_ALL && (pattern == NULL || pattern[0] == '\0'))
+		return (NULL);
+
+	columns = sqlite3_mprintf(
+	    "p.id, p.origin, p.name, p.name as uniqueid, p.version, p.comment, "
+	    "p.prefix, p.desc, p.arch, p.maintainer, p.www, "
+	    "p.licenselogic, p.flatsize, p.pkgsize, "
+	    "p.cksum, p.manifestdigest, p.path AS repopath, %Q AS dbname",
+	    repo->name);
+
+	stmt = pkgdb_deps_closure_stmt(sqlite, columns, pattern, match, reverse,
+	    maxdepth);
+	sqlite3_free(columns);
+	if (stmt == NULL)
+		return (NULL);
+
+	return (pkg_repo_binary_it_new(repo, stmt, PKGDB_IT_FLAG_ONCE));
+}
+
 struct pkg_repo_it *
 pkg_repo_binary_shlib_provide(struct pkg_repo *repo, const char *require)
 {
@@ -169,7 +196,7 @@ pkg_repo_binary_shlib_provide(struct pkg_repo *repo, const char *require)
 
 	sbuf_finish(sql);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sbuf_data(sql));
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sbuf_data(sql));
 	ret = sqlite3_prepare_v2(sqlite, sbuf_data(sql), -1, &stmt, NULL);
 	if (ret != SQLITE_OK) {
 		ERROR_SQLITE(sqlite, sbuf_data(sql));
@@ -207,7 +234,7 @@ pkg_repo_binary_provide(struct pkg_repo *repo, const char *require)
 
 	sbuf_finish(sql);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sbuf_data(sql));
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sbuf_data(sql));
 	ret = sqlite3_prepare_v2(sqlite, sbuf_data(sql), -1, &stmt, NULL);
 	if (ret != SQLITE_OK) {
 		ERROR_SQLITE(sqlite, sbuf_data(sql));
@@ -244,7 +271,7 @@ pkg_repo_binary_shlib_require(struct pkg_repo *repo, const char *provide)
 
 	sbuf_finish(sql);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sbuf_data(sql));
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sbuf_data(sql));
 	ret = sqlite3_prepare_v2(sqlite, sbuf_data(sql), -1, &stmt, NULL);
 	if (ret != SQLITE_OK) {
 		ERROR_SQLITE(sqlite, sbuf_data(sql));
@@ -254,7 +281,7 @@ pkg_repo_binary_shlib_require(struct pkg_repo *repo, const char *provide)
 
 	sbuf_delete(sql);
 
-	pkg_debug(1, "> loading provides");
+	pkg_dbg(DB, 1, "> loading provides");
 	sqlite3_bind_text(stmt, 1, provide, -1, SQLITE_TRANSIENT);
 
 	return (pkg_repo_binary_it_new(repo, stmt, PKGDB_IT_FLAG_ONCE));
@@ -282,7 +309,7 @@ pkg_repo_binary_require(struct pkg_repo *repo, const char *provide)
 
 	sbuf_finish(sql);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sbuf_data(sql));
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sbuf_data(sql));
 	ret = sqlite3_prepare_v2(sqlite, sbuf_data(sql), -1, &stmt, NULL);
 	if (ret != SQLITE_OK) {
 		ERROR_SQLITE(sqlite, sbuf_data(sql));
@@ -418,7 +445,7 @@ pkg_repo_binary_search(struct pkg_repo *repo, const char *pattern, match_t match
 	sbuf_cat(sql, ";");
 	sbuf_finish(sql);
 
-	pkg_debug(4, "Pkgdb: running '%s'", sbuf_data(sql));
+	pkg_dbg(DB, 4, "Pkgdb: running '%s'", sbuf_data(sql));
 	ret = sqlite3_prepare_v2(sqlite, sbuf_data(sql), -1, &stmt, NULL);
 	if (ret != SQLITE_OK) {
 		ERROR_SQLITE(sqlite, sbuf_data(sql));
@@ -453,7 +480,7 @@ pkg_repo_binary_ensure_loaded(struct pkg_repo *repo,
 		if (pkg_repo_cached_name(pkg, path, sizeof(path)) != EPKG_OK)
 			return (EPKG_FATAL);
 
-		pkg_debug(1, "Binary> loading %s", path);
+		pkg_dbg(DB, 1, "Binary> loading %s", path);
 		if (pkg_open(&cached, path, keys, PKG_OPEN_TRY) != EPKG_OK) {
 			pkg_free(cached);
 			return (EPKG_FATAL);
@@ -485,48 +512,40 @@ pkg_repo_binary_stat(struct pkg_repo *repo, pkg_stats_t type)
 	sqlite3 *sqlite = PRIV_GET(repo);
 	sqlite3_stmt	*stmt = NULL;
 	int64_t		 stats = 0;
-	struct sbuf	*sql = NULL;
+	const char	*sql;
 	int		 ret;
 
-	sql = sbuf_new_auto();
-
 	switch(type) {
-	case PKG_STATS_LOCAL_COUNT:
-		goto out;
-		break;
-	case PKG_STATS_LOCAL_SIZE:
-		goto out;
-		break;
 	case PKG_STATS_REMOTE_UNIQUE:
-		sbuf_printf(sql, "SELECT COUNT(id) FROM main.packages;");
+		sql = "SELECT names FROM main.repo_stats;";
 		break;
 	case PKG_STATS_REMOTE_COUNT:
-		sbuf_printf(sql, "SELECT COUNT(id) FROM main.packages;");
+		sql = "SELECT packages FROM main.repo_stats;";
 		break;
 	case PKG_STATS_REMOTE_SIZE:
-		sbuf_printf(sql, "SELECT SUM(pkgsize) FROM main.packages;");
+		sql = "SELECT pkgsize FROM main.repo_stats;";
+		break;
+	case PKG_STATS_REMOTE_FLATSIZE:
+		sql = "SELECT flatsize FROM main.repo_stats;";
 		break;
-	case PKG_STATS_REMOTE_REPOS:
-		goto out;
+	case PKG_STATS_REMOTE_UPDATED:
+		sql = "SELECT updated FROM main.repo_stats;";
 		break;
+	default:
+		return (0);
 	}
 
-	sbuf_finish(sql);
-	pkg_debug(4, "binary_repo: running '%s'", sbuf_data(sql));
-	ret = sqlite3_prepare_v2(sqlite, sbuf_data(sql), -1, &stmt, NULL);
+	pkg_dbg(DB, 4, "binary_repo: running '%s'", sql);
+	ret = sqlite3_prepare_v2(sqlite, sql, -1, &stmt, NULL);
 	if (ret != SQLITE_OK) {
-		ERROR_SQLITE(sqlite, sbuf_data(sql));
-		goto out;
+		ERROR_SQLITE(sqlite, sql);
+		return (0);
 	}
 
-	while (sqlite3_step(stmt) != SQLITE_DONE) {
+	if (pkgdb_step(stmt) == SQLITE_ROW)
 		stats = sqlite3_column_int64(stmt, 0);
-	}
 
-out:
-	sbuf_free(sql);
-	if (stmt != NULL)
-		sqlite3_finalize(stmt);
+	sqlite3_finalize(stmt);
 
 	return (stats);
 }
@@ -35,6 +35,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <limits.h>
+#include <time.h>
 
 #include <archive.h>
 #include <archive_entry.h>
@@ -283,97 +284,6 @@ try_again:
 	return (EPKG_OK);
 }
 
-static int
-pkg_repo_binary_register_conflicts(const char *origin, char **conflicts,
-		int conflicts_num, sqlite3 *sqlite)
-{
-	const char clean_conflicts_sql[] = ""
-			"DELETE FROM pkg_conflicts "
-			"WHERE package_id = ?1;";
-	const char select_id_sql[] = ""
-			"SELECT id FROM packages "
-			"WHERE origin = ?1;";
-	const char insert_conflict_sql[] = ""
-			"INSERT INTO pkg_conflicts "
-			"(package_id, conflict_id) "
-			"VALUES (?1, ?2);";
-	sqlite3_stmt *stmt = NULL;
-	int ret, i;
-	int64_t origin_id, conflict_id;
-
-	pkg_debug(4, "pkgdb_repo_register_conflicts: running '%s'", select_id_sql);
-	if (sqlite3_prepare_v2(sqlite, select_id_sql, -1, &stmt, NULL) != SQLITE_OK) {
-		ERROR_SQLITE(sqlite, select_id_sql);
-		return (EPKG_FATAL);
-	}
-
-	sqlite3_bind_text(stmt, 1, origin, -1, SQLITE_TRANSIENT);
-	ret = sqlite3_step(stmt);
-
-	if (ret == SQLITE_ROW) {
-		origin_id = sqlite3_column_int64(stmt, 0);
-	}
-	else {
-		ERROR_SQLITE(sqlite, select_id_sql);
-		return (EPKG_FATAL);
-	}
-	sqlite3_finalize(stmt);
-
-	pkg_debug(4, "pkgdb_repo_register_conflicts: running '%s'", clean_conflicts_sql);
-	if (sqlite3_prepare_v2(sqlite, clean_conflicts_sql, -1, &stmt, NULL) != SQLITE_OK) {
-		ERROR_SQLITE(sqlite, clean_conflicts_sql);
-		return (EPKG_FATAL);
-	}
-
-	sqlite3_bind_int64(stmt, 1, origin_id);
-	/* Ignore cleanup result */
-	(void)sqlite3_step(stmt);
-
-	sqlite3_finalize(stmt);
-
-	for (i = 0; i < conflicts_num; i ++) {
-		/* Select a conflict */
-		pkg_debug(4, "pkgdb_repo_register_conflicts: running '%s'", select_id_sql);
-		if (sqlite3_prepare_v2(sqlite, select_id_sql, -1, &stmt, NULL) != SQLITE_OK) {
-			ERROR_SQLITE(sqlite, select_id_sql);
-			return (EPKG_FATAL);
-		}
-
-		sqlite3_bind_text(stmt, 1, conflicts[i], -1, SQLITE_TRANSIENT);
-		ret = sqlite3_step(stmt);
-
-		if (ret == SQLITE_ROW) {
-			conflict_id = sqlite3_column_int64(stmt, 0);
-		}
-		else {
-			ERROR_SQLITE(sqlite, select_id_sql);
-			return (EPKG_FATAL);
-		}
-
-		sqlite3_finalize(stmt);
-
-		/* Insert a pair */
-		pkg_debug(4, "pkgdb_repo_register_conflicts: running '%s'", insert_conflict_sql);
-		if (sqlite3_prepare_v2(sqlite, insert_conflict_sql, -1, &stmt, NULL) != SQLITE_OK) {
-			ERROR_SQLITE(sqlite, insert_conflict_sql);
-			return (EPKG_FATAL);
-		}
-
-		sqlite3_bind_int64(stmt, 1, origin_id);
-		sqlite3_bind_int64(stmt, 2, conflict_id);
-		ret = sqlite3_step(stmt);
-
-		if (ret != SQLITE_DONE) {
-			ERROR_SQLITE(sqlite, insert_conflict_sql);
-			return (EPKG_FATAL);
-		}
-
-		sqlite3_finalize(stmt);
-	}
-
-	return (EPKG_OK);
-}
-
 static int
 pkg_repo_binary_add_from_manifest(char *buf, sqlite3 *sqlite, size_t len,
 		struct pkg_manifest_key **keys, struct pkg **p __unused,
@@ -401,8 +311,7 @@ pkg_repo_binary_add_from_manifest(char *buf, sqlite3 *sqlite, size_t len,
 		goto cleanup;
 	}
 
-	free(pkg->reponame);
-	pkg->reponame = strdup(repo->name);
+	pkg->reponame = pkg_intern(repo->name);
 
 	rc = pkg_repo_binary_add_pkg(pkg, NULL, sqlite, true);
 
@@ -412,40 +321,110 @@ cleanup:
 	return (rc);
 }
 
-static void __unused
+/*
+ * Each line of the conflicts file is "origin:conflict1,conflict2,...".
+ *
+ * The pairs are staged in a temporary table in a single pass over the file
+ * then resolved against the packages with one join. The result is the same
+ * as registering the lines one by one:
+ * - the last line of an origin replaces the previous ones
+ * - an origin or a conflict is resolved to the first package having it
+ * - a line stops at the first unknown or repeated conflict
+ */
+int
 pkg_repo_binary_parse_conflicts(FILE *f, sqlite3 *sqlite)
 {
 	size_t linecap = 0;
 	ssize_t linelen;
-	char *linebuf = NULL, *p, **deps;
-	const char *origin, *pdep;
-	int ndep, i;
-	const char conflicts_clean_sql[] = ""
-			"DELETE FROM pkg_conflicts;";
+	char *linebuf = NULL, *p;
+	const char *origin, *conflict;
+	sqlite3_stmt *stmt = NULL;
+	int64_t line = 0, pos;
+	int ret, rc = EPKG_OK;
+	const char conflicts_stage_sql[] = ""
+			"CREATE TEMPORARY TABLE conflicts_import ("
+			"line INTEGER NOT NULL,"
+			"pos INTEGER NOT NULL,"
+			"origin TEXT NOT NULL,"
+			"conflict TEXT NOT NULL,"
+			"UNIQUE(line, conflict)"
+			");";
+	const char conflicts_insert_sql[] = ""
+			"INSERT OR IGNORE INTO conflicts_import "
+			"(line, pos, origin, conflict) "
+			"VALUES (?1, ?2, ?3, ?4);";
+	const char conflicts_resolve_sql[] = ""
+			"DELETE FROM pkg_conflicts;"
+			"CREATE TEMPORARY TABLE conflicts_ids AS "
+			"SELECT origin, MIN(id) AS id FROM packages GROUP BY origin;"
+			"CREATE UNIQUE INDEX temp.conflicts_ids_origin "
+			"ON conflicts_ids(origin);"
+			"INSERT INTO pkg_conflicts (package_id, conflict_id) "
+			"SELECT o.id, c.id FROM conflicts_import AS i "
+			"JOIN (SELECT MAX(line) AS line FROM conflicts_import "
+			"GROUP BY origin) AS l ON l.line = i.line "
+			"JOIN conflicts_ids AS o ON o.origin = i.origin "
+			"JOIN conflicts_ids AS c ON c.origin = i.conflict "
+			"WHERE NOT EXISTS (SELECT 1 FROM conflicts_import AS u "
+			"LEFT JOIN conflicts_ids AS uc ON uc.origin = u.conflict "
+			"WHERE u.line = i.line AND u.pos < i.pos AND uc.id IS NULL);";
+	const char conflicts_drop_sql[] = ""
+			"DROP TABLE IF EXISTS temp.conflicts_import;"
+			"DROP TABLE IF EXISTS temp.conflicts_ids;";
+
+	pkg_dbg(DB, 4, "pkg_parse_conflicts_file: running '%s'", conflicts_stage_sql);
+	if (sql_exec(sqlite, conflicts_stage_sql) != EPKG_OK)
+		return (EPKG_FATAL);
 
-	pkg_debug(4, "pkg_parse_conflicts_file: running '%s'", conflicts_clean_sql);
-	(void)sql_exec(sqlite, conflicts_clean_sql);
+	pkg_dbg(DB, 4, "pkg_parse_conflicts_file: running '%s'", conflicts_insert_sql);
+	if (sqlite3_prepare_v2(sqlite, conflicts_insert_sql, -1, &stmt,
+	    NULL) != SQLITE_OK) {
+		ERROR_SQLITE(sqlite, conflicts_insert_sql);
+		rc = EPKG_FATAL;
+		goto cleanup;
+	}
 
-	while ((linelen = getline(&linebuf, &linecap, f)) > 0) {
+	while (rc == EPKG_OK &&
+	    (linelen = getline(&linebuf, &linecap, f)) > 0) {
+		if (linebuf[linelen - 1] == '\n')
+			linebuf[linelen - 1] = '\0';
+		line++;
 		p = linebuf;
 		origin = strsep(&p, ":");
-		/* Check dependencies number */
-		pdep = p;
-		ndep = 1;
-		while (*pdep != '\0') {
-			if (*pdep == ',')
-				ndep ++;
-			pdep ++;
-		}
-		deps = malloc(sizeof(char *) * ndep);
-		for (i = 0; i < ndep; i ++) {
-			deps[i] = strsep(&p, ",\n");
+		if (p == NULL)
+			continue;
+
+		for (pos = 0; p != NULL; pos++) {
+			conflict = strsep(&p, ",");
+			sqlite3_bind_int64(stmt, 1, line);
+			sqlite3_bind_int64(stmt, 2, pos);
+			sqlite3_bind_text(stmt, 3, origin, -1, SQLITE_STATIC);
+			sqlite3_bind_text(stmt, 4, conflict, -1, SQLITE_STATIC);
+			ret = pkgdb_step(stmt);
+			sqlite3_reset(stmt);
+			if (ret != SQLITE_DONE) {
+				ERROR_SQLITE(sqlite, conflicts_insert_sql);
+				rc = EPKG_FATAL;
+				break;
+			}
+			/* A conflict listed twice ends the line */
+			if (sqlite3_changes(sqlite) == 0)
+				break;
 		}
-		pkg_repo_binary_register_conflicts(origin, deps, ndep, sqlite);
-		free(deps);
 	}
 
+	if (rc == EPKG_OK) {
+		pkg_dbg(DB, 4, "pkg_parse_conflicts_file: running '%s'",
+		    conflicts_resolve_sql);
+		rc = sql_exec(sqlite, conflicts_resolve_sql);
+	}
+
+cleanup:
+	sqlite3_finalize(stmt);
+	(void)sql_exec(sqlite, conflicts_drop_sql);
 	free(linebuf);
+
+	return (rc);
 }
 
 static void
@@ -476,7 +455,7 @@ pkg_repo_binary_update_proceed(const char *name, struct pkg_repo *repo,
 	bool in_trans = false;
 	char path[MAXPATHLEN];
 
-	pkg_debug(1, "Pkgrepo, begin update of '%s'", name);
+	pkg_dbg(DB, 1, "Pkgrepo, begin update of '%s'", name);
 
 	/* In forced mode, ignore mtime */
 	if (force)
@@ -513,7 +492,7 @@ pkg_repo_binary_update_proceed(const char *name, struct pkg_repo *repo,
 	/* Here sqlite is initialized */
 	sqlite = PRIV_GET(repo);
 
-	pkg_debug(1, "Pkgrepo, reading new packagesite.yaml for '%s'", name);
+	pkg_dbg(DB, 1, "Pkgrepo, reading new packagesite.yaml for '%s'", name);
 
 	pkg_emit_progress_start("Processing entries");
 
@@ -559,8 +538,13 @@ pkg_repo_binary_update_proceed(const char *name, struct pkg_repo *repo,
 	"CREATE INDEX packages_uid ON packages(name, origin);"
 	"CREATE INDEX packages_version ON packages(name, version);"
 	"CREATE UNIQUE INDEX packages_digest ON packages(manifestdigest);"
+	"CREATE INDEX deps_name ON deps(name);"
 	 );
 
+	if (rc == EPKG_OK)
+		sql_exec(sqlite, "UPDATE repo_stats SET updated = %lld;",
+		    (long long)time(NULL));
+
 cleanup:
 
 	if (in_trans) {
@@ -606,11 +590,11 @@ pkg_repo_binary_update(struct pkg_repo *repo, bool force)
 		return (EPKG_OK);
 
 	dbdir = pkg_object_string(pkg_config_get("PKG_DBDIR"));
-	pkg_debug(1, "PkgRepo: verifying update for %s", pkg_repo_name(repo));
+	pkg_dbg(DB, 1, "PkgRepo: verifying update for %s", pkg_repo_name(repo));
 
 	/* First of all, try to open and init repo and check whether it is fine */
 	if (repo->ops->open(repo, R_OK|W_OK) != EPKG_OK) {
-		pkg_debug(1, "PkgRepo: need forced update of %s", pkg_repo_name(repo));
+		pkg_dbg(DB, 1, "PkgRepo: need forced update of %s", pkg_repo_name(repo));
 		t = 0;
 		force = true;
 		snprintf(filepath, sizeof(filepath), "%s/%s", dbdir,
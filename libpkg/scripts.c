@@ -47,6 +47,34 @@
 
 extern char **environ;
 
+/*
+ * Wait for a script, while jobs are running poll it so a cancellation or
+ * the script budget can kill it.
+ */
+static int
+pkg_script_wait(pid_t pid, int *pstat)
+{
+	pid_t r;
+
+	for (;;) {
+		r = waitpid(pid, pstat, pkg_cancel_token != NULL ? WNOHANG : 0);
+		if (r == pid)
+			return (EPKG_OK);
+		if (r == -1) {
+			if (errno != EINTR)
+				return (EPKG_FATAL);
+			continue;
+		}
+		if (pkg_cancel_check(0) != EPKG_OK) {
+			kill(pid, SIGKILL);
+			while (waitpid(pid, pstat, 0) == -1 && errno == EINTR)
+				;
+			return (EPKG_CANCEL);
+		}
+		usleep(10000);
+	}
+}
+
 int
 pkg_script_run(struct pkg * const pkg, pkg_script type)
 {
@@ -65,6 +93,7 @@ pkg_script_run(struct pkg * const pkg, pkg_script type)
 	ssize_t bytes_written;
 	size_t script_cmd_len;
 	long argmax;
+	pkg_jobs_phase_t prev;
 #ifdef PROC_REAP_KILL
 	bool do_reap;
 	pid_t mypid;
@@ -98,6 +127,8 @@ pkg_script_run(struct pkg * const pkg, pkg_script type)
 
 	assert(i < sizeof(map) / sizeof(map[0]));
 
+	prev = pkg_cancel_enter(PKG_JOBS_PHASE_SCRIPT);
+
 #ifdef PROC_REAP_KILL
 	mypid = getpid();
 	do_reap = procctl(P_PID, mypid, PROC_REAP_ACQUIRE, NULL) == 0;
@@ -137,7 +168,7 @@ pkg_script_run(struct pkg * const pkg, pkg_script type)
 				argmax -= strlen(*ep) + 1 + sizeof(*ep);
 			argmax -= 1 + sizeof(*ep);
 
-			pkg_debug(3, "Scripts: executing\n--- BEGIN ---\n%s\nScripts: --- END ---", sbuf_data(script_cmd));
+			pkg_dbg(SCRIPTS, 3, "Scripts: executing\n--- BEGIN ---\n%s\nScripts: --- END ---", sbuf_data(script_cmd));
 			if (sbuf_len(script_cmd) > argmax) {
 				if (pipe(stdin_pipe) < 0) {
 					ret = EPKG_FATAL;
@@ -163,6 +194,9 @@ pkg_script_run(struct pkg * const pkg, pkg_script type)
 				use_pipe = 0;
 			}
 
+			if ((ret = pkg_cancel_check(0)) != EPKG_OK)
+				goto cleanup;
+
 			if ((error = posix_spawn(&pid, _PATH_BSHELL,
 			    use_pipe ? &action : NULL,
 			    NULL, __DECONST(char **, argv),
@@ -192,10 +226,8 @@ pkg_script_run(struct pkg * const pkg, pkg_script type)
 
 			unsetenv("PKG_PREFIX");
 
-			while (waitpid(pid, &pstat, 0) == -1) {
-				if (errno != EINTR)
-					goto cleanup;
-			}
+			if ((ret = pkg_script_wait(pid, &pstat)) != EPKG_OK)
+				goto cleanup;
 
 			if (WEXITSTATUS(pstat) != 0) {
 				pkg_emit_error("%s script failed", map[i].arg);
@@ -207,6 +239,7 @@ pkg_script_run(struct pkg * const pkg, pkg_script type)
 
 cleanup:
 
+	pkg_cancel_leave(prev);
 	sbuf_delete(script_cmd);
 	if (stdin_pipe[0] != -1)
 		close(stdin_pipe[0]);
@@ -94,7 +94,7 @@ pkg_sshserve(int fd)
 			continue;
 		}
 
-		pkg_debug(1, "SSH server> file requested: %s", file);
+		pkg_dbg(FETCH, 1, "SSH server> file requested: %s", file);
 
 		age = file;
 		while (!isspace(*age)) {
@@ -151,7 +151,7 @@ pkg_sshserve(int fd)
 		}
 
 		if (fstatat(fd, file, &st, 0) == -1) {
-			pkg_debug(1, "SSH server> fstatat failed");
+			pkg_dbg(FETCH, 1, "SSH server> fstatat failed");
 			printf("ko: file not found\n");
 			continue;
 		}
@@ -172,14 +172,14 @@ pkg_sshserve(int fd)
 		}
 
 		printf("ok: %" PRIdMAX "\n", (intmax_t)st.st_size);
-		pkg_debug(1, "SSH server> sending ok: %" PRIdMAX "", (intmax_t)st.st_size);
+		pkg_dbg(FETCH, 1, "SSH server> sending ok: %" PRIdMAX "", (intmax_t)st.st_size);
 
 		while ((r = read(ffd, buf, sizeof(buf))) > 0) {
-			pkg_debug(1, "SSH server> sending data");
+			pkg_dbg(FETCH, 1, "SSH server> sending data");
 			fwrite(buf, 1, r, stdout);
 		}
 
-		pkg_debug(1, "SSH server> finished");
+		pkg_dbg(FETCH, 1, "SSH server> finished");
 
 		close(ffd);
 	}
@@ -391,13 +391,31 @@ string_end_with(const char *path, const char *str)
 bool
 check_for_hardlink(hardlinks_t *hl, struct stat *st)
 {
+
+	return (first_hardlink(hl, st, NULL) != NULL);
+}
+
+/*
+ * Records the file described by `st` and returns the path recorded for the
+ * first file of its group of hardlinks, or NULL if it is the first one.
+ * The path is not copied.
+ */
+const char *
+first_hardlink(hardlinks_t *hl, struct stat *st, const char *path)
+{
+	struct hardlink key;
+	khint_t k;
 	int absent;
 
-	kh_put_hardlinks(hl, st->st_ino, &absent);
-	if (absent == 0)
-		return (true);
+	key.dev = st->st_dev;
+	key.ino = st->st_ino;
+	k = kh_put_hardlinks(hl, key, &absent);
+	if (absent != 0) {
+		kh_val(hl, k) = path != NULL ? path : "";
+		return (NULL);
+	}
 
-	return (false);
+	return (kh_val(hl, k));
 }
 
 bool
@@ -60,7 +60,8 @@
 void
 usage_audit(void)
 {
-	fprintf(stderr, "Usage: pkg audit [-Fqr] [-f file] <pattern>\n\n");
+	fprintf(stderr, "Usage: pkg audit [-Fqr] [-f file] <pattern>\n");
+	fprintf(stderr, "       pkg audit -d [-Fq] [-f file]\n\n");
 	fprintf(stderr, "For more information see 'pkg help audit'.\n");
 }
 
@@ -109,6 +110,48 @@ print_recursive_rdeps(kh_pkgs_t *head, struct pkg *p, struct sbuf *sb,
 	}
 }
 
+static int
+audit_delta(struct pkg_audit *audit, kh_pkgs_t *check, int fd)
+{
+	struct pkg		*pkg;
+	struct sbuf		*diff;
+	unsigned int		 added = 0, resolved = 0;
+	int			 ret = EX_OK;
+
+	diff = sbuf_new_auto();
+	if (pkg_audit_state_load(audit, fd) != EPKG_OK) {
+		warnx("cannot load the audit state");
+		ret = EX_SOFTWARE;
+	}
+
+	kh_foreach_value(check, pkg, {
+		if (ret == EX_OK &&
+		    pkg_audit_state_check(audit, pkg, diff) != EPKG_OK) {
+			warnx("cannot process vulnxml");
+			ret = EX_SOFTWARE;
+		}
+		pkg_free(pkg);
+	});
+	kh_destroy_pkgs(check);
+
+	if (ret == EX_OK &&
+	    pkg_audit_state_save(audit, fd, diff, &added, &resolved) != EPKG_OK)
+		ret = EX_IOERR;
+
+	sbuf_finish(diff);
+	printf("%s", sbuf_data(diff));
+	sbuf_delete(diff);
+
+	if (ret != EX_OK)
+		return (ret);
+
+	if (!quiet)
+		printf("%u problem(s) added and %u resolved since the last "
+		    "audit.\n", added, resolved);
+
+	return (added != 0 ? EXIT_FAILURE : EX_OK);
+}
+
 int
 exec_audit(int argc, char **argv)
 {
@@ -121,9 +164,10 @@ exec_audit(int argc, char **argv)
 	char			*version;
 	char			 audit_file_buf[MAXPATHLEN];
 	char			*audit_file = audit_file_buf;
+	char			 state_file[MAXPATHLEN];
 	unsigned int		 vuln = 0;
-	bool			 fetch = false, recursive = false;
-	int			 ch, i;
+	bool			 fetch = false, recursive = false, delta = false;
+	int			 ch, i, statefd = -1;
 	int			 ret = EX_OK;
 	const char		*portaudit_site = NULL;
 	struct sbuf		*sb;
@@ -131,8 +175,10 @@ exec_audit(int argc, char **argv)
 
 	db_dir = pkg_object_string(pkg_config_get("PKG_DBDIR"));
 	snprintf(audit_file_buf, sizeof(audit_file_buf), "%s/vuln.xml", db_dir);
+	snprintf(state_file, sizeof(state_file), "%s/vuln.state", db_dir);
 
 	struct option longopts[] = {
+		{ "delta",	no_argument,		NULL,	'd' },
 		{ "fetch",	no_argument,		NULL,	'F' },
 		{ "file",	required_argument,	NULL,	'f' },
 		{ "recursive",	no_argument,	NULL,	'r' },
@@ -140,8 +186,11 @@ exec_audit(int argc, char **argv)
 		{ NULL,		0,			NULL,	0   },
 	};
 
-	while ((ch = getopt_long(argc, argv, "+Ff:qr", longopts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "+dFf:qr", longopts, NULL)) != -1) {
 		switch (ch) {
+		case 'd':
+			delta = true;
+			break;
 		case 'F':
 			fetch = true;
 			break;
@@ -162,6 +211,12 @@ exec_audit(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 
+	/* The state only records the installed packages */
+	if (delta && (argc != 0 || recursive)) {
+		usage_audit();
+		return (EX_USAGE);
+	}
+
 	audit = pkg_audit_new();
 
 	if (fetch == true) {
@@ -268,6 +323,13 @@ exec_audit(int argc, char **argv)
 		}
 	}
 
+	if (delta && (statefd = open(state_file, O_RDWR|O_CREAT, 0644)) == -1) {
+		warn("unable to open the audit state %s", state_file);
+		pkg_audit_free(audit);
+		kh_destroy_pkgs(check);
+		return (EX_IOERR);
+	}
+
 	/* Now we have vulnxml loaded and check list formed */
 #ifdef HAVE_CAPSICUM
 	if (cap_enter() < 0 && errno != ENOSYS) {
@@ -278,6 +340,13 @@ exec_audit(int argc, char **argv)
 	}
 #endif
 
+	if (delta) {
+		ret = audit_delta(audit, check, statefd);
+		close(statefd);
+		pkg_audit_free(audit);
+		return (ret);
+	}
+
 	if (pkg_audit_process(audit) == EPKG_OK) {
 		kh_foreach_value(check, pkg, {
 			if (pkg_audit_is_vulnerable(audit, pkg, quiet, &sb)) {
@@ -122,11 +122,14 @@ exec_autoremove(int argc, char **argv)
 
 	pkg_jobs_set_flags(jobs, f);
 
+	cancel_jobs_on_signal(jobs);
 	if ((retcode = pkg_jobs_solve(jobs)) != EPKG_OK) {
 		retcode = EX_SOFTWARE;
 		goto cleanup;
 	}
 
+	cancel_jobs_on_signal(NULL);
+
 	if ((nbactions = pkg_jobs_count(jobs)) == 0) {
 		printf("Nothing to do.\n");
 		goto cleanup;
@@ -139,6 +142,7 @@ exec_autoremove(int argc, char **argv)
 			rc = query_yesno(false,
 		            "\nProceed with deinstalling packages? ");
 	}
+	cancel_jobs_on_signal(jobs);
 	if ((yes || rc ) && !dry_run && ((retcode = pkg_jobs_apply(jobs)) != EPKG_OK)) {
 		goto cleanup;
 	}
@@ -146,6 +150,7 @@ exec_autoremove(int argc, char **argv)
 	pkgdb_compact(db);
 
 cleanup:
+	cancel_jobs_on_signal(NULL);
 	pkg_jobs_free(jobs);
 	pkgdb_release_lock(db, lock_type);
 	pkgdb_close(db);
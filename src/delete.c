@@ -184,12 +184,15 @@ exec_delete(int argc, char **argv)
 	if (pkg_jobs_add(jobs, match, argv, argc) == EPKG_FATAL)
 		goto cleanup;
 
+	cancel_jobs_on_signal(jobs);
 	if (pkg_jobs_solve(jobs) != EPKG_OK) {
 		fprintf(stderr, "Cannot perform request\n");
 		retcode = EX_NOPERM;
 		goto cleanup;
 	}
 
+	cancel_jobs_on_signal(NULL);
+
 	/* check if we have something to deinstall */
 	if ((nbactions = pkg_jobs_count(jobs)) == 0) {
 		if (argc == 0) {
@@ -220,6 +223,7 @@ exec_delete(int argc, char **argv)
 	else
 		rc = yes;
 
+	cancel_jobs_on_signal(jobs);
 	if (!rc || (retcode = pkg_jobs_apply(jobs)) != EPKG_OK)
 		goto cleanup;
 
@@ -232,6 +236,7 @@ exec_delete(int argc, char **argv)
 	retcode = EX_OK;
 
 cleanup:
+	cancel_jobs_on_signal(NULL);
 	pkgdb_release_lock(db, lock_type);
 	pkg_jobs_free(jobs);
 	pkgdb_close(db);
@@ -43,6 +43,7 @@
 #endif
 
 #include <err.h>
+#include <inttypes.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
@@ -569,6 +570,7 @@ event_callback(void *data, struct pkg_event *ev)
 {
 	struct pkg *pkg = NULL, *pkg_new, *pkg_old;
 	struct cleanup *evtmp;
+	struct sigaction sa;
 	int *debug = data, i;
 	struct pkg_event_conflict *cur_conflict;
 	const char *filename;
@@ -878,9 +880,15 @@ event_callback(void *data, struct pkg_event *ev)
 	case PKG_EVENT_CLEANUP_CALLBACK_REGISTER:
 		if (!signal_handler_installed) {
 			kv_init(cleanup_list);
-			signal(SIGINT, cleanup_handler);
 			signal_handler_installed = true;
 		}
+		/*
+		 * Cancellable jobs clean up by themselves, and put this handler
+		 * back when they are done; ignored signals stay ignored.
+		 */
+		if (sigaction(SIGINT, NULL, &sa) == 0 &&
+		    sa.sa_handler == SIG_DFL)
+			signal(SIGINT, cleanup_handler);
 		evtmp = malloc(sizeof(struct cleanup));
 		evtmp->cb = ev->e_cleanup_callback.cleanup_cb;
 		evtmp->data = ev->e_cleanup_callback.data;
@@ -898,6 +906,21 @@ event_callback(void *data, struct pkg_event *ev)
 			}
 		}
 		break;
+	case PKG_EVENT_SQL_PROFILE:
+		fprintf(stderr, "SQL profile, sorted by total time:\n");
+		fprintf(stderr, "%8s %10s %10s %10s %10s %8s  %s\n", "calls",
+		    "total ms", "max ms", "rows", "scan steps", "prepares",
+		    "statement");
+		for (i = 0; i < ev->e_sql_profile.count; i++) {
+			const struct pkg_sql_profile *p =
+			    &ev->e_sql_profile.stmts[i];
+
+			fprintf(stderr, "%8" PRId64 " %10.3f %10.3f %10" PRId64
+			    " %10" PRId64 " %8" PRId64 "  %s\n", p->calls,
+			    p->total / 1000000.0, p->max / 1000000.0,
+			    p->rows, p->fullscan_steps, p->prepares, p->sql);
+		}
+		break;
 	default:
 		break;
 	}
@@ -0,0 +1,191 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "pkg_config.h"
+#endif
+
+#include <sys/param.h>
+
+#include <err.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sysexits.h>
+
+#include <pkg.h>
+
+#include <bsd_compat.h>
+
+#include "pkgcli.h"
+
+static const struct {
+	const char		*name;
+	pkg_export_table_t	 table;
+} export_tables[] = {
+	{ "packages",		PKG_EXPORT_PACKAGES },
+	{ "deps",		PKG_EXPORT_DEPS },
+	{ "files",		PKG_EXPORT_FILES },
+	{ "options",		PKG_EXPORT_OPTIONS },
+	{ "annotations",	PKG_EXPORT_ANNOTATIONS },
+};
+
+void
+usage_export(void)
+{
+	fprintf(stderr, "Usage: pkg export [-f ndjson|csv] <table>\n");
+	fprintf(stderr, "       pkg export [-f ndjson|csv] -o <directory> "
+	    "[table ...]\n\n");
+	fprintf(stderr, "For more information see 'pkg help export'.\n");
+}
+
+static int
+export_table(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < NELEM(export_tables); i++) {
+		if (strcmp(export_tables[i].name, name) == 0)
+			return (i);
+	}
+
+	warnx("Unknown table '%s', expecting packages, deps, files, "
+	    "options or annotations", name);
+
+	return (-1);
+}
+
+static int
+export_to_dir(struct pkgdb *db, const char *dir, int t,
+    pkg_export_format_t format)
+{
+	char path[MAXPATHLEN];
+	FILE *out;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/%s.%s", dir, export_tables[t].name,
+	    format == PKG_EXPORT_CSV ? "csv" : "ndjson");
+	if ((out = fopen(path, "w")) == NULL) {
+		warn("%s", path);
+		return (EPKG_FATAL);
+	}
+	ret = pkgdb_export(db, export_tables[t].table, format, out);
+	if (fclose(out) != 0) {
+		warn("%s", path);
+		ret = EPKG_FATAL;
+	}
+
+	return (ret);
+}
+
+int
+exec_export(int argc, char **argv)
+{
+	struct pkgdb		*db = NULL;
+	const char		*dir = NULL;
+	pkg_export_format_t	 format = PKG_EXPORT_NDJSON;
+	bool			 tables[NELEM(export_tables)];
+	int			 ch, t, ret;
+	unsigned int		 i;
+
+	struct option longopts[] = {
+		{ "format",	required_argument,	NULL,	'f' },
+		{ "output",	required_argument,	NULL,	'o' },
+		{ NULL,		0,			NULL,	0   },
+	};
+
+	while ((ch = getopt_long(argc, argv, "+f:o:", longopts, NULL)) != -1) {
+		switch (ch) {
+		case 'f':
+			if (strcasecmp(optarg, "ndjson") == 0)
+				format = PKG_EXPORT_NDJSON;
+			else if (strcasecmp(optarg, "csv") == 0)
+				format = PKG_EXPORT_CSV;
+			else
+				errx(EX_USAGE, "Invalid format '%s', expecting "
+				    "ndjson or csv", optarg);
+			break;
+		case 'o':
+			dir = optarg;
+			break;
+		default:
+			usage_export();
+			return (EX_USAGE);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	/* only one table at a time can go to stdout */
+	if (dir == NULL && argc != 1) {
+		usage_export();
+		return (EX_USAGE);
+	}
+
+	for (i = 0; i < NELEM(export_tables); i++)
+		tables[i] = (argc == 0);
+	for (; argc > 0; argc--, argv++) {
+		if ((t = export_table(argv[0])) == -1)
+			return (EX_USAGE);
+		tables[t] = true;
+	}
+
+	ret = pkgdb_access(PKGDB_MODE_READ, PKGDB_DB_LOCAL);
+	if (ret == EPKG_ENOACCESS) {
+		warnx("Insufficient privileges to query the package database");
+		return (EX_NOPERM);
+	} else if (ret == EPKG_ENODB) {
+		warnx("No packages installed");
+		return (EX_OK);
+	} else if (ret != EPKG_OK)
+		return (EX_IOERR);
+
+	if (pkgdb_open(&db, PKGDB_DEFAULT) != EPKG_OK)
+		return (EX_IOERR);
+
+	if (pkgdb_obtain_lock(db, PKGDB_LOCK_READONLY) != EPKG_OK) {
+		pkgdb_close(db);
+		warnx("Cannot get a read lock on a database, it is locked by another process");
+		return (EX_TEMPFAIL);
+	}
+
+	ret = EPKG_OK;
+	for (i = 0; ret == EPKG_OK && i < NELEM(export_tables); i++) {
+		if (!tables[i])
+			continue;
+		if (dir != NULL)
+			ret = export_to_dir(db, dir, i, format);
+		else
+			ret = pkgdb_export(db, export_tables[i].table, format,
+			    stdout);
+	}
+
+	pkgdb_release_lock(db, PKGDB_LOCK_READONLY);
+	pkgdb_close(db);
+
+	return (ret == EPKG_OK ? EX_OK : EX_IOERR);
+}
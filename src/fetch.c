@@ -193,8 +193,10 @@ exec_fetch(int argc, char **argv)
 	    pkg_jobs_add(jobs, match, argv, argc) != EPKG_OK)
 		goto cleanup;
 
+	cancel_jobs_on_signal(jobs);
 	if (pkg_jobs_solve(jobs) != EPKG_OK)
 		goto cleanup;
+	cancel_jobs_on_signal(NULL);
 
 	if (pkg_jobs_count(jobs) == 0)
 		goto cleanup;
@@ -218,6 +220,7 @@ exec_fetch(int argc, char **argv)
 		rc = true;
 	}
 
+	cancel_jobs_on_signal(jobs);
 	if (!rc || (retcode = pkg_jobs_apply(jobs)) != EPKG_OK)
 		goto cleanup;
 
@@ -227,6 +230,7 @@ exec_fetch(int argc, char **argv)
 	retcode = EX_OK;
 
 cleanup:
+	cancel_jobs_on_signal(NULL);
 	pkg_jobs_free(jobs);
 	pkgdb_release_lock(db, PKGDB_LOCK_READONLY);
 	pkgdb_close(db);
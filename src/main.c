@@ -93,6 +93,7 @@ static struct commands {
 	{ "convert", "Convert database from/to pkgng", exec_convert, usage_convert},
 	{ "create", "Creates software package distributions", exec_create, usage_create},
 	{ "delete", "Deletes packages from the database and the system", exec_delete, usage_delete},
+	{ "export", "Exports tables of the local package database", exec_export, usage_export},
 	{ "fetch", "Fetches packages from a remote repository", exec_fetch, usage_fetch},
 	{ "help", "Displays help information", exec_help, usage_help},
 	{ "info", "Displays information about installed packages", exec_info, usage_info},
@@ -105,6 +106,7 @@ static struct commands {
 	{ "repo", "Creates a package repository catalogue", exec_repo, usage_repo},
 	{ "rquery", "Queries information in repository catalogues", exec_rquery, usage_rquery},
 	{ "search", "Performs a search of package repository catalogues", exec_search, usage_search},
+	{ "serve", "Answers read-only queries over a local socket", exec_serve, usage_serve},
 	{ "set", "Modifies information about packages in the local database", exec_set, usage_set},
 	{ "ssh", "Package server (to be used via ssh)", exec_ssh, usage_ssh},
 	{ "shell", "Opens a debug shell", exec_shell, usage_shell},
@@ -171,7 +173,7 @@ usage(const char *conffile, const char *reposdir, FILE *out, enum pkg_usage_reas
 #else
 #define JAIL_ARG
 #endif
-	fprintf(out, "Usage: pkg [-v] [-d] [-l] [-N] ["JAIL_ARG"-c <chroot path>|-r <rootdir>] [-C <configuration file>] [-R <repo config dir>] [-o var=value] [-4|-6] <command> [<args>]\n");
+	fprintf(out, "Usage: pkg [-v] [-d] [-l] [-N] ["JAIL_ARG"-c <chroot path>|-r <rootdir>] [-C <configuration file>] [-R <repo config dir>] [-o var=value] [-4|-6] [-S <socket>] <command> [<args>]\n");
 	if (reason == PKG_USAGE_HELP) {
 		fprintf(out, "Global options supported:\n");
 		fprintf(out, "\t%-15s%s\n", "-d", "Increment debug level");
@@ -188,6 +190,7 @@ usage(const char *conffile, const char *reposdir, FILE *out, enum pkg_usage_reas
 		fprintf(out, "\t%-15s%s\n", "-o", "Override configuration option from the command line");
 		fprintf(out, "\t%-15s%s\n", "-4", "Only use IPv4");
 		fprintf(out, "\t%-15s%s\n", "-6", "Only use IPv6");
+		fprintf(out, "\t%-15s%s\n", "-S", "Send the command to a pkg-serve(8) service");
 		fprintf(out, "\nCommands supported:\n");
 
 		for (i = 0; i < cmd_len; i++)
@@ -444,6 +447,30 @@ export_arg_option (char *arg)
 	}
 }
 
+static pid_t worker_pid = -1;
+
+/*
+ * The worker shares our process group so it gets the terminal signals by
+ * itself, a SIGTERM is forwarded to let it cancel its jobs cleanly.
+ */
+static void
+worker_signal(int sig)
+{
+
+	if (sig == SIGTERM && worker_pid > 0)
+		kill(worker_pid, sig);
+}
+
+/* Signals ignored by our parent stay ignored, as they are for the worker */
+static void
+worker_forward(int sig)
+{
+	struct sigaction sa;
+
+	if (sigaction(sig, NULL, &sa) == 0 && sa.sa_handler != SIG_IGN)
+		signal(sig, worker_signal);
+}
+
 static void
 start_process_worker(char *const *save_argv)
 {
@@ -470,6 +497,10 @@ start_process_worker(char *const *save_argv)
 			if (child_pid == -1)
 				err(EX_OSERR, "Failed to fork worker process");
 
+			worker_pid = child_pid;
+			worker_forward(SIGINT);
+			worker_forward(SIGTERM);
+
 			while (waitpid(child_pid, &status, 0) == -1) {
 				if (errno != EINTR)
 					err(EX_OSERR, "Child process pid=%d", (int)child_pid);
@@ -578,6 +609,8 @@ main(int argc, char **argv)
 	struct plugcmd	 *c;
 	const char	 *conffile = NULL;
 	const char	 *reposdir = NULL;
+	const char	 *serve_socket = NULL;
+	bool		  options = false;
 	char		**save_argv;
 	int		  j;
 
@@ -595,6 +628,7 @@ main(int argc, char **argv)
 		{ "option",		required_argument,	NULL,	'o' },
 		{ "only-ipv4",		no_argument,		NULL,	'4' },
 		{ "only-ipv6",		no_argument,		NULL,	'6' },
+		{ "serve-socket",	required_argument,	NULL,	'S' },
 		{ NULL,			0,			NULL,	0   },
 	};
 
@@ -623,7 +657,7 @@ main(int argc, char **argv)
 #else
 #define JAIL_OPT
 #endif
-	while ((ch = getopt_long(argc, argv, "+d"JAIL_OPT"c:C:R:r:lNvo:46", longopts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "+d"JAIL_OPT"c:C:R:r:lNvo:46S:", longopts, NULL)) != -1) {
 		switch (ch) {
 		case 'd':
 			debug++;
@@ -656,6 +690,7 @@ main(int argc, char **argv)
 			break;
 		case 'o':
 			export_arg_option (optarg);
+			options = true;
 			break;
 		case '4':
 			init_flags = PKG_INIT_FLAG_USE_IPV4;
@@ -663,6 +698,9 @@ main(int argc, char **argv)
 		case '6':
 			init_flags = PKG_INIT_FLAG_USE_IPV6;
 			break;
+		case 'S':
+			serve_socket = optarg;
+			break;
 		default:
 			break;
 		}
@@ -683,6 +721,17 @@ main(int argc, char **argv)
 	if (argc == 0 && version == 0 && !activation_test)
 		usage(conffile, reposdir, stderr, PKG_USAGE_INVALID_ARGUMENTS, "no commands specified");
 
+	/* The service runs the command with its own configuration */
+	if (serve_socket != NULL) {
+		if (jail_str != NULL || chroot_path != NULL ||
+		    rootdir != NULL || conffile != NULL || reposdir != NULL ||
+		    options || debug > 0)
+			usage(conffile, reposdir, stderr,
+			    PKG_USAGE_INVALID_ARGUMENTS,
+			    "-S cannot be used with -d, -j, -c, -r, -C, -R or -o");
+		return (serve_client(serve_socket, argc, argv));
+	}
+
 	umask(022);
 	pkg_event_register(&event_callback, &debug);
 
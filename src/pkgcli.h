@@ -147,6 +147,10 @@ void usage_updating(void);
 int exec_upgrade(int, char **);
 void usage_upgrade(void);
 
+/* pkg export */
+int exec_export(int, char **);
+void usage_export(void);
+
 /* pkg fetch */
 int exec_fetch(int, char **);
 void usage_fetch(void);
@@ -189,6 +193,11 @@ void usage_convert(void);
 int exec_ssh(int, char **);
 void usage_ssh(void);
 
+/* pkg serve */
+int exec_serve(int, char **);
+void usage_serve(void);
+int serve_client(const char *, int, char **);
+
 /* pkg config */
 int exec_config(int, char **);
 void usage_config(void);
@@ -267,6 +276,7 @@ bool query_tty_yesno(bool deft, const char *msg, ...);
 int info_flags(uint64_t opt, bool remote);
 void print_info(struct pkg * const pkg, uint64_t opt);
 int print_jobs_summary(struct pkg_jobs *j, const char *msg, ...);
+void cancel_jobs_on_signal(struct pkg_jobs *jobs);
 
 void job_status_begin(struct sbuf *);
 void job_status_end(struct sbuf *);
@@ -290,6 +300,8 @@ struct query_flags {
 };
 
 void print_query(struct pkg *pkg, char *qstr, char multiline);
+void query_closure_add(struct pkg *pkg);
+void query_closure_reset(void);
 int format_sql_condition(const char *str, struct sbuf *sqlcond,
 			 bool for_remote);
 int analyse_query_string(char *qstr, struct query_flags *q_flags,
@@ -34,6 +34,8 @@
 #include <err.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <khash.h>
+#include <limits.h>
 #include <pkg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -75,14 +77,90 @@ static struct query_flags accepted_query_flags[] = {
 	{ 't', "",		0, PKG_LOAD_BASIC },
 	{ 'R', "",              0, PKG_LOAD_ANNOTATIONS },
 	{ 'V', "",		0, PKG_LOAD_BASIC },
+	{ 'H', "",		0, PKG_LOAD_BASIC },
+	{ 'P', "",		0, PKG_LOAD_BASIC },
 };
 
+KHASH_MAP_INIT_STR(closure_paths, char *);
+
+/* Shortest paths of the closure being printed, by package name */
+static kh_closure_paths_t *closure_paths = NULL;
+
+/*
+ * The closure comes by increasing depth, so the path of the package
+ * preceding this one is always known already, unless it is one of the
+ * matching packages.
+ */
+void
+query_closure_add(struct pkg *pkg)
+{
+	const char	*name, *via;
+	const char	*parent;
+	char		*path;
+	int64_t		 depth;
+	khint_t		 k;
+	int		 ret;
+
+	pkg_get(pkg, PKG_NAME, &name, PKG_VIA, &via, PKG_DEPTH, &depth);
+	if (via == NULL)
+		return;
+
+	if (closure_paths == NULL)
+		closure_paths = kh_init_closure_paths();
+
+	parent = via;
+	if (depth > 1) {
+		k = kh_get_closure_paths(closure_paths, via);
+		if (k != kh_end(closure_paths))
+			parent = kh_value(closure_paths, k);
+	}
+	if (asprintf(&path, "%s>%s", parent, name) == -1)
+		err(EX_OSERR, "asprintf");
+
+	k = kh_put_closure_paths(closure_paths, name, &ret);
+	if (ret == 0)
+		free(kh_value(closure_paths, k));
+	kh_value(closure_paths, k) = path;
+}
+
+void
+query_closure_reset(void)
+{
+	char *path;
+
+	if (closure_paths == NULL)
+		return;
+
+	kh_foreach_value(closure_paths, path, free(path));
+	kh_destroy_closure_paths(closure_paths);
+	closure_paths = NULL;
+}
+
+static const char *
+query_closure_path(struct pkg *pkg)
+{
+	const char	*name;
+	khint_t		 k;
+
+	if (closure_paths == NULL)
+		return (NULL);
+
+	pkg_get(pkg, PKG_NAME, &name);
+	k = kh_get_closure_paths(closure_paths, name);
+	if (k == kh_end(closure_paths))
+		return (NULL);
+
+	return (kh_value(closure_paths, k));
+}
+
 static void
 format_str(struct pkg *pkg, struct sbuf *dest, const char *qstr, const void *data)
 {
 	bool automatic;
 	bool locked;
 	bool vital;
+	int64_t depth;
+	const char *path;
 
 	sbuf_clear(dest);
 
@@ -295,6 +373,14 @@ format_str(struct pkg *pkg, struct sbuf *dest, const char *qstr, const void *dat
 				pkg_get(pkg, PKG_VITAL, &vital);
 				sbuf_printf(dest, "%d", vital);
 				break;
+			case 'H':
+				pkg_get(pkg, PKG_DEPTH, &depth);
+				sbuf_printf(dest, "%" PRId64, depth);
+				break;
+			case 'P':
+				if ((path = query_closure_path(pkg)) != NULL)
+					sbuf_cat(dest, path);
+				break;
 			case '%':
 				sbuf_putc(dest, '%');
 				break;
@@ -727,8 +813,6 @@ bad_option:
 				sbuf_putc(sqlcond, str[0]);
 				if (str[0] == '\'')
 					sbuf_putc(sqlcond, str[0]);
-				else if (str[0] == '%' && for_remote)
-					sbuf_putc(sqlcond, str[0]);
 			}
 		}
 		str++;
@@ -842,7 +926,8 @@ usage_query(void)
 	fprintf(stderr, "       pkg query [-a] <query-format>\n");
 	fprintf(stderr, "       pkg query -F <pkg-name> <query-format>\n");
 	fprintf(stderr, "       pkg query -e <evaluation> <query-format>\n");
-	fprintf(stderr, "       pkg query [-Cgix] <query-format> <pattern> <...>\n\n");
+	fprintf(stderr, "       pkg query [-Cgix] <query-format> <pattern> <...>\n");
+	fprintf(stderr, "       pkg query -D|-R [-L depth] [-Cgix] <query-format> <pattern> <...>\n\n");
 	fprintf(stderr, "For more information see 'pkg help query.'\n");
 }
 
@@ -862,21 +947,28 @@ exec_query(int argc, char **argv)
 	int			 i;
 	char			 multiline = 0;
 	char			*condition = NULL;
+	char			*end;
 	struct sbuf		*sqlcond = NULL;
 	const unsigned int	 q_flags_len = NELEM(accepted_query_flags);
+	bool			 closure = false;
+	bool			 reverse = false;
+	long			 maxdepth = 0;
 
 	struct option longopts[] = {
 		{ "all",		no_argument,		NULL,	'a' },
 		{ "case-sensitive",	no_argument,		NULL,	'C' },
+		{ "deps-closure",	no_argument,		NULL,	'D' },
 		{ "evaluate",		required_argument,	NULL,	'e' },
 		{ "file",		required_argument,	NULL,	'F' },
 		{ "glob",		no_argument,		NULL,	'g' },
 		{ "case-insensitive",	no_argument,		NULL,	'i' },
+		{ "max-depth",		required_argument,	NULL,	'L' },
+		{ "rdeps-closure",	no_argument,		NULL,	'R' },
 		{ "regex",		no_argument,		NULL,	'x' },
 		{ NULL,			0,			NULL,	0   },
 	};
 
-	while ((ch = getopt_long(argc, argv, "+aCe:F:gix", longopts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "+aCDe:F:giL:Rx", longopts, NULL)) != -1) {
 		switch (ch) {
 		case 'a':
 			match = MATCH_ALL;
@@ -884,6 +976,22 @@ exec_query(int argc, char **argv)
 		case 'C':
 			pkgdb_set_case_sensitivity(true);
 			break;
+		case 'D':
+			closure = true;
+			reverse = false;
+			break;
+		case 'L':
+			maxdepth = strtol(optarg, &end, 10);
+			if (*optarg == '\0' || *end != '\0' || maxdepth < 1 ||
+			    maxdepth > INT_MAX)
+				errx(EX_USAGE, "Wrong value for -L. "
+				    "Expecting a positive number, got: %s",
+				    optarg);
+			break;
+		case 'R':
+			closure = true;
+			reverse = true;
+			break;
 		case 'e':
 			match = MATCH_CONDITION;
 			condition = optarg;
@@ -923,6 +1031,11 @@ exec_query(int argc, char **argv)
 		return (EX_USAGE);
 	}
 
+	if (closure && (match == MATCH_ALL || pkgname != NULL)) {
+		usage_query();
+		return (EX_USAGE);
+	}
+
 	if (analyse_query_string(argv[0], accepted_query_flags, q_flags_len,
 			&query_flags, &multiline) != EPKG_OK)
 		return (EX_USAGE);
@@ -973,31 +1086,48 @@ exec_query(int argc, char **argv)
 		const char *condition_sql = NULL;
 		if (match == MATCH_CONDITION && sqlcond)
 			condition_sql = sbuf_data(sqlcond);
-		if ((it = pkgdb_query(db, condition_sql, match)) == NULL)
+		if (closure)
+			it = pkgdb_query_deps_closure(db, condition_sql, match,
+			    reverse, maxdepth);
+		else
+			it = pkgdb_query(db, condition_sql, match);
+		if (it == NULL)
 			return (EX_IOERR);
 
-		while ((ret = pkgdb_it_next(it, &pkg, query_flags)) == EPKG_OK)
+		while ((ret = pkgdb_it_next(it, &pkg, query_flags)) == EPKG_OK) {
+			if (closure)
+				query_closure_add(pkg);
 			print_query(pkg, argv[0],  multiline);
+		}
 
 		if (ret != EPKG_END)
 			retcode = EX_SOFTWARE;
 
+		query_closure_reset();
 		pkgdb_it_free(it);
 	} else {
 		int nprinted = 0;
 		for (i = 1; i < argc; i++) {
 			pkgname = argv[i];
 
-			if ((it = pkgdb_query(db, pkgname, match)) == NULL) {
+			if (closure)
+				it = pkgdb_query_deps_closure(db, pkgname,
+				    match, reverse, maxdepth);
+			else
+				it = pkgdb_query(db, pkgname, match);
+			if (it == NULL) {
 				retcode = EX_IOERR;
 				goto cleanup;
 			}
 
 			while ((ret = pkgdb_it_next(it, &pkg, query_flags)) == EPKG_OK) {
 				nprinted++;
+				if (closure)
+					query_closure_add(pkg);
 				print_query(pkg, argv[0], multiline);
 			}
 
+			query_closure_reset();
 			if (ret != EPKG_END) {
 				retcode = EX_SOFTWARE;
 				break;
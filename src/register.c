@@ -28,6 +28,8 @@
  */
 
 #include <sys/param.h>
+#include <sys/sbuf.h>
+#include <sys/stat.h>
 
 #include <err.h>
 #include <stdio.h>
@@ -71,52 +73,280 @@ usage_register(void)
 	fprintf(stderr, "Usage: pkg register [-ldt] [-i <input-path>]"
 	                " [-f <plist-file>] -m <metadatadir>\n");
 	fprintf(stderr, "       pkg register [-ldt] [-i <input_path>]"
-		        " -M <manifest>\n\n");
+		        " -M <manifest>\n");
+	fprintf(stderr, "       pkg register [-ldt] [-i <input_path>]"
+		        " [-n <chunk>] -b <list>\n\n");
 	fprintf(stderr, "For more information see 'pkg help register'.\n");
 }
 
-int
-exec_register(int argc, char **argv)
+/*
+ * Assemble the metadata of a package from a manifest or from a metadata
+ * directory
+ */
+static int
+register_read(struct pkg *pkg, const char *mdir, const char *mfile,
+    const char *plist, const char *input_path)
 {
-	struct pkg	*pkg = NULL;
-	struct pkgdb	*db  = NULL;
-
 	struct pkg_manifest_key *keys = NULL;
 
 	regex_t		 preg;
 	regmatch_t	 pmatch[2];
 
-	char		*arch = NULL;
-	char		 myarch[BUFSIZ];
 	char		*www  = NULL;
 	char		 fpath[MAXPATHLEN];
+	const char	*desc = NULL;
+
+	size_t		 size;
+	int		 i;
+	int		 ret;
+
+	pkg_manifest_keys_new(&keys);
+
+	if (mfile != NULL) {
+		ret = pkg_parse_manifest_file(pkg, mfile, keys);
+		pkg_manifest_keys_free(keys);
+		return (ret);
+	}
+
+	snprintf(fpath, sizeof(fpath), "%s/+MANIFEST", mdir);
+	ret = pkg_parse_manifest_file(pkg, fpath, keys);
+	pkg_manifest_keys_free(keys);
+	if (ret != EPKG_OK)
+		return (ret);
+
+	snprintf(fpath, sizeof(fpath), "%s/+DESC", mdir);
+	if (access(fpath, F_OK) == 0)
+		pkg_set_from_file(pkg, PKG_DESC, fpath, false);
+
+	snprintf(fpath, sizeof(fpath), "%s/+DISPLAY", mdir);
+	if (access(fpath, F_OK) == 0)
+		pkg_set_from_file(pkg, PKG_MESSAGE, fpath, false);
+
+	for (i = 0; scripts[i] != NULL; i++) {
+		snprintf(fpath, sizeof(fpath), "%s/%s", mdir,
+		    scripts[i]);
+		if (access(fpath, F_OK) == 0)
+			pkg_addscript_file(pkg, fpath);
+	}
+
+	pkg_get(pkg, PKG_WWW, &www);
+
+	/* 
+	 * if www is not given then try to determine it from
+	 * description
+	 */
+
+	if (www == NULL) {
+		pkg_get(pkg, PKG_DESC, &desc);
+		regcomp(&preg, "^WWW:[[:space:]]*(.*)$",
+		    REG_EXTENDED|REG_ICASE|REG_NEWLINE);
+		if (regexec(&preg, desc, 2, pmatch, 0) == 0) {
+			size = pmatch[1].rm_eo - pmatch[1].rm_so;
+			www = strndup(&desc[pmatch[1].rm_so], size);
+			pkg_set(pkg, PKG_WWW, www);
+			free(www);
+		} else {
+			pkg_set(pkg, PKG_WWW, "UNKNOWN");
+		}
+		regfree(&preg);
+	}
+
+	if (plist != NULL)
+		ret += ports_parse_plist(pkg, plist, input_path);
+
+	return (ret);
+}
+
+static int
+register_add(struct pkgdb *db, struct pkg *pkg, const char *input_path,
+    const char *location, bool testing_mode, bool legacy)
+{
+	char		*arch = NULL;
+	char		 myarch[BUFSIZ];
+	bool		 developer;
+	int		 ret;
+
+	developer = pkg_object_bool(pkg_config_get("DEVELOPER_MODE"));
+
+	/*
+	 * testing_mode allows updating the local package database
+	 * without any check that the files etc. listed in the meta
+	 * data actually exist on the system.  Inappropriate use of
+	 * testing_mode can really screw things up.
+	 */
+
+	if (!testing_mode)
+		pkg_analyse_files(db, pkg, input_path);
+
+	pkg_get(pkg, PKG_ABI, &arch);
+	if (arch == NULL) {
+		/*
+		 * do not take the one from configuration on purpose
+		 * but the real abi of the package.
+		 */
+		pkg_get_myarch(myarch, BUFSIZ);
+		if (developer)
+			pkg_suggest_arch(pkg, myarch, true);
+		pkg_set(pkg, PKG_ABI, myarch);
+	} else {
+		if (developer)
+			pkg_suggest_arch(pkg, arch, false);
+	}
+
+	ret = pkg_add_port(db, pkg, input_path, location, testing_mode);
+
+	if (!legacy && ret == EPKG_OK && messages != NULL) {
+		sbuf_finish(messages);
+		printf("%s\n", sbuf_data(messages));
+		sbuf_clear(messages);
+	}
+
+	return (ret);
+}
+
+static int
+register_commit(struct pkgdb *db, int *done, int *registered, int *failed)
+{
+	int ret;
+
+	if ((ret = pkgdb_transaction_commit(db, NULL)) == EPKG_OK)
+		*registered += *done;
+	else {
+		pkgdb_transaction_rollback(db, NULL);
+		*failed += *done;
+	}
+	*done = 0;
+
+	return (ret);
+}
+
+/*
+ * Register every metadata directory or manifest listed in the batch file,
+ * one per line, committing every chunk packages.  A failed package is
+ * rolled back alone and reported, the others are still registered.
+ */
+static int
+register_batch(struct pkgdb *db, const char *batch, long chunk,
+    bool automatic, const char *input_path, const char *location,
+    bool testing_mode, bool legacy)
+{
+	FILE		*f;
+	struct pkg	*pkg;
+	struct stat	 st;
+	char		*line = NULL;
+	size_t		 linecap = 0;
+	ssize_t		 linelen;
+	long		 pending = 0;
+	int		 done = 0, registered = 0, failed = 0;
+	int		 ret;
+
+	if (strcmp(batch, "-") == 0)
+		f = stdin;
+	else if ((f = fopen(batch, "r")) == NULL) {
+		warn("%s", batch);
+		return (EX_NOINPUT);
+	}
+
+	pkg_analyse_cache_shlibs(true);
+	pkgdb_set_register_nested(db, true);
+
+	while ((linelen = getline(&line, &linecap, f)) > 0) {
+		if (line[linelen - 1] == '\n')
+			line[--linelen] = '\0';
+		if (linelen == 0 || line[0] == '#')
+			continue;
+
+		if (pending == 0 &&
+		    pkgdb_transaction_begin(db, NULL) != EPKG_OK) {
+			warnx("Cannot start transaction for registering");
+			failed++;
+			break;
+		}
+
+		if (pkg_new(&pkg, PKG_INSTALLED) != EPKG_OK)
+			err(EX_OSERR, "malloc");
+		if (automatic)
+			pkg_set(pkg, PKG_AUTOMATIC, (bool)true);
+
+		if (stat(line, &st) == -1) {
+			warn("%s", line);
+			ret = EPKG_FATAL;
+		} else if (S_ISDIR(st.st_mode))
+			ret = register_read(pkg, line, NULL, NULL, input_path);
+		else
+			ret = register_read(pkg, NULL, line, NULL, input_path);
+
+		if (ret == EPKG_OK)
+			ret = register_add(db, pkg, input_path, location,
+			    testing_mode, legacy);
+		pkg_free(pkg);
+
+		if (ret != EPKG_OK) {
+			warnx("%s: cannot be registered", line);
+			failed++;
+		} else
+			done++;
+
+		if (++pending == chunk) {
+			pending = 0;
+			if (register_commit(db, &done, &registered, &failed)
+			    != EPKG_OK)
+				break;
+		}
+	}
+
+	if (pending > 0)
+		register_commit(db, &done, &registered, &failed);
+
+	pkgdb_set_register_nested(db, false);
+	pkg_analyse_cache_shlibs(false);
+	free(line);
+	if (f != stdin)
+		fclose(f);
+
+	if (failed > 0) {
+		warnx("%d package(s) registered, %d failed", registered,
+		    failed);
+		return (EX_SOFTWARE);
+	}
+
+	return (EX_OK);
+}
+
+int
+exec_register(int argc, char **argv)
+{
+	struct pkg	*pkg = NULL;
+	struct pkgdb	*db  = NULL;
 
 	const char	*plist      = NULL;
 	const char	*mdir       = NULL;
 	const char	*mfile      = NULL;
+	const char	*batch      = NULL;
 	const char	*input_path = NULL;
-	const char	*desc       = NULL;
 	const char	*location   = NULL;
 
-	size_t		 size;
+	char		*end;
+	long		 chunk = 100;
 
-	bool		 developer;
+	bool		 automatic     = false;
 	bool		 legacy        = false;
 	bool		 __unused metadata_only = false;
 	bool		 testing_mode  = false;
 
 	int		 ch;
-	int		 i;
 	int		 ret     = EPKG_OK;
 	int		 retcode = EX_OK;
 
 	/* options descriptor */
 	struct option longopts[] = {
 		{ "automatic",	no_argument,		NULL,	'A' },
+		{ "batch",	required_argument,	NULL,	'b' },
 		{ "debug",      no_argument,		NULL,	'd' },
 		{ "legacy",	no_argument,		NULL,	'l' },
 		{ "manifest",	required_argument,	NULL,	'M' },
 		{ "metadata",	required_argument,	NULL,	'm' },
+		{ "chunk",	required_argument,	NULL,	'n' },
 		{ "plist",	required_argument,	NULL,	'f' },
 		{ "relocate",	required_argument,	NULL, 	1 },
 		{ "root",	required_argument,	NULL,	'i' },
@@ -124,16 +354,14 @@ exec_register(int argc, char **argv)
 		{ NULL,		0,			NULL,	0},
 	};
 
-	developer = pkg_object_bool(pkg_config_get("DEVELOPER_MODE"));
-
-	if (pkg_new(&pkg, PKG_INSTALLED) != EPKG_OK)
-		err(EX_OSERR, "malloc");
-
-	while ((ch = getopt_long(argc, argv, "+Adf:i:lM:m:t", longopts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "+Ab:df:i:lM:m:n:t", longopts, NULL)) != -1) {
 		switch (ch) {
 		case 'A':
 		case 'd':
-			pkg_set(pkg, PKG_AUTOMATIC, (bool)true);
+			automatic = true;
+			break;
+		case 'b':
+			batch = optarg;
 			break;
 		case 'f':
 			plist = optarg;
@@ -151,6 +379,13 @@ exec_register(int argc, char **argv)
 		case 'm':
 			mdir = optarg;
 			break;
+		case 'n':
+			chunk = strtol(optarg, &end, 10);
+			if (*optarg == '\0' || *end != '\0' || chunk < 1)
+				errx(EX_USAGE, "Wrong value for -n. "
+				    "Expecting a positive number, got: %s",
+				    optarg);
+			break;
 		case 't':
 			testing_mode = true;
 			break;
@@ -160,7 +395,6 @@ exec_register(int argc, char **argv)
 		default:
 			warnx("Unrecognised option -%c\n", ch);
 			usage_register();
-			pkg_free(pkg);
 			return (EX_USAGE);
 		}
 	}
@@ -171,10 +405,8 @@ exec_register(int argc, char **argv)
 			       PKGDB_DB_LOCAL);
 	if (retcode == EPKG_ENOACCESS) {
 		warnx("Insufficient privileges to register packages");
-		pkg_free(pkg);
 		return (EX_NOPERM);
 	} else if (retcode != EPKG_OK) {
-		pkg_free(pkg);
 		return (EX_IOERR);
 	} else
 		retcode = EX_OK;
@@ -190,112 +422,53 @@ exec_register(int argc, char **argv)
 	 * meta-data from, and overrides the use of legacy meta-data
 	 * inputs.
 	 *
+	 * The -b option lists many metadata directories or manifests,
+	 * registered in one session of the database.
+	 *
 	 * Dependencies, shlibs, files etc. may be derived by
 	 * analysing the package files (maybe discovered as the
 	 * content of the staging directory) unless -t (testing_mode)
 	 * is used.
 	 */
 
-	if (mfile != NULL && mdir != NULL) {
-		warnx("Cannot use both -m and -M together");
+	if ((mfile != NULL) + (mdir != NULL) + (batch != NULL) > 1) {
+		warnx("Only one of -b, -m or -M can be used");
 		usage_register();
-		pkg_free(pkg);
 		return (EX_USAGE);
 	}
 
 
-	if (mfile == NULL && mdir == NULL) {
-		warnx("One of either -m or -M flags is required");
+	if (mfile == NULL && mdir == NULL && batch == NULL) {
+		warnx("One of either -b, -m or -M flags is required");
 		usage_register();
-		pkg_free(pkg);
 		return (EX_USAGE);
 	}
 
-	if (mfile != NULL && plist != NULL) {
-		warnx("-M incompatible with -f option");
+	if ((mfile != NULL || batch != NULL) && plist != NULL) {
+		warnx("-f only works with -m");
 		usage_register();
-		pkg_free(pkg);
 		return (EX_USAGE);
 	}
 
 	if (testing_mode && input_path != NULL) {
 		warnx("-i incompatible with -t option");
 		usage_register();
-		pkg_free(pkg);
 		return (EX_USAGE);
 	}
 
-	pkg_manifest_keys_new(&keys);
-
-	if (mfile != NULL) {
-		ret = pkg_parse_manifest_file(pkg, mfile, keys);
-		pkg_manifest_keys_free(keys);
-		if (ret != EPKG_OK) {
-			pkg_free(pkg);
-			return (EX_IOERR);
-		}
+	if (batch == NULL) {
+		if (pkg_new(&pkg, PKG_INSTALLED) != EPKG_OK)
+			err(EX_OSERR, "malloc");
+		if (automatic)
+			pkg_set(pkg, PKG_AUTOMATIC, (bool)true);
 
-	} else {
-		snprintf(fpath, sizeof(fpath), "%s/+MANIFEST", mdir);
-		ret = pkg_parse_manifest_file(pkg, fpath, keys);
-		pkg_manifest_keys_free(keys);
+		ret = register_read(pkg, mdir, mfile, plist, input_path);
 		if (ret != EPKG_OK) {
 			pkg_free(pkg);
 			return (EX_IOERR);
 		}
-
-		snprintf(fpath, sizeof(fpath), "%s/+DESC", mdir);
-		if (access(fpath, F_OK) == 0)
-			pkg_set_from_file(pkg, PKG_DESC, fpath, false);
-
-		snprintf(fpath, sizeof(fpath), "%s/+DISPLAY", mdir);
-		if (access(fpath, F_OK) == 0)
-			pkg_set_from_file(pkg, PKG_MESSAGE, fpath, false);
-
-		for (i = 0; scripts[i] != NULL; i++) {
-			snprintf(fpath, sizeof(fpath), "%s/%s", mdir,
-			    scripts[i]);
-			if (access(fpath, F_OK) == 0)
-				pkg_addscript_file(pkg, fpath);
-		}
-
-		if (www != NULL) {
-			pkg_set(pkg, PKG_WWW, www);
-			free(www);
-		}
-
-		pkg_get(pkg, PKG_WWW, &www);
-
-		/* 
-		 * if www is not given then try to determine it from
-		 * description
-		 */
-
-		if (www == NULL) {
-			pkg_get(pkg, PKG_DESC, &desc);
-			regcomp(&preg, "^WWW:[[:space:]]*(.*)$",
-			    REG_EXTENDED|REG_ICASE|REG_NEWLINE);
-			if (regexec(&preg, desc, 2, pmatch, 0) == 0) {
-				size = pmatch[1].rm_eo - pmatch[1].rm_so;
-				www = strndup(&desc[pmatch[1].rm_so], size);
-				pkg_set(pkg, PKG_WWW, www);
-				free(www);
-			} else {
-				pkg_set(pkg, PKG_WWW, "UNKNOWN");
-			}
-			regfree(&preg);
-		}
-
-		if (plist != NULL)
-			ret += ports_parse_plist(pkg, plist, input_path);
-	}
-
-	if (ret != EPKG_OK) {
-		pkg_free(pkg);
-		return (EX_IOERR);
 	}
 
-
 	if (pkgdb_open(&db, PKGDB_DEFAULT) != EPKG_OK) {
 		pkg_free(pkg);
 		return (EX_IOERR);
@@ -308,39 +481,18 @@ exec_register(int argc, char **argv)
 		return (EX_TEMPFAIL);
 	}
 
-	/*
-	 * testing_mode allows updating the local package database
-	 * without any check that the files etc. listed in the meta
-	 * data actually exist on the system.  Inappropriate use of
-	 * testing_mode can really screw things up.
-	 */
-
-	if (!testing_mode)
-		pkg_analyse_files(db, pkg, input_path);
-
-	pkg_get(pkg, PKG_ABI, &arch);
-	if (arch == NULL) {
-		/*
-		 * do not take the one from configuration on purpose
-		 * but the real abi of the package.
-		 */
-		pkg_get_myarch(myarch, BUFSIZ);
-		if (developer)
-			pkg_suggest_arch(pkg, myarch, true);
-		pkg_set(pkg, PKG_ABI, myarch);
+	if (batch != NULL) {
+		retcode = register_batch(db, batch, chunk, automatic,
+		    input_path, location, testing_mode, legacy);
 	} else {
-		if (developer)
-			pkg_suggest_arch(pkg, arch, false);
-	}
-
-	retcode = pkg_add_port(db, pkg, input_path, location, testing_mode);
-
-	if (!legacy && retcode == EPKG_OK && messages != NULL) {
-		sbuf_finish(messages);
-		printf("%s\n", sbuf_data(messages));
+		ret = register_add(db, pkg, input_path, location,
+		    testing_mode, legacy);
+		pkg_free(pkg);
+		retcode = (ret != EPKG_OK ? EX_SOFTWARE : EX_OK);
 	}
 
-	pkg_free(pkg);
+	pkgdb_release_lock(db, PKGDB_LOCK_EXCLUSIVE);
+	pkgdb_close(db);
 
-	return (retcode != EPKG_OK ? EX_SOFTWARE : EX_OK);
+	return (retcode);
 }
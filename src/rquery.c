@@ -34,6 +34,7 @@
 #include <err.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <pkg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -66,7 +67,9 @@ static struct query_flags accepted_rquery_flags[] = {
 	{ 'w', "",		0, PKG_LOAD_BASIC },
 	{ 'l', "",		0, PKG_LOAD_BASIC },
 	{ 'q', "",		0, PKG_LOAD_BASIC },
-	{ 'M', "",		0, PKG_LOAD_BASIC }
+	{ 'M', "",		0, PKG_LOAD_BASIC },
+	{ 'H', "",		0, PKG_LOAD_BASIC },
+	{ 'P', "",		0, PKG_LOAD_BASIC }
 };
 
 void
@@ -75,7 +78,8 @@ usage_rquery(void)
 	fprintf(stderr, "Usage: pkg rquery [-r reponame] [-I|<query-format>] <pkg-name>\n");
 	fprintf(stderr, "       pkg rquery [-a] [-r reponame] [-I|<query-format>]\n");
 	fprintf(stderr, "       pkg rquery -e <evaluation> [-r reponame] <query-format>\n");
-	fprintf(stderr, "       pkg rquery [-Cgix] [-r reponame] [-I|<query-format>] <pattern> <...>\n\n");
+	fprintf(stderr, "       pkg rquery [-Cgix] [-r reponame] [-I|<query-format>] <pattern> <...>\n");
+	fprintf(stderr, "       pkg rquery -D|-R [-L depth] [-Cgix] [-r reponame] <query-format> <pattern> <...>\n\n");
 	fprintf(stderr, "For more information see 'pkg help rquery.'\n");
 }
 
@@ -123,14 +127,21 @@ exec_rquery(int argc, char **argv)
 	bool			 onematched = false;
 	bool			 old_quiet;
 	bool			 index_output = false;
+	bool			 closure = false;
+	bool			 reverse = false;
+	long			 maxdepth = 0;
+	char			*end;
 
 	struct option longopts[] = {
 		{ "all",		no_argument,		NULL,	'a' },
 		{ "case-sensitive",	no_argument,		NULL,	'C' },
+		{ "deps-closure",	no_argument,		NULL,	'D' },
 		{ "evaluate",		required_argument,	NULL,	'e' },
 		{ "glob",		no_argument,		NULL,	'g' },
 		{ "case-insensitive",	no_argument,		NULL,	'i' },
 		{ "index-line",		no_argument,		NULL,	'I' },
+		{ "max-depth",		required_argument,	NULL,	'L' },
+		{ "rdeps-closure",	no_argument,		NULL,	'R' },
 		{ "repository",		required_argument,	NULL,	'r' },
 		{ "no-repo-update",	no_argument,		NULL,	'U' },
 		{ "regex",		no_argument,		NULL,	'x' },
@@ -139,7 +150,7 @@ exec_rquery(int argc, char **argv)
 
 	portsdir = pkg_object_string(pkg_config_get("PORTSDIR"));
 
-	while ((ch = getopt_long(argc, argv, "+aCgiIxe:r:U", longopts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "+aCDgiIL:Rxe:r:U", longopts, NULL)) != -1) {
 		switch (ch) {
 		case 'a':
 			match = MATCH_ALL;
@@ -147,6 +158,22 @@ exec_rquery(int argc, char **argv)
 		case 'C':
 			pkgdb_set_case_sensitivity(true);
 			break;
+		case 'D':
+			closure = true;
+			reverse = false;
+			break;
+		case 'L':
+			maxdepth = strtol(optarg, &end, 10);
+			if (*optarg == '\0' || *end != '\0' || maxdepth < 1 ||
+			    maxdepth > INT_MAX)
+				errx(EX_USAGE, "Wrong value for -L. "
+				    "Expecting a positive number, got: %s",
+				    optarg);
+			break;
+		case 'R':
+			closure = true;
+			reverse = true;
+			break;
 		case 'e':
 			match = MATCH_CONDITION;
 			condition = optarg;
@@ -196,6 +223,11 @@ exec_rquery(int argc, char **argv)
 			match = MATCH_ALL;
 	}
 
+	if (closure && (index_output || match == MATCH_ALL)) {
+		usage_rquery();
+		return (EX_USAGE);
+	}
+
 	if (!index_output && analyse_query_string(argv[0], accepted_rquery_flags, q_flags_len, &query_flags, &multiline) != EPKG_OK)
 		return (EX_USAGE);
 
@@ -244,13 +276,20 @@ exec_rquery(int argc, char **argv)
 		const char *condition_sql = NULL;
 		if (match == MATCH_CONDITION && sqlcond)
 			condition_sql = sbuf_data(sqlcond);
-		if ((it = pkgdb_repo_query(db, condition_sql, match, reponame)) == NULL) {
+		if (closure)
+			it = pkgdb_repo_query_deps_closure(db, condition_sql,
+			    match, reverse, maxdepth, reponame);
+		else
+			it = pkgdb_repo_query(db, condition_sql, match, reponame);
+		if (it == NULL) {
 			if (sqlcond != NULL)
 				sbuf_delete(sqlcond);
 			return (EX_IOERR);
 		}
 
 		while ((ret = pkgdb_it_next(it, &pkg, query_flags)) == EPKG_OK) {
+			if (closure)
+				query_closure_add(pkg);
 			if (index_output)
 				print_index(pkg, portsdir);
 			else
@@ -260,12 +299,19 @@ exec_rquery(int argc, char **argv)
 		if (ret != EPKG_END)
 			retcode = EX_SOFTWARE;
 
+		query_closure_reset();
+
 		pkgdb_it_free(it);
 	} else {
 		for (i = (index_output ? 0 : 1); i < argc; i++) {
 			pkgname = argv[i];
 
-			if ((it = pkgdb_repo_query(db, pkgname, match, reponame)) == NULL) {
+			if (closure)
+				it = pkgdb_repo_query_deps_closure(db, pkgname,
+				    match, reverse, maxdepth, reponame);
+			else
+				it = pkgdb_repo_query(db, pkgname, match, reponame);
+			if (it == NULL) {
 				if (sqlcond != NULL)
 					sbuf_delete(sqlcond);
 				return (EX_IOERR);
@@ -273,12 +319,16 @@ exec_rquery(int argc, char **argv)
 
 			while ((ret = pkgdb_it_next(it, &pkg, query_flags)) == EPKG_OK) {
 				onematched = true;
+				if (closure)
+					query_closure_add(pkg);
 				if (index_output)
 					print_index(pkg, portsdir);
 				else
 					print_query(pkg, argv[0], multiline);
 			}
 
+			query_closure_reset();
+
 			if (ret != EPKG_END) {
 				retcode = EX_SOFTWARE;
 				break;
@@ -0,0 +1,611 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "pkg_config.h"
+#endif
+
+#include <sys/param.h>
+#include <sys/sbuf.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#include <pkg.h>
+
+#include "pkgcli.h"
+
+/*
+ * A request is the client cwd followed by the command line, each string NUL
+ * terminated, preceded by its length which carries the client stdin, stdout
+ * and stderr.  The answer is the exit status of the command.
+ */
+#define SERVE_MAXREQ	65536
+
+/* Only the read-only commands are served */
+static const struct {
+	const char *name;
+	int (*exec)(int argc, char **argv);
+} served[] = {
+	{ "info", exec_info },
+	{ "query", exec_query },
+	{ "rquery", exec_rquery },
+	{ "search", exec_search },
+	{ "version", exec_version },
+};
+
+static volatile sig_atomic_t serve_stopped = 0;
+
+void
+usage_serve(void)
+{
+	fprintf(stderr, "Usage: pkg serve [-s socket]\n\n");
+	fprintf(stderr, "For more information see 'pkg help serve'.\n");
+}
+
+static ssize_t
+read_full(int fd, void *buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t r;
+
+	while (done < len) {
+		r = read(fd, (char *)buf + done, len - done);
+		if (r == -1 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			break;
+		done += r;
+	}
+
+	return (done);
+}
+
+static int
+write_full(int fd, const void *buf, size_t len)
+{
+	ssize_t w;
+
+	while (len > 0) {
+		w = write(fd, buf, len);
+		if (w == -1 && errno == EINTR)
+			continue;
+		if (w <= 0)
+			return (-1);
+		buf = (const char *)buf + w;
+		len -= w;
+	}
+
+	return (0);
+}
+
+static int
+send_fds(int sock, const void *buf, size_t len, const int *fds, int nfds)
+{
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	char control[CMSG_SPACE(3 * sizeof(int))];
+
+	memset(&msg, 0, sizeof(msg));
+	memset(control, 0, sizeof(control));
+	iov.iov_base = (void *)buf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+
+	return (sendmsg(sock, &msg, 0) == (ssize_t)len ? 0 : -1);
+}
+
+/*
+ * Returns the length read, or -1 unless the whole buffer and exactly nfds
+ * descriptors were received.  On failure every descriptor that came with
+ * the message is closed.
+ */
+static ssize_t
+recv_fds(int sock, void *buf, size_t len, int *fds, int nfds)
+{
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	char control[CMSG_SPACE(3 * sizeof(int))];
+	int got = 0, fd, i, n;
+	ssize_t r;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+
+	while ((r = recvmsg(sock, &msg, 0)) == -1 && errno == EINTR)
+		;
+	if (r == -1)
+		return (-1);
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+	    cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+		    cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (i = 0; i < n; i++, got++) {
+			memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int),
+			    sizeof(int));
+			if (got < nfds)
+				fds[got] = fd;
+			else
+				close(fd);
+		}
+	}
+
+	if (r != (ssize_t)len || got != nfds ||
+	    (msg.msg_flags & MSG_CTRUNC)) {
+		for (i = 0; i < MIN(got, nfds); i++)
+			close(fds[i]);
+		return (-1);
+	}
+
+	return (r);
+}
+
+static int
+serve_sockaddr(const char *path, struct sockaddr_un *sun)
+{
+
+	memset(sun, 0, sizeof(*sun));
+	sun->sun_family = AF_UNIX;
+	if (strlcpy(sun->sun_path, path, sizeof(sun->sun_path)) >=
+	    sizeof(sun->sun_path)) {
+		warnx("%s: socket path too long", path);
+		return (-1);
+	}
+
+	return (0);
+}
+
+int
+serve_client(const char *path, int argc, char **argv)
+{
+	struct sockaddr_un sun;
+	struct sbuf *sb;
+	char cwd[MAXPATHLEN];
+	const int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+	uint32_t len;
+	int32_t status;
+	int sock, serrno, i;
+
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+		err(EX_SOFTWARE, "getcwd()");
+
+	sb = sbuf_new_auto();
+	sbuf_bcat(sb, cwd, strlen(cwd) + 1);
+	for (i = 0; i < argc; i++)
+		sbuf_bcat(sb, argv[i], strlen(argv[i]) + 1);
+	sbuf_finish(sb);
+	len = sbuf_len(sb);
+
+	if (serve_sockaddr(path, &sun) == -1) {
+		sbuf_delete(sb);
+		return (EX_USAGE);
+	}
+
+	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1 ||
+	    connect(sock, (struct sockaddr *)&sun, sizeof(sun)) == -1) {
+		warn("%s", path);
+		sbuf_delete(sb);
+		if (sock != -1)
+			close(sock);
+		return (EX_UNAVAILABLE);
+	}
+
+	/* A refused request is answered before it is read */
+	if (send_fds(sock, &len, sizeof(len), fds, 3) == -1 ||
+	    write_full(sock, sbuf_data(sb), len) == -1) {
+		serrno = errno;
+		if (read_full(sock, &status, sizeof(status)) !=
+		    sizeof(status)) {
+			errno = serrno;
+			warn("%s", path);
+			status = EX_IOERR;
+		}
+	} else if (read_full(sock, &status, sizeof(status)) !=
+	    sizeof(status)) {
+		warnx("%s: connection closed by the service", path);
+		status = EX_SOFTWARE;
+	}
+
+	close(sock);
+	sbuf_delete(sb);
+
+	return (status);
+}
+
+static int32_t
+serve_run(char *cwd, int argc, char **argv)
+{
+	unsigned i;
+	int cwdfd;
+	int32_t status;
+
+	if ((cwdfd = open(".", O_RDONLY|O_DIRECTORY)) == -1) {
+		warn("open(.)");
+		return (EX_SOFTWARE);
+	}
+	if (chdir(cwd) == -1) {
+		warn("%s", cwd);
+		close(cwdfd);
+		return (EX_NOINPUT);
+	}
+
+	status = EX_USAGE;
+	for (i = 0; i < NELEM(served); i++) {
+		if (argc > 0 && strcmp(argv[0], served[i].name) == 0)
+			break;
+	}
+	if (i == NELEM(served)) {
+		warnx("'%s' is not served, only read-only commands are",
+		    argc > 0 ? argv[0] : "");
+	} else {
+		set_globals();
+		/* Only pkg update refreshes the catalogues */
+		auto_update = false;
+		/* 0 also restarts a GNU getopt_long left in the middle of
+		 * a previous command line */
+		optreset = 1;
+		optind = 0;
+		status = served[i].exec(argc, argv);
+	}
+
+	if (fchdir(cwdfd) == -1)
+		err(EX_SOFTWARE, "fchdir()");
+	close(cwdfd);
+
+	return (status);
+}
+
+static void
+serve_request(int conn)
+{
+	uint32_t len;
+	int32_t status;
+	int fds[3], saved[3];
+	char *buf, **argv, *p;
+	int argc, i;
+
+	if (recv_fds(conn, &len, sizeof(len), fds, 3) != sizeof(len))
+		return;
+
+	buf = NULL;
+	argv = NULL;
+	if (len == 0 || len > SERVE_MAXREQ || (buf = malloc(len)) == NULL ||
+	    read_full(conn, buf, len) != len || buf[len - 1] != '\0')
+		goto cleanup;
+
+	/* the first string is the cwd */
+	argc = -1;
+	for (p = buf; p < buf + len; p += strlen(p) + 1)
+		argc++;
+	if ((argv = calloc(argc + 1, sizeof(char *))) == NULL)
+		goto cleanup;
+	p = buf + strlen(buf) + 1;
+	for (i = 0; i < argc; i++, p += strlen(p) + 1)
+		argv[i] = p;
+
+	fflush(stdout);
+	fflush(stderr);
+	for (i = 0; i < 3; i++) {
+		saved[i] = dup(i);
+		dup2(fds[i], i);
+	}
+
+	status = serve_run(buf, argc, argv);
+
+	fflush(stdout);
+	fflush(stderr);
+	for (i = 0; i < 3; i++) {
+		dup2(saved[i], i);
+		close(saved[i]);
+	}
+
+	write_full(conn, &status, sizeof(status));
+
+	/* No package outlives the request */
+	pkg_intern_reset();
+
+cleanup:
+	for (i = 0; i < 3; i++)
+		close(fds[i]);
+	free(argv);
+	free(buf);
+}
+
+/*
+ * The worker keeps the databases open between the requests it is handed by
+ * the supervisor.
+ */
+static void
+serve_worker(int ctl)
+{
+	char ack = 0;
+	int conn;
+
+	pkgdb_set_resident(true);
+
+	for (;;) {
+		if (recv_fds(ctl, &ack, 1, &conn, 1) != 1)
+			exit(EX_OK);
+		serve_request(conn);
+		close(conn);
+		if (write_full(ctl, &ack, 1) == -1)
+			exit(EX_OK);
+	}
+}
+
+static pid_t
+serve_spawn(int sock, int *ctl)
+{
+	int sp[2];
+	pid_t pid;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sp) == -1) {
+		warn("socketpair()");
+		return (-1);
+	}
+
+	if ((pid = fork()) == -1) {
+		warn("fork()");
+		close(sp[0]);
+		close(sp[1]);
+		return (-1);
+	}
+
+	if (pid == 0) {
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		close(sock);
+		close(sp[0]);
+		serve_worker(sp[1]);
+		/* NOTREACHED */
+	}
+
+	close(sp[1]);
+	*ctl = sp[0];
+
+	return (pid);
+}
+
+/* Returns the exit status of the worker */
+static int32_t
+serve_reap(pid_t *worker, int *ctl)
+{
+	int wstatus;
+
+	close(*ctl);
+	*ctl = -1;
+	while (waitpid(*worker, &wstatus, 0) == -1) {
+		if (errno != EINTR) {
+			*worker = -1;
+			return (EX_SOFTWARE);
+		}
+	}
+	*worker = -1;
+
+	return (WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : EX_SOFTWARE);
+}
+
+/*
+ * The commands run with the privileges of the service, in a directory the
+ * client chose: only serve root and the user running the service.
+ */
+static bool
+serve_allowed(int conn)
+{
+	uid_t uid;
+#ifdef HAVE_GETPEEREID
+	gid_t gid;
+
+	if (getpeereid(conn, &uid, &gid) == -1) {
+		warn("getpeereid()");
+		return (false);
+	}
+#elif defined(SO_PEERCRED)
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1) {
+		warn("getsockopt(SO_PEERCRED)");
+		return (false);
+	}
+	uid = cred.uid;
+#else
+	warnx("the credentials of the clients cannot be checked");
+	return (false);
+#endif
+
+	if (uid != 0 && uid != geteuid()) {
+		warnx("refusing the requests of uid %ju", (uintmax_t)uid);
+		return (false);
+	}
+
+	return (true);
+}
+
+static int
+serve_listen(const char *path)
+{
+	struct sockaddr_un sun;
+	struct stat st;
+	mode_t mask;
+	int sock;
+
+	if (serve_sockaddr(path, &sun) == -1)
+		return (-1);
+
+	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		warn("socket()");
+		return (-1);
+	}
+
+	/* Reuse a socket left behind, unless it is still served */
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		if (connect(sock, (struct sockaddr *)&sun, sizeof(sun)) == 0) {
+			warnx("%s: already served", path);
+			close(sock);
+			return (-1);
+		}
+		unlink(path);
+	}
+
+	/* Created 0600, so that no one else can even connect */
+	mask = umask(0177);
+	if (bind(sock, (struct sockaddr *)&sun, sizeof(sun)) == -1 ||
+	    listen(sock, 16) == -1) {
+		warn("%s", path);
+		umask(mask);
+		close(sock);
+		return (-1);
+	}
+	umask(mask);
+
+	return (sock);
+}
+
+static void
+serve_stop(int sig __unused)
+{
+	serve_stopped = 1;
+}
+
+int
+exec_serve(int argc, char **argv)
+{
+	const char *path = "/var/run/pkg.sock";
+	struct sigaction sa;
+	pid_t worker = -1;
+	int32_t status;
+	int sock, conn, ctl = -1, ch, tries;
+	char ack;
+
+	struct option longopts[] = {
+		{ "socket",	required_argument,	NULL,	's' },
+		{ NULL,		0,			NULL,	0   },
+	};
+
+	while ((ch = getopt_long(argc, argv, "+s:", longopts, NULL)) != -1) {
+		switch (ch) {
+		case 's':
+			path = optarg;
+			break;
+		default:
+			usage_serve();
+			return (EX_USAGE);
+		}
+	}
+	argc -= optind;
+
+	if (argc != 0) {
+		usage_serve();
+		return (EX_USAGE);
+	}
+
+	if ((sock = serve_listen(path)) == -1)
+		return (EX_UNAVAILABLE);
+
+	/* Not restarted, so that accept() returns and the socket is removed */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = serve_stop;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	while (!serve_stopped) {
+		if ((conn = accept(sock, NULL, NULL)) == -1) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			warn("accept()");
+			break;
+		}
+
+		if (!serve_allowed(conn)) {
+			status = EX_NOPERM;
+			write_full(conn, &status, sizeof(status));
+			close(conn);
+			continue;
+		}
+
+		/* Respawn a worker which exited while idle */
+		for (tries = 0; tries < 2; tries++) {
+			if (worker == -1 &&
+			    (worker = serve_spawn(sock, &ctl)) == -1)
+				break;
+			if (send_fds(ctl, "", 1, &conn, 1) == 0)
+				break;
+			serve_reap(&worker, &ctl);
+		}
+		if (worker == -1 || tries == 2) {
+			close(conn);
+			break;
+		}
+
+		if (read_full(ctl, &ack, 1) != 1) {
+			/* The worker exited, most likely from a usage error */
+			status = serve_reap(&worker, &ctl);
+			write_full(conn, &status, sizeof(status));
+		}
+		close(conn);
+	}
+
+	close(sock);
+	unlink(path);
+	if (worker != -1)
+		serve_reap(&worker, &ctl);
+
+	return (serve_stopped ? EX_OK : EX_SOFTWARE);
+}
@@ -48,7 +48,8 @@
 void
 usage_set(void)
 {
-	fprintf(stderr, "Usage: pkg set [-a] [-A [01]] [-o <oldorigin>:<neworigin>] [-n <oldname>:<newname>] [-y] [-Cgix] [-v 0|1] <pkg-name>\n\n");
+	fprintf(stderr, "Usage: pkg set [-a] [-A [01]] [-o <oldorigin>:<neworigin>] [-n <oldname>:<newname>] [-y] [-Cgix] [-v 0|1] <pkg-name>\n");
+	fprintf(stderr, "       pkg set -B json|tsv\n\n");
 	fprintf(stderr, "For more information see 'pkg help set'. \n");
 }
 
@@ -85,6 +86,46 @@ check_change_values(const char *opt, char **oldv, char **newv, char guard)
 	return (true);
 }
 
+/* Tuples read from stdin, see pkgdb_set_bulk() */
+static int
+exec_set_bulk(pkg_bulk_t format)
+{
+	struct pkgdb	*db = NULL;
+	int		 ret;
+
+	ret = pkgdb_access(PKGDB_MODE_READ|PKGDB_MODE_WRITE, PKGDB_DB_LOCAL);
+	if (ret == EPKG_ENODB) {
+		if (!quiet)
+			warnx("No packages installed.  Nothing to do!");
+		return (EX_OK);
+	} else if (ret == EPKG_ENOACCESS) {
+		warnx("Insufficient privileges to modify the package database");
+		return (EX_NOPERM);
+	} else if (ret != EPKG_OK) {
+		warnx("Error accessing package database");
+		return (EX_SOFTWARE);
+	}
+
+	if (pkgdb_open(&db, PKGDB_DEFAULT) != EPKG_OK)
+		return (EX_IOERR);
+
+	if (pkgdb_obtain_lock(db, PKGDB_LOCK_EXCLUSIVE) != EPKG_OK) {
+		pkgdb_close(db);
+		warnx("Cannot get an exclusive lock on a database, it is locked by another process");
+		return (EX_TEMPFAIL);
+	}
+
+	ret = pkgdb_set_bulk(db, stdin, format);
+
+	pkgdb_release_lock(db, PKGDB_LOCK_EXCLUSIVE);
+	pkgdb_close(db);
+
+	if (ret == EPKG_WARN)
+		return (EX_DATAERR);
+
+	return (ret == EPKG_OK ? EX_OK : EX_IOERR);
+}
+
 int
 exec_set(int argc, char **argv)
 {
@@ -106,10 +147,12 @@ exec_set(int argc, char **argv)
 	unsigned int	 sets = 0;
 	unsigned int	 field = 0, depfield = 0;
 	int		 retcode;
+	int		 bulk = -1;
 
 	struct option longopts[] = {
 		{ "automatic",		required_argument,	NULL,	'A' },
 		{ "all",		no_argument,		NULL,	'a' },
+		{ "bulk",		required_argument,	NULL,	'B' },
 		{ "case-sensitive",	no_argument,		NULL,	'C' },
 		{ "glob",		no_argument,		NULL,	'g' },
 		{ "case-insensitive",	no_argument,		NULL,	'i' },
@@ -121,7 +164,7 @@ exec_set(int argc, char **argv)
 		{ NULL,			0,			NULL,	0   },
 	};
 
-	while ((ch = getopt_long(argc, argv, "+A:aCgio:xyn:v:", longopts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "+A:aB:Cgio:xyn:v:", longopts, NULL)) != -1) {
 		switch (ch) {
 		case 'A':
 			sets |= AUTOMATIC;
@@ -134,6 +177,16 @@ exec_set(int argc, char **argv)
 		case 'a':
 			match = MATCH_ALL;
 			break;
+		case 'B':
+			if (strcmp(optarg, "json") == 0)
+				bulk = PKG_BULK_JSON;
+			else if (strcmp(optarg, "tsv") == 0)
+				bulk = PKG_BULK_TSV;
+			else
+				errx(EX_USAGE, "Wrong value for -B. "
+				    "Expecting json or tsv, got: %s",
+				    optarg);
+			break;
 		case 'C':
 			pkgdb_set_case_sensitivity(true);
 			break;
@@ -190,6 +243,16 @@ exec_set(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 
+	if (bulk != -1) {
+		if (argc > 0 || sets != 0 || match != MATCH_EXACT) {
+			free(oldvalue);
+			free(newvalue);
+			usage_set();
+			return (EX_USAGE);
+		}
+		return (exec_set_bulk(bulk));
+	}
+
 	if ((argc < 1 && match != MATCH_ALL) ||
 		(newautomatic == -1 && newvital == -1 && newvalue == NULL) ||
 		(sets & (NAME|ORIGIN)) == (NAME|ORIGIN)) {
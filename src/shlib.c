@@ -42,7 +42,9 @@
 void
 usage_shlib(void)
 {
-	fprintf(stderr, "Usage: pkg shlib [-q] [-P|R] <library>\n\n");
+	fprintf(stderr, "Usage: pkg shlib [-qg] [-P|R] <library>\n");
+	fprintf(stderr, "       pkg shlib [-qg] -t <library>\n");
+	fprintf(stderr, "       pkg shlib [-qg] -m [<library>]\n\n");
 	fprintf(stderr, "<library> should be a filename without leading path.\n");
 	fprintf(stderr, "For more information see 'pkg help shlib'.\n");
 }
@@ -134,6 +136,144 @@ pkgs_requiring_lib(struct pkgdb *db, const char *libname)
 	return (ret);
 }
 
+struct shlib_graph_output {
+	const char	*header;
+	const char	*shlib;
+	int		 count;
+};
+
+static int
+print_graph_link(void *data, const char *name, const char *version,
+    const char *shlib, int depth __unused)
+{
+	struct shlib_graph_output *out = data;
+
+	if (quiet) {
+		printf("%s-%s\n", name, version);
+		return (EPKG_OK);
+	}
+
+	if (out->shlib == NULL || strcmp(out->shlib, shlib) != 0) {
+		printf(out->header, shlib);
+		out->shlib = shlib;
+	}
+	printf("%s-%s\n", name, version);
+	out->count++;
+
+	return (EPKG_OK);
+}
+
+static int
+print_graph_broken(void *data, const char *name, const char *version,
+    const char *shlib, int depth)
+{
+	struct shlib_graph_output *out = data;
+
+	if (quiet) {
+		printf("%s-%s\n", name, version);
+		return (EPKG_OK);
+	}
+
+	if (out->count == 0)
+		printf(out->header, out->shlib);
+	if (depth == 0)
+		printf("\t%s-%s (requires %s)\n", name, version, shlib);
+	else
+		printf("\t%s-%s (requires %s, depth %d)\n", name, version,
+		    shlib, depth);
+	out->count++;
+
+	return (EPKG_OK);
+}
+
+static int
+print_graph_dangling(void *data, const char *name, const char *version,
+    const char *shlib, int depth __unused)
+{
+	struct shlib_graph_output *out = data;
+
+	if (quiet)
+		printf("%s-%s %s\n", name, version, shlib);
+	else
+		printf("%s-%s requires %s which is not provided by any "
+		    "installed package\n", name, version, shlib);
+	out->count++;
+
+	return (EPKG_OK);
+}
+
+/*
+ * The graph queries always match with fnmatch(3): without -g the library
+ * name is escaped so that only the exact name matches.
+ */
+static const char *
+shlib_exact(char *dst, const char *src, size_t size)
+{
+	size_t i = 0;
+
+	for (; *src != '\0' && i < size - 2; src++) {
+		if (strchr("*?[\\", *src) != NULL)
+			dst[i++] = '\\';
+		dst[i++] = *src;
+	}
+	dst[i] = '\0';
+
+	return (dst);
+}
+
+static int
+shlib_graph_run(struct pkgdb *db, const char *libname, bool glob,
+    bool provides_only, bool requires_only, bool transitive, bool dangling)
+{
+	struct pkg_shlib_graph *g = NULL;
+	struct shlib_graph_output out;
+	char exact[MAXPATHLEN * 2];
+	const char *pattern = libname;
+	int ret;
+
+	if (libname != NULL && !glob)
+		pattern = shlib_exact(exact, libname, sizeof(exact));
+
+	if (pkg_shlib_graph_new(&g, db) != EPKG_OK)
+		return (EPKG_FATAL);
+
+	memset(&out, 0, sizeof(out));
+	if (dangling) {
+		ret = pkg_shlib_graph_query(g, PKG_SHLIB_QUERY_DANGLING,
+		    pattern, print_graph_dangling, &out);
+		if (ret == EPKG_OK && out.count == 0 && !quiet)
+			printf("No missing shared libraries.\n");
+	} else if (transitive) {
+		out.header = "The following packages break if %s disappears:\n";
+		out.shlib = libname;
+		ret = pkg_shlib_graph_query(g, PKG_SHLIB_QUERY_BROKEN,
+		    pattern, print_graph_broken, &out);
+		if (ret == EPKG_OK && out.count == 0 && !quiet)
+			printf("No packages depend on %s.\n", libname);
+	} else {
+		ret = EPKG_OK;
+		if (!requires_only) {
+			out.header = "%s is provided by the following packages:\n";
+			ret = pkg_shlib_graph_query(g, PKG_SHLIB_QUERY_PROVIDED,
+			    pattern, print_graph_link, &out);
+			if (ret == EPKG_OK && out.count == 0 && !quiet)
+				printf("No packages provide %s.\n", libname);
+		}
+		if (ret == EPKG_OK && !provides_only) {
+			memset(&out, 0, sizeof(out));
+			out.header = "%s is linked to by the following packages:\n";
+			ret = pkg_shlib_graph_query(g, PKG_SHLIB_QUERY_REQUIRED,
+			    pattern, print_graph_link, &out);
+			if (ret == EPKG_OK && out.count == 0 && !quiet)
+				printf("No packages require %s.\n", libname);
+		}
+	}
+
+	pkg_shlib_graph_free(g);
+
+	return (ret);
+}
+
 int
 exec_shlib(int argc, char **argv)
 {
@@ -143,16 +283,31 @@ exec_shlib(int argc, char **argv)
 	int		 ch;
 	bool		 provides_only = false;
 	bool		 requires_only = false;
+	bool		 glob = false;
+	bool		 transitive = false;
+	bool		 dangling = false;
 	
 	struct option longopts[] = {
+		{ "glob",	no_argument,	NULL,	'g' },
+		{ "missing",	no_argument,	NULL,	'm' },
 		{ "provides",	no_argument,	NULL,	'P' },
 		{ "requires",	no_argument,	NULL,	'R' },
 		{ "quiet" ,	no_argument,	NULL,	'q' },
+		{ "transitive",	no_argument,	NULL,	't' },
 		{ NULL,		0,		NULL,	0 },
 	};
 
-	while ((ch = getopt_long(argc, argv, "+qPR", longopts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "+gmqPRt", longopts, NULL)) != -1) {
 		switch (ch) {
+		case 'g':
+			glob = true;
+			break;
+		case 'm':
+			dangling = true;
+			break;
+		case 't':
+			transitive = true;
+			break;
 		case 'P':
 			provides_only = true;
 			break;
@@ -170,7 +325,9 @@ exec_shlib(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 
-	if (argc < 1 || (provides_only && requires_only)) {
+	if ((argc < 1 && !dangling) || (provides_only && requires_only) ||
+	    (transitive && (provides_only || requires_only || dangling)) ||
+	    (dangling && (provides_only || requires_only))) {
 		usage_shlib();
 		return (EX_USAGE);
 	}
@@ -180,7 +337,7 @@ exec_shlib(int argc, char **argv)
 		return (EX_USAGE);
 	}
 
-	if (sanitize(libname, argv[0], sizeof(libname)) == NULL) {
+	if (argc == 1 && sanitize(libname, argv[0], sizeof(libname)) == NULL) {
 		usage_shlib();
 		return (EX_USAGE);
 	}
@@ -195,11 +352,16 @@ exec_shlib(int argc, char **argv)
 		return (EX_TEMPFAIL);
 	}
 
-	if (retcode == EPKG_OK && !requires_only)
-		retcode = pkgs_providing_lib(db, libname);
+	if (glob || transitive || dangling) {
+		retcode = shlib_graph_run(db, argc == 1 ? libname : NULL, glob,
+		    provides_only, requires_only, transitive, dangling);
+	} else {
+		if (retcode == EPKG_OK && !requires_only)
+			retcode = pkgs_providing_lib(db, libname);
 
-	if (retcode == EPKG_OK && !provides_only)
-		retcode = pkgs_requiring_lib(db, libname);
+		if (retcode == EPKG_OK && !provides_only)
+			retcode = pkgs_requiring_lib(db, libname);
+	}
 
 	if (retcode != EPKG_OK)
 		retcode = (EX_IOERR);
@@ -36,8 +36,11 @@
 #include <libutil.h>
 #endif
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sysexits.h>
 #include <unistd.h>
+#include <ucl.h>
 
 #include <pkg.h>
 
@@ -48,10 +51,154 @@
 void
 usage_stats(void)
 {
-	fprintf(stderr, "Usage: pkg stats [-qlrb]\n\n");
+	fprintf(stderr, "Usage: pkg stats [-qlrb] [-f format]\n\n");
 	fprintf(stderr, "For more information see 'pkg help stats'.\n");
 }
 
+enum stats_format {
+	STATS_FORMAT_TEXT = 0,
+	STATS_FORMAT_PROMETHEUS,
+	STATS_FORMAT_JSON,
+};
+
+static void
+prometheus_header(const char *metric, const char *help)
+{
+	printf("# HELP %s %s\n", metric, help);
+	printf("# TYPE %s gauge\n", metric);
+}
+
+static void
+prometheus_local(struct pkgdb *db)
+{
+	prometheus_header("pkg_local_packages",
+	    "Number of installed packages.");
+	printf("pkg_local_packages %" PRId64 "\n",
+	    pkgdb_stats(db, PKG_STATS_LOCAL_COUNT));
+	prometheus_header("pkg_local_flatsize_bytes",
+	    "Disk space occupied by installed packages.");
+	printf("pkg_local_flatsize_bytes %" PRId64 "\n",
+	    pkgdb_stats(db, PKG_STATS_LOCAL_SIZE));
+	prometheus_header("pkg_local_locked_packages",
+	    "Number of locked packages.");
+	printf("pkg_local_locked_packages %" PRId64 "\n",
+	    pkgdb_stats(db, PKG_STATS_LOCAL_LOCKED));
+	prometheus_header("pkg_local_automatic_packages",
+	    "Number of packages installed as dependencies.");
+	printf("pkg_local_automatic_packages %" PRId64 "\n",
+	    pkgdb_stats(db, PKG_STATS_LOCAL_AUTOMATIC));
+}
+
+static const struct {
+	pkg_stats_t	 type;
+	const char	*metric;
+	const char	*json;
+	const char	*help;
+} repo_metrics[] = {
+	{ PKG_STATS_REMOTE_COUNT, "pkg_repo_packages", "packages",
+	    "Number of packages available in the repository." },
+	{ PKG_STATS_REMOTE_UNIQUE, "pkg_repo_unique_packages", "unique",
+	    "Number of distinct package names in the repository." },
+	{ PKG_STATS_REMOTE_SIZE, "pkg_repo_pkgsize_bytes", "pkgsize",
+	    "Total size of the package files in the repository." },
+	{ PKG_STATS_REMOTE_FLATSIZE, "pkg_repo_flatsize_bytes", "flatsize",
+	    "Total installed size of the packages in the repository." },
+	{ PKG_STATS_REMOTE_UPDATED, "pkg_repo_last_update_timestamp_seconds",
+	    "updated", "Time the repository catalogue was last updated." },
+};
+
+static void
+prometheus_label(const char *str)
+{
+	for (; *str != '\0'; str++) {
+		switch (*str) {
+		case '\\':
+		case '"':
+			putchar('\\');
+			putchar(*str);
+			break;
+		case '\n':
+			fputs("\\n", stdout);
+			break;
+		default:
+			putchar(*str);
+			break;
+		}
+	}
+}
+
+static void
+prometheus_remote(struct pkgdb *db)
+{
+	struct pkg_repo	*r;
+	int64_t		 val;
+	unsigned int	 i;
+
+	for (i = 0; i < NELEM(repo_metrics); i++) {
+		prometheus_header(repo_metrics[i].metric, repo_metrics[i].help);
+		r = NULL;
+		while (pkg_repos(&r) == EPKG_OK) {
+			val = pkgdb_repo_stats(db, pkg_repo_name(r),
+			    repo_metrics[i].type);
+			if (val < 0)
+				continue;
+			printf("%s{repo=\"", repo_metrics[i].metric);
+			prometheus_label(pkg_repo_name(r));
+			printf("\"} %" PRId64 "\n", val);
+		}
+	}
+}
+
+static void
+json_stats(struct pkgdb *db, unsigned int opt)
+{
+	struct pkg_repo	*r;
+	ucl_object_t	*top, *obj, *repos;
+	unsigned char	*out;
+	unsigned int	 i;
+
+	top = ucl_object_typed_new(UCL_OBJECT);
+	if (opt & STATS_LOCAL) {
+		obj = ucl_object_typed_new(UCL_OBJECT);
+		ucl_object_insert_key(obj, ucl_object_fromint(
+		    pkgdb_stats(db, PKG_STATS_LOCAL_COUNT)),
+		    "packages", 0, false);
+		ucl_object_insert_key(obj, ucl_object_fromint(
+		    pkgdb_stats(db, PKG_STATS_LOCAL_SIZE)),
+		    "flatsize", 0, false);
+		ucl_object_insert_key(obj, ucl_object_fromint(
+		    pkgdb_stats(db, PKG_STATS_LOCAL_LOCKED)),
+		    "locked", 0, false);
+		ucl_object_insert_key(obj, ucl_object_fromint(
+		    pkgdb_stats(db, PKG_STATS_LOCAL_AUTOMATIC)),
+		    "automatic", 0, false);
+		ucl_object_insert_key(top, obj, "local", 0, false);
+	}
+	if (opt & STATS_REMOTE) {
+		repos = ucl_object_typed_new(UCL_OBJECT);
+		r = NULL;
+		while (pkg_repos(&r) == EPKG_OK) {
+			if (pkgdb_repo_stats(db, pkg_repo_name(r),
+			    PKG_STATS_REMOTE_REPOS) < 0)
+				continue;
+			obj = ucl_object_typed_new(UCL_OBJECT);
+			for (i = 0; i < NELEM(repo_metrics); i++)
+				ucl_object_insert_key(obj, ucl_object_fromint(
+				    pkgdb_repo_stats(db, pkg_repo_name(r),
+				    repo_metrics[i].type)),
+				    repo_metrics[i].json, 0, false);
+			ucl_object_insert_key(repos, obj, pkg_repo_name(r), 0,
+			    true);
+		}
+		ucl_object_insert_key(top, repos, "repositories", 0, false);
+	}
+
+	out = ucl_object_emit(top, UCL_EMIT_JSON_COMPACT);
+	printf("%s\n", out);
+	free(out);
+	ucl_object_unref(top);
+}
+
 int
 exec_stats(int argc, char **argv)
 {
@@ -61,20 +208,31 @@ exec_stats(int argc, char **argv)
 	char		 size[8];
 	int		 ch;
 	bool		 show_bytes = false;
+	enum stats_format format = STATS_FORMAT_TEXT;
 
 	struct option longopts[] = {
 		{ "bytes",	no_argument,	NULL,	'b' },
+		{ "format",	required_argument,	NULL,	'f' },
 		{ "local",	no_argument,	NULL,	'l' },
 		{ "quiet",	no_argument,	NULL,	'q' },
 		{ "remote",	no_argument,	NULL,	'r' },
 		{ NULL,		0,		NULL,	0   },
 	};
 	
-	while ((ch = getopt_long(argc, argv, "+blqr", longopts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "+bf:lqr", longopts, NULL)) != -1) {
                 switch (ch) {
 		case 'b':
 			show_bytes = true;
 			break;
+		case 'f':
+			if (strcasecmp(optarg, "prometheus") == 0)
+				format = STATS_FORMAT_PROMETHEUS;
+			else if (strcasecmp(optarg, "json") == 0)
+				format = STATS_FORMAT_JSON;
+			else
+				errx(EX_USAGE, "Invalid format '%s', expecting "
+				    "prometheus or json", optarg);
+			break;
 		case 'l':
 			opt |= STATS_LOCAL;
 			break;
@@ -96,7 +254,12 @@ exec_stats(int argc, char **argv)
 	if (opt == 0)
 		opt |= (STATS_LOCAL | STATS_REMOTE);
 
-	if (pkgdb_open(&db, PKGDB_REMOTE) != EPKG_OK) {
+	/* without any repository there is nothing remote to report */
+	if (pkg_repos_total_count() == 0)
+		opt &= ~STATS_REMOTE;
+
+	if (pkgdb_open(&db, (opt & STATS_REMOTE) ? PKGDB_REMOTE :
+	    PKGDB_DEFAULT) != EPKG_OK) {
 		return (EX_IOERR);
 	}
 
@@ -106,6 +269,17 @@ exec_stats(int argc, char **argv)
 		return (EX_TEMPFAIL);
 	}
 
+	if (format == STATS_FORMAT_JSON) {
+		json_stats(db, opt);
+		goto out;
+	} else if (format == STATS_FORMAT_PROMETHEUS) {
+		if (opt & STATS_LOCAL)
+			prometheus_local(db);
+		if (opt & STATS_REMOTE)
+			prometheus_remote(db);
+		goto out;
+	}
+
 	if (opt & STATS_LOCAL) {
 		printf("Local package database:\n");
 		printf("\tInstalled packages: %" PRId64 "\n", pkgdb_stats(db, PKG_STATS_LOCAL_COUNT));
@@ -121,7 +295,7 @@ exec_stats(int argc, char **argv)
 		}
 	}
 
-	if ((opt & STATS_REMOTE) && pkg_repos_total_count() > 0) {
+	if (opt & STATS_REMOTE) {
 		printf("Remote package database(s):\n");
 		printf("\tNumber of repositories: %" PRId64 "\n", pkgdb_stats(db, PKG_STATS_REMOTE_REPOS));
 		printf("\tPackages available: %" PRId64 "\n", pkgdb_stats(db, PKG_STATS_REMOTE_COUNT));
@@ -138,6 +312,7 @@ exec_stats(int argc, char **argv)
 		}
 	}
 
+out:
 	pkgdb_release_lock(db, PKGDB_LOCK_READONLY);
 	pkgdb_close(db);
 
@@ -33,22 +33,58 @@
 #include <sys/capability.h>
 #endif
 
-#include <sys/queue.h>
+#include <sys/param.h>
+#include <sys/stat.h>
 
+#include <ctype.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <pkg.h>
 #include <stdio.h>
 #include <string.h>
 #include <sysexits.h>
 #include <unistd.h>
+#include <kvec.h>
 
 #include "pkgcli.h"
 
-struct installed_ports {
-	char *origin;
-	SLIST_ENTRY(installed_ports) next;
+/*
+ * The origins to look for are compiled into an Aho-Corasick automaton, so
+ * that each AFFECTS line is scanned once whatever the number of origins.
+ * The children of a state are chained through their first child and their
+ * next sibling.
+ */
+struct origin_state {
+	int child;
+	int sibling;
+	int fail;
+	unsigned char c;
+	bool match;
+};
+
+typedef kvec_t(struct origin_state) origin_matcher;
+
+/*
+ * Offset of each entry of an UPDATING file, cached along with the identity
+ * of the file so that -d only reads the entries recent enough.
+ */
+struct updating_entry {
+	char date[9];
+	off_t offset;
+};
+
+typedef kvec_t(struct updating_entry) updating_index;
+
+struct updating_scan {
+	origin_matcher *origins;
+	const char *date;
+	bool caseinsensitive;
+	char *dateline;
+	int head;
+	int found;
 };
 
 void
@@ -59,26 +95,229 @@ usage_updating(void)
 
 }
 
+static int
+origin_next(origin_matcher *m, int state, unsigned char c)
+{
+	int child;
+
+	for (child = kv_A(*m, state).child; child != -1;
+	    child = kv_A(*m, child).sibling) {
+		if (kv_A(*m, child).c == c)
+			return (child);
+	}
+
+	return (-1);
+}
+
+static int
+origin_new_state(origin_matcher *m, unsigned char c)
+{
+	struct origin_state st;
+
+	st.child = st.sibling = -1;
+	st.fail = 0;
+	st.c = c;
+	st.match = false;
+	kv_push(struct origin_state, *m, st);
+
+	return (kv_size(*m) - 1);
+}
+
+static void
+origin_add(origin_matcher *m, const char *origin, bool caseinsensitive)
+{
+	const unsigned char *p;
+	unsigned char c;
+	int state = 0, next;
+
+	if (kv_size(*m) == 0)
+		origin_new_state(m, '\0');
+
+	for (p = (const unsigned char *)origin; *p != '\0'; p++) {
+		c = caseinsensitive ? tolower(*p) : *p;
+		if ((next = origin_next(m, state, c)) == -1) {
+			next = origin_new_state(m, c);
+			kv_A(*m, next).sibling = kv_A(*m, state).child;
+			kv_A(*m, state).child = next;
+		}
+		state = next;
+	}
+	kv_A(*m, state).match = true;
+}
+
+static void
+origin_compile(origin_matcher *m)
+{
+	kvec_t(int) queue;
+	size_t i;
+	int state, child, fail, next;
+
+	if (kv_size(*m) == 0)
+		return;
+
+	/* Breadth first, the failure of a state is always known before */
+	kv_init(queue);
+	kv_push(int, queue, 0);
+	for (i = 0; i < kv_size(queue); i++) {
+		state = kv_A(queue, i);
+		for (child = kv_A(*m, state).child; child != -1;
+		    child = kv_A(*m, child).sibling) {
+			kv_push(int, queue, child);
+			if (state == 0)
+				continue;
+			fail = kv_A(*m, state).fail;
+			while ((next = origin_next(m, fail, kv_A(*m, child).c)) == -1 &&
+			    fail != 0)
+				fail = kv_A(*m, fail).fail;
+			kv_A(*m, child).fail = next == -1 ? 0 : next;
+			if (kv_A(*m, kv_A(*m, child).fail).match)
+				kv_A(*m, child).match = true;
+		}
+	}
+	kv_destroy(queue);
+}
+
+static bool
+origin_search(origin_matcher *m, const char *line, bool caseinsensitive)
+{
+	const unsigned char *p;
+	unsigned char c;
+	int state = 0, next;
+
+	if (kv_size(*m) == 0)
+		return (false);
+	if (kv_A(*m, 0).match)
+		return (true);
+
+	for (p = (const unsigned char *)line; *p != '\0'; p++) {
+		c = caseinsensitive ? tolower(*p) : *p;
+		while ((next = origin_next(m, state, c)) == -1 && state != 0)
+			state = kv_A(*m, state).fail;
+		state = next == -1 ? 0 : next;
+		if (kv_A(*m, state).match)
+			return (true);
+	}
+
+	return (false);
+}
+
+static bool
+updating_is_dateline(const char *line)
+{
+	return (strspn(line, "0123456789:") == 9);
+}
+
+static void
+updating_line(struct updating_scan *scan, const char *line)
+{
+	if (updating_is_dateline(line)) {
+		free(scan->dateline);
+		scan->dateline = strdup(line);
+		scan->found = 0;
+		scan->head = 1;
+	} else if (scan->head == 0) {
+		return;
+	}
+
+	if (scan->found != 0) {
+		printf("%s", line);
+		return;
+	}
+
+	if (strstr(line, "AFFECTS") == NULL ||
+	    !origin_search(scan->origins, line, scan->caseinsensitive))
+		return;
+	if (scan->date != NULL && strncmp(scan->dateline, scan->date, 8) < 0)
+		return;
+	printf("%s%s", scan->dateline, line);
+	scan->found = 1;
+}
+
+/*
+ * Read the index of the entries, it is only valid for the very same file.
+ */
+static bool
+updating_index_load(FILE *idx, const char *path, struct stat *st,
+    updating_index *entries)
+{
+	struct updating_entry e;
+	char *line = NULL, *key = NULL;
+	size_t linecap = 0;
+	intmax_t offset;
+	bool valid = false;
+
+	asprintf(&key, "%ju %ju %jd %jd %s\n", (uintmax_t)st->st_dev,
+	    (uintmax_t)st->st_ino, (intmax_t)st->st_size,
+	    (intmax_t)st->st_mtime, path);
+	if (key == NULL)
+		return (false);
+
+	if (getline(&line, &linecap, idx) <= 0 || strcmp(line, key) != 0)
+		goto out;
+
+	while (getline(&line, &linecap, idx) > 0) {
+		if (sscanf(line, "%8s %jd", e.date, &offset) != 2)
+			goto out;
+		e.offset = offset;
+		kv_push(struct updating_entry, *entries, e);
+	}
+	valid = true;
+
+out:
+	if (!valid)
+		kv_size(*entries) = 0;
+	free(line);
+	free(key);
+
+	return (valid);
+}
+
+static void
+updating_index_save(FILE *idx, const char *path, struct stat *st,
+    updating_index *entries)
+{
+	size_t i;
+
+	rewind(idx);
+	if (ftruncate(fileno(idx), 0) == -1)
+		return;
+
+	fprintf(idx, "%ju %ju %jd %jd %s\n", (uintmax_t)st->st_dev,
+	    (uintmax_t)st->st_ino, (intmax_t)st->st_size,
+	    (intmax_t)st->st_mtime, path);
+	for (i = 0; i < kv_size(*entries); i++) {
+		fprintf(idx, "%s %jd\n", kv_A(*entries, i).date,
+		    (intmax_t)kv_A(*entries, i).offset);
+	}
+	fflush(idx);
+}
+
 int
 exec_updating(int argc, char **argv)
 {
 	char			*date = NULL;
-	char			*dateline = NULL;
 	char			*updatingfile = NULL;
+	char			 indexfile[MAXPATHLEN];
+	char			*origin;
 	bool			caseinsensitive = false;
-	struct installed_ports	*port;
-	SLIST_HEAD(,installed_ports) origins;
+	origin_matcher		 origins;
+	updating_index		 entries;
+	struct updating_scan	 scan;
+	struct updating_entry	 e;
+	struct stat		 st;
 	int			 ch;
 	char			*line = NULL;
 	size_t			 linecap = 0;
 	ssize_t			 linelen;
-	char			*tmp;
-	int			 head = 0;
-	int			 found = 0;
+	off_t			 offset, end;
+	size_t			 i;
+	int			 idxfd = -1;
+	bool			 indexed = false;
 	struct pkgdb		*db = NULL;
 	struct pkg		*pkg = NULL;
 	struct pkgdb_it		*it = NULL;
 	FILE			*fd;
+	FILE			*idx = NULL;
 	int			 retcode = EXIT_SUCCESS;
 #ifdef HAVE_CAPSICUM
 	cap_rights_t rights;
@@ -139,86 +378,119 @@ exec_updating(int argc, char **argv)
 		goto cleanup;
 	}
 
+	/* Only -d benefits from the index of the entries */
+	if (date != NULL && fstat(fileno(fd), &st) == 0) {
+		snprintf(indexfile, sizeof(indexfile), "%s/updating.index",
+		    pkg_object_string(pkg_config_get("PKG_DBDIR")));
+		if ((idxfd = open(indexfile, O_RDWR|O_CREAT, 0644)) != -1)
+			idx = fdopen(idxfd, "r+");
+		else if ((idxfd = open(indexfile, O_RDONLY)) != -1)
+			idx = fdopen(idxfd, "r");
+		if (idx == NULL && idxfd != -1)
+			close(idxfd);
+	}
+
 #ifdef HAVE_CAPSICUM
-	cap_rights_init(&rights, CAP_READ);
+	cap_rights_init(&rights, CAP_READ, CAP_SEEK);
 	if (cap_rights_limit(fileno(fd), &rights) < 0 && errno != ENOSYS ) {
 		warn("cap_rights_limit() failed");
 		fclose(fd);
 		return (EX_SOFTWARE);
 	}
 
+	cap_rights_init(&rights, CAP_READ, CAP_WRITE, CAP_SEEK, CAP_FTRUNCATE);
+	if (idx != NULL && cap_rights_limit(fileno(idx), &rights) < 0 &&
+	    errno != ENOSYS ) {
+		warn("cap_rights_limit() failed");
+		fclose(fd);
+		fclose(idx);
+		return (EX_SOFTWARE);
+	}
+
 	if (cap_enter() < 0 && errno != ENOSYS) {
 		warn("cap_enter() failed");
 		fclose(fd);
+		if (idx != NULL)
+			fclose(idx);
 		return (EX_SOFTWARE);
 	}
 #endif
 
-	SLIST_INIT(&origins);
+	kv_init(origins);
 	if (argc == 0) {
 		if ((it = pkgdb_query(db, NULL, MATCH_ALL)) == NULL) {
 			retcode = EX_UNAVAILABLE;
 			fclose(fd);
+			if (idx != NULL)
+				fclose(idx);
 			goto cleanup;
 		}
 
 		while (pkgdb_it_next(it, &pkg, PKG_LOAD_BASIC) == EPKG_OK) {
-			port = malloc(sizeof(struct installed_ports));
-			pkg_asprintf(&port->origin, "%o", pkg);
-			SLIST_INSERT_HEAD(&origins, port, next);
+			pkg_asprintf(&origin, "%o", pkg);
+			origin_add(&origins, origin, caseinsensitive);
+			free(origin);
 		}
 	} else {
 		while (*argv) {
-			port = malloc(sizeof(struct installed_ports));
-			port->origin = strdup(*argv);
-			SLIST_INSERT_HEAD(&origins, port, next);
+			origin_add(&origins, *argv, caseinsensitive);
 			argv++;
 		}
 	}
+	origin_compile(&origins);
 
-	while ((linelen = getline(&line, &linecap, fd)) > 0) {
-		if (strspn(line, "0123456789:") == 9) {
-			dateline = strdup(line);
-			found = 0;
-			head = 1;
-		} else if (head == 0) {
-			continue;
-		}
+	memset(&scan, 0, sizeof(scan));
+	scan.origins = &origins;
+	scan.date = date;
+	scan.caseinsensitive = caseinsensitive;
 
-		tmp = NULL;
-		if (found == 0) {
-			if (strstr(line, "AFFECTS") != NULL) {
-				SLIST_FOREACH(port, &origins, next) {
-					if (caseinsensitive) {
-						if ((tmp = strcasestr(line, port->origin)) != NULL) {
-							break;
-						}
-					} else {
-						if ((tmp = strstr(line, port->origin)) != NULL) {
-							break;
-						}
-					}
-				}
-				if (tmp != NULL) {
-					if ((date != NULL) && strncmp(dateline, date, 8) < 0) {
-						continue;
-					}
-					printf("%s%s",dateline, line);
-					found = 1;
-				}
+	kv_init(entries);
+	if (idx != NULL)
+		indexed = updating_index_load(idx, updatingfile, &st, &entries);
+
+	if (indexed) {
+		/* Only read the entries which are not older than the date */
+		for (i = 0; i < kv_size(entries); i++) {
+			if (strncmp(kv_A(entries, i).date, date, 8) < 0)
+				continue;
+			offset = kv_A(entries, i).offset;
+			end = i + 1 < kv_size(entries) ?
+			    kv_A(entries, i + 1).offset : -1;
+			if (fseeko(fd, offset, SEEK_SET) != 0)
+				break;
+			while ((end == -1 || offset < end) &&
+			    (linelen = getline(&line, &linecap, fd)) > 0) {
+				updating_line(&scan, line);
+				offset += linelen;
+			}
+		}
+	} else {
+		offset = 0;
+		while ((linelen = getline(&line, &linecap, fd)) > 0) {
+			if (updating_is_dateline(line)) {
+				strlcpy(e.date, line, sizeof(e.date));
+				e.offset = offset;
+				kv_push(struct updating_entry, entries, e);
 			}
-		} else {
-			printf("%s",line);
+			updating_line(&scan, line);
+			offset += linelen;
 		}
+		if (idx != NULL)
+			updating_index_save(idx, updatingfile, &st, &entries);
 	}
 	fclose(fd);
+	if (idx != NULL)
+		fclose(idx);
+	kv_destroy(origins);
+	kv_destroy(entries);
+	free(scan.dateline);
+	free(line);
 
 cleanup:
 	pkgdb_it_free(it);
 	pkgdb_release_lock(db, PKGDB_LOCK_READONLY);
 	pkgdb_close(db);
 	pkg_free(pkg);
-	free(dateline);
 
 	return (retcode);
 }
@@ -175,8 +175,10 @@ exec_upgrade(int argc, char **argv)
 		if (pkg_jobs_add(jobs, match, argv, argc) == EPKG_FATAL)
 				goto cleanup;
 
+	cancel_jobs_on_signal(jobs);
 	if (pkg_jobs_solve(jobs) != EPKG_OK)
 		goto cleanup;
+	cancel_jobs_on_signal(NULL);
 
 	while ((nbactions = pkg_jobs_count(jobs)) > 0) {
 		/* print a summary before applying the jobs */
@@ -195,7 +197,9 @@ exec_upgrade(int argc, char **argv)
 		}
 
 		if (rc) {
+			cancel_jobs_on_signal(jobs);
 			retcode = pkg_jobs_apply(jobs);
+			cancel_jobs_on_signal(NULL);
 			done = 1;
 			if (retcode == EPKG_CONFLICT) {
 				printf("Conflicts with the existing packages "
@@ -220,6 +224,7 @@ exec_upgrade(int argc, char **argv)
 	retcode = EX_OK;
 
 cleanup:
+	cancel_jobs_on_signal(NULL);
 	pkg_jobs_free(jobs);
 	pkgdb_release_lock(db, lock_type);
 	pkgdb_close(db);
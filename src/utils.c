@@ -45,6 +45,7 @@
 #include <unistd.h>
 #include <stdarg.h>
 #include <paths.h>
+#include <signal.h>
 #include <stdio.h>
 #include <errno.h>
 #include <pkg.h>
@@ -966,3 +967,59 @@ sbuf_flush(struct sbuf *buf)
 	printf("%s", sbuf_data(buf));
 	sbuf_clear(buf);
 }
+
+static struct pkg_jobs *cancel_jobs = NULL;
+static struct sigaction cancel_saved[2];
+static bool cancel_installed = false;
+static const int cancel_signals[2] = { SIGINT, SIGTERM };
+
+static void
+cancel_handler(int sig)
+{
+	int i;
+
+	if (cancel_jobs != NULL)
+		pkg_jobs_cancel(cancel_jobs);
+	for (i = 0; i < 2; i++) {
+		if (cancel_signals[i] == sig)
+			sigaction(sig, &cancel_saved[i], NULL);
+	}
+}
+
+/*
+ * While jobs are solved or applied, SIGINT and SIGTERM cancel them so they
+ * stop at a safe point and clean up; a second signal gets the action they
+ * had before.  Ignored signals, as under nohup(1) or for background jobs,
+ * stay ignored.  Passing NULL puts the previous actions back.
+ */
+void
+cancel_jobs_on_signal(struct pkg_jobs *jobs)
+{
+	struct sigaction sa;
+	int i;
+
+	if (jobs == NULL) {
+		if (cancel_installed) {
+			for (i = 0; i < 2; i++)
+				sigaction(cancel_signals[i], &cancel_saved[i],
+				    NULL);
+			cancel_installed = false;
+		}
+		cancel_jobs = NULL;
+		return;
+	}
+
+	cancel_jobs = jobs;
+	if (cancel_installed)
+		return;
+
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_handler = cancel_handler;
+	for (i = 0; i < 2; i++) {
+		sigaction(cancel_signals[i], NULL, &cancel_saved[i]);
+		if (cancel_saved[i].sa_handler != SIG_IGN)
+			sigaction(cancel_signals[i], &sa, NULL);
+	}
+	cancel_installed = true;
+}
@@ -11,7 +11,11 @@ tests_init	\
 		add_quiet \
 		add_stdin \
 		add_stdin_missing \
-		add_no_version
+		add_no_version \
+		add_indexed \
+		add_sparse \
+		add_uncompressed \
+		add_event_pipe
 
 initialize_pkg() {
 	touch a
@@ -301,3 +305,237 @@ EOF
 	atf_check -o ignore -s exit:0 \
 		pkg add final-1.txz
 }
+
+add_indexed_body() {
+	touch a
+	echo content > b
+	cat << EOF > test.ucl
+name: test
+origin: test
+version: 1
+maintainer: test
+categories: [test]
+comment: a test
+www: http://test
+prefix: /
+abi = "*";
+desc: <<EOD
+Yet another test
+EOD
+files: {
+	${TMPDIR}/a: "",
+	${TMPDIR}/b: ""
+}
+EOF
+
+	atf_check \
+		-o empty \
+		-e empty \
+		-s exit:0 \
+		pkg -o ARCHIVE_INDEX=yes create -f tgz -M test.ucl
+
+	# still a plain tgz for any tar
+	atf_check \
+		-o inline:"+COMPACT_MANIFEST\n+MANIFEST\n${TMPDIR}/a\n${TMPDIR}/b\n" \
+		-e ignore \
+		-s exit:0 \
+		tar tf test-1.tgz
+
+	rm a b
+
+OUTPUT="${JAILED}Installing test-1...
+${JAILED}Extracting test-1:  done
+"
+	atf_check \
+		-o inline:"${OUTPUT}" \
+		-e empty \
+		pkg add test-1.tgz
+
+	atf_check \
+		-o inline:"content\n" \
+		-e empty \
+		cat b
+}
+
+add_sparse_body() {
+	truncate -s 2G sparse
+	echo data | dd of=sparse bs=1M seek=1024 conv=notrunc 2>/dev/null
+	cat << EOF > test.ucl
+name: test
+origin: test
+version: 1
+maintainer: test
+categories: [test]
+comment: a test
+www: http://test
+prefix: /
+abi = "*";
+desc: <<EOD
+Yet another test
+EOD
+files: {
+	${TMPDIR}/sparse: ""
+}
+EOF
+
+	atf_check \
+		-o empty \
+		-e empty \
+		-s exit:0 \
+		pkg create -f tar -M test.ucl
+
+	# the holes are not stored
+	[ $(du -k test-1.tar | cut -f1) -lt 64 ] || atf_fail "holes packed"
+
+	rm sparse
+
+OUTPUT="${JAILED}Installing test-1...
+${JAILED}Extracting test-1:  done
+"
+	atf_check \
+		-o inline:"${OUTPUT}" \
+		-e empty \
+		pkg add test-1.tar
+
+	# nor written back
+	[ $(du -k sparse | cut -f1) -lt 1024 ] || atf_fail "holes extracted"
+	atf_check \
+		-o inline:"2147483648\n" \
+		-e empty \
+		sh -c "ls -l sparse | awk '{ print \$5 }'"
+	atf_check \
+		-o inline:"data\n" \
+		-e empty \
+		sh -c 'dd if=sparse bs=1M skip=1024 count=1 2>/dev/null | tr -d "\000"'
+}
+
+add_uncompressed_body() {
+	dd if=/dev/urandom of=a bs=1k count=700 2>/dev/null
+	dd if=/dev/urandom of=b bs=1k count=1501 2>/dev/null
+	for f in a b c; do
+		echo ${f} >> ${f}
+		cp ${f} ${f}.orig
+	done
+	cat << EOF > test.ucl
+name: test
+origin: test
+version: 1
+maintainer: test
+categories: [test]
+comment: a test
+www: http://test
+prefix: /
+abi = "*";
+desc: <<EOD
+Yet another test
+EOD
+files: {
+	${TMPDIR}/a: "",
+	${TMPDIR}/b: "",
+	${TMPDIR}/c: ""
+}
+EOF
+
+	atf_check \
+		-o empty \
+		-e empty \
+		-s exit:0 \
+		pkg create -f tar -M test.ucl
+
+	rm a b c
+
+	# the members are copied straight from the package file
+	atf_check \
+		-o ignore \
+		-e save:error.log \
+		-s exit:0 \
+		pkg -d -d add ${TMPDIR}/test-1.tar
+	atf_check \
+		-o inline:"a 716802\nb 1537026\nc 2\n" \
+		-e empty \
+		-s exit:0 \
+		sed -n -e 's|^DBG.*copy_file_range: .*/\([abc]\), \([0-9]*\) bytes$|\1 \2|p' \
+		    error.log
+
+	for f in a b c; do
+		atf_check -o empty -e empty -s exit:0 cmp ${f} ${f}.orig
+	done
+
+	# a package read from stdin goes through libarchive
+	atf_check -o ignore -e empty -s exit:0 pkg delete -y test
+	atf_check \
+		-o ignore \
+		-e save:error.log \
+		-s exit:0 \
+		pkg -d -d add - < ${TMPDIR}/test-1.tar
+	atf_check \
+		-o empty \
+		-e empty \
+		-s exit:1 \
+		grep copy_file_range error.log
+
+	for f in a b c; do
+		atf_check -o empty -e empty -s exit:0 cmp ${f} ${f}.orig
+	done
+}
+
+add_event_pipe_body() {
+	mkdir files
+	i=0
+	while [ $i -lt 2000 ]; do
+		i=$((i + 1))
+		echo ${i} > files/f${i}
+		echo "	${TMPDIR}/files/f${i}: \"\","
+	done > files.ucl
+	cat << EOF > test.ucl
+name: test
+origin: test
+version: 1
+maintainer: test
+categories: [test]
+comment: a test
+www: http://test
+prefix: /
+abi = "*";
+desc: <<EOD
+Yet another test
+EOD
+files: {
+$(cat files.ucl)
+}
+EOF
+	atf_check -o empty -e empty -s exit:0 pkg create -M test.ucl
+	rm -rf files
+
+	# the reader takes the first event, then stalls until released
+	mkfifo evpipe
+	(read first; echo "${first}"; while [ ! -f go ]; do sleep 0.1; done; cat) \
+	    < evpipe > events &
+	reader=$!
+	sleep 0.5
+	pkg -o EVENT_PIPE=${TMPDIR}/evpipe -o EVENT_PIPE_BUFFER=16 \
+	    add test-1.txz > add.out 2>&1 &
+	add=$!
+
+	# the installation is not held back by the reader
+	i=0
+	while ! pkg info -e test 2>/dev/null; do
+		i=$((i + 1))
+		[ $i -lt 100 ] || atf_fail "installation stalled by the event pipe"
+		sleep 0.1
+	done
+	test -f files/f2000 || atf_fail "files missing"
+	test -s events && [ $(wc -l < events) -eq 1 ] || \
+	    atf_fail "the reader was not stalled"
+
+	# every event but the coalesced ticks arrives once released
+	touch go
+	wait ${add} || atf_fail "pkg add failed: $(cat add.out)"
+	wait ${reader}
+	for e in INSTALL_BEGIN EXTRACT_BEGIN EXTRACT_FINISHED INSTALL_FINISHED; do
+		atf_check -o inline:"1\n" grep -c "\"INFO_${e}\"" events
+	done
+	atf_check -o save:ticks grep "INFO_PROGRESS_TICK" events
+	[ $(wc -l < ticks) -lt 2000 ] || atf_fail "progress ticks not coalesced"
+	atf_check -o match:'"current": 2000, "total" : 2000' tail -n 1 ticks
+}
@@ -0,0 +1,95 @@
+#! /usr/bin/env atf-sh
+
+. $(atf_get_srcdir)/test_environment.sh
+
+tests_init \
+	audit_delta
+
+vuln_entry() {
+	cat << EOF
+  <vuln vid="$1">
+    <topic>$2 -- $3</topic>
+    <affects>
+      <package>
+	<name>$2</name>
+	<range><lt>$4</lt></range>
+      </package>
+    </affects>
+    <description><body>$3</body></description>
+    <references><cvename>CVE-2016-$1</cvename></references>
+    <dates><discovery>2016-10-01</discovery><entry>2016-10-$5</entry></dates>
+  </vuln>
+EOF
+}
+
+vuln_xml() {
+	echo '<?xml version="1.0" encoding="utf-8"?>'
+	echo '<vuxml xmlns="http://www.vuxml.org/apps/vuxml-1">'
+	cat
+	echo '</vuxml>'
+}
+
+audit_delta_body() {
+	new_pkg foo foo 1.0 /
+	new_pkg bar bar 2.0 /
+	new_pkg baz baz 1.0 /
+	for p in foo bar baz; do
+		atf_check -o ignore -e ignore -s exit:0 pkg register -M ${p}.ucl
+	done
+
+	{
+		vuln_entry 0001 foo overflow 1.1 02
+		vuln_entry 0002 bar injection 2.0 02
+	} | vuln_xml > ${TMPDIR}/vuln1.xml
+	{
+		vuln_entry 0001 foo overflow 1.1 02
+		vuln_entry 0002 bar injection 2.1 03
+		vuln_entry 0003 baz traversal 2.0 03
+	} | vuln_xml > ${TMPDIR}/vuln2.xml
+
+	# the first run reports everything
+	atf_check \
+		-o save:out \
+		-e empty \
+		-s exit:1 \
+		env VULNXML_SITE=file://${TMPDIR}/vuln1.xml pkg audit -dF
+	atf_check \
+		-o inline:"+ foo-1.0 0001: foo -- overflow\n1 problem(s) added and 0 resolved since the last audit.\n" \
+		grep -v "^Fetching" out
+	test -f vuln.state || atf_fail "no audit state saved"
+
+	atf_check \
+		-o inline:"0 problem(s) added and 0 resolved since the last audit.\n" \
+		-e empty \
+		-s exit:0 \
+		pkg audit -d
+
+	# only the changed and the new entries are reported
+	atf_check \
+		-o save:out \
+		-e empty \
+		-s exit:1 \
+		pkg audit -d -f ${TMPDIR}/vuln2.xml
+	atf_check \
+		-o inline:"+ bar-2.0 0002: bar -- injection\n+ baz-1.0 0003: baz -- traversal\n2 problem(s) added and 0 resolved since the last audit.\n" \
+		sort out
+
+	# upgraded and removed packages resolve their vulnerabilities
+	atf_check -o ignore -e ignore -s exit:0 pkg delete -y foo baz
+	new_pkg foo foo 1.1 /
+	atf_check -o ignore -e ignore -s exit:0 pkg register -M foo.ucl
+	atf_check \
+		-o save:out \
+		-e empty \
+		-s exit:0 \
+		pkg audit -dq -f ${TMPDIR}/vuln2.xml
+	atf_check \
+		-o inline:"- baz-1.0 0003: baz -- traversal\n- foo-1.0 0001: foo -- overflow\n" \
+		sort out
+
+	atf_check \
+		-o empty \
+		-e ignore \
+		-s exit:64 \
+		pkg audit -d foo
+}
@@ -0,0 +1,152 @@
+#! /usr/bin/env atf-sh
+
+. $(atf_get_srcdir)/test_environment.sh
+
+tests_init \
+	budget_fetch \
+	budget_solve \
+	budget_extract \
+	budget_script \
+	cancel_signal \
+	cancel_signal_ignored
+
+# A repository holding test-1 with 512 KiB of incompressible data
+budget_repo() {
+	mkdir -p data
+	dd if=/dev/urandom of=data/big bs=1024 count=512 2>/dev/null
+	new_pkg test test 1 /
+	cat << EOF >> test.ucl
+files: {
+	${TMPDIR}/data/big: ""
+}
+EOF
+	atf_check -o ignore -e empty -s exit:0 pkg create -o repo -M test.ucl
+	atf_check -o ignore -e empty -s exit:0 pkg repo repo
+	cat << EOF > repo.conf
+local: {
+	url: file://${TMPDIR}/repo,
+	enabled: true
+}
+EOF
+}
+
+# A package whose pre-install script sleeps
+sleeping_pkg() {
+	new_pkg test test 1
+	cat << EOF >> test.ucl
+scripts: {
+	pre-install: "sleep 5"
+}
+EOF
+	atf_check -o ignore -e empty -s exit:0 pkg create -M test.ucl
+}
+
+budget_fetch_body() {
+	budget_repo
+	mkdir dl
+
+	atf_check \
+		-o ignore \
+		-e match:"The fetch phase ran over its budget of 100000 bytes" \
+		-s not-exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" -o FETCH_BYTE_BUDGET=100000 \
+		fetch -y -o dl test
+	test -z "$(find dl -type f)" || atf_fail "partial download left"
+
+	# throttle the repository: every open of the package waits 2 seconds
+	mv repo/test-1.txz test-1.txz
+	mkfifo repo/test-1.txz
+	timeout 20 sh -c 'while :; do
+		(sleep 2; cat test-1.txz) > repo/test-1.txz
+	done' 2>/dev/null &
+
+	atf_check \
+		-o ignore \
+		-e match:"The fetch phase ran over its budget of 1 seconds" \
+		-s not-exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" -o FETCH_TIME_BUDGET=1 \
+		fetch -y -o dl test
+	test -z "$(find dl -type f)" || atf_fail "partial download left"
+}
+
+budget_solve_body() {
+	budget_repo
+
+	atf_check \
+		-o ignore \
+		-e match:"The solve phase ran over its budget of 1 seconds" \
+		-s not-exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" -o SOLVE_TIME_BUDGET=1 \
+		-o SAT_SOLVER="cat >/dev/null; sleep 2; echo SAT; echo 1 0" \
+		install -y test
+	atf_check -o empty -e ignore -s not-exit:0 pkg info -e test
+}
+
+budget_extract_body() {
+	budget_repo
+	mkdir target
+
+	atf_check \
+		-o ignore \
+		-e match:"The extract phase ran over its budget of 100000 bytes" \
+		-s not-exit:0 \
+		pkg -o REPOS_DIR=/dev/null -o EXTRACT_BYTE_BUDGET=100000 \
+		-r ${TMPDIR}/target install -y ${TMPDIR}/repo/test-1.txz
+	test -z "$(find target -type f ! -name '*.sqlite*')" || \
+	    atf_fail "extracted files left"
+	atf_check -o empty -e ignore -s not-exit:0 \
+		pkg -r ${TMPDIR}/target info -e test
+
+	# the lock has been released
+	atf_check -o ignore -e ignore -s exit:0 \
+		pkg -o REPOS_DIR=/dev/null -r ${TMPDIR}/target \
+		install -y ${TMPDIR}/repo/test-1.txz
+	test -f target${TMPDIR}/data/big || atf_fail "package not extracted"
+}
+
+budget_script_body() {
+	sleeping_pkg
+
+	start=$(date +%s)
+	atf_check \
+		-o ignore \
+		-e match:"The script phase ran over its budget of 1 seconds" \
+		-s not-exit:0 \
+		pkg -o REPOS_DIR=/dev/null -o SCRIPT_TIME_BUDGET=1 \
+		install -y ${TMPDIR}/test-1.txz
+	[ $(($(date +%s) - start)) -lt 5 ] || atf_fail "script not killed"
+	atf_check -o empty -e ignore -s not-exit:0 pkg info -e test
+}
+
+cancel_signal_body() {
+	sleeping_pkg
+
+	pkg -o REPOS_DIR=/dev/null install -y ${TMPDIR}/test-1.txz \
+		> out 2> err &
+	pid=$!
+	sleep 1
+	kill -TERM ${pid}
+	wait ${pid} && atf_fail "cancelled install succeeded"
+
+	atf_check -o match:"Cancelled during the script phase" cat err
+	atf_check -o empty -e ignore -s not-exit:0 pkg info -e test
+
+	atf_check -o ignore -e ignore -s exit:0 \
+		pkg -o REPOS_DIR=/dev/null install -y ${TMPDIR}/test-1.txz
+	atf_check -o ignore -e ignore -s exit:0 pkg info -e test
+}
+
+cancel_signal_ignored_body() {
+	sleeping_pkg
+
+	# as under nohup(1), an ignored signal does not cancel the jobs
+	sh -c "trap '' TERM; exec pkg -o REPOS_DIR=/dev/null \
+		install -y ${TMPDIR}/test-1.txz" > out 2> err &
+	pid=$!
+	sleep 1
+	kill -TERM ${pid}
+	wait ${pid} || atf_fail "install cancelled by an ignored signal"
+
+	atf_check -o not-match:"Cancelled" cat err
+	atf_check -o ignore -e ignore -s exit:0 pkg info -e test
+}
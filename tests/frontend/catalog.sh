@@ -0,0 +1,115 @@
+#! /usr/bin/env atf-sh
+
+. $(atf_get_srcdir)/test_environment.sh
+
+tests_init \
+	catalog
+
+catalog_body()
+{
+	for r in one two three; do
+		mkdir ${r}
+		cat << EOF >> repo.conf
+${r}: {
+	url: file:///${TMPDIR}/${r},
+	enabled: true
+}
+EOF
+	done
+
+	new_pkg a a 1 /usr/local
+	new_pkg b b 1 /usr/local
+	for p in a b; do
+		atf_check -o empty -e empty -s exit:0 \
+			pkg create -M ${p}.ucl -o one
+	done
+	new_pkg a a 2 /usr/local
+	atf_check -o empty -e empty -s exit:0 pkg create -M a.ucl -o two
+	new_pkg c c 1 /usr/local
+	atf_check -o empty -e empty -s exit:0 pkg create -M c.ucl -o two
+	new_pkg a a 3 /usr/local
+	atf_check -o empty -e empty -s exit:0 pkg create -M a.ucl -o three
+
+	for r in one two three; do
+		atf_check -o ignore -e empty -s exit:0 pkg repo ${r}
+	done
+
+	atf_check \
+		-o ignore \
+		-e ignore \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" -o PKG_CACHEDIR="${TMPDIR}" update
+
+	# all the repositories are looked up at once, in repository order
+	pkg -d -o REPOS_DIR="${TMPDIR}" rquery -a '%n-%v %R' > output.log 2>&1
+	atf_check \
+		-o inline:"DBG(1)[*]> Catalog: 3 repositories attached\n" \
+		-e empty \
+		-s exit:0 \
+		sed -n -e 's/[0-9][0-9]*\]>/*]>/' -e '/Catalog:/p' output.log
+
+	atf_check \
+		-o inline:"a-1 one\nb-1 one\na-2 two\nc-1 two\na-3 three\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" rquery -a '%n-%v %R'
+
+	atf_check \
+		-o inline:"a-1 one\na-2 two\na-3 three\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" rquery '%n-%v %R' a
+
+	atf_check \
+		-o inline:"a-2 two\nc-1 two\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" rquery -r two -a '%n-%v %R'
+
+	# a '%' in a condition is not taken for a conversion
+	atf_check \
+		-o inline:"a-1 one\na-2 two\na-3 three\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" rquery -e '%c !~ *50%s%n* && %n = a' '%n-%v %R'
+
+	atf_check \
+		-o inline:"a-2 two\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" rquery -r two -e '%c !~ *50%s%n* && %n = a' '%n-%v %R'
+
+	atf_check \
+		-o empty \
+		-e empty \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" rquery -e '%c ~ *50%*' '%n-%v %R'
+
+	atf_check \
+		-o inline:"a-1\na-2\na-3\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" search -U -q -S name -L pkg-name -e a
+
+	# repositories of higher priority come first, then in repository order
+	sed -i'' -e '/^three:/a\
+	priority: 10,
+' repo.conf
+	atf_check \
+		-o inline:"a-3 three\na-1 one\nb-1 one\na-2 two\nc-1 two\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" rquery -a '%n-%v %R'
+
+	atf_check \
+		-o inline:"a-3 three\na-1 one\na-2 two\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" rquery '%n-%v %R' a
+
+	atf_check \
+		-o inline:"a-3\na-1\na-2\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" search -U -q -S name -L pkg-name -e a
+}
@@ -2,7 +2,8 @@
 
 . $(atf_get_srcdir)/test_environment.sh
 tests_init \
-	config
+	config \
+	config_dedup
 
 config_body()
 {
@@ -43,3 +44,68 @@ config_body()
 		-o inline:"entry 2\naddition\n" \
 		cat ${TMPDIR}/target/${TMPDIR}/a
 }
+
+config_count() {
+	echo "SELECT COUNT(*) FROM config_content;" | pkg shell
+}
+
+config_dedup_body()
+{
+	mkdir -p ${TMPDIR}/etc repo1 repo2
+	for p in p1 p2; do
+		echo "@config ${TMPDIR}/etc/${p}.conf" > ${p}.plist
+	done
+
+	# both packages ship the same pristine content
+	for p in p1 p2; do
+		new_pkg ${p} ${p} 1 /
+		echo "shared" > ${TMPDIR}/etc/${p}.conf
+		atf_check pkg create -M ${p}.ucl -p ${p}.plist -o repo1
+	done
+	new_pkg p1 p1 2 /
+	echo "shared 2" > ${TMPDIR}/etc/p1.conf
+	atf_check pkg create -M p1.ucl -p p1.plist -o repo2
+	rm ${TMPDIR}/etc/*.conf
+	for r in repo1 repo2; do
+		atf_check -o ignore pkg repo ${r}
+	done
+
+	echo "local: { url: file://${TMPDIR}/repo1 }" > local.conf
+	atf_check \
+		-o ignore \
+		pkg -o REPOS_DIR=${TMPDIR} -o PKG_CACHEDIR=${TMPDIR}/cache \
+		install -y p1 p2
+	atf_check -o inline:"1\n" config_count
+
+	# unreferenced contents are dropped with their last package
+	atf_check -o ignore pkg delete -y p2
+	atf_check -o inline:"1\n" config_count
+
+	echo "addition" >> ${TMPDIR}/etc/p1.conf
+	echo "local: { url: file://${TMPDIR}/repo2 }" > local.conf
+	atf_check \
+		-o ignore \
+		pkg -o REPOS_DIR=${TMPDIR} -o PKG_CACHEDIR=${TMPDIR}/cache \
+		upgrade -y p1
+	atf_check \
+		-o inline:"shared 2\naddition\n" \
+		cat ${TMPDIR}/etc/p1.conf
+	atf_check -o inline:"1\n" config_count
+
+	# the contents of the version replaced are dropped even when the new
+	# one has no configuration file
+	mkdir repo3
+	new_pkg p1 p1 3 /
+	atf_check pkg create -M p1.ucl -o repo3
+	atf_check -o ignore pkg repo repo3
+	echo "local: { url: file://${TMPDIR}/repo3 }" > local.conf
+	atf_check \
+		-o ignore \
+		pkg -o REPOS_DIR=${TMPDIR} -o PKG_CACHEDIR=${TMPDIR}/cache \
+		upgrade -y p1
+	atf_check -o inline:"p1-3\n" pkg query "%n-%v" p1
+	atf_check -o inline:"0\n" config_count
+
+	atf_check -o ignore pkg delete -y p1
+	atf_check -o inline:"0\n" config_count
+}
@@ -15,7 +15,8 @@ tests_init \
 	create_from_plist_with_keyword_arguments \
 	create_from_manifest_and_plist \
 	create_from_plist_pkg_descr \
-	create_from_plist_with_keyword_and_message
+	create_from_plist_with_keyword_and_message \
+	create_from_plist_hardlinks
 
 genmanifest() {
 	cat << EOF >> +MANIFEST
@@ -428,3 +429,54 @@ on install
 	atf_check -o inline:"${OUTPUT}" pkg info -D -F ./test-1.txz
 
 }
+
+create_from_plist_hardlinks_body() {
+	mkdir -p stage/a stage/b
+	echo "shared content" > stage/a/file1
+	ln stage/a/file1 stage/b/file2
+	ln stage/a/file1 stage/a/file3
+	echo "other" > stage/a/other
+	genmanifest
+	# the first of the group in the plist order is packed in full
+	genplist "a/file3
+a/other
+b/file2
+a/file1"
+
+	atf_check \
+		-o empty \
+		-e empty \
+		-s exit:0 \
+		pkg create -o ${TMPDIR} -m . -p test.plist -r stage
+
+	basic_validation
+	tar tvf test-1.txz > list 2>/dev/null
+	atf_check -o match:"^-.* 15 .* /a/file3$" grep "/a/file3$" list
+	atf_check -o match:" /b/file2 link to /?a/file3$" grep "/b/file2" list
+	atf_check -o match:" /a/file1 link to /?a/file3$" grep "/a/file1" list
+
+	# the group shares one checksum and is counted once in the flat size
+	sum=$(sha256 -q stage/a/file1 2>/dev/null || sha256sum stage/a/file1 | cut -d" " -f1)
+	atf_check \
+		-o save:sums \
+		-e empty \
+		-s exit:0 \
+		pkg query -F test-1.txz "%Fp %Fs"
+	atf_check \
+		-o inline:"/a/file3 1\$${sum}\n/b/file2 1\$${sum}\n/a/file1 1\$${sum}\n" \
+		grep -v /a/other sums
+	atf_check \
+		-o inline:"21\n" \
+		-e empty \
+		-s exit:0 \
+		pkg query -F test-1.txz "%sb"
+
+	mkdir ${TMPDIR}/target
+	atf_check -o ignore -e ignore -s exit:0 \
+		pkg -r ${TMPDIR}/target add ${TMPDIR}/test-1.txz
+	inode=$(ls -i ${TMPDIR}/target/a/file3 | cut -d" " -f1)
+	for f in a/file1 b/file2; do
+		[ "$(ls -i ${TMPDIR}/target/${f} | cut -d" " -f1)" = "${inode}" ] || \
+		    atf_fail "${f} is not a hardlink of a/file3"
+	done
+}
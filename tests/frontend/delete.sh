@@ -5,7 +5,8 @@
 tests_init \
 	simple_delete \
 	simple_delete_prefix_ending_with_slash \
-	delete_with_directory_owned
+	delete_with_directory_owned \
+	delete_shared_directories
 
 simple_delete_body() {
 	touch file1
@@ -159,3 +160,69 @@ EOF
 	test -d dir && atf_fail "'dir' still present"
 	test -d ${TMPDIR} || atf_fail "Prefix has been removed"
 }
+
+delete_shared_directories_body() {
+	mkdir -p share/a/deep/x share/common share/empty
+	touch share/a/deep/x/file share/common/fa share/common/fb
+
+	for p in a b; do
+		cat << EOF > ${p}.ucl
+name: ${p}
+origin: test/${p}
+version: 1
+maintainer: test
+categories: [test]
+comment: a test
+www: http://test
+prefix: ${TMPDIR}/
+desc: <<EOD
+Yet another test
+EOD
+directories: {
+    ${TMPDIR}/share/common: 'y',
+    ${TMPDIR}/share/empty: 'y',
+}
+EOF
+	done
+	cat << EOF >> a.ucl
+files: {
+    ${TMPDIR}/share/a/deep/x/file: "",
+    ${TMPDIR}/share/common/fa: "",
+}
+EOF
+	cat << EOF >> b.ucl
+files: {
+    ${TMPDIR}/share/common/fb: "",
+}
+EOF
+	for p in a b; do
+		atf_check -o ignore -e empty -s exit:0 pkg register -M ${p}.ucl
+	done
+
+	atf_check \
+		-o inline:"${TMPDIR}/share/common|2\n${TMPDIR}/share/empty|2\n" \
+		-e empty \
+		-s exit:0 \
+		pkg shell "SELECT path, refcount FROM directories ORDER BY path"
+
+	atf_check -o ignore -e empty -s exit:0 pkg delete -y a
+
+	test -d share/a && atf_fail "'share/a' still present"
+	test -f share/common/fb || atf_fail "'share/common/fb' has been removed"
+	# empty, but still owned by b
+	test -d share/empty || atf_fail "'share/empty' has been removed"
+	atf_check \
+		-o inline:"${TMPDIR}/share/common|1\n${TMPDIR}/share/empty|1\n" \
+		-e empty \
+		-s exit:0 \
+		pkg shell "SELECT path, refcount FROM directories ORDER BY path"
+
+	atf_check -o ignore -e empty -s exit:0 pkg delete -y b
+
+	test -d share && atf_fail "'share' still present"
+	atf_check \
+		-o inline:"0\n" \
+		-e empty \
+		-s exit:0 \
+		pkg shell "SELECT COUNT(*) FROM directories"
+}
@@ -0,0 +1,117 @@
+#! /usr/bin/env atf-sh
+
+. $(atf_get_srcdir)/test_environment.sh
+
+tests_init \
+	export_query \
+	export_formats
+
+export_pkgs() {
+	mkdir -p ${TMPDIR}/target/dir
+	echo a > ${TMPDIR}/target/dir/a
+	echo b > ${TMPDIR}/target/dir/b
+
+	new_pkg foo foo 1.0 /usr/local
+	cat << EOF >> foo.ucl
+options: { OPT1: on, OPT2: off }
+annotations: { tag1: value1, tag2: value2 }
+files: {
+	${TMPDIR}/target/dir/a: "",
+	${TMPDIR}/target/dir/b: ""
+}
+EOF
+	new_pkg bar bar 2.0 /usr/local
+	cat << EOF >> bar.ucl
+deps: {
+	foo: { origin: foo, version: "1.0" }
+}
+EOF
+	new_pkg baz baz 3.0 /opt
+	cat << EOF >> baz.ucl
+deps: {
+	bar: { origin: bar, version: "2.0" },
+	foo: { origin: foo, version: "1.0" }
+}
+EOF
+
+	atf_check -o ignore -e empty -s exit:0 pkg create -M foo.ucl
+	rm -rf ${TMPDIR}/target
+	atf_check -o ignore -e empty -s exit:0 pkg add foo-1.0.txz
+	atf_check -o ignore -e empty -s exit:0 pkg register -M bar.ucl
+	atf_check -o ignore -e empty -s exit:0 pkg register -M baz.ucl
+	atf_check -o ignore -e empty -s exit:0 pkg set -y -A 1 bar
+}
+
+# compare a table exported as csv, without its header, with pkg query
+export_compare() {
+	atf_check -o save:export.csv -e empty -s exit:0 \
+		pkg export -f csv $1
+	tail -n +2 export.csv | cut -d, -f$2 > export.out
+	atf_check -o save:query.out -e empty -s exit:0 pkg query -a "$3"
+	[ -s export.out ] || atf_fail "nothing exported from $1"
+	atf_check -o file:export.out sort query.out
+}
+
+export_query_body() {
+	export_pkgs
+
+	export_compare packages 1-3,9-13 '%n,%o,%v,%p,%sb,%a,%k,%V'
+	export_compare deps 1-4 '%n,%dn,%do,%dv'
+	export_compare files 1-3 '%n,%Fp,%Fs'
+	export_compare options 1-3 '%n,%Ok,%Ov'
+	export_compare annotations 1-3 '%n,%At,%Av'
+
+	# ndjson carries the same rows
+	for t in packages deps files options annotations; do
+		atf_check -o save:${t}.ndjson -e empty -s exit:0 \
+			pkg export ${t}
+		atf_check -o save:${t}.csv -e empty -s exit:0 \
+			pkg export -f csv ${t}
+		[ $(wc -l < ${t}.ndjson) -eq $(($(wc -l < ${t}.csv) - 1)) ] || \
+		    atf_fail "${t}: ndjson and csv row counts differ"
+	done
+}
+
+export_formats_body() {
+	cat << EOF > test.ucl
+name: test
+origin: misc/test
+version: "1.0"
+maintainer: test
+categories: [test]
+comment: "a, \"quoted\" comment"
+www: http://test
+prefix: /usr/local
+abi: "*"
+desc: "line1\nline2"
+annotations: { note: "tab\there" }
+EOF
+	atf_check -o ignore -e empty -s exit:0 pkg register -M test.ucl
+
+	atf_check -o save:out -e empty -s exit:0 pkg export packages
+	atf_check \
+		-o match:'^\{"name":"test","origin":"misc/test","version":"1.0","comment":"a, \\"quoted\\" comment","desc":"line1\\nline2",' \
+		-o match:'"flatsize":0,"automatic":0,"locked":0,"vital":0,' \
+		cat out
+	atf_check \
+		-o inline:'{"package":"test","tag":"note","value":"tab\\there"}\n' \
+		-e empty -s exit:0 \
+		pkg export annotations
+
+	atf_check -o save:out -e empty -s exit:0 pkg export -f csv packages
+	atf_check \
+		-o match:'^test,misc/test,1.0,"a, ""quoted"" comment","line1$' \
+		-o match:'^line2",' \
+		cat out
+
+	mkdir dump
+	atf_check -o empty -e empty -s exit:0 pkg export -f csv -o dump
+	for t in packages deps files options annotations; do
+		test -f dump/${t}.csv || atf_fail "${t}.csv not written"
+	done
+	atf_check -o inline:"package,option,value\n" cat dump/options.csv
+
+	atf_check -o empty -e ignore -s exit:64 pkg export
+	atf_check -o empty -e match:"Unknown table 'nope'" -s exit:64 \
+		pkg export nope
+}
@@ -0,0 +1,71 @@
+#! /usr/bin/env atf-sh
+
+. $(atf_get_srcdir)/test_environment.sh
+
+tests_init \
+	memstats
+
+memstats_body()
+{
+	new_pkg test test 1 /usr/local
+	cat << EOF >> test.ucl
+deps: {
+	dep: {
+		origin: dep,
+		version: "1"
+	}
+}
+files: {
+	${TMPDIR}/file1: ""
+}
+EOF
+	new_pkg dep dep 1 /usr/local
+	echo content > ${TMPDIR}/file1
+
+	for p in test dep; do
+		atf_check \
+			-o ignore \
+			-e empty \
+			-s exit:0 \
+			pkg create -M ${p}.ucl
+	done
+	rm ${TMPDIR}/file1
+
+	atf_check \
+		-o ignore \
+		-e empty \
+		-s exit:0 \
+		pkg repo .
+
+	cat << EOF > repo.conf
+local: {
+	url: file:///$TMPDIR,
+	enabled: true
+}
+EOF
+
+	OUTPUT="Memory pkg: 0 bytes in use
+Memory files: 0 bytes in use
+Memory universe: 0 bytes in use
+Memory solver: 0 bytes in use
+Memory conflicts: 0 bytes in use
+"
+
+	# every subsystem gives back what it allocated once a job is done
+	for cmd in "install -y test" "upgrade -y" "delete -y test dep"; do
+		atf_check \
+			-o save:output.log \
+			-e save:error.log \
+			-s exit:0 \
+			pkg -d -o REPOS_DIR="${TMPDIR}" \
+			-o PKG_CACHEDIR="${TMPDIR}" -o MEMORY_STATS=yes ${cmd}
+		atf_check \
+			-o inline:"${OUTPUT}" \
+			-e empty \
+			-s exit:0 \
+			sed -n -e '/Memory intern/d' \
+			    -e 's/^.*\(Memory .*in use\).*$/\1/p' \
+			    output.log error.log
+	done
+	atf_check -o empty -e ignore -s not-exit:0 pkg info -e test
+}
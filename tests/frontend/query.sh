@@ -3,7 +3,9 @@
 . $(atf_get_srcdir)/test_environment.sh
 
 tests_init \
-	query
+	query \
+	query_closure \
+	query_closure_skip
 
 query_body() {
 	touch plop
@@ -64,3 +66,189 @@ EOF
 		-s exit:0 \
 		pkg query -e "%#O == 0" "%n"
 }
+
+# add_deps <pkg> <dep>...
+add_deps() {
+	p=$1
+	shift
+	echo "deps: {" >> ${p}.ucl
+	for d in "$@"; do
+		echo "	${d}: { origin: ${d}, version: \"1\" }" >> ${p}.ucl
+	done
+	echo "}" >> ${p}.ucl
+}
+
+query_closure_body() {
+	# top -> left -> bottom -> base
+	#     -> right -^
+	for p in top left right bottom base; do
+		new_pkg ${p} ${p} 1 /usr/local
+	done
+	add_deps top left right
+	add_deps left bottom
+	add_deps right bottom
+	add_deps bottom base
+
+	# c1 -> c2 -> ... -> c40
+	i=1
+	while [ ${i} -le 40 ]; do
+		new_pkg c${i} c${i} 1 /usr/local
+		[ ${i} -lt 40 ] && add_deps c${i} c$((i + 1))
+		i=$((i + 1))
+	done
+
+	mkdir repo
+	for p in base bottom left right top $(seq -f "c%g" 40 -1 1); do
+		atf_check -o ignore -e ignore -s exit:0 pkg register -M ${p}.ucl
+		atf_check -o empty -e empty -s exit:0 \
+			pkg create -M ${p}.ucl -o repo
+	done
+
+	DEPS="1 left top>left
+1 right top>right
+2 bottom top>left>bottom
+3 base top>left>bottom>base
+"
+	RDEPS="1 bottom base>bottom
+2 left base>bottom>left
+2 right base>bottom>right
+3 top base>bottom>left>top
+"
+
+	atf_check \
+		-o inline:"${DEPS}" \
+		-e empty \
+		-s exit:0 \
+		pkg query -D "%H %n %P" top
+
+	atf_check \
+		-o inline:"${RDEPS}" \
+		-e empty \
+		-s exit:0 \
+		pkg query --rdeps-closure "%H %n %P" base
+
+	atf_check \
+		-o inline:"1 left\n1 right\n2 bottom\n" \
+		-e empty \
+		-s exit:0 \
+		pkg query -D -L 2 "%H %n" top
+
+	atf_check \
+		-o inline:"1 bottom\n2 base\n" \
+		-e empty \
+		-s exit:0 \
+		pkg query -D -g "%H %n" "[lr]*"
+
+	atf_check \
+		-o save:out \
+		-e empty \
+		-s exit:0 \
+		pkg query -D "%H %n" c1
+	atf_check -o inline:"39 c40\n" tail -n 1 out
+
+	atf_check \
+		-o save:out \
+		-e empty \
+		-s exit:0 \
+		pkg query -R -L 4 "%P" c40
+	atf_check -o inline:"c40>c39>c38>c37>c36\n" tail -n 1 out
+
+	atf_check \
+		-o empty \
+		-e empty \
+		-s exit:69 \
+		pkg query -D "%n" base
+
+	atf_check \
+		-o ignore \
+		-e ignore \
+		-s exit:64 \
+		pkg query -D "%n"
+
+	# the repository catalogs answer the same
+	atf_check -o ignore -e empty -s exit:0 pkg repo repo
+	cat << EOF > repo.conf
+local: {
+	url: file:///${TMPDIR}/repo,
+	enabled: true
+}
+EOF
+	atf_check \
+		-o ignore \
+		-e ignore \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" -o PKG_CACHEDIR="${TMPDIR}" update
+
+	atf_check \
+		-o inline:"${DEPS}" \
+		-e empty \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" rquery -U -D "%H %n %P" top
+
+	atf_check \
+		-o inline:"${RDEPS}" \
+		-e empty \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" rquery -U -R "%H %n %P" base
+}
+
+query_closure_skip_body() {
+	# l01 -> l02 -> l03 -> ... -> l60, and each one skips over the next:
+	# every package is reached through many paths of many lengths
+	mkdir repo
+	for i in $(seq -w 60 -1 1); do
+		new_pkg l${i} l${i} 1 /usr/local
+		deps=
+		for j in $((1${i} - 99)) $((1${i} - 98)); do
+			[ ${j} -le 60 ] && deps="${deps} l$(printf %02d ${j})"
+		done
+		[ -n "${deps}" ] && add_deps l${i} ${deps}
+		atf_check -o ignore -e ignore -s exit:0 pkg register -M l${i}.ucl
+		atf_check -o empty -e empty -s exit:0 \
+			pkg create -M l${i}.ucl -o repo
+	done
+
+	# each package at its shortest distance, through the lowest names
+	PATH60="l01$(seq -f ">l%02g" 2 2 60 | tr -d '\n')"
+	atf_check \
+		-o save:out \
+		-e empty \
+		-s exit:0 \
+		pkg query -D "%H %n %P" l01
+	atf_check -o inline:"59\n" sh -c "wc -l < out | tr -d ' '"
+	atf_check -o inline:"1 l02 l01>l02\n1 l03 l01>l03\n2 l04 l01>l02>l04\n" \
+		head -n 3 out
+	atf_check -o inline:"30 l60 ${PATH60}\n" tail -n 1 out
+
+	atf_check \
+		-o inline:"1 l59\n1 l60\n" \
+		-e empty \
+		-s exit:0 \
+		pkg query -D -L 1 "%H %n" l58
+
+	atf_check \
+		-o save:rout \
+		-e empty \
+		-s exit:0 \
+		pkg query -R "%H %n" l60
+	atf_check -o inline:"30 l01\n" tail -n 1 rout
+
+	atf_check -o ignore -e empty -s exit:0 pkg repo repo
+	cat << EOF > repo.conf
+local: {
+	url: file:///${TMPDIR}/repo,
+	enabled: true
+}
+EOF
+	atf_check \
+		-o ignore \
+		-e ignore \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" -o PKG_CACHEDIR="${TMPDIR}" update
+
+	atf_check \
+		-o file:out \
+		-e empty \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" rquery -U -D "%H %n %P" l01
+}
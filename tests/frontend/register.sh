@@ -4,7 +4,11 @@
 
 tests_init \
 	register_conflicts \
-	register_message
+	register_message \
+	register_batch \
+	register_batch_failure \
+	register_batch_rollback \
+	register_batch_shlibs
 
 register_conflicts_body() {
 	mkdir -p teststage/${TMPDIR}
@@ -102,3 +106,184 @@ remove
 	atf_check -o inline:"${OUTPUT}" pkg info -D test2
 
 }
+
+batch_manifest() {
+	cat << EOF
+name: "p$1"
+origin: "test/p$1"
+version: "1.$1"
+arch: "freebsd:*"
+maintainer: "non"
+prefix: "/usr/local"
+www: "unknown"
+comment: "need one"
+desc: "here as well"
+deps: {
+	p$(($1 / 2)): { origin: "test/p$(($1 / 2))", version: "1.$(($1 / 2))" }
+}
+files: {
+	"/usr/local/share/p$1/file" : ""
+}
+EOF
+}
+
+register_batch_body() {
+	# every other package from a metadata directory
+	for i in $(seq 1 1000); do
+		if [ $((i % 2)) -eq 0 ]; then
+			mkdir -p meta/p${i}
+			batch_manifest ${i} > meta/p${i}/+MANIFEST
+			echo ${TMPDIR}/meta/p${i}
+		else
+			batch_manifest ${i} > p${i}.ucl
+			echo ${TMPDIR}/p${i}.ucl
+		fi
+	done > list
+
+	mkdir batch sequential
+	atf_check \
+		-o match:"Installing p1000-1.1000" \
+		-e ignore \
+		-s exit:0 \
+		pkg -r ${TMPDIR}/batch register -t -n 64 -b ${TMPDIR}/list
+
+	while read p; do
+		if [ -d ${p} ]; then
+			pkg -r ${TMPDIR}/sequential register -t -m ${p}
+		else
+			pkg -r ${TMPDIR}/sequential register -t -M ${p}
+		fi
+	done < list > /dev/null 2>&1
+
+	for q in "%n %v %o %a %Fp" "%n %dn-%dv"; do
+		pkg -r ${TMPDIR}/sequential query -a "${q}" > expected
+		atf_check \
+			-o file:expected \
+			-e empty \
+			-s exit:0 \
+			pkg -r ${TMPDIR}/batch query -a "${q}"
+	done
+	atf_check \
+		-o match:"^ *1000\$" \
+		-e empty \
+		-s exit:0 \
+		sh -c "pkg -r ${TMPDIR}/batch query -a %n | wc -l"
+}
+
+register_batch_failure_body() {
+	for i in 1 2 3; do
+		batch_manifest ${i} > p${i}.ucl
+	done
+	echo "name: broken" > broken.ucl
+	cat << EOF > list
+${TMPDIR}/p1.ucl
+${TMPDIR}/broken.ucl
+
+# comments and empty lines are skipped
+${TMPDIR}/missing.ucl
+${TMPDIR}/p2.ucl
+${TMPDIR}/p3.ucl
+EOF
+
+	# the failures do not roll the other packages of their chunk back
+	atf_check \
+		-o ignore \
+		-e match:"broken.ucl: cannot be registered" \
+		-e match:"missing.ucl: cannot be registered" \
+		-e match:"3 package\(s\) registered, 2 failed" \
+		-s exit:70 \
+		pkg register -t -n 2 -b list
+
+	atf_check \
+		-o inline:"p1\np2\np3\n" \
+		-e empty \
+		-s exit:0 \
+		pkg query -a "%n"
+
+	# from stdin
+	pkg delete -qya
+	atf_check \
+		-o ignore \
+		-e empty \
+		-s exit:0 \
+		sh -c "grep p[13] list | pkg register -t -b -"
+	atf_check \
+		-o inline:"p1\np3\n" \
+		-e empty \
+		-s exit:0 \
+		pkg query -a "%n"
+}
+
+batch_stage() {
+	for i in "$@"; do
+		mkdir -p stage/usr/local/share/p${i}
+		echo ${i} > stage/usr/local/share/p${i}/file
+		batch_manifest ${i} > p${i}.ucl
+		echo ${TMPDIR}/p${i}.ucl
+	done
+}
+
+register_batch_rollback_body() {
+	batch_stage 1 2 3 > list
+	# p4 fails after its own rows are written: it conflicts with p1
+	batch_manifest 4 | sed -e 's,share/p4/,share/p1/,' > p4.ucl
+	sed -i'' -e "2a\\
+${TMPDIR}/p4.ucl
+" list
+	mkdir root
+
+	atf_check \
+		-o ignore \
+		-e match:"p4-1.4 conflicts with p1-1.1" \
+		-e match:"p4.ucl: cannot be registered" \
+		-e match:"3 package\(s\) registered, 1 failed" \
+		-s exit:70 \
+		pkg -r ${TMPDIR}/root register -i ${TMPDIR}/stage -n 10 \
+		    -b ${TMPDIR}/list
+
+	# the savepoint of p4 is rolled back, its chunk is committed
+	atf_check \
+		-o inline:"p1 /usr/local/share/p1/file\np2 /usr/local/share/p2/file\np3 /usr/local/share/p3/file\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -r ${TMPDIR}/root query -a "%n %Fp"
+	atf_check \
+		-o empty \
+		-e empty \
+		-s exit:1 \
+		pkg -r ${TMPDIR}/root info -e p4
+}
+
+register_batch_shlibs_body() {
+	batch_stage 1 2 3 > list
+	mkdir batch sequential
+
+	# the shared libraries of the system are scanned once for the batch
+	atf_check \
+		-o ignore \
+		-e save:batch.log \
+		-s exit:0 \
+		pkg -d -r ${TMPDIR}/batch register -i ${TMPDIR}/stage \
+		    -b ${TMPDIR}/list
+	atf_check \
+		-o match:"^ *1\$" \
+		-e empty \
+		-s exit:0 \
+		sh -c "grep -c 'Scanning the shared libraries' batch.log"
+
+	# and once per package otherwise
+	while read p; do
+		pkg -d -r ${TMPDIR}/sequential register -i ${TMPDIR}/stage -M ${p}
+	done < list > /dev/null 2> sequential.log
+	atf_check \
+		-o match:"^ *3\$" \
+		-e empty \
+		-s exit:0 \
+		sh -c "grep -c 'Scanning the shared libraries' sequential.log"
+
+	atf_check \
+		-o inline:"p1\np2\np3\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -r ${TMPDIR}/batch query -a "%n"
+}
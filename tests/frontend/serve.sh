@@ -0,0 +1,166 @@
+#! /usr/bin/env atf-sh
+
+. $(atf_get_srcdir)/test_environment.sh
+CLEANUP="serve serve_repo"
+tests_init \
+	serve \
+	serve_repo
+
+serve_start() {
+	pkg "$@" serve -s ${TMPDIR}/sock &
+	for i in 1 2 3 4 5 6 7 8 9 10; do
+		[ -S ${TMPDIR}/sock ] && return
+		sleep 0.5
+	done
+	atf_fail "pkg serve did not start"
+}
+
+serve_stop() {
+	pkill -f "serve -s ${TMPDIR}/sock"
+	for i in 1 2 3 4 5 6 7 8 9 10; do
+		[ -S ${TMPDIR}/sock ] || return 0
+		sleep 0.5
+	done
+	atf_fail "pkg serve left its socket"
+}
+
+serve_body() {
+	for p in test test2; do
+		new_pkg ${p} ${p} "1" "/"
+	done
+	atf_check -o ignore -e ignore -s exit:0 pkg register -M test.ucl
+
+	serve_start
+
+	# only the owner of the service can connect
+	atf_check \
+		-o match:"^srw------- " \
+		-e empty \
+		-s exit:0 \
+		ls -l ${TMPDIR}/sock
+
+	atf_check \
+		-o inline:"test-1\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -S ${TMPDIR}/sock query "%n-%v"
+
+	pkg info > info.direct
+	atf_check \
+		-o file:info.direct \
+		-e empty \
+		-s exit:0 \
+		pkg -S ${TMPDIR}/sock info
+
+	atf_check \
+		-o empty \
+		-e empty \
+		-s exit:1 \
+		pkg -S ${TMPDIR}/sock info -e test2
+
+	# the resident database follows the changes
+	atf_check -o ignore -e ignore -s exit:0 pkg register -M test2.ucl
+	atf_check \
+		-o inline:"test-1\ntest2-1\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -S ${TMPDIR}/sock query "%n-%v"
+
+	atf_check \
+		-o empty \
+		-e inline:"pkg: 'delete' is not served, only read-only commands are\n" \
+		-s exit:64 \
+		pkg -S ${TMPDIR}/sock delete -y test
+
+	# a usage error ends the worker, the next request respawns it
+	atf_check \
+		-o ignore \
+		-e ignore \
+		-s exit:64 \
+		pkg -S ${TMPDIR}/sock query -Z
+	atf_check \
+		-o inline:"test\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -S ${TMPDIR}/sock query "%n" test
+
+	for opt in "-r ${TMPDIR}" "-o PKG_DBDIR=${TMPDIR}" "-d"; do
+		atf_check \
+			-o empty \
+			-e match:"cannot be used with -d, -j, -c, -r, -C, -R or -o" \
+			-s exit:64 \
+			pkg -S ${TMPDIR}/sock ${opt} info
+	done
+
+	# the socket is removed on exit
+	serve_stop
+}
+
+serve_cleanup() {
+	pkill -f "serve -s ${TMPDIR}/sock"
+}
+
+serve_repo_body() {
+	mkdir repo
+	cat << EOF > repo.conf
+local: {
+	url: file:///${TMPDIR}/repo,
+	enabled: true
+}
+EOF
+	new_pkg test test 1 /
+	atf_check -o empty -e empty -s exit:0 pkg create -M test.ucl -o repo
+	atf_check -o ignore -e empty -s exit:0 pkg repo repo
+	atf_check \
+		-o ignore \
+		-e ignore \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" -o PKG_CACHEDIR="${TMPDIR}" update
+
+	serve_start -o REPOS_DIR="${TMPDIR}" -o PKG_CACHEDIR="${TMPDIR}"
+
+	atf_check \
+		-o inline:"test-1 local\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -S ${TMPDIR}/sock rquery -a '%n-%v %R'
+
+	atf_check \
+		-o inline:"test-1\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -S ${TMPDIR}/sock search -q -L pkg-name test
+
+	# the catalogue fetched by pkg update replaces the resident one
+	new_pkg test test 2 /
+	new_pkg test2 test2 1 /
+	for p in test test2; do
+		atf_check -o empty -e empty -s exit:0 \
+			pkg create -M ${p}.ucl -o repo
+	done
+	rm repo/test-1.txz
+	atf_check -o ignore -e empty -s exit:0 pkg repo repo
+	atf_check \
+		-o ignore \
+		-e ignore \
+		-s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" -o PKG_CACHEDIR="${TMPDIR}" update -f
+
+	atf_check \
+		-o inline:"test-2 local\ntest2-1 local\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -S ${TMPDIR}/sock rquery -a '%n-%v %R'
+
+	atf_check \
+		-o inline:"test-2\ntest2-1\n" \
+		-e empty \
+		-s exit:0 \
+		pkg -S ${TMPDIR}/sock search -q -L pkg-name test
+
+	serve_stop
+}
+
+serve_repo_cleanup() {
+	pkill -f "serve -s ${TMPDIR}/sock"
+}
@@ -6,7 +6,10 @@ tests_init \
 	set_automatic \
 	set_change_name \
 	set_change_origin \
-	set_vital
+	set_vital \
+	set_bulk_json \
+	set_bulk_tsv \
+	set_bulk_rollback
 
 initialize_pkg() {
 	cat << EOF > test.ucl
@@ -130,3 +133,102 @@ set_vital_body() {
 		-s exit:0 \
 		pkg query "%V" test
 }
+
+initialize_bulk() {
+	for p in a b c; do
+		new_pkg ${p} ${p} 1 /
+		atf_check -o ignore -e empty -s exit:0 pkg register -t -M ${p}.ucl
+	done
+	atf_check -o ignore -e ignore -s exit:0 \
+		pkg annotate -Ay c old gone
+}
+
+set_bulk_json_body() {
+	initialize_bulk
+
+	cat << EOF > bulk.json
+{"package": "a", "attribute": "automatic", "value": 1}
+{"package": "b", "attribute": "vital", "value": true}
+{"package": "c", "attribute": "locked", "value": "1"}
+{"package": "a", "attribute": "annotation:role", "value": "web"}
+{"package": "b", "attribute": "annotation:role", "value": "db"}
+{"package": "a", "attribute": "annotation:role", "value": "cache"}
+{"package": "c", "attribute": "annotation:old", "value": null}
+{"package": "b", "attribute": "automatic", "value": 1}
+{"package": "b", "attribute": "automatic", "value": false}
+EOF
+	atf_check \
+		-o empty \
+		-e empty \
+		-s exit:0 \
+		pkg set -B json < bulk.json
+
+	atf_check \
+		-o inline:"a 1 0 0\nb 0 1 0\nc 0 0 1\n" \
+		-e empty \
+		-s exit:0 \
+		pkg query -a "%n %a %V %k"
+	atf_check \
+		-o inline:"a role cache\nb role db\n" \
+		-e empty \
+		-s exit:0 \
+		pkg query -a "%n %At %Av"
+}
+
+set_bulk_tsv_body() {
+	initialize_bulk
+
+	printf "a\tvital\t1\nmissing\tvital\t1\nc\tannotation:old\t\nb\tannotation:new\tvalue with spaces\nother\tlocked\t0\n" > bulk.tsv
+
+	# unmatched packages are reported, the others updated
+	atf_check \
+		-o empty \
+		-e inline:"pkg: missing: not installed\npkg: other: not installed\n" \
+		-s exit:65 \
+		pkg set -B tsv < bulk.tsv
+
+	atf_check \
+		-o inline:"a 1\nb 0\nc 0\n" \
+		-e empty \
+		-s exit:0 \
+		pkg query -a "%n %V"
+	atf_check \
+		-o inline:"b new value with spaces\n" \
+		-e empty \
+		-s exit:0 \
+		pkg query -a "%n %At %Av"
+}
+
+set_bulk_rollback_body() {
+	initialize_bulk
+
+	cat << EOF > bulk.json
+{"package": "a", "attribute": "automatic", "value": 1}
+{"package": "b", "attribute": "annotation:role", "value": "db"}
+{"package": "c", "attribute": "vital", "value": 2}
+EOF
+	# nothing is changed on error
+	atf_check \
+		-o empty \
+		-e inline:"pkg: line 3: vital expects 0 or 1\n" \
+		-s exit:74 \
+		pkg set -B json < bulk.json
+
+	printf "a\tautomatic\t1\nb\tversion\t2\n" > bulk.tsv
+	atf_check \
+		-o empty \
+		-e inline:"pkg: line 2: unknown attribute 'version'\n" \
+		-s exit:74 \
+		pkg set -B tsv < bulk.tsv
+
+	atf_check \
+		-o inline:"a 0 0\nb 0 0\nc 0 0\n" \
+		-e empty \
+		-s exit:0 \
+		pkg query -a "%n %a %V"
+	atf_check \
+		-o inline:"c old gone\n" \
+		-e empty \
+		-s exit:0 \
+		pkg query -a "%n %At %Av"
+}
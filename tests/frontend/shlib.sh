@@ -0,0 +1,167 @@
+#! /usr/bin/env atf-sh
+
+. $(atf_get_srcdir)/test_environment.sh
+
+tests_init \
+	shlib_glob \
+	shlib_transitive \
+	shlib_missing
+
+shlib_setup() {
+	new_pkg libfoo libfoo 1.0 /usr/local
+	echo 'shlibs_provided: [libfoo.so.5]' >> libfoo.ucl
+
+	new_pkg libbar libbar 1.0 /usr/local
+	echo 'shlibs_provided: [libbar.so.1]' >> libbar.ucl
+	echo 'shlibs_required: [libfoo.so.5]' >> libbar.ucl
+
+	new_pkg libbaz libbaz 1.0 /usr/local
+	echo 'shlibs_provided: [libbaz.so.3]' >> libbaz.ucl
+	echo 'shlibs_required: [libfoo.so.5]' >> libbaz.ucl
+
+	new_pkg libbaz-compat libbaz-compat 1.0 /usr/local
+	echo 'shlibs_provided: [libbaz.so.3]' >> libbaz-compat.ucl
+
+	new_pkg app1 app1 1.0 /usr/local
+	echo 'shlibs_required: [libbar.so.1]' >> app1.ucl
+
+	new_pkg app2 app2 1.0 /usr/local
+	echo 'shlibs_required: [libfoo.so.5, libmissing.so.2]' >> app2.ucl
+
+	new_pkg app3 app3 1.0 /usr/local
+	echo 'shlibs_required: [libbaz.so.3]' >> app3.ucl
+
+	for p in libfoo libbar libbaz libbaz-compat app1 app2 app3; do
+		atf_check \
+		    -o ignore \
+		    -e empty \
+		    -s exit:0 \
+		    pkg register -t -M ${p}.ucl
+	done
+}
+
+shlib_glob_body() {
+	shlib_setup
+
+	OUTPUT="libbar.so.1 is provided by the following packages:
+libbar-1.0
+libbaz.so.3 is provided by the following packages:
+libbaz-1.0
+libbaz-compat-1.0
+"
+	atf_check \
+	    -o inline:"${OUTPUT}" \
+	    -e empty \
+	    -s exit:0 \
+	    pkg shlib -g -P 'libba*'
+
+	OUTPUT="libfoo.so.5 is linked to by the following packages:
+app2-1.0
+libbar-1.0
+libbaz-1.0
+"
+	atf_check \
+	    -o inline:"${OUTPUT}" \
+	    -e empty \
+	    -s exit:0 \
+	    pkg shlib -g -R 'libfoo.so.*'
+
+	atf_check \
+	    -o inline:"No packages provide libnone*.\nNo packages require libnone*.\n" \
+	    -e empty \
+	    -s exit:0 \
+	    pkg shlib -g 'libnone*'
+}
+
+shlib_transitive_body() {
+	shlib_setup
+
+	OUTPUT="The following packages break if libfoo.so.5 disappears:
+	app2-1.0 (requires libfoo.so.5)
+	libbar-1.0 (requires libfoo.so.5)
+	libbaz-1.0 (requires libfoo.so.5)
+	app1-1.0 (requires libbar.so.1, depth 1)
+"
+	atf_check \
+	    -o inline:"${OUTPUT}" \
+	    -e empty \
+	    -s exit:0 \
+	    pkg shlib -t libfoo.so.5
+
+	atf_check \
+	    -o inline:"app2-1.0\nlibbar-1.0\nlibbaz-1.0\napp1-1.0\n" \
+	    -e empty \
+	    -s exit:0 \
+	    pkg shlib -q -t libfoo.so.5
+
+	atf_check \
+	    -o inline:"app1-1.0\n" \
+	    -e empty \
+	    -s exit:0 \
+	    pkg shlib -q -t libbar.so.1
+
+	atf_check \
+	    -o inline:"No packages depend on libnone.so.1.\n" \
+	    -e empty \
+	    -s exit:0 \
+	    pkg shlib -t libnone.so.1
+
+	atf_check \
+	    -o inline:"No packages depend on libfoo.so.*.\n" \
+	    -e empty \
+	    -s exit:0 \
+	    pkg shlib -t 'libfoo.so.*'
+
+	atf_check \
+	    -o inline:"app2-1.0\nlibbar-1.0\nlibbaz-1.0\napp1-1.0\n" \
+	    -e empty \
+	    -s exit:0 \
+	    pkg shlib -q -g -t 'libfoo.so.*'
+}
+
+shlib_missing_body() {
+	shlib_setup
+
+	atf_check \
+	    -o inline:"app2-1.0 requires libmissing.so.2 which is not provided by any installed package\n" \
+	    -e empty \
+	    -s exit:0 \
+	    pkg shlib -m
+
+	atf_check \
+	    -o inline:"app2-1.0 libmissing.so.2\n" \
+	    -e empty \
+	    -s exit:0 \
+	    pkg shlib -q -g -m 'libmissing*'
+
+	atf_check \
+	    -o inline:"app2-1.0 libmissing.so.2\n" \
+	    -e empty \
+	    -s exit:0 \
+	    pkg shlib -q -m libmissing.so.2
+
+	# without -g the name is matched exactly
+	atf_check \
+	    -o inline:"" \
+	    -e empty \
+	    -s exit:0 \
+	    pkg shlib -q -m 'libmissing*'
+
+	atf_check \
+	    -o inline:"" \
+	    -e empty \
+	    -s exit:0 \
+	    pkg shlib -q -g -m 'libfoo*'
+
+	atf_check \
+	    -o ignore \
+	    -e empty \
+	    -s exit:0 \
+	    pkg delete -qy libbar
+
+	atf_check \
+	    -o inline:"app1-1.0 libbar.so.1\napp2-1.0 libmissing.so.2\n" \
+	    -e empty \
+	    -s exit:0 \
+	    pkg shlib -q -m
+}
@@ -0,0 +1,140 @@
+#! /usr/bin/env atf-sh
+
+. $(atf_get_srcdir)/test_environment.sh
+
+tests_init \
+	stats_local \
+	stats_repo
+
+stats_local_body() {
+	new_pkg test1 test1 1.0 /usr/local
+	echo 'flatsize = 100' >> test1.ucl
+	new_pkg test2 test2 1.0 /usr/local
+	echo 'flatsize = 200' >> test2.ucl
+	new_pkg test3 test3 1.0 /usr/local
+	echo 'flatsize = 400' >> test3.ucl
+
+	atf_check \
+	    -o inline:'{"local":{"packages":0,"flatsize":0,"locked":0,"automatic":0}}\n' \
+	    -e empty \
+	    -s exit:0 \
+	    pkg stats -l -f json
+
+	atf_check -o ignore -e empty -s exit:0 pkg register -t -M test1.ucl
+	atf_check -o ignore -e empty -s exit:0 pkg register -t -A -M test2.ucl
+	atf_check -o ignore -e empty -s exit:0 pkg register -t -M test3.ucl
+	atf_check -o ignore -e empty -s exit:0 pkg lock -y test3
+
+	atf_check \
+	    -o inline:'{"local":{"packages":3,"flatsize":700,"locked":1,"automatic":1}}\n' \
+	    -e empty \
+	    -s exit:0 \
+	    pkg stats -l -f json
+
+	atf_check -o ignore -e empty -s exit:0 pkg set -y -A 1 test1
+	atf_check -o ignore -e empty -s exit:0 pkg set -y -A 0 test2
+	atf_check -o ignore -e empty -s exit:0 pkg unlock -y test3
+	atf_check -o ignore -e empty -s exit:0 pkg delete -y test2
+
+	OUTPUT="# HELP pkg_local_packages Number of installed packages.
+# TYPE pkg_local_packages gauge
+pkg_local_packages 2
+# HELP pkg_local_flatsize_bytes Disk space occupied by installed packages.
+# TYPE pkg_local_flatsize_bytes gauge
+pkg_local_flatsize_bytes 500
+# HELP pkg_local_locked_packages Number of locked packages.
+# TYPE pkg_local_locked_packages gauge
+pkg_local_locked_packages 0
+# HELP pkg_local_automatic_packages Number of packages installed as dependencies.
+# TYPE pkg_local_automatic_packages gauge
+pkg_local_automatic_packages 1
+"
+	atf_check \
+	    -o inline:"${OUTPUT}" \
+	    -e empty \
+	    -s exit:0 \
+	    pkg stats -l -f prometheus
+
+	atf_check -o ignore -e empty -s exit:0 pkg delete -y -a
+	atf_check -o ignore -e empty -s exit:0 pkg register -t -M test2.ucl
+
+	atf_check \
+	    -o inline:'{"local":{"packages":1,"flatsize":200,"locked":0,"automatic":0}}\n' \
+	    -e empty \
+	    -s exit:0 \
+	    pkg stats -l -f json
+
+	atf_check \
+	    -o empty \
+	    -e inline:"pkg: Invalid format 'xml', expecting prometheus or json\n" \
+	    -s exit:64 \
+	    pkg stats -f xml
+}
+
+stats_repo_body() {
+	mkdir -p data
+	for p in test1:100 test2:200 test3:400; do
+		name=${p%%:*}
+		dd if=/dev/zero of=data/${name} bs=${p##*:} count=1 2>/dev/null
+		new_pkg ${name} ${name} 1.0 /
+		cat << EOF >> ${name}.ucl
+files: {
+	${TMPDIR}/data/${name}: ""
+}
+EOF
+	done
+
+	mkdir repo
+	for p in test1 test2 test3; do
+		atf_check -o ignore -e empty -s exit:0 \
+			pkg create -o repo -M ${p}.ucl
+	done
+	atf_check -o ignore -e empty -s exit:0 pkg repo repo
+	cat << EOF > repo.conf
+"my\\"repo": {
+	url: file://${TMPDIR}/repo,
+	enabled: true
+}
+EOF
+	atf_check -o ignore -e ignore -s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" update -f
+
+	atf_check \
+	    -o match:'^\{"repositories":\{"my\\"repo":\{"packages":3,"unique":3,"pkgsize":[1-9][0-9]*,"flatsize":700,"updated":[1-9][0-9]*\}\}\}$' \
+	    -e empty \
+	    -s exit:0 \
+	    pkg -o REPOS_DIR="${TMPDIR}" stats -r -f json
+
+	atf_check \
+	    -o match:'^pkg_repo_packages\{repo="my\\"repo"\} 3$' \
+	    -o match:'^pkg_repo_flatsize_bytes\{repo="my\\"repo"\} 700$' \
+	    -e empty \
+	    -s exit:0 \
+	    pkg -o REPOS_DIR="${TMPDIR}" stats -r -f prometheus
+
+	# the triggers follow the catalogue when it is updated again
+	rm repo/test2-1.0.txz
+	atf_check -o ignore -e empty -s exit:0 pkg repo repo
+	atf_check -o ignore -e ignore -s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" update -f
+
+	atf_check \
+	    -o match:'"packages":2,"unique":2,"pkgsize":[1-9][0-9]*,"flatsize":500,' \
+	    -e empty \
+	    -s exit:0 \
+	    pkg -o REPOS_DIR="${TMPDIR}" stats -r -f json
+
+	# a catalogue repeating an origin keeps one package for it
+	sed -i'' -e 's/^version = .*/version = "2.0"/' test1.ucl
+	atf_check -o ignore -e empty -s exit:0 \
+		pkg create -o repo -M test1.ucl
+	atf_check -o ignore -e empty -s exit:0 pkg repo repo
+	atf_check -o ignore -e ignore -s exit:0 \
+		pkg -o REPOS_DIR="${TMPDIR}" update -f
+
+	atf_check \
+	    -o match:'"packages":2,"unique":2,"pkgsize":[1-9][0-9]*,"flatsize":500,' \
+	    -e empty \
+	    -s exit:0 \
+	    pkg -o REPOS_DIR="${TMPDIR}" stats -r -f json
+}
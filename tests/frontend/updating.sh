@@ -0,0 +1,73 @@
+#! /usr/bin/env atf-sh
+
+. $(atf_get_srcdir)/test_environment.sh
+
+tests_init \
+	updating
+
+updating_file() {
+	cat << EOF
+This file documents some of the problems you may encounter when upgrading
+your ports, AFFECTS: www/foo is not an entry.
+
+20161015:
+  AFFECTS: users of www/foo and lang/bar
+  AUTHOR: test@FreeBSD.org
+
+  foo and bar changed.
+
+20160601:
+  AUTHOR: test@FreeBSD.org
+  AFFECTS: users of LANG/BAR
+
+  bar moved.
+
+20150101:
+  AFFECTS: users of devel/baz
+
+  baz removed.
+EOF
+}
+
+updating_body() {
+	updating_file > UPDATING
+	new_pkg foo www/foo 1.0 /
+	atf_check -o ignore -e ignore -s exit:0 pkg register -M foo.ucl
+
+	atf_check \
+		-o inline:"20161015:\n  AFFECTS: users of www/foo and lang/bar\n  AUTHOR: test@FreeBSD.org\n\n  foo and bar changed.\n\n" \
+		-e empty \
+		-s exit:0 \
+		pkg updating -f UPDATING
+
+	atf_check \
+		-o inline:"20161015:\n  AFFECTS: users of www/foo and lang/bar\n  AUTHOR: test@FreeBSD.org\n\n  foo and bar changed.\n\n20160601:\n  AFFECTS: users of LANG/BAR\n\n  bar moved.\n\n" \
+		-e empty \
+		-s exit:0 \
+		pkg updating -f UPDATING -i devel/nothing lang/bar
+
+	atf_check \
+		-o inline:"20150101:\n  AFFECTS: users of devel/baz\n\n  baz removed.\n" \
+		-e empty \
+		-s exit:0 \
+		pkg updating -f UPDATING baz
+
+	# the second run only reads the entries from the index
+	for i in 1 2; do
+		atf_check \
+			-o inline:"20161015:\n  AFFECTS: users of www/foo and lang/bar\n  AUTHOR: test@FreeBSD.org\n\n  foo and bar changed.\n\n20160601:\n  AFFECTS: users of LANG/BAR\n\n  bar moved.\n\n" \
+			-e empty \
+			-s exit:0 \
+			pkg updating -f UPDATING -d 20160101 -i /bar baz
+	done
+	test -f updating.index || atf_fail "no index saved"
+
+	# a modified file is read again
+	printf "20170101:\n  AFFECTS: devel/baz\n\n" > UPDATING
+	updating_file | tail -n +4 >> UPDATING
+	atf_check \
+		-o inline:"20170101:\n  AFFECTS: devel/baz\n\n" \
+		-e empty \
+		-s exit:0 \
+		pkg updating -f UPDATING -d 20160101 baz
+}
@@ -0,0 +1,252 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <archive.h>
+#include <archive_entry.h>
+#include <atf-c.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pkg.h>
+#include <private/pkg.h>
+
+#define MANIFEST \
+	"name: test\n" \
+	"origin: test/test\n" \
+	"version: 1\n" \
+	"arch: freebsd:10:x86:64\n" \
+	"maintainer: test\n" \
+	"prefix: /usr/local\n" \
+	"www: http://test\n" \
+	"comment: a test\n" \
+	"desc: a test\n" \
+	"files: { /usr/local/small: \"\", /usr/local/big: \"\" }\n"
+
+static const char *members[] = {
+	"+COMPACT_MANIFEST", "+MANIFEST", "/usr/local/small", "/usr/local/big"
+};
+
+static char *
+member_content(const char *path, size_t *len)
+{
+	unsigned int seed = 42;
+	char *buf;
+	size_t i;
+
+	if (strcmp(path, "/usr/local/big") == 0) {
+		/* poorly compressible, spans several frames */
+		*len = 700 * 1024;
+		buf = malloc(*len);
+		for (i = 0; i < *len; i++) {
+			seed = seed * 1103515245 + 12345;
+			buf[i] = (seed >> 16) & 0xff;
+		}
+	} else if (path[0] == '+') {
+		buf = strdup(MANIFEST);
+		*len = strlen(buf);
+	} else {
+		buf = strdup("small file\n");
+		*len = strlen(buf);
+	}
+
+	return (buf);
+}
+
+static void
+create_package(const char *name, bool indexed)
+{
+	struct packing *pack;
+	char *buf;
+	size_t len, i;
+	FILE *f;
+
+	setenv("ARCHIVE_INDEX", indexed ? "yes" : "no", 1);
+	ATF_REQUIRE_EQ(EPKG_OK, pkg_init("/dev/null", "/dev/null"));
+
+	ATF_REQUIRE_EQ(EPKG_OK, packing_init(&pack, name, TGZ, false));
+	for (i = 0; i < 2; i++) {
+		buf = member_content(members[i], &len);
+		ATF_REQUIRE_EQ(EPKG_OK,
+		    packing_append_buffer(pack, buf, members[i], len));
+		free(buf);
+	}
+	for (i = 2; i < 4; i++) {
+		buf = member_content(members[i], &len);
+		ATF_REQUIRE((f = fopen("content", "w")) != NULL);
+		ATF_REQUIRE_EQ(1, fwrite(buf, len, 1, f));
+		fclose(f);
+		free(buf);
+		ATF_REQUIRE_EQ(EPKG_OK, packing_append_file_attr(pack,
+		    "content", members[i], "root", "wheel", 0644, 0));
+	}
+	packing_finish(pack);
+
+	pkg_shutdown();
+}
+
+static void
+check_member(struct archive *a, struct archive_entry *ae)
+{
+	char *expected, *buf;
+	size_t len;
+
+	expected = member_content(archive_entry_pathname(ae), &len);
+	ATF_REQUIRE_EQ(len, archive_entry_size(ae));
+	buf = malloc(len);
+	ATF_REQUIRE_EQ(len, archive_read_data(a, buf, len));
+	ATF_REQUIRE(memcmp(expected, buf, len) == 0);
+	free(buf);
+	free(expected);
+}
+
+/* The plain streaming reader, as any tar would do */
+static void
+check_stream(const char *path)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	int i = 0;
+
+	a = archive_read_new();
+	archive_read_support_filter_all(a);
+	archive_read_support_format_tar(a);
+	ATF_REQUIRE_EQ(ARCHIVE_OK, archive_read_open_filename(a, path, 4096));
+	while (archive_read_next_header(a, &ae) == ARCHIVE_OK) {
+		ATF_REQUIRE(i < 4);
+		ATF_REQUIRE_STREQ(members[i++], archive_entry_pathname(ae));
+		check_member(a, ae);
+	}
+	ATF_REQUIRE_EQ(4, i);
+	ATF_REQUIRE_EQ(ARCHIVE_FILTER_GZIP, archive_filter_code(a, 0));
+	archive_read_close(a);
+	archive_read_free(a);
+}
+
+static void
+check_pkg_open(const char *path)
+{
+	struct pkg *pkg = NULL;
+	struct pkg_manifest_key *keys = NULL;
+	struct archive *a;
+	struct archive_entry *ae;
+
+	ATF_REQUIRE_EQ(EPKG_OK, pkg_init("/dev/null", "/dev/null"));
+	pkg_manifest_keys_new(&keys);
+
+	ATF_REQUIRE_EQ(EPKG_OK, pkg_open(&pkg, path, keys,
+	    PKG_OPEN_MANIFEST_COMPACT));
+	ATF_REQUIRE_STREQ("test", pkg->name);
+	pkg_free(pkg);
+	pkg = NULL;
+
+	/* positioned on the first payload member */
+	ATF_REQUIRE_EQ(EPKG_OK, pkg_open2(&pkg, &a, &ae, path, keys, 0, -1));
+	ATF_REQUIRE_STREQ("1", pkg->version);
+	ATF_REQUIRE_STREQ("/usr/local/small", archive_entry_pathname(ae));
+	check_member(a, ae);
+	ATF_REQUIRE_EQ(ARCHIVE_OK, archive_read_next_header(a, &ae));
+	check_member(a, ae);
+	ATF_REQUIRE_EQ(ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	archive_read_close(a);
+	archive_read_free(a);
+	pkg_free(pkg);
+	pkg_manifest_keys_free(keys);
+
+	pkg_shutdown();
+}
+
+ATF_TC(archive_index_roundtrip);
+
+ATF_TC_HEAD(archive_index_roundtrip, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "indexed packages are read by the streaming and the indexed readers");
+}
+
+ATF_TC_BODY(archive_index_roundtrip, tc)
+{
+	struct pkg_archive_index *idx;
+	struct archive *a;
+	struct archive_entry *ae;
+	int fd, i;
+
+	create_package("indexed", true);
+	check_stream("indexed.tgz");
+
+	ATF_REQUIRE((fd = open("indexed.tgz", O_RDONLY)) != -1);
+	ATF_REQUIRE_EQ(EPKG_OK, pkg_archive_index_load(fd, &idx));
+	/* members are read in any order */
+	for (i = 3; i >= 0; i--) {
+		ATF_REQUIRE(pkg_archive_index_has(idx, members[i]));
+		ATF_REQUIRE_EQ(EPKG_OK, pkg_archive_index_open(idx, fd,
+		    members[i], false, &a, &ae));
+		ATF_REQUIRE_STREQ(members[i], archive_entry_pathname(ae));
+		check_member(a, ae);
+		archive_read_close(a);
+		archive_read_free(a);
+	}
+	ATF_REQUIRE(!pkg_archive_index_has(idx, "/usr/local/none"));
+	ATF_REQUIRE_EQ(EPKG_END, pkg_archive_index_open(idx, fd,
+	    "/usr/local/none", false, &a, &ae));
+	pkg_archive_index_free(idx);
+	close(fd);
+
+	check_pkg_open("indexed.tgz");
+}
+
+ATF_TC(archive_index_legacy);
+
+ATF_TC_HEAD(archive_index_legacy, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "packages without an index are still streamed");
+}
+
+ATF_TC_BODY(archive_index_legacy, tc)
+{
+	struct pkg_archive_index *idx;
+	int fd;
+
+	create_package("plain", false);
+	check_stream("plain.tgz");
+
+	ATF_REQUIRE((fd = open("plain.tgz", O_RDONLY)) != -1);
+	ATF_REQUIRE_EQ(EPKG_END, pkg_archive_index_load(fd, &idx));
+	ATF_REQUIRE(idx == NULL);
+	close(fd);
+
+	check_pkg_open("plain.tgz");
+}
+
+ATF_TP_ADD_TCS(tp)
+{
+	ATF_TP_ADD_TC(tp, archive_index_roundtrip);
+	ATF_TP_ADD_TC(tp, archive_index_legacy);
+
+	return (atf_no_error());
+}
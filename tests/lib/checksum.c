@@ -24,9 +24,13 @@
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <sys/sbuf.h>
+
 #include <atf-c.h>
 #include <err.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <utlist.h>
 #include <pkg.h>
 #include <private/pkg.h>
 
@@ -87,10 +91,199 @@ ATF_TC_BODY(check_files, tc)
 	ATF_REQUIRE_STREQ(sum, "1$7d865e959b2466918c9863afca942d0fb89d7c9ac0c99bafc3749504ded97730");
 }
 
+/* The digest as computed from a sorted list of copies of every field */
+struct ref_entry {
+	const char *field;
+	char *value;
+	struct ref_entry *next, *prev;
+};
+
+static void
+ref_add(struct ref_entry **entries, const char *field, const char *value)
+{
+	struct ref_entry *e;
+
+	e = malloc(sizeof(*e));
+	e->field = field;
+	e->value = strdup(value);
+	DL_APPEND(*entries, e);
+}
+
+static int
+ref_cmp(struct ref_entry *e1, struct ref_entry *e2)
+{
+	int r;
+
+	r = strcmp(e1->field, e2->field);
+	if (r != 0)
+		return (r);
+	return (strcmp(e1->value, e2->value));
+}
+
+static char *
+ref_digest(struct pkg *p, pkg_checksum_type_t type)
+{
+	struct ref_entry *entries = NULL, *e, *etmp;
+	struct pkg_option *o = NULL;
+	struct pkg_dep *d = NULL;
+	struct sbuf *b;
+	char *buf, *res;
+
+	ref_add(&entries, "name", p->name);
+	ref_add(&entries, "origin", p->origin);
+	ref_add(&entries, "version", p->version);
+	ref_add(&entries, "arch", p->arch);
+	while (pkg_options(p, &o) == EPKG_OK)
+		ref_add(&entries, o->key, o->value);
+	buf = NULL;
+	while (pkg_shlibs_required(p, &buf) == EPKG_OK)
+		ref_add(&entries, "required_shlib", buf);
+	buf = NULL;
+	while (pkg_shlibs_provided(p, &buf) == EPKG_OK)
+		ref_add(&entries, "provided_shlib", buf);
+	buf = NULL;
+	while (pkg_users(p, &buf) == EPKG_OK)
+		ref_add(&entries, "user", buf);
+	buf = NULL;
+	while (pkg_groups(p, &buf) == EPKG_OK)
+		ref_add(&entries, "group", buf);
+	while (pkg_deps(p, &d) == EPKG_OK) {
+		asprintf(&buf, "%s~%s", d->name, d->origin);
+		ref_add(&entries, "depend", buf);
+		free(buf);
+	}
+	buf = NULL;
+	while (pkg_provides(p, &buf) == EPKG_OK)
+		ref_add(&entries, "provide", buf);
+	buf = NULL;
+	while (pkg_requires(p, &buf) == EPKG_OK)
+		ref_add(&entries, "require", buf);
+
+	DL_SORT(entries, ref_cmp);
+
+	b = sbuf_new_auto();
+	DL_FOREACH_SAFE(entries, e, etmp) {
+		sbuf_cat(b, e->field);
+		sbuf_cat(b, e->value);
+		free(e->value);
+		free(e);
+	}
+	sbuf_finish(b);
+	res = pkg_checksum_data(sbuf_data(b), sbuf_len(b), type);
+	sbuf_delete(b);
+
+	return (res);
+}
+
+/* Short strings from a small alphabet, so they often share prefixes */
+static const char *
+rnd_str(char *buf)
+{
+	static const char chars[] = "ab~-_.0";
+	int i, len;
+
+	len = 1 + random() % 4;
+	for (i = 0; i < len; i++)
+		buf[i] = chars[random() % (sizeof(chars) - 1)];
+	buf[i] = '\0';
+
+	return (buf);
+}
+
+static struct pkg *
+rnd_pkg(void)
+{
+	static const char *keys[] = { "arch", "depend", "name", "provide",
+	    "provided", "provided_shlib", "require", "user", "A", "zz" };
+	struct pkg *p;
+	char b1[8], b2[8];
+	int i, n;
+
+	ATF_REQUIRE_EQ(pkg_new(&p, PKG_FILE), EPKG_OK);
+	pkg_set(p, PKG_NAME, rnd_str(b1));
+	pkg_set(p, PKG_ORIGIN, rnd_str(b1));
+	pkg_set(p, PKG_VERSION, rnd_str(b1));
+	pkg_set(p, PKG_ARCH, rnd_str(b1));
+
+	n = random() % 6;
+	for (i = 0; i < n; i++) {
+		snprintf(b2, sizeof(b2), "%s", rnd_str(b1));
+		pkg_addoption(p, random() % 2 ? keys[random() % 10] : b2,
+		    rnd_str(b1));
+	}
+	n = random() % 8;
+	for (i = 0; i < n; i++) {
+		snprintf(b2, sizeof(b2), "%s", rnd_str(b1));
+		pkg_adddep(p, b2, rnd_str(b1), "1", false);
+	}
+	n = random() % 4;
+	for (i = 0; i < n; i++) {
+		pkg_addshlib_required(p, rnd_str(b1));
+		pkg_addshlib_provided(p, rnd_str(b1));
+		pkg_adduser(p, rnd_str(b1));
+		pkg_addgroup(p, rnd_str(b1));
+		pkg_addprovide(p, rnd_str(b1));
+		pkg_addrequire(p, rnd_str(b1));
+	}
+
+	return (p);
+}
+
+ATF_TC_WITHOUT_HEAD(check_pkg_digest);
+ATF_TC_BODY(check_pkg_digest, tc)
+{
+	pkg_checksum_type_t types[] = { PKG_HASH_TYPE_SHA256_BASE32,
+	    PKG_HASH_TYPE_SHA256_HEX, PKG_HASH_TYPE_BLAKE2_BASE32,
+	    PKG_HASH_TYPE_SHA256_RAW, PKG_HASH_TYPE_BLAKE2_RAW };
+	struct pkg *p;
+	char dest[128], *ref, *sum;
+	int i, t;
+
+	srandom(42);
+	for (i = 0; i < 5000; i++) {
+		p = rnd_pkg();
+		for (t = 0; t < 5; t++) {
+			memset(dest, 0, sizeof(dest));
+			ATF_REQUIRE_EQ(pkg_checksum_generate(p, dest,
+			    sizeof(dest), types[t]), EPKG_OK);
+			ref = ref_digest(p, types[t]);
+			if (types[t] == PKG_HASH_TYPE_SHA256_RAW ||
+			    types[t] == PKG_HASH_TYPE_BLAKE2_RAW) {
+				ATF_REQUIRE(memcmp(dest, ref,
+				    pkg_checksum_type_size(types[t])) == 0);
+			} else {
+				sum = strchr(strchr(dest, '$') + 1, '$') + 1;
+				ATF_REQUIRE_STREQ(sum, ref);
+			}
+			free(ref);
+		}
+		pkg_free(p);
+	}
+
+	/* a known digest */
+	ATF_REQUIRE_EQ(pkg_new(&p, PKG_FILE), EPKG_OK);
+	pkg_set(p, PKG_NAME, "foo");
+	pkg_set(p, PKG_ORIGIN, "misc/foo");
+	pkg_set(p, PKG_VERSION, "1.0");
+	pkg_set(p, PKG_ARCH, "freebsd:10:x86:64");
+	pkg_addoption(p, "DOCS", "on");
+	pkg_addoption(p, "arch", "off");
+	pkg_adddep(p, "bar", "misc/bar", "1", false);
+	pkg_adddep(p, "bar-lib", "misc/bar-lib", "1", false);
+	pkg_addshlib_required(p, "libbar.so.1");
+	pkg_adduser(p, "foo");
+	ATF_REQUIRE_EQ(pkg_checksum_generate(p, dest, sizeof(dest),
+	    PKG_HASH_TYPE_SHA256_HEX), EPKG_OK);
+	ATF_REQUIRE_STREQ(dest,
+	    "2$1$e9c01fff93739acea3bf475176680c549d8a049d10e8c51b5e8fd10a3102625e");
+	pkg_free(p);
+}
+
 ATF_TP_ADD_TCS(tp)
 {
 	ATF_TP_ADD_TC(tp, check_symlinks);
 	ATF_TP_ADD_TC(tp, check_files);
+	ATF_TP_ADD_TC(tp, check_pkg_digest);
 
 	return (atf_no_error());
 }
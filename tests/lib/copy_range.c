@@ -0,0 +1,207 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "pkg_config.h"
+#endif
+
+#include <sys/param.h>
+
+#include <archive.h>
+#include <archive_entry.h>
+#include <atf-c.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_SIZE	(64 * 1024 * 1024)
+#define BENCH_LOOPS	4
+
+static double
+elapsed(struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((now.tv_sec - start->tv_sec) +
+	    (now.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+/* an uncompressed package holding one member of BENCH_SIZE bytes */
+static void
+write_package(const char *path)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	char *buf;
+	size_t i;
+
+	buf = malloc(BENCH_SIZE);
+	ATF_REQUIRE(buf != NULL);
+	srandom(42);
+	for (i = 0; i < BENCH_SIZE; i++)
+		buf[i] = random();
+
+	a = archive_write_new();
+	archive_write_set_format_pax_restricted(a);
+	archive_write_add_filter_none(a);
+	ATF_REQUIRE_EQ(archive_write_open_filename(a, path), ARCHIVE_OK);
+	ae = archive_entry_new();
+	archive_entry_set_pathname(ae, "data");
+	archive_entry_set_filetype(ae, AE_IFREG);
+	archive_entry_set_perm(ae, 0644);
+	archive_entry_set_size(ae, BENCH_SIZE);
+	ATF_REQUIRE_EQ(archive_write_header(a, ae), ARCHIVE_OK);
+	ATF_REQUIRE_EQ(archive_write_data(a, buf, BENCH_SIZE), BENCH_SIZE);
+	archive_entry_free(ae);
+	archive_write_close(a);
+	archive_write_free(a);
+	free(buf);
+}
+
+/*
+ * Extract the member of the package into path, the way pkg_add does:
+ * through libarchive, or with copy_file_range() from the offset libarchive
+ * has reached.
+ */
+static void
+extract(const char *pkg, const char *path, bool kernel)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	char buf[BUFSIZ];
+	off_t offset;
+	int64_t len;
+	ssize_t r;
+	int pfd, fd;
+
+	a = archive_read_new();
+	archive_read_support_filter_all(a);
+	archive_read_support_format_tar(a);
+	ATF_REQUIRE_EQ(archive_read_open_filename(a, pkg, 4096), ARCHIVE_OK);
+	ATF_REQUIRE_EQ(archive_read_next_header(a, &ae), ARCHIVE_OK);
+	fd = open(path, O_CREAT|O_TRUNC|O_WRONLY, 0644);
+	ATF_REQUIRE(fd != -1);
+
+	if (kernel) {
+#ifdef HAVE_COPY_FILE_RANGE
+		pfd = open(pkg, O_RDONLY);
+		ATF_REQUIRE(pfd != -1);
+		offset = archive_filter_bytes(a, 0);
+		for (len = archive_entry_size(ae); len > 0; len -= r) {
+			r = copy_file_range(pfd, &offset, fd, NULL,
+			    MIN(len, SSIZE_MAX), 0);
+			ATF_REQUIRE(r > 0);
+		}
+		close(pfd);
+		ATF_REQUIRE_EQ(archive_read_data_skip(a), ARCHIVE_OK);
+#endif
+	} else {
+		while ((r = archive_read_data(a, buf, sizeof(buf))) > 0)
+			ATF_REQUIRE_EQ(write(fd, buf, r), r);
+		ATF_REQUIRE_EQ(r, 0);
+	}
+
+	close(fd);
+	archive_read_close(a);
+	archive_read_free(a);
+}
+
+static bool
+same_content(const char *p1, const char *p2)
+{
+	char b1[BUFSIZ], b2[BUFSIZ];
+	FILE *f1, *f2;
+	size_t r1, r2;
+	bool same = true;
+
+	f1 = fopen(p1, "r");
+	f2 = fopen(p2, "r");
+	ATF_REQUIRE(f1 != NULL && f2 != NULL);
+	do {
+		r1 = fread(b1, 1, sizeof(b1), f1);
+		r2 = fread(b2, 1, sizeof(b2), f2);
+		if (r1 != r2 || memcmp(b1, b2, r1) != 0)
+			same = false;
+	} while (same && r1 > 0);
+	fclose(f1);
+	fclose(f2);
+
+	return (same);
+}
+
+ATF_TC(copy_range_bench);
+
+ATF_TC_HEAD(copy_range_bench, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "extracting an uncompressed member with copy_file_range()");
+}
+
+ATF_TC_BODY(copy_range_bench, tc)
+{
+	struct timespec start;
+	double user = 0, kernel = 0;
+	int i;
+
+#ifndef HAVE_COPY_FILE_RANGE
+	atf_tc_skip("copy_file_range() is not available");
+#endif
+	write_package("bench.tar");
+
+	for (i = 0; i < BENCH_LOOPS; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		extract("bench.tar", "user", false);
+		user += elapsed(&start);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		extract("bench.tar", "kernel", true);
+		kernel += elapsed(&start);
+	}
+
+	/*
+	 * The gain depends on the filesystem, from a copy kept in the kernel
+	 * to cloned blocks, so it is reported and not asserted.
+	 */
+	printf("%d MiB member, %d runs: libarchive %.3fs, "
+	    "copy_file_range %.3fs\n", BENCH_SIZE / (1024 * 1024), BENCH_LOOPS,
+	    user / BENCH_LOOPS, kernel / BENCH_LOOPS);
+
+	ATF_REQUIRE(same_content("user", "kernel"));
+}
+
+ATF_TP_ADD_TCS(tp)
+{
+	ATF_TP_ADD_TC(tp, copy_range_bench);
+
+	return (atf_no_error());
+}
@@ -0,0 +1,317 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <atf-c.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucl.h>
+#include <pkg.h>
+#include <private/pkg.h>
+#include <private/event.h>
+
+#define BENCH_LOOPS	20000000
+
+static volatile int nargs;
+static int nmsgs;
+static char lastmsg[2048];
+
+static const char *
+arg(void)
+{
+	nargs++;
+	return ("argument");
+}
+
+static int
+record_cb(void *data, struct pkg_event *ev)
+{
+	if (ev->type != PKG_EVENT_DEBUG)
+		return (0);
+	nmsgs++;
+	strlcpy(lastmsg, ev->e_debug.msg, sizeof(lastmsg));
+	return (0);
+}
+
+static void
+debug_setup(int level, uint64_t flags, pkg_event_cb cb)
+{
+	debug_level = level;
+	debug_flags = flags;
+	nargs = 0;
+	nmsgs = 0;
+	lastmsg[0] = '\0';
+	pkg_event_register(cb, NULL);
+}
+
+static double
+elapsed(struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((now.tv_sec - start->tv_sec) +
+	    (now.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+ATF_TC(debug_disabled);
+
+ATF_TC_HEAD(debug_disabled, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "disabled messages do not evaluate their arguments");
+}
+
+ATF_TC_BODY(debug_disabled, tc)
+{
+	debug_setup(0, PKG_DBG_ALL, record_cb);
+	pkg_dbg(DB, 1, "%s", arg());
+	pkg_debug(1, "%s", arg());
+	ATF_REQUIRE_EQ(nargs, 0);
+	ATF_REQUIRE_EQ(nmsgs, 0);
+
+	/* below the level */
+	debug_setup(2, PKG_DBG_ALL, record_cb);
+	pkg_dbg(DB, 3, "%s", arg());
+	pkg_debug(3, "%s", arg());
+	ATF_REQUIRE_EQ(nargs, 0);
+	ATF_REQUIRE_EQ(nmsgs, 0);
+
+	/* filtered category */
+	debug_setup(4, PKG_DBG_ALL & ~PKG_DBG_DB, record_cb);
+	pkg_dbg(DB, 1, "%s", arg());
+	ATF_REQUIRE_EQ(nargs, 0);
+	ATF_REQUIRE_EQ(nmsgs, 0);
+	pkg_dbg(SOLVER, 1, "%s", arg());
+	ATF_REQUIRE_EQ(nargs, 1);
+	ATF_REQUIRE_EQ(nmsgs, 1);
+
+	/* messages without a category ignore the filter */
+	debug_setup(1, 0, record_cb);
+	pkg_debug(1, "%s", arg());
+	ATF_REQUIRE_EQ(nmsgs, 1);
+	ATF_REQUIRE_STREQ(lastmsg, "argument");
+}
+
+ATF_TC(debug_bench);
+
+ATF_TC_HEAD(debug_bench, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "disabled messages cost less than a function call");
+}
+
+ATF_TC_BODY(debug_bench, tc)
+{
+	struct timespec start;
+	double none, disabled, call;
+	volatile int sink = 0;
+	int i;
+
+	debug_setup(0, PKG_DBG_ALL, record_cb);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < BENCH_LOOPS; i++)
+		sink += i;
+	none = elapsed(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < BENCH_LOOPS; i++) {
+		sink += i;
+		pkg_dbg(DB, 4, "iteration %d: %s", i, arg());
+	}
+	disabled = elapsed(&start);
+
+	/* what every message used to cost */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < BENCH_LOOPS; i++) {
+		sink += i;
+		(pkg_debug)(4, "iteration %d: %s", i, arg());
+	}
+	call = elapsed(&start);
+
+	printf("%d iterations: no message %.3fs, disabled message %.3fs, "
+	    "function call %.3fs\n", BENCH_LOOPS, none, disabled, call);
+
+	ATF_REQUIRE_EQ(nargs, BENCH_LOOPS);
+	ATF_REQUIRE_EQ(nmsgs, 0);
+	ATF_REQUIRE(disabled < call);
+}
+
+ATF_TC(debug_long);
+
+ATF_TC_HEAD(debug_long, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "messages larger than the buffer are not truncated");
+}
+
+ATF_TC_BODY(debug_long, tc)
+{
+	char big[1500];
+
+	memset(big, 'x', sizeof(big) - 1);
+	big[sizeof(big) - 1] = '\0';
+
+	debug_setup(1, PKG_DBG_ALL, record_cb);
+	pkg_dbg(FETCH, 1, "<%s>", big);
+	ATF_REQUIRE_EQ(nmsgs, 1);
+	ATF_REQUIRE_EQ(strlen(lastmsg), sizeof(big) + 1);
+	ATF_REQUIRE(lastmsg[0] == '<' && lastmsg[sizeof(big)] == '>');
+
+	pkg_dbg(FETCH, 1, "short %d", 42);
+	ATF_REQUIRE_STREQ(lastmsg, "short 42");
+}
+
+static int
+nested_cb(void *data, struct pkg_event *ev)
+{
+	if (ev->type != PKG_EVENT_DEBUG)
+		return (0);
+	nmsgs++;
+	if (strcmp(ev->e_debug.msg, "outer") == 0) {
+		pkg_dbg(JOBS, 1, "inner %d", nmsgs);
+		/* the inner message did not reuse the buffer of this one */
+		ATF_REQUIRE_STREQ(ev->e_debug.msg, "outer");
+	}
+	return (0);
+}
+
+ATF_TC(debug_nested);
+
+ATF_TC_HEAD(debug_nested, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "a message emitted by a callback does not clobber the current one");
+}
+
+ATF_TC_BODY(debug_nested, tc)
+{
+	debug_setup(1, PKG_DBG_ALL, nested_cb);
+	pkg_dbg(JOBS, 1, "%s", "outer");
+	ATF_REQUIRE_EQ(nmsgs, 2);
+}
+
+#define THREADS		4
+#define THREAD_MSGS	20000
+
+static int thread_msgs[THREADS];
+static int thread_errors;
+
+static int
+thread_cb(void *data, struct pkg_event *ev)
+{
+	int t, n;
+
+	if (ev->type != PKG_EVENT_DEBUG)
+		return (0);
+	if (sscanf(ev->e_debug.msg, "thread %d message %d", &t, &n) != 2 ||
+	    t < 0 || t >= THREADS || n != thread_msgs[t])
+		__sync_fetch_and_add(&thread_errors, 1);
+	else
+		thread_msgs[t]++;
+	return (0);
+}
+
+static void *
+thread_run(void *data)
+{
+	int t = (int)(intptr_t)data;
+	int i;
+
+	for (i = 0; i < THREAD_MSGS; i++)
+		pkg_dbg(SOLVER, 2, "thread %d message %d", t, i);
+
+	return (NULL);
+}
+
+ATF_TC(debug_threads);
+
+ATF_TC_HEAD(debug_threads, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "threads format their messages in their own buffer");
+}
+
+ATF_TC_BODY(debug_threads, tc)
+{
+	pthread_t threads[THREADS];
+	intptr_t i;
+
+	debug_setup(2, PKG_DBG_SOLVER, thread_cb);
+	for (i = 0; i < THREADS; i++)
+		ATF_REQUIRE_EQ(0, pthread_create(&threads[i], NULL,
+		    thread_run, (void *)i));
+	for (i = 0; i < THREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	ATF_REQUIRE_EQ(thread_errors, 0);
+	for (i = 0; i < THREADS; i++)
+		ATF_REQUIRE_EQ(thread_msgs[i], THREAD_MSGS);
+}
+
+ATF_TC(debug_flags);
+
+ATF_TC_HEAD(debug_flags, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "parsing of DEBUG_FLAGS");
+}
+
+ATF_TC_BODY(debug_flags, tc)
+{
+	ucl_object_t *names;
+
+	ATF_REQUIRE_EQ(pkg_dbg_flags(NULL), PKG_DBG_ALL);
+
+	names = ucl_object_typed_new(UCL_ARRAY);
+	ucl_array_append(names, ucl_object_fromstring("db"));
+	ucl_array_append(names, ucl_object_fromstring("Solver"));
+	ATF_REQUIRE_EQ(pkg_dbg_flags(names), PKG_DBG_DB | PKG_DBG_SOLVER);
+
+	ucl_array_append(names, ucl_object_fromstring("ALL"));
+	ATF_REQUIRE_EQ(pkg_dbg_flags(names), PKG_DBG_ALL);
+	ucl_object_unref(names);
+
+	names = ucl_object_typed_new(UCL_ARRAY);
+	ucl_array_append(names, ucl_object_fromstring("nope"));
+	ATF_REQUIRE_EQ(pkg_dbg_flags(names), 0);
+	ucl_object_unref(names);
+}
+
+ATF_TP_ADD_TCS(tp)
+{
+	ATF_TP_ADD_TC(tp, debug_disabled);
+	ATF_TP_ADD_TC(tp, debug_bench);
+	ATF_TP_ADD_TC(tp, debug_long);
+	ATF_TP_ADD_TC(tp, debug_nested);
+	ATF_TP_ADD_TC(tp, debug_threads);
+	ATF_TP_ADD_TC(tp, debug_flags);
+
+	return (atf_no_error());
+}
@@ -0,0 +1,74 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/stat.h>
+
+#include <atf-c.h>
+#include <string.h>
+#include <pkg.h>
+#include <private/pkg.h>
+
+ATF_TC(hardlinks_device);
+
+ATF_TC_HEAD(hardlinks_device, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "files are hardlinks only on the same device");
+}
+
+ATF_TC_BODY(hardlinks_device, tc)
+{
+	hardlinks_t *hl;
+	struct stat st;
+
+	hl = kh_init_hardlinks();
+	memset(&st, 0, sizeof(st));
+
+	st.st_dev = 1;
+	st.st_ino = 42;
+	ATF_REQUIRE(first_hardlink(hl, &st, "/a") == NULL);
+	ATF_REQUIRE_STREQ(first_hardlink(hl, &st, "/b"), "/a");
+	ATF_REQUIRE_STREQ(first_hardlink(hl, &st, "/c"), "/a");
+
+	/* same inode number on another file system */
+	st.st_dev = 2;
+	ATF_REQUIRE(first_hardlink(hl, &st, "/mnt/a") == NULL);
+	ATF_REQUIRE_STREQ(first_hardlink(hl, &st, "/mnt/b"), "/mnt/a");
+
+	st.st_ino = 43;
+	ATF_REQUIRE(!check_for_hardlink(hl, &st));
+	ATF_REQUIRE(check_for_hardlink(hl, &st));
+	ATF_REQUIRE_EQ(kh_count(hl), 3);
+
+	kh_destroy_hardlinks(hl);
+}
+
+ATF_TP_ADD_TCS(tp)
+{
+	ATF_TP_ADD_TC(tp, hardlinks_device);
+
+	return (atf_no_error());
+}
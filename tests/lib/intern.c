@@ -0,0 +1,301 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <atf-c.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pkg.h>
+#include <private/pkg.h>
+#include <khash.h>
+
+ATF_TC(intern_atoms);
+
+ATF_TC_HEAD(intern_atoms, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "interned strings are unique and compare by pointer");
+}
+
+ATF_TC_BODY(intern_atoms, tc)
+{
+	char buf[32];
+	const char *a, *b;
+	size_t count, bytes;
+
+	ATF_REQUIRE(pkg_intern(NULL) == NULL);
+	ATF_REQUIRE(pkg_intern_lookup("never-interned") == NULL);
+
+	strlcpy(buf, "freebsd:11:x86:64", sizeof(buf));
+	a = pkg_intern(buf);
+	ATF_REQUIRE(a != NULL);
+	ATF_REQUIRE(a != buf);
+	ATF_REQUIRE_STREQ(a, "freebsd:11:x86:64");
+
+	/* the atom does not depend on the original buffer */
+	buf[0] = 'X';
+	ATF_REQUIRE_STREQ(a, "freebsd:11:x86:64");
+
+	b = pkg_intern("freebsd:11:x86:64");
+	ATF_REQUIRE(a == b);
+	ATF_REQUIRE(pkg_intern_lookup("freebsd:11:x86:64") == a);
+
+	ATF_REQUIRE(pkg_internn("freebsd:11:x86:64-extra", 17) == a);
+	ATF_REQUIRE(pkg_internn("freebsd", 64) == pkg_intern("freebsd"));
+	ATF_REQUIRE(pkg_intern("") != NULL);
+
+	pkg_intern_stats(&count, &bytes);
+	ATF_REQUIRE_EQ(count, 3);
+	ATF_REQUIRE(bytes > 0);
+
+	pkg_intern_free();
+	ATF_REQUIRE(pkg_intern_lookup("freebsd:11:x86:64") == NULL);
+	pkg_intern_stats(&count, &bytes);
+	ATF_REQUIRE_EQ(count, 0);
+	ATF_REQUIRE_EQ(bytes, 0);
+}
+
+ATF_TC(intern_pkg);
+
+ATF_TC_HEAD(intern_pkg, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "identity fields of packages and dependencies are shared");
+}
+
+ATF_TC_BODY(intern_pkg, tc)
+{
+	struct pkg *p1, *p2;
+	struct pkg_dep *d = NULL;
+
+	ATF_REQUIRE_EQ(EPKG_OK, pkg_new(&p1, PKG_REMOTE));
+	ATF_REQUIRE_EQ(EPKG_OK, pkg_new(&p2, PKG_REMOTE));
+
+	pkg_set(p1, PKG_NAME, "foo", PKG_ORIGIN, "misc/foo",
+	    PKG_VERSION, "1.0", PKG_ARCH, "freebsd:11:x86:64",
+	    PKG_PREFIX, "/usr/local", PKG_REPONAME, "repo");
+	pkg_set(p2, PKG_NAME, "bar", PKG_ORIGIN, "misc/bar",
+	    PKG_VERSION, "1.0", PKG_ARCH, "freebsd:11:x86:64",
+	    PKG_PREFIX, "/usr/local", PKG_REPONAME, "repo");
+
+	ATF_REQUIRE(p1->uid == p1->name);
+	ATF_REQUIRE(p1->version == p2->version);
+	ATF_REQUIRE(p1->arch == p2->arch);
+	ATF_REQUIRE(p1->prefix == p2->prefix);
+	ATF_REQUIRE(p1->reponame == p2->reponame);
+
+	/* a dependency on foo refers to the very same uid */
+	ATF_REQUIRE_EQ(EPKG_OK, pkg_adddep(p2, "foo", "misc/foo", "1.0", false));
+	ATF_REQUIRE_EQ(EPKG_OK, pkg_deps(p2, &d));
+	ATF_REQUIRE(d->uid == p1->uid);
+	ATF_REQUIRE(d->origin == p1->origin);
+
+	/* changing a field only moves the pointer */
+	pkg_set(p1, PKG_VERSION, "2.0");
+	ATF_REQUIRE_STREQ(p2->version, "1.0");
+	ATF_REQUIRE_STREQ(p1->version, "2.0");
+
+	pkg_free(p1);
+	pkg_free(p2);
+	ATF_REQUIRE_STREQ(pkg_intern_lookup("misc/foo"), "misc/foo");
+}
+
+ATF_TC(intern_reset);
+
+ATF_TC_HEAD(intern_reset, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "pkg_intern_reset() releases every atom");
+}
+
+ATF_TC_BODY(intern_reset, tc)
+{
+	size_t count, bytes;
+
+	ATF_REQUIRE(pkg_intern("freebsd:11:x86:64") != NULL);
+	ATF_REQUIRE(pkg_intern("misc/foo") != NULL);
+
+	pkg_intern_reset();
+	ATF_REQUIRE(pkg_intern_lookup("freebsd:11:x86:64") == NULL);
+	pkg_intern_stats(&count, &bytes);
+	ATF_REQUIRE_EQ(count, 0);
+	ATF_REQUIRE_EQ(bytes, 0);
+
+	/* the interner is usable again */
+	ATF_REQUIRE_STREQ(pkg_intern("misc/foo"), "misc/foo");
+	ATF_REQUIRE(pkg_intern_lookup("misc/foo") == pkg_intern("misc/foo"));
+	pkg_intern_free();
+}
+
+/*
+ * A synthetic universe: every name is available installed and remote,
+ * with BENCH_DEPS dependencies each, and a few maintainers.
+ */
+#define BENCH_NAMES	30000
+#define BENCH_DEPS	8
+#define BENCH_LOOKUPS	(BENCH_NAMES * 2 * BENCH_DEPS * 20)
+
+KHASH_MAP_INIT_STR(bench_str, struct pkg *);
+KHASH_MAP_INIT_INT64(bench_atom, struct pkg *);
+
+static double
+elapsed(struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((now.tv_sec - start->tv_sec) +
+	    (now.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+static size_t
+dup_size(const char *str)
+{
+	return (str != NULL ? strlen(str) + 1 : 0);
+}
+
+ATF_TC(intern_bench);
+
+ATF_TC_HEAD(intern_bench, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "memory and lookup time of a universe keyed by atoms");
+}
+
+ATF_TC_BODY(intern_bench, tc)
+{
+	struct pkg **pkgs;
+	struct pkg_dep *d;
+	struct timespec start;
+	kh_bench_str_t *bystr;
+	kh_bench_atom_t *byatom;
+	char name[32], dep[32], maint[32];
+	size_t count, bytes, dups = 0, n = BENCH_NAMES * 2, i;
+	double load, strtime, atomtime;
+	khint_t k;
+	int j, ret, found = 0;
+
+	pkgs = calloc(n, sizeof(*pkgs));
+	ATF_REQUIRE(pkgs != NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < n; i++) {
+		snprintf(name, sizeof(name), "package%zu", i % BENCH_NAMES);
+		snprintf(maint, sizeof(maint), "maint%zu@FreeBSD.org",
+		    i % (BENCH_NAMES / 10));
+		ATF_REQUIRE_EQ(EPKG_OK, pkg_new(&pkgs[i],
+		    i < BENCH_NAMES ? PKG_INSTALLED : PKG_REMOTE));
+		pkg_set(pkgs[i], PKG_NAME, name, PKG_ORIGIN, name,
+		    PKG_VERSION, i < BENCH_NAMES ? "1.0" : "1.1",
+		    PKG_ARCH, "freebsd:11:x86:64", PKG_PREFIX, "/usr/local",
+		    PKG_MAINTAINER, maint, PKG_WWW, "http://www.FreeBSD.org");
+		if (i >= BENCH_NAMES)
+			pkg_set(pkgs[i], PKG_REPONAME, "FreeBSD");
+		for (j = 1; j <= BENCH_DEPS; j++) {
+			snprintf(dep, sizeof(dep), "package%zu",
+			    (i + j * 97) % BENCH_NAMES);
+			pkg_adddep(pkgs[i], dep, dep, "1.0", false);
+		}
+	}
+	load = elapsed(&start);
+
+	/* what the same strings take when every package owns a copy */
+	for (i = 0; i < n; i++) {
+		dups += dup_size(pkgs[i]->uid) + dup_size(pkgs[i]->name) +
+		    dup_size(pkgs[i]->origin) + dup_size(pkgs[i]->version) +
+		    dup_size(pkgs[i]->arch) + dup_size(pkgs[i]->prefix) +
+		    dup_size(pkgs[i]->maintainer) + dup_size(pkgs[i]->www) +
+		    dup_size(pkgs[i]->reponame);
+		d = NULL;
+		while (pkg_deps(pkgs[i], &d) == EPKG_OK)
+			dups += dup_size(d->uid) + dup_size(d->name) +
+			    dup_size(d->origin) + dup_size(d->version);
+	}
+	pkg_intern_stats(&count, &bytes);
+
+	/* resolve every dependency against the remote packages */
+	bystr = kh_init_bench_str();
+	byatom = kh_init_bench_atom();
+	for (i = BENCH_NAMES; i < n; i++) {
+		k = kh_put_bench_str(bystr, pkgs[i]->uid, &ret);
+		kh_value(bystr, k) = pkgs[i];
+		k = kh_put_bench_atom(byatom, (uintptr_t)pkgs[i]->uid, &ret);
+		kh_value(byatom, k) = pkgs[i];
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (j = 0; j < BENCH_LOOKUPS / (int)(n * BENCH_DEPS); j++) {
+		for (i = 0; i < n; i++) {
+			d = NULL;
+			while (pkg_deps(pkgs[i], &d) == EPKG_OK) {
+				k = kh_get_bench_str(bystr, d->uid);
+				found += (k != kh_end(bystr));
+			}
+		}
+	}
+	strtime = elapsed(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (j = 0; j < BENCH_LOOKUPS / (int)(n * BENCH_DEPS); j++) {
+		for (i = 0; i < n; i++) {
+			d = NULL;
+			while (pkg_deps(pkgs[i], &d) == EPKG_OK) {
+				k = kh_get_bench_atom(byatom, (uintptr_t)d->uid);
+				found += (k != kh_end(byatom));
+			}
+		}
+	}
+	atomtime = elapsed(&start);
+
+	printf("%zu packages loaded in %.3fs\n", n, load);
+	printf("strings: %zu bytes as copies, %zu atoms in %zu bytes\n",
+	    dups, count, bytes);
+	printf("%d uid lookups: %.3fs keyed by string, %.3fs keyed by atom\n",
+	    BENCH_LOOKUPS, strtime, atomtime);
+
+	ATF_REQUIRE_EQ(found, 2 * BENCH_LOOKUPS);
+	ATF_REQUIRE(bytes < dups);
+
+	kh_destroy_bench_str(bystr);
+	kh_destroy_bench_atom(byatom);
+	for (i = 0; i < n; i++)
+		pkg_free(pkgs[i]);
+	free(pkgs);
+	pkg_intern_free();
+}
+
+ATF_TP_ADD_TCS(tp)
+{
+	ATF_TP_ADD_TC(tp, intern_atoms);
+	ATF_TP_ADD_TC(tp, intern_pkg);
+	ATF_TP_ADD_TC(tp, intern_reset);
+	ATF_TP_ADD_TC(tp, intern_bench);
+
+	return (atf_no_error());
+}
@@ -0,0 +1,300 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <atf-c.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pkg.h>
+#include <private/pkg.h>
+#include <private/pkg_jobs.h>
+
+static struct pkg_jobs_universe *
+universe_new(void)
+{
+	struct pkg_jobs_universe *u;
+
+	u = calloc(1, sizeof(*u));
+	ATF_REQUIRE(u != NULL);
+
+	return (u);
+}
+
+static struct pkg_job_universe_item *
+universe_add(struct pkg_jobs_universe *u, const char *name, pkg_t type)
+{
+	struct pkg_job_universe_item *item, *chain = NULL;
+	struct pkg *p = NULL;
+	char digest[BUFSIZ];
+
+	snprintf(digest, sizeof(digest), "%s-%s", name,
+	    type == PKG_INSTALLED ? "local" : "remote");
+	ATF_REQUIRE_EQ(EPKG_OK, pkg_new(&p, type));
+	pkg_set(p, PKG_NAME, name, PKG_ORIGIN, name, PKG_VERSION, "1",
+	    PKG_DIGEST, digest);
+
+	item = calloc(1, sizeof(*item));
+	ATF_REQUIRE(item != NULL);
+	item->pkg = p;
+	item->uid = p->uid;
+
+	HASH_FIND_PTR(u->items, &item->uid, chain);
+	if (chain == NULL)
+		HASH_ADD_PTR(u->items, uid, item);
+	DL_APPEND(chain, item);
+
+	return (item);
+}
+
+static void
+universe_dep(struct pkg_job_universe_item *from,
+    struct pkg_job_universe_item *to)
+{
+	ATF_REQUIRE_EQ(EPKG_OK, pkg_adddep(from->pkg, to->pkg->name,
+	    to->pkg->origin, "1", false));
+	if (to->pkg->type == PKG_INSTALLED && from->pkg->type == PKG_INSTALLED)
+		ATF_REQUIRE_EQ(EPKG_OK, pkg_addrdep(to->pkg, from->pkg->name,
+		    from->pkg->origin, "1", false));
+}
+
+static void
+jobs_add(struct pkg_solved **jobs, struct pkg_job_universe_item *item,
+    pkg_solved_t type)
+{
+	struct pkg_solved *s;
+
+	s = calloc(1, sizeof(*s));
+	ATF_REQUIRE(s != NULL);
+	s->items[0] = item;
+	s->type = type;
+	DL_APPEND(*jobs, s);
+}
+
+static int notices;
+
+static int
+notice_cb(void *data, struct pkg_event *ev)
+{
+	if (ev->type == PKG_EVENT_NOTICE)
+		notices++;
+	return (0);
+}
+
+static void
+jobs_free(struct pkg_solved *jobs)
+{
+	struct pkg_solved *s, *stmp;
+
+	DL_FOREACH_SAFE(jobs, s, stmp)
+		free(s);
+}
+
+ATF_TC(jobs_order_chain);
+
+ATF_TC_HEAD(jobs_order_chain, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "a long dependency chain is ordered from its end");
+}
+
+ATF_TC_BODY(jobs_order_chain, tc)
+{
+	struct pkg_jobs_universe *u = universe_new();
+	struct pkg_solved *jobs = NULL;
+	struct pkg_job_universe_item *items[5000];
+	char name[32];
+	int i, n = sizeof(items) / sizeof(items[0]);
+
+	for (i = 0; i < n; i++) {
+		snprintf(name, sizeof(name), "chain%d", i);
+		items[i] = universe_add(u, name, PKG_REMOTE);
+		if (i > 0)
+			universe_dep(items[i - 1], items[i]);
+	}
+	/* Request the jobs from the end of the chain */
+	for (i = n - 1; i >= 0; i--)
+		jobs_add(&jobs, items[i], PKG_SOLVED_INSTALL);
+
+	ATF_REQUIRE_EQ(0, pkg_jobs_universe_order(u, jobs));
+	for (i = 0; i < n; i++)
+		ATF_REQUIRE_EQ(i, items[i]->priority);
+
+	jobs_free(jobs);
+	pkg_jobs_universe_free(u);
+}
+
+ATF_TC(jobs_order_diamonds);
+
+ATF_TC_HEAD(jobs_order_diamonds, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "stacked diamonds are ordered in linear time");
+}
+
+ATF_TC_BODY(jobs_order_diamonds, tc)
+{
+	struct pkg_jobs_universe *u = universe_new();
+	struct pkg_solved *jobs = NULL;
+	struct pkg_job_universe_item *items[200][2];
+	char name[32];
+	int i, k, n = sizeof(items) / sizeof(items[0]);
+
+	/*
+	 * Every package of a layer depends on both packages of the next one:
+	 * there are 2^200 paths from the top to the bottom.
+	 */
+	for (i = 0; i < n; i++) {
+		for (k = 0; k < 2; k++) {
+			snprintf(name, sizeof(name), "layer%d-%c", i, 'a' + k);
+			items[i][k] = universe_add(u, name, PKG_REMOTE);
+			jobs_add(&jobs, items[i][k], PKG_SOLVED_INSTALL);
+		}
+		if (i > 0) {
+			for (k = 0; k < 4; k++)
+				universe_dep(items[i - 1][k / 2], items[i][k % 2]);
+		}
+	}
+
+	ATF_REQUIRE_EQ(0, pkg_jobs_universe_order(u, jobs));
+	for (i = 0; i < n; i++) {
+		ATF_REQUIRE_EQ(i, items[i][0]->priority);
+		ATF_REQUIRE_EQ(i, items[i][1]->priority);
+	}
+
+	jobs_free(jobs);
+	pkg_jobs_universe_free(u);
+}
+
+ATF_TC(jobs_order_cycle);
+
+ATF_TC_HEAD(jobs_order_cycle, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "cycles are broken by package name whatever the order of the jobs");
+}
+
+ATF_TC_BODY(jobs_order_cycle, tc)
+{
+	struct pkg_jobs_universe *u = universe_new();
+	struct pkg_solved *jobs = NULL, *rjobs = NULL;
+	struct pkg_job_universe_item *a, *b, *c, *d, *e;
+
+	/* d -> b -> c -> a -> b, e -> e */
+	a = universe_add(u, "a", PKG_REMOTE);
+	b = universe_add(u, "b", PKG_REMOTE);
+	c = universe_add(u, "c", PKG_REMOTE);
+	d = universe_add(u, "d", PKG_REMOTE);
+	e = universe_add(u, "e", PKG_REMOTE);
+	universe_dep(d, b);
+	universe_dep(b, c);
+	universe_dep(c, a);
+	universe_dep(a, b);
+	universe_dep(e, e);
+
+	jobs_add(&jobs, d, PKG_SOLVED_INSTALL);
+	jobs_add(&jobs, c, PKG_SOLVED_INSTALL);
+	jobs_add(&jobs, e, PKG_SOLVED_INSTALL);
+	jobs_add(&rjobs, e, PKG_SOLVED_INSTALL);
+	jobs_add(&rjobs, a, PKG_SOLVED_INSTALL);
+	jobs_add(&rjobs, b, PKG_SOLVED_INSTALL);
+	jobs_add(&rjobs, d, PKG_SOLVED_INSTALL);
+
+	notices = 0;
+	pkg_event_register(notice_cb, NULL);
+
+	/* the edge from c back to a is ignored */
+	ATF_REQUIRE_EQ(1, pkg_jobs_universe_order(u, jobs));
+	ATF_REQUIRE_EQ(1, notices);
+	ATF_REQUIRE_EQ(0, d->priority);
+	ATF_REQUIRE_EQ(0, a->priority);
+	ATF_REQUIRE_EQ(1, b->priority);
+	ATF_REQUIRE_EQ(2, c->priority);
+	ATF_REQUIRE_EQ(0, e->priority);
+
+	/* the same cycle is only reported once */
+	ATF_REQUIRE_EQ(1, pkg_jobs_universe_order(u, rjobs));
+	ATF_REQUIRE_EQ(1, notices);
+	ATF_REQUIRE_EQ(0, d->priority);
+	ATF_REQUIRE_EQ(0, a->priority);
+	ATF_REQUIRE_EQ(1, b->priority);
+	ATF_REQUIRE_EQ(2, c->priority);
+	ATF_REQUIRE_EQ(0, e->priority);
+
+	jobs_free(jobs);
+	jobs_free(rjobs);
+	pkg_jobs_universe_free(u);
+}
+
+ATF_TC(jobs_order_delete);
+
+ATF_TC_HEAD(jobs_order_delete, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "reverse dependencies are removed first, conflicts before install");
+}
+
+ATF_TC_BODY(jobs_order_delete, tc)
+{
+	struct pkg_jobs_universe *u = universe_new();
+	struct pkg_solved *jobs = NULL;
+	struct pkg_job_universe_item *lib, *app, *plugin, *repl, *dep;
+
+	/* plugin -> app -> lib are installed, repl conflicts with lib */
+	lib = universe_add(u, "lib", PKG_INSTALLED);
+	app = universe_add(u, "app", PKG_INSTALLED);
+	plugin = universe_add(u, "plugin", PKG_INSTALLED);
+	repl = universe_add(u, "repl", PKG_REMOTE);
+	dep = universe_add(u, "repl-dep", PKG_REMOTE);
+	universe_dep(app, lib);
+	universe_dep(plugin, app);
+	universe_dep(repl, dep);
+	ATF_REQUIRE_EQ(EPKG_OK, pkg_addconflict(repl->pkg, "lib"));
+
+	jobs_add(&jobs, repl, PKG_SOLVED_INSTALL);
+	jobs_add(&jobs, dep, PKG_SOLVED_INSTALL);
+	jobs_add(&jobs, lib, PKG_SOLVED_DELETE);
+	jobs_add(&jobs, app, PKG_SOLVED_DELETE);
+	jobs_add(&jobs, plugin, PKG_SOLVED_DELETE);
+
+	ATF_REQUIRE_EQ(0, pkg_jobs_universe_order(u, jobs));
+	ATF_REQUIRE_EQ(0, repl->priority);
+	ATF_REQUIRE_EQ(1, dep->priority);
+	ATF_REQUIRE_EQ(1, lib->priority);
+	ATF_REQUIRE_EQ(2, app->priority);
+	ATF_REQUIRE_EQ(3, plugin->priority);
+
+	jobs_free(jobs);
+	pkg_jobs_universe_free(u);
+}
+
+ATF_TP_ADD_TCS(tp)
+{
+	ATF_TP_ADD_TC(tp, jobs_order_chain);
+	ATF_TP_ADD_TC(tp, jobs_order_diamonds);
+	ATF_TP_ADD_TC(tp, jobs_order_cycle);
+	ATF_TP_ADD_TC(tp, jobs_order_delete);
+
+	return (atf_no_error());
+}
@@ -0,0 +1,284 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <atf-c.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sqlite3.h>
+#include <pkg.h>
+#include <private/pkg.h>
+#include <repo/binary/binary_private.h>
+
+static sqlite3 *
+conflicts_db(int npkgs)
+{
+	sqlite3 *s;
+	char sql[128];
+	int i;
+
+	ATF_REQUIRE_EQ(SQLITE_OK, sqlite3_initialize());
+	ATF_REQUIRE_EQ(SQLITE_OK, sqlite3_open(":memory:", &s));
+	ATF_REQUIRE_EQ(SQLITE_OK, sqlite3_exec(s,
+	    "CREATE TABLE packages (id INTEGER PRIMARY KEY, origin TEXT);"
+	    "CREATE TABLE pkg_conflicts ("
+	    "package_id INTEGER NOT NULL REFERENCES packages(id)"
+	    "  ON DELETE CASCADE ON UPDATE CASCADE,"
+	    "conflict_id INTEGER NOT NULL,"
+	    "UNIQUE(package_id, conflict_id));", NULL, NULL, NULL));
+
+	for (i = 0; i < npkgs; i++) {
+		/* every tenth origin is shared by two packages */
+		snprintf(sql, sizeof(sql),
+		    "INSERT INTO packages(origin) VALUES ('cat/o%d');",
+		    i % 10 == 9 ? i - 1 : i);
+		ATF_REQUIRE_EQ(SQLITE_OK, sqlite3_exec(s, sql, NULL, NULL, NULL));
+	}
+
+	return (s);
+}
+
+static FILE *
+conflicts_file(const char *content)
+{
+	FILE *f;
+
+	ATF_REQUIRE((f = tmpfile()) != NULL);
+	ATF_REQUIRE(fputs(content, f) >= 0);
+	rewind(f);
+
+	return (f);
+}
+
+static char *
+conflicts_dump(sqlite3 *s)
+{
+	sqlite3_stmt *stmt;
+	struct sbuf *b = sbuf_new_auto();
+	char *res;
+
+	ATF_REQUIRE_EQ(SQLITE_OK, sqlite3_prepare_v2(s,
+	    "SELECT package_id, conflict_id FROM pkg_conflicts "
+	    "ORDER BY package_id, conflict_id;", -1, &stmt, NULL));
+	while (sqlite3_step(stmt) == SQLITE_ROW)
+		sbuf_printf(b, "%lld:%lld\n",
+		    (long long)sqlite3_column_int64(stmt, 0),
+		    (long long)sqlite3_column_int64(stmt, 1));
+	sqlite3_finalize(stmt);
+	sbuf_finish(b);
+	res = strdup(sbuf_data(b));
+	sbuf_delete(b);
+
+	return (res);
+}
+
+/*
+ * Reference: the conflicts registered one line at a time, one statement per
+ * lookup, as the import used to do.
+ */
+static int64_t
+legacy_id(sqlite3 *s, const char *origin)
+{
+	sqlite3_stmt *stmt;
+	int64_t id = -1;
+
+	sqlite3_prepare_v2(s, "SELECT id FROM packages WHERE origin = ?1;",
+	    -1, &stmt, NULL);
+	sqlite3_bind_text(stmt, 1, origin, -1, SQLITE_TRANSIENT);
+	if (sqlite3_step(stmt) == SQLITE_ROW)
+		id = sqlite3_column_int64(stmt, 0);
+	sqlite3_finalize(stmt);
+
+	return (id);
+}
+
+static void
+legacy_register(sqlite3 *s, const char *origin, char **conflicts, int n)
+{
+	sqlite3_stmt *stmt;
+	int64_t origin_id, conflict_id;
+	int i, ret;
+
+	if ((origin_id = legacy_id(s, origin)) < 0)
+		return;
+
+	sqlite3_prepare_v2(s, "DELETE FROM pkg_conflicts WHERE package_id = ?1;",
+	    -1, &stmt, NULL);
+	sqlite3_bind_int64(stmt, 1, origin_id);
+	sqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+
+	for (i = 0; i < n; i++) {
+		if ((conflict_id = legacy_id(s, conflicts[i])) < 0)
+			return;
+		sqlite3_prepare_v2(s, "INSERT INTO pkg_conflicts "
+		    "(package_id, conflict_id) VALUES (?1, ?2);", -1, &stmt, NULL);
+		sqlite3_bind_int64(stmt, 1, origin_id);
+		sqlite3_bind_int64(stmt, 2, conflict_id);
+		ret = sqlite3_step(stmt);
+		sqlite3_finalize(stmt);
+		if (ret != SQLITE_DONE)
+			return;
+	}
+}
+
+static void
+legacy_parse(FILE *f, sqlite3 *s)
+{
+	size_t linecap = 0;
+	char *linebuf = NULL, *p, **deps;
+	const char *origin, *pdep;
+	int ndep, i;
+
+	sqlite3_exec(s, "DELETE FROM pkg_conflicts;", NULL, NULL, NULL);
+	while (getline(&linebuf, &linecap, f) > 0) {
+		p = linebuf;
+		origin = strsep(&p, ":");
+		if (p == NULL)
+			continue;
+		ndep = 1;
+		for (pdep = p; *pdep != '\0'; pdep++)
+			if (*pdep == ',')
+				ndep++;
+		deps = malloc(sizeof(char *) * ndep);
+		for (i = 0; i < ndep; i++)
+			deps[i] = strsep(&p, ",\n");
+		legacy_register(s, origin, deps, ndep);
+		free(deps);
+	}
+	free(linebuf);
+}
+
+ATF_TC(conflicts_import);
+
+ATF_TC_HEAD(conflicts_import, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "conflicts are resolved against the packages");
+}
+
+ATF_TC_BODY(conflicts_import, tc)
+{
+	sqlite3 *s;
+	FILE *f;
+	char *res;
+
+	s = conflicts_db(12);
+	f = conflicts_file(
+	    /* stale rows are removed */
+	    "cat/o1:cat/o2,cat/o3\n"
+	    /* the last line of an origin wins */
+	    "cat/o1:cat/o4\n"
+	    /* unknown origin */
+	    "cat/none:cat/o1\n"
+	    /* stops at the first unknown conflict */
+	    "cat/o2:cat/o1,cat/none,cat/o3\n"
+	    /* stops at a repeated conflict */
+	    "cat/o3:cat/o1,cat/o4,cat/o1,cat/o5\n"
+	    /* first package of a shared origin, no trailing newline */
+	    "cat/o8:cat/o2,cat/o8");
+	ATF_REQUIRE_EQ(SQLITE_OK, sqlite3_exec(s,
+	    "INSERT INTO pkg_conflicts VALUES (6, 7);", NULL, NULL, NULL));
+
+	ATF_REQUIRE_EQ(EPKG_OK, pkg_repo_binary_parse_conflicts(f, s));
+	fclose(f);
+
+	res = conflicts_dump(s);
+	ATF_REQUIRE_STREQ(res,
+	    "2:5\n"
+	    "3:2\n"
+	    "4:2\n"
+	    "4:5\n"
+	    "9:3\n"
+	    "9:9\n");
+	free(res);
+
+	/* the staging tables are gone */
+	ATF_REQUIRE(sqlite3_exec(s, "SELECT 1 FROM conflicts_import;",
+	    NULL, NULL, NULL) != SQLITE_OK);
+
+	sqlite3_close(s);
+}
+
+ATF_TC(conflicts_legacy);
+
+ATF_TC_HEAD(conflicts_legacy, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "bulk import of conflicts matches the per line registration");
+}
+
+ATF_TC_BODY(conflicts_legacy, tc)
+{
+	sqlite3 *s1, *s2;
+	struct sbuf *b = sbuf_new_auto();
+	unsigned int seed = 42;
+	char *res1, *res2;
+	FILE *f;
+	int i, j, n;
+
+#define NEXT()	(seed = seed * 1103515245 + 12345, (seed >> 16) & 0x7fff)
+	for (i = 0; i < 2000; i++) {
+		sbuf_printf(b, "cat/o%d:", NEXT() % 600);
+		n = 1 + NEXT() % 6;
+		for (j = 0; j < n; j++) {
+			/* some origins are unknown */
+			sbuf_printf(b, "%scat/o%d", j > 0 ? "," : "",
+			    NEXT() % 550);
+		}
+		sbuf_cat(b, "\n");
+	}
+#undef NEXT
+	sbuf_finish(b);
+
+	s1 = conflicts_db(500);
+	s2 = conflicts_db(500);
+
+	f = conflicts_file(sbuf_data(b));
+	legacy_parse(f, s1);
+	rewind(f);
+	ATF_REQUIRE_EQ(EPKG_OK, pkg_repo_binary_parse_conflicts(f, s2));
+	fclose(f);
+
+	res1 = conflicts_dump(s1);
+	res2 = conflicts_dump(s2);
+	ATF_REQUIRE(strlen(res1) > 0);
+	ATF_REQUIRE_STREQ(res1, res2);
+
+	free(res1);
+	free(res2);
+	sbuf_delete(b);
+	sqlite3_close(s1);
+	sqlite3_close(s2);
+}
+
+ATF_TP_ADD_TCS(tp)
+{
+	ATF_TP_ADD_TC(tp, conflicts_import);
+	ATF_TP_ADD_TC(tp, conflicts_legacy);
+
+	return (atf_no_error());
+}
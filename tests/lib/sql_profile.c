@@ -0,0 +1,194 @@
+/*-
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <atf-c.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sqlite3.h>
+#include <pkg.h>
+#include <private/pkgdb.h>
+
+struct profile_result {
+	int count;
+	struct pkg_sql_profile stmts[16];
+	char sql[16][256];
+};
+
+static int
+profile_event_cb(void *data, struct pkg_event *ev)
+{
+	struct profile_result *res = data;
+	int i;
+
+	if (ev->type != PKG_EVENT_SQL_PROFILE)
+		return (0);
+
+	res->count = ev->e_sql_profile.count;
+	for (i = 0; i < res->count && i < 16; i++) {
+		res->stmts[i] = ev->e_sql_profile.stmts[i];
+		strlcpy(res->sql[i], ev->e_sql_profile.stmts[i].sql,
+		    sizeof(res->sql[i]));
+		res->stmts[i].sql = res->sql[i];
+	}
+
+	return (0);
+}
+
+/* Run a statement to completion, return its rows */
+static int
+run_stmt(sqlite3 *s, const char *sql)
+{
+	sqlite3_stmt *stmt;
+	int rows = 0;
+
+	ATF_REQUIRE_EQ(SQLITE_OK, sqlite3_prepare_v2(s, sql, -1, &stmt, NULL));
+	while (pkgdb_step(stmt) == SQLITE_ROW)
+		rows++;
+	sqlite3_finalize(stmt);
+
+	return (rows);
+}
+
+static const struct pkg_sql_profile *
+profile_find(struct profile_result *res, const char *sql)
+{
+	int i;
+
+	for (i = 0; i < res->count; i++) {
+		if (strcmp(res->stmts[i].sql, sql) == 0)
+			return (&res->stmts[i]);
+	}
+
+	return (NULL);
+}
+
+ATF_TC(sql_profile);
+
+ATF_TC_HEAD(sql_profile, tc)
+{
+	atf_tc_set_md_var(tc, "descr",
+	    "aggregation of the SQLITE_PROFILE statement timings");
+}
+
+ATF_TC_BODY(sql_profile, tc)
+{
+	struct profile_result res;
+	const struct pkg_sql_profile *p;
+	sqlite3 *s;
+	sqlite3_stmt *stmt;
+	int i;
+
+	memset(&res, 0, sizeof(res));
+	setenv("SQLITE_PROFILE", "yes", 1);
+	ATF_REQUIRE_EQ(EPKG_OK, pkg_init("/dev/null", "/dev/null"));
+	pkg_event_register(profile_event_cb, &res);
+
+	sqlite3_initialize();
+	ATF_REQUIRE_EQ(SQLITE_OK, sqlite3_open(":memory:", &s));
+	pkgdb_profile_attach(s);
+
+	ATF_REQUIRE_EQ(SQLITE_OK, sqlite3_exec(s,
+	    "CREATE TABLE t (id INTEGER PRIMARY KEY, name TEXT);",
+	    NULL, NULL, NULL));
+
+	/* literals are folded: one entry, one handle per execution */
+	ATF_REQUIRE_EQ(SQLITE_OK, sqlite3_exec(s,
+	    "INSERT INTO t(name) VALUES ('a');", NULL, NULL, NULL));
+	ATF_REQUIRE_EQ(SQLITE_OK, sqlite3_exec(s,
+	    "INSERT INTO   t(name) VALUES ('it''s');", NULL, NULL, NULL));
+	ATF_REQUIRE_EQ(SQLITE_OK, sqlite3_exec(s,
+	    "INSERT INTO t(name)\n\tVALUES ('c');", NULL, NULL, NULL));
+
+	/* a cached statement: many executions, a single handle */
+	ATF_REQUIRE_EQ(SQLITE_OK, sqlite3_prepare_v2(s,
+	    "SELECT name FROM t WHERE id > ?1", -1, &stmt, NULL));
+	for (i = 0; i < 5; i++) {
+		sqlite3_bind_int(stmt, 1, i);
+		while (pkgdb_step(stmt) == SQLITE_ROW)
+			;
+		sqlite3_reset(stmt);
+	}
+	sqlite3_finalize(stmt);
+
+	/*
+	 * Statements prepared, run and finalized in a row, which share an
+	 * entry once their literals are folded: the rows of each execution
+	 * are counted once, even when the allocator hands out the same
+	 * handle again.
+	 */
+	ATF_REQUIRE_EQ(run_stmt(s, "SELECT name FROM t WHERE name > 'b'"), 2);
+	ATF_REQUIRE_EQ(run_stmt(s, "SELECT name FROM t WHERE name > ''"), 3);
+
+	pkgdb_profile_report();
+	sqlite3_close(s);
+
+	ATF_REQUIRE_EQ(res.count, 4);
+
+	p = profile_find(&res, "INSERT INTO t(name) VALUES (?);");
+	ATF_REQUIRE(p != NULL);
+	ATF_REQUIRE_EQ(p->calls, 3);
+	ATF_REQUIRE_EQ(p->prepares, 3);
+	ATF_REQUIRE(p->max <= p->total);
+
+	p = profile_find(&res, "SELECT name FROM t WHERE id > ?1");
+	ATF_REQUIRE(p != NULL);
+	ATF_REQUIRE_EQ(p->calls, 5);
+	ATF_REQUIRE_EQ(p->prepares, 1);
+	/* 3 + 2 + 1 rows for the ids above 0, 1 and 2 */
+	ATF_REQUIRE_EQ(p->rows, 6);
+	/* the rows are found through the primary key, the table is not scanned */
+	ATF_REQUIRE_EQ(p->fullscan_steps, 0);
+
+	p = profile_find(&res, "SELECT name FROM t WHERE name > ?");
+	ATF_REQUIRE(p != NULL);
+	ATF_REQUIRE_EQ(p->calls, 2);
+	ATF_REQUIRE_EQ(p->rows, 5);
+	/* without an index on name, every execution walks the table */
+	ATF_REQUIRE(p->fullscan_steps > 0);
+
+	p = profile_find(&res,
+	    "CREATE TABLE t (id INTEGER PRIMARY KEY, name TEXT);");
+	ATF_REQUIRE(p != NULL);
+	ATF_REQUIRE_EQ(p->calls, 1);
+
+	/* sorted by total time */
+	for (i = 1; i < res.count; i++)
+		ATF_REQUIRE(res.stmts[i - 1].total >= res.stmts[i].total);
+
+	/* the report resets the counters */
+	res.count = 0;
+	pkgdb_profile_report();
+	ATF_REQUIRE_EQ(res.count, 0);
+
+	pkg_shutdown();
+}
+
+ATF_TP_ADD_TCS(tp)
+{
+	ATF_TP_ADD_TC(tp, sql_profile);
+
+	return (atf_no_error());
+}